@@ -0,0 +1,145 @@
+// Generated by scripts/embed_web.py from web/, do not edit
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct WebAsset
+{
+  const char *uri;
+  const char *mime;
+  const uint8_t *data; // gzip-compressed
+  size_t len;
+  const char *etag;
+};
+
+// index.html: 4244 bytes, 1875 gzipped
+constexpr uint8_t web_index_html_gz[] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x7d, 0x58, 0x7b, 0x6f, 0xdb, 0x46,
+    0x12, 0xff, 0xdf, 0x9f, 0x62, 0xaa, 0xa2, 0x20, 0x15, 0x49, 0x94, 0xe4, 0x1a, 0x85, 0xa1, 0x87,
+    0x8b, 0x24, 0x56, 0xd1, 0xa0, 0x6d, 0x12, 0xc4, 0xe9, 0xe1, 0x0e, 0xb6, 0x5b, 0xac, 0xc8, 0xa5,
+    0xb4, 0x12, 0xb9, 0x24, 0x76, 0x97, 0xb6, 0x75, 0x85, 0xbf, 0xfb, 0xcd, 0xec, 0x2e, 0x29, 0x52,
+    0x8e, 0x2f, 0x68, 0x4a, 0x71, 0x77, 0xde, 0x8f, 0xdf, 0x0c, 0xb3, 0xf8, 0xee, 0xfa, 0xd3, 0xfb,
+    0xaf, 0xff, 0xf9, 0xbc, 0x82, 0xad, 0xc9, 0xb3, 0xab, 0xb3, 0x45, 0xfd, 0xe0, 0x2c, 0xc1, 0x47,
+    0xce, 0x0d, 0x83, 0x78, 0xcb, 0x94, 0xe6, 0x66, 0xd9, 0xab, 0x4c, 0x3a, 0xba, 0xec, 0xd5, 0xc7,
+    0x92, 0xe5, 0x7c, 0xd9, 0x7b, 0x10, 0xfc, 0xb1, 0x2c, 0x94, 0xe9, 0x41, 0x5c, 0x48, 0xc3, 0x25,
+    0x92, 0x3d, 0x8a, 0xc4, 0x6c, 0x97, 0x09, 0x7f, 0x10, 0x31, 0x1f, 0xd9, 0x97, 0x21, 0x08, 0x29,
+    0x8c, 0x60, 0xd9, 0x48, 0xc7, 0x2c, 0xe3, 0xcb, 0x29, 0x09, 0x31, 0xc2, 0x64, 0xfc, 0x6a, 0x75,
+    0xf3, 0xf9, 0xc7, 0xf3, 0xd1, 0xfb, 0xb7, 0x7f, 0xc0, 0x8d, 0x51, 0x9c, 0xe5, 0x8b, 0xb1, 0x3b,
+    0x3f, 0x5b, 0x68, 0x73, 0xa0, 0xe7, 0xba, 0x48, 0x0e, 0xf0, 0x0f, 0xe4, 0x4c, 0x6d, 0x84, 0x9c,
+    0xc1, 0x64, 0x0e, 0x29, 0x2a, 0x1a, 0xa5, 0x2c, 0x17, 0xd9, 0x61, 0x06, 0x9a, 0x49, 0x3d, 0xd2,
+    0x5c, 0x89, 0x74, 0x0e, 0x6b, 0x16, 0xef, 0x37, 0xaa, 0xa8, 0x64, 0x32, 0x83, 0xef, 0xa7, 0xd3,
+    0xe9, 0x1c, 0x6d, 0xca, 0x0a, 0x85, 0x2f, 0x9c, 0xf3, 0x39, 0x3c, 0x9f, 0x6d, 0xa7, 0x28, 0xc9,
+    0xb2, 0x6b, 0xf1, 0x5f, 0x3e, 0x83, 0x69, 0x74, 0xce, 0xf3, 0x79, 0x23, 0x7b, 0x7a, 0x5e, 0x3e,
+    0x11, 0xd9, 0xf7, 0xe4, 0x14, 0x52, 0x96, 0x85, 0x46, 0xab, 0x0b, 0xbc, 0x51, 0x3c, 0x63, 0x46,
+    0x3c, 0xa0, 0x90, 0x44, 0xe8, 0x32, 0x63, 0xa8, 0x58, 0xc8, 0x4c, 0x48, 0x3e, 0x5a, 0x67, 0x45,
+    0xbc, 0x3f, 0x8a, 0x98, 0x1c, 0x85, 0xa4, 0x0a, 0x03, 0x84, 0x52, 0x1a, 0x8e, 0x86, 0xf4, 0xc9,
+    0x45, 0x05, 0x15, 0x4e, 0x26, 0x3f, 0xcc, 0xc1, 0xbf, 0xfc, 0x74, 0x31, 0x21, 0xce, 0x8e, 0x13,
+    0x93, 0xc9, 0xc4, 0xca, 0xd2, 0x86, 0x19, 0xdd, 0xb1, 0x88, 0xad, 0x75, 0x91, 0x55, 0x06, 0x2d,
+    0x32, 0x45, 0x89, 0xcc, 0xc4, 0x9a, 0xf1, 0xd4, 0xf8, 0x9f, 0x25, 0x4b, 0x12, 0x21, 0x37, 0x33,
+    0xb8, 0x28, 0x9f, 0xe0, 0xf2, 0x54, 0xae, 0xda, 0xac, 0x59, 0x38, 0x19, 0x82, 0xff, 0x2f, 0xfa,
+    0xa9, 0x3f, 0x3f, 0x83, 0xfa, 0x0f, 0xc5, 0xc7, 0xc5, 0x02, 0xf2, 0x42, 0x16, 0xba, 0x64, 0x31,
+    0x6a, 0x79, 0xdc, 0x0a, 0xc3, 0x47, 0xf6, 0x65, 0x06, 0xa5, 0xc2, 0x93, 0x75, 0xa1, 0x12, 0xae,
+    0x46, 0x8a, 0x25, 0xa2, 0xd2, 0x33, 0xf8, 0xd1, 0xbb, 0xcd, 0x62, 0x32, 0x50, 0xb7, 0x52, 0x56,
+    0x47, 0x64, 0x5d, 0x19, 0x53, 0xc8, 0xe6, 0x62, 0xa4, 0xc4, 0x66, 0x8b, 0x9a, 0x2e, 0xdd, 0xed,
+    0x62, 0xec, 0x13, 0xbe, 0x18, 0xfb, 0xe2, 0xa3, 0xcc, 0x53, 0x29, 0x4e, 0x5b, 0x45, 0xf2, 0x2f,
+    0x91, 0xf0, 0xa2, 0xae, 0x14, 0xbc, 0x39, 0x5b, 0x24, 0xe2, 0x01, 0x44, 0xe2, 0x0a, 0x11, 0xcb,
+    0x0a, 0x60, 0x21, 0xf2, 0x8d, 0x3d, 0xb1, 0x09, 0xe8, 0x01, 0xcb, 0xb0, 0x26, 0xb5, 0x65, 0xe9,
+    0xb9, 0x58, 0x2f, 0x7b, 0x18, 0xeb, 0x1e, 0x6c, 0x39, 0x19, 0xb0, 0xec, 0x5d, 0x5c, 0x4e, 0x1c,
+    0x63, 0x2d, 0xca, 0x46, 0xbb, 0x77, 0x85, 0x05, 0x2d, 0x39, 0x7a, 0x23, 0x37, 0x51, 0x14, 0x2d,
+    0xc6, 0x78, 0x4b, 0xc6, 0xb9, 0x47, 0x4d, 0xea, 0xbd, 0x75, 0xfc, 0xde, 0x41, 0x2b, 0x62, 0x5b,
+    0x98, 0xde, 0xd5, 0x0d, 0x97, 0x09, 0x94, 0xf8, 0xb3, 0xc0, 0x2c, 0xc1, 0x57, 0x9e, 0xf1, 0x8d,
+    0x22, 0xc3, 0x1d, 0xa1, 0xe5, 0x61, 0xb0, 0x55, 0x3c, 0x5d, 0xf6, 0xc6, 0x5a, 0xb2, 0x92, 0xb8,
+    0xa2, 0x5d, 0xb9, 0xe9, 0x81, 0xc1, 0x10, 0x51, 0xcb, 0xfd, 0xbd, 0xce, 0x98, 0xdc, 0xa3, 0x24,
+    0x7f, 0xbb, 0x18, 0xb3, 0xa3, 0x11, 0x3a, 0x56, 0xa2, 0x34, 0x57, 0x67, 0x61, 0x5a, 0x49, 0x6b,
+    0x07, 0x84, 0x7d, 0xf8, 0x07, 0xa5, 0x3e, 0x30, 0x05, 0x14, 0x85, 0x25, 0x24, 0x45, 0x5c, 0xe5,
+    0xd8, 0x95, 0x11, 0x4a, 0x5b, 0x65, 0x9c, 0x7e, 0xbe, 0x3b, 0x7c, 0x48, 0xc2, 0xc0, 0x06, 0x27,
+    0xb0, 0x79, 0x27, 0x6a, 0xeb, 0xf2, 0x2a, 0xfb, 0x7f, 0x1c, 0x96, 0xe4, 0xc8, 0xc1, 0x65, 0x8c,
+    0xd4, 0x12, 0x1b, 0xe5, 0x2b, 0x7f, 0x32, 0x2b, 0x19, 0x17, 0x58, 0x0d, 0x61, 0x73, 0x9d, 0xf0,
+    0xf6, 0xf5, 0x35, 0x3f, 0xb9, 0xfe, 0x75, 0xf5, 0xf6, 0x7a, 0xf5, 0xe5, 0xef, 0xd5, 0xc7, 0x6b,
+    0xa4, 0x42, 0x51, 0x11, 0xb7, 0x02, 0xc2, 0xe0, 0x4e, 0xdd, 0x49, 0xfa, 0x4b, 0x8a, 0x90, 0x76,
+    0x3c, 0x86, 0xcf, 0x58, 0x64, 0x1a, 0xf9, 0x31, 0x94, 0x31, 0x96, 0xaf, 0xe1, 0x4a, 0x63, 0x8d,
+    0x2a, 0x30, 0x5b, 0x0e, 0xc5, 0x03, 0x57, 0xd8, 0x5b, 0x5e, 0xa8, 0xf5, 0x49, 0xa3, 0x40, 0x2c,
+    0xea, 0xf5, 0xc1, 0xd4, 0x3f, 0x33, 0xa6, 0xcd, 0x0d, 0xf6, 0xbb, 0x7b, 0x7b, 0x14, 0x32, 0x29,
+    0x1e, 0x6f, 0x30, 0xc0, 0x06, 0x0f, 0x4a, 0xae, 0x50, 0x56, 0xce, 0x64, 0xcc, 0x23, 0x59, 0x3c,
+    0x3a, 0x03, 0x51, 0xe9, 0xb5, 0x45, 0x2f, 0x88, 0x59, 0x69, 0x2a, 0xc5, 0xc1, 0x08, 0x6c, 0xe5,
+    0x07, 0x1d, 0x01, 0x53, 0x4a, 0x3c, 0xb0, 0x6c, 0x6e, 0xb5, 0xeb, 0x9c, 0x65, 0x19, 0xd7, 0x06,
+    0x8a, 0x34, 0x45, 0x80, 0x04, 0xcd, 0x39, 0x66, 0x5f, 0x63, 0xf2, 0xf6, 0xf8, 0x83, 0x69, 0x27,
+    0x4a, 0x72, 0xf3, 0x58, 0xa8, 0xfd, 0xa8, 0x90, 0xd9, 0x01, 0x8c, 0x42, 0xbc, 0x12, 0x66, 0x08,
+    0xba, 0x40, 0xbb, 0x10, 0x2f, 0xe3, 0x03, 0x71, 0x60, 0x6a, 0x1f, 0x65, 0x83, 0x32, 0x54, 0x2c,
+    0x24, 0x3f, 0x45, 0xc3, 0x49, 0xbc, 0xf5, 0xcb, 0xfb, 0xb8, 0xc6, 0x83, 0x4f, 0x4e, 0xdd, 0x12,
+    0x3e, 0xc8, 0x94, 0x80, 0xf5, 0x30, 0x6c, 0x64, 0xa1, 0x8b, 0x36, 0x6e, 0x4d, 0x45, 0xa0, 0xb7,
+    0xfc, 0xe9, 0x53, 0x1a, 0xae, 0xab, 0x74, 0x88, 0xa8, 0x80, 0x9a, 0x53, 0x55, 0xe4, 0xae, 0x4c,
+    0x00, 0x0a, 0x44, 0x10, 0x35, 0x3b, 0x73, 0x6d, 0xaf, 0x20, 0xb4, 0x85, 0x83, 0x42, 0x88, 0x66,
+    0x8e, 0xbf, 0x16, 0x4b, 0x40, 0xc6, 0x28, 0xe3, 0x72, 0x63, 0xb6, 0x30, 0x22, 0x01, 0xfe, 0x05,
+    0x6f, 0x07, 0x83, 0x5a, 0x4c, 0x8b, 0x7b, 0x67, 0x4d, 0xc0, 0xc7, 0xa2, 0x43, 0xbc, 0x6b, 0x13,
+    0x03, 0x88, 0x14, 0xc8, 0xa2, 0x5b, 0x01, 0x03, 0xd8, 0xdd, 0xc3, 0x77, 0xcb, 0x25, 0x51, 0xdf,
+    0xee, 0xee, 0xfb, 0x76, 0x8c, 0x08, 0x59, 0x71, 0x67, 0x5b, 0x8d, 0x4b, 0xcf, 0xfe, 0xa9, 0x38,
+    0xe6, 0x03, 0xbd, 0x72, 0xe7, 0xee, 0xd4, 0x9f, 0x8d, 0xa6, 0x74, 0xf8, 0xdc, 0xf1, 0x9e, 0x90,
+    0x04, 0xcb, 0xce, 0x60, 0x09, 0x0e, 0xed, 0xc0, 0xaa, 0x8d, 0x20, 0x53, 0x73, 0x5f, 0xa0, 0x5f,
+    0xf8, 0x66, 0xf5, 0x54, 0x86, 0xc1, 0x5f, 0x01, 0x5a, 0x43, 0x44, 0xf8, 0x08, 0x66, 0x77, 0x77,
+    0xfa, 0x4d, 0x78, 0xfb, 0xd7, 0x1d, 0x16, 0xe3, 0x9d, 0xbc, 0x1f, 0xf4, 0x83, 0x21, 0x04, 0xb9,
+    0x08, 0xfa, 0x11, 0x7f, 0xe2, 0xb1, 0x95, 0xe8, 0x41, 0xd3, 0xab, 0xcf, 0xe1, 0x67, 0xc8, 0x6f,
+    0xa7, 0xf7, 0x30, 0x03, 0x59, 0x65, 0xd9, 0x4b, 0x5b, 0x28, 0xc7, 0xe1, 0xae, 0xe4, 0x9b, 0x21,
+    0x18, 0xdd, 0xb6, 0xa3, 0x52, 0xd4, 0x77, 0x7f, 0x7e, 0xf9, 0x3d, 0x8a, 0x11, 0xa4, 0x0c, 0xff,
+    0xb4, 0xde, 0x21, 0xec, 0xe0, 0x7b, 0x48, 0xd6, 0xbd, 0xcb, 0x8a, 0x75, 0x78, 0x4b, 0x7c, 0xf7,
+    0x43, 0xc4, 0x4e, 0x73, 0x28, 0x11, 0x80, 0x03, 0x91, 0xb3, 0x0d, 0x1f, 0xd3, 0x69, 0x00, 0xcf,
+    0x7d, 0x6f, 0x09, 0xb6, 0x7c, 0x84, 0x55, 0x56, 0xb0, 0x84, 0x52, 0xd8, 0xc6, 0x04, 0x2b, 0x5d,
+    0xf1, 0x87, 0x62, 0xdf, 0x92, 0x8e, 0x7a, 0xfb, 0x88, 0xbc, 0x47, 0x5e, 0xad, 0xa8, 0x67, 0xf1,
+    0xd8, 0x96, 0x10, 0xf8, 0x7e, 0x1a, 0x0c, 0x1c, 0x85, 0xeb, 0xa8, 0xc1, 0x12, 0x48, 0x6b, 0x9d,
+    0x58, 0x7b, 0xd3, 0x6a, 0xb0, 0x17, 0x77, 0x94, 0x69, 0x1c, 0x5d, 0x94, 0x61, 0x0a, 0xcb, 0xb1,
+    0x08, 0xc8, 0xf3, 0xa2, 0x2e, 0xe4, 0x17, 0x6d, 0x68, 0x6b, 0x0d, 0xb7, 0x8e, 0x5f, 0xd0, 0x1b,
+    0x13, 0x52, 0xbc, 0xde, 0xd0, 0xb4, 0x9c, 0xd4, 0xf5, 0xd0, 0x69, 0x83, 0x3f, 0x98, 0xd9, 0x46,
+    0xb9, 0x90, 0xe1, 0xf1, 0x74, 0xe8, 0x65, 0x37, 0x83, 0xed, 0xd8, 0x20, 0x5e, 0xe9, 0xa8, 0x25,
+    0xe3, 0x58, 0x4d, 0xdd, 0x94, 0x29, 0x4e, 0xab, 0x4d, 0xd8, 0x4e, 0x16, 0x5a, 0xf7, 0x1a, 0x6c,
+    0x78, 0x24, 0xe5, 0x31, 0xe1, 0x4e, 0x48, 0x84, 0xa3, 0x36, 0xda, 0xf4, 0x61, 0xdc, 0x72, 0xc1,
+    0x03, 0x6e, 0x44, 0x85, 0xf4, 0xde, 0x6d, 0x4e, 0xb0, 0xf4, 0xb6, 0x06, 0x69, 0xa9, 0xdd, 0x0f,
+    0xac, 0xc4, 0xd0, 0xa3, 0xda, 0xd8, 0x4a, 0xee, 0x47, 0xa6, 0xf8, 0x45, 0x3c, 0xf1, 0x24, 0x9c,
+    0xf6, 0xa9, 0x4c, 0x11, 0x28, 0x61, 0xd0, 0xb0, 0xd9, 0x8d, 0xc3, 0xb3, 0x35, 0x49, 0x21, 0xad,
+    0xe7, 0x17, 0xa7, 0x8c, 0xf0, 0xdb, 0xbb, 0x0e, 0xaf, 0xc2, 0xf8, 0x34, 0x2a, 0x5d, 0xaa, 0xdf,
+    0xc0, 0xa5, 0x37, 0xf9, 0x85, 0xf2, 0x89, 0x93, 0xb1, 0x5f, 0x0b, 0x33, 0xd6, 0x1d, 0x39, 0x75,
+    0x9c, 0x07, 0x24, 0xc8, 0xbf, 0x9c, 0xb2, 0xe5, 0x3a, 0x98, 0xb7, 0x0a, 0xcc, 0x81, 0xd6, 0xb1,
+    0xc4, 0x9a, 0xd7, 0x2e, 0x54, 0x63, 0x40, 0x9b, 0xa6, 0xa2, 0xb1, 0x40, 0xe5, 0xa1, 0x2d, 0x4e,
+    0xe6, 0x55, 0x66, 0x44, 0x49, 0x54, 0x6e, 0xcc, 0xa3, 0x1c, 0xd8, 0x32, 0x9c, 0x17, 0xda, 0xe1,
+    0x28, 0x66, 0x6b, 0x64, 0xaf, 0x1d, 0x1c, 0x68, 0x44, 0x71, 0x44, 0x73, 0xa1, 0xc5, 0x3a, 0xe3,
+    0x9d, 0x74, 0x57, 0xb2, 0xc9, 0x75, 0xca, 0x4d, 0xbc, 0x0d, 0x83, 0xb1, 0x93, 0x88, 0x6d, 0x8f,
+    0x82, 0x64, 0x6b, 0xd0, 0x2a, 0xae, 0xbb, 0xb5, 0xac, 0xac, 0x6c, 0xb4, 0x13, 0x6f, 0x22, 0x5a,
+    0x5d, 0x68, 0x80, 0x7e, 0x71, 0xf8, 0xd3, 0x54, 0xa1, 0x45, 0xf0, 0x2a, 0xf5, 0xc0, 0xf3, 0xa7,
+    0x90, 0xe6, 0xf2, 0xad, 0x52, 0xec, 0x80, 0x91, 0xa9, 0x49, 0x1a, 0x15, 0x65, 0x95, 0x97, 0x61,
+    0x1b, 0x34, 0x3d, 0xd0, 0x38, 0x45, 0x11, 0x3d, 0xc2, 0x97, 0x66, 0xb5, 0x19, 0x5c, 0xf7, 0xa9,
+    0x28, 0x29, 0x24, 0x02, 0x9f, 0xd9, 0x2a, 0x2c, 0x49, 0xd2, 0xbb, 0x52, 0xaa, 0x50, 0x34, 0xd0,
+    0x6d, 0xb0, 0x70, 0x47, 0xe1, 0x49, 0xd0, 0xde, 0x00, 0x5d, 0xa1, 0x63, 0x61, 0xbe, 0xb4, 0xb3,
+    0x35, 0x0d, 0x06, 0xa0, 0x22, 0x1c, 0x85, 0x15, 0xf7, 0x07, 0x1d, 0x09, 0xc4, 0x1d, 0x61, 0x67,
+    0x11, 0xc3, 0xb7, 0x2f, 0x3c, 0xf3, 0xb0, 0x35, 0x60, 0x3a, 0x84, 0x75, 0x98, 0x9e, 0x8c, 0x47,
+    0x23, 0xf7, 0x07, 0xf7, 0xd0, 0x8c, 0x23, 0xa4, 0xa8, 0x8a, 0x77, 0x5d, 0xad, 0xb7, 0x12, 0xc2,
+    0xbe, 0xce, 0xd0, 0x3b, 0xae, 0x1a, 0xb8, 0xea, 0x76, 0x54, 0xb8, 0xf8, 0x10, 0xcb, 0x02, 0x6f,
+    0x60, 0x8d, 0xe1, 0xd8, 0xcf, 0x5f, 0x88, 0x34, 0x2e, 0x10, 0xb8, 0xd0, 0x44, 0x89, 0x5d, 0x63,
+    0x6c, 0x10, 0x74, 0xb5, 0x66, 0x2e, 0x73, 0x43, 0x52, 0xda, 0xef, 0xbf, 0x64, 0x44, 0xa7, 0x08,
+    0x2a, 0xa8, 0x4e, 0x3f, 0x48, 0x13, 0x76, 0x66, 0x51, 0xe0, 0x7b, 0x7e, 0xf4, 0xbb, 0xf5, 0x3c,
+    0xe8, 0x0f, 0xb1, 0xd1, 0xbe, 0x61, 0x9c, 0xd0, 0x1f, 0xd9, 0xc7, 0x10, 0x25, 0xf5, 0x4f, 0xbd,
+    0xb5, 0x4d, 0xf0, 0x8e, 0xf6, 0x79, 0xa6, 0x0e, 0x40, 0xdf, 0x22, 0x80, 0x33, 0xb8, 0xa4, 0x94,
+    0x62, 0x59, 0xe3, 0x82, 0xb1, 0x17, 0x25, 0x08, 0x73, 0xc2, 0xe3, 0xa2, 0xda, 0x71, 0x80, 0xfc,
+    0x1f, 0xc0, 0xc5, 0x89, 0x72, 0x68, 0x06, 0x71, 0xf7, 0xfc, 0xf9, 0x85, 0x89, 0xad, 0x92, 0x58,
+    0x80, 0x17, 0x46, 0xbd, 0x8f, 0x36, 0x7f, 0x2b, 0xa4, 0x76, 0x0c, 0x5a, 0x03, 0x32, 0xdc, 0xb0,
+    0x6a, 0xed, 0xc3, 0x13, 0xce, 0x61, 0x77, 0x74, 0x07, 0xff, 0x1e, 0x7d, 0xc5, 0x15, 0x0c, 0x41,
+    0x33, 0x2f, 0x83, 0xd3, 0x58, 0xbf, 0xee, 0x93, 0x17, 0xd6, 0x26, 0x6f, 0xdb, 0xef, 0x1b, 0xca,
+    0x35, 0xda, 0x91, 0xe8, 0xb9, 0xff, 0xca, 0xd6, 0xd1, 0x26, 0x7c, 0xee, 0x47, 0x31, 0x23, 0x88,
+    0x38, 0xdd, 0xbd, 0x5f, 0x05, 0x77, 0xc4, 0x58, 0xde, 0xf9, 0xa4, 0x08, 0x6a, 0x35, 0xd8, 0x0e,
+    0xe4, 0x1d, 0x2e, 0x3c, 0x21, 0x42, 0xd0, 0x10, 0xce, 0x11, 0x72, 0x1b, 0x35, 0x0d, 0xe6, 0xbd,
+    0xbe, 0x98, 0xe3, 0x77, 0x01, 0x02, 0x54, 0x21, 0x63, 0x8c, 0xe8, 0xfe, 0x74, 0xf4, 0x77, 0xd1,
+    0xcc, 0x91, 0x7e, 0x03, 0x34, 0x1a, 0x74, 0x89, 0x76, 0xba, 0x40, 0x18, 0x9c, 0x93, 0x87, 0x27,
+    0x74, 0x3b, 0xa2, 0xc3, 0xef, 0x77, 0x1c, 0x89, 0xbb, 0x08, 0xb3, 0xa1, 0x71, 0x07, 0xb1, 0x84,
+    0xd6, 0x46, 0xdb, 0xa6, 0xe8, 0xca, 0x07, 0x5a, 0xd1, 0xb1, 0xb7, 0x43, 0x37, 0x3d, 0x87, 0x76,
+    0x82, 0x58, 0x12, 0x8b, 0xaf, 0xf3, 0xb3, 0xe7, 0x3e, 0xfd, 0x1f, 0xbf, 0xf7, 0xfc, 0xe7, 0x0b,
+    0x7e, 0x0f, 0xb9, 0x2f, 0xbd, 0xb1, 0xfb, 0xc7, 0x87, 0xff, 0x01, 0xdf, 0xd1, 0x08, 0xef, 0x94,
+    0x10, 0x00, 0x00,
+};
+
+constexpr WebAsset web_assets[] = {
+    {"/", "text/html", web_index_html_gz, sizeof(web_index_html_gz), "\"da4105de81f6ebfb\""},
+};
+
+constexpr size_t web_asset_count = sizeof(web_assets) / sizeof(web_assets[0]);
+
+#endif // WEB_ASSETS_H
@@ -0,0 +1,110 @@
+"""Compresses the files in web/ and embeds them as constexpr arrays.
+
+Runs as a PlatformIO pre-build script (extra_scripts = pre:scripts/embed_web.py)
+and can also be run by hand: python scripts/embed_web.py
+The output, include/web_assets.h, is only rewritten when its content changes,
+so an unchanged UI does not trigger a rebuild.
+
+The header is committed, because the Arduino IDE builds without running this
+script. After changing web/, run it and commit the header together with the
+change; python scripts/embed_web.py --check exits with 1 while it is stale.
+"""
+
+import gzip
+import hashlib
+import os
+import re
+import sys
+
+MIME_TYPES = {
+    ".html": "text/html",
+    ".js": "application/javascript",
+    ".css": "text/css",
+    ".svg": "image/svg+xml",
+    ".ico": "image/x-icon",
+}
+
+
+def project_dir():
+    try:
+        return env.subst("$PROJECT_DIR")  # noqa: F821, provided by PlatformIO
+    except NameError:
+        return os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def symbol_for(name):
+    return "web_" + re.sub(r"[^0-9a-zA-Z]", "_", name) + "_gz"
+
+
+def url_for(name):
+    return "/" if name == "index.html" else "/" + name
+
+
+def render(web_dir):
+    arrays = []
+    entries = []
+    for name in sorted(os.listdir(web_dir)):
+        path = os.path.join(web_dir, name)
+        ext = os.path.splitext(name)[1]
+        if not os.path.isfile(path) or ext not in MIME_TYPES:
+            continue
+
+        with open(path, "rb") as f:
+            raw = f.read()
+        # mtime=0 keeps the output identical across builds
+        packed = gzip.compress(raw, compresslevel=9, mtime=0)
+        etag = hashlib.sha1(raw).hexdigest()[:16]
+        symbol = symbol_for(name)
+
+        lines = []
+        for i in range(0, len(packed), 16):
+            lines.append("    " + ", ".join("0x%02x" % b for b in packed[i:i + 16]) + ",")
+        arrays.append("// %s: %d bytes, %d gzipped\nconstexpr uint8_t %s[] = {\n%s\n};\n"
+                      % (name, len(raw), len(packed), symbol, "\n".join(lines)))
+        entries.append('    {"%s", "%s", %s, sizeof(%s), "\\"%s\\""},'
+                       % (url_for(name), MIME_TYPES[ext], symbol, symbol, etag))
+
+    return (
+        "// Generated by scripts/embed_web.py from web/, do not edit\n"
+        "#ifndef WEB_ASSETS_H\n"
+        "#define WEB_ASSETS_H\n\n"
+        "#include <stddef.h>\n"
+        "#include <stdint.h>\n\n"
+        "struct WebAsset\n{\n"
+        "  const char *uri;\n"
+        "  const char *mime;\n"
+        "  const uint8_t *data; // gzip-compressed\n"
+        "  size_t len;\n"
+        "  const char *etag;\n"
+        "};\n\n"
+        + "\n".join(arrays) +
+        "\nconstexpr WebAsset web_assets[] = {\n" + "\n".join(entries) + "\n};\n\n"
+        "constexpr size_t web_asset_count = sizeof(web_assets) / sizeof(web_assets[0]);\n\n"
+        "#endif // WEB_ASSETS_H\n"
+    )
+
+
+def main(check=False):
+    root = project_dir()
+    output = os.path.join(root, "include", "web_assets.h")
+    content = render(os.path.join(root, "web"))
+
+    if os.path.exists(output):
+        with open(output) as f:
+            if f.read() == content:
+                return 0
+    if check:
+        print("embed_web: %s is out of date, run python scripts/embed_web.py" % output)
+        return 1
+    with open(output, "w") as f:
+        f.write(content)
+    print("embed_web: wrote " + output)
+    return 0
+
+
+try:
+    Import("env")  # noqa: F821, provided by PlatformIO
+except NameError:
+    sys.exit(main(check="--check" in sys.argv[1:]))
+else:
+    main()
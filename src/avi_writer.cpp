@@ -0,0 +1,264 @@
+#include "avi_writer.h"
+#include <string.h>
+#include <unistd.h>
+
+// Fixed header size; the JUNK chunk pads it so 'movi' data starts at 512
+#define AVI_HEADER_SIZE 512
+#define AVI_JUNK_SIZE 280
+#define AVIF_HASINDEX 0x10
+#define AVIIF_KEYFRAME 0x10
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void putFourcc(uint8_t *p, const char *cc)
+{
+    memcpy(p, cc, 4);
+}
+
+AviWriter::AviWriter(uint8_t *buffer, size_t buffer_size)
+    : buf(buffer), buf_size(buffer_size), fill(0), file(NULL), index(NULL),
+      file_pos(0), movi_bytes(0), frames(0), width(0), height(0)
+{
+    index_path[0] = '\0';
+}
+
+AviWriter::~AviWriter()
+{
+    if (file)
+    {
+        close(0);
+    }
+}
+
+bool AviWriter::writeHeader(uint32_t fps, uint32_t total_frames, uint32_t movi_size, uint32_t riff_size)
+{
+    uint8_t h[AVI_HEADER_SIZE];
+    memset(h, 0, sizeof(h));
+    uint32_t us_per_frame = fps ? 1000000 / fps : 0;
+
+    putFourcc(h + 0, "RIFF");
+    put32(h + 4, riff_size);
+    putFourcc(h + 8, "AVI ");
+
+    putFourcc(h + 12, "LIST");
+    put32(h + 16, 192);
+    putFourcc(h + 20, "hdrl");
+
+    // MainAVIHeader
+    putFourcc(h + 24, "avih");
+    put32(h + 28, 56);
+    put32(h + 32, us_per_frame);
+    put32(h + 44, AVIF_HASINDEX);
+    put32(h + 48, total_frames);
+    put32(h + 56, 1); // streams
+    put32(h + 64, width);
+    put32(h + 68, height);
+
+    putFourcc(h + 88, "LIST");
+    put32(h + 92, 116);
+    putFourcc(h + 96, "strl");
+
+    // AVIStreamHeader
+    putFourcc(h + 100, "strh");
+    put32(h + 104, 56);
+    putFourcc(h + 108, "vids");
+    putFourcc(h + 112, "MJPG");
+    put32(h + 128, 1);   // scale
+    put32(h + 132, fps); // rate
+    put32(h + 140, total_frames);
+    put32(h + 148, 0xFFFFFFFF); // quality: default
+    put16(h + 160, width);
+    put16(h + 162, height);
+
+    // BITMAPINFOHEADER
+    putFourcc(h + 164, "strf");
+    put32(h + 168, 40);
+    put32(h + 172, 40);
+    put32(h + 176, width);
+    put32(h + 180, height);
+    put16(h + 184, 1);
+    put16(h + 186, 24);
+    putFourcc(h + 188, "MJPG");
+    put32(h + 192, (uint32_t)width * height * 3);
+
+    putFourcc(h + 212, "JUNK");
+    put32(h + 216, AVI_JUNK_SIZE);
+
+    putFourcc(h + 500, "LIST");
+    put32(h + 504, movi_size);
+    putFourcc(h + 508, "movi");
+
+    if (file_pos == 0 && fill == 0)
+    {
+        return stage(h, sizeof(h));
+    }
+
+    // Patching an already written header
+    return fseek(file, 0, SEEK_SET) == 0 && fwrite(h, 1, sizeof(h), file) == sizeof(h);
+}
+
+bool AviWriter::open(const char *path, uint16_t w, uint16_t h, uint32_t fps, size_t prealloc_bytes)
+{
+    snprintf(index_path, sizeof(index_path), "%s.idx", path);
+    file = fopen(path, "wb+");
+    index = fopen(index_path, "wb+");
+    if (!file || !index)
+    {
+        if (file)
+        {
+            fclose(file);
+        }
+        if (index)
+        {
+            fclose(index);
+        }
+        file = index = NULL;
+        return false;
+    }
+
+    // Our own block buffer already batches writes
+    setvbuf(file, NULL, _IONBF, 0);
+
+    if (prealloc_bytes > AVI_HEADER_SIZE)
+    {
+        fseek(file, prealloc_bytes - 1, SEEK_SET);
+        fputc(0, file);
+        fseek(file, 0, SEEK_SET);
+    }
+
+    width = w;
+    height = h;
+    fill = 0;
+    file_pos = 0;
+    movi_bytes = 0;
+    frames = 0;
+    return writeHeader(fps, 0, 4, 0);
+}
+
+bool AviWriter::flushBlock()
+{
+    if (fill == 0)
+    {
+        return true;
+    }
+    if (fwrite(buf, 1, fill, file) != fill)
+    {
+        return false;
+    }
+    file_pos += fill;
+    fill = 0;
+    return true;
+}
+
+bool AviWriter::stage(const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    while (len > 0)
+    {
+        size_t n = buf_size - fill;
+        if (n > len)
+        {
+            n = len;
+        }
+        memcpy(buf + fill, p, n);
+        fill += n;
+        p += n;
+        len -= n;
+        if (fill == buf_size && !flushBlock())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AviWriter::addFrame(const uint8_t *jpeg, size_t len)
+{
+    if (!file)
+    {
+        return false;
+    }
+
+    uint8_t chunk[8];
+    putFourcc(chunk, "00dc");
+    put32(chunk + 4, len);
+
+    uint8_t entry[16];
+    putFourcc(entry, "00dc");
+    put32(entry + 4, AVIIF_KEYFRAME);
+    put32(entry + 8, 4 + movi_bytes); // relative to the 'movi' fourcc
+    put32(entry + 12, len);
+
+    static const uint8_t pad = 0;
+    if (!stage(chunk, sizeof(chunk)) || !stage(jpeg, len) || ((len & 1) && !stage(&pad, 1)))
+    {
+        return false;
+    }
+    if (fwrite(entry, 1, sizeof(entry), index) != sizeof(entry))
+    {
+        return false;
+    }
+
+    movi_bytes += sizeof(chunk) + len + (len & 1);
+    frames++;
+    return true;
+}
+
+bool AviWriter::close(uint32_t duration_ms)
+{
+    if (!file)
+    {
+        return false;
+    }
+
+    // idx1 follows the movie data, copied from the side file
+    bool ok = true;
+    uint8_t hdr[8];
+    putFourcc(hdr, "idx1");
+    put32(hdr + 4, frames * 16);
+    ok = stage(hdr, sizeof(hdr));
+
+    uint8_t entries[512];
+    fflush(index);
+    fseek(index, 0, SEEK_SET);
+    size_t n;
+    while (ok && (n = fread(entries, 1, sizeof(entries), index)) > 0)
+    {
+        ok = stage(entries, n);
+    }
+    ok = ok && flushBlock();
+
+    uint64_t file_size = file_pos;
+    uint32_t fps = duration_ms ? (uint32_t)((frames * 1000ULL + duration_ms / 2) / duration_ms) : 0;
+    if (fps == 0)
+    {
+        fps = 1;
+    }
+    ok = ok && writeHeader(fps, frames, 4 + movi_bytes, (uint32_t)(file_size - 8));
+
+    // fclose flushes; a failure there loses data as surely as a failed write
+    ok = fclose(file) == 0 && ok;
+    fclose(index);
+    file = index = NULL;
+    unlink(index_path);
+
+    // Drop whatever preallocated space was not used; left in place, it would
+    // sit behind idx1 where players expect the end of the RIFF
+    char path[96];
+    strncpy(path, index_path, sizeof(path));
+    path[strlen(path) - 4] = '\0';
+    ok = truncate(path, file_size) == 0 && ok;
+    return ok;
+}
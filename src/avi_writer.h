@@ -0,0 +1,56 @@
+#ifndef AVI_WRITER_H
+#define AVI_WRITER_H
+
+// Minimal MJPEG AVI 1.0 writer on top of stdio, so it runs unchanged on the
+// SD card VFS and on a host file.
+//
+// Frames are staged in a caller-provided buffer and written out in whole
+// buffer-sized blocks; the header is padded so 'movi' data starts on a 512-byte
+// boundary, which keeps every block write sector aligned. idx1 entries are
+// appended to a side file as frames arrive and copied behind the movie data
+// on close.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+class AviWriter
+{
+public:
+    // buffer_size must be a multiple of 512
+    AviWriter(uint8_t *buffer, size_t buffer_size);
+    ~AviWriter();
+
+    // Creates path (and path + ".idx"), reserving prealloc_bytes up front so
+    // the filesystem does not have to extend the file on every write.
+    bool open(const char *path, uint16_t width, uint16_t height, uint32_t fps, size_t prealloc_bytes);
+    bool addFrame(const uint8_t *jpeg, size_t len);
+
+    // Flushes, appends idx1, patches the headers and trims the preallocated
+    // space; duration_ms sets the real frame rate. False when any of it
+    // failed, in which case the file is not a valid AVI.
+    bool close(uint32_t duration_ms);
+
+    bool isOpen() const { return file != NULL; }
+    uint32_t frameCount() const { return frames; }
+    uint64_t bytesWritten() const { return file_pos + fill; }
+
+private:
+    bool stage(const void *data, size_t len);
+    bool flushBlock();
+    bool writeHeader(uint32_t fps, uint32_t total_frames, uint32_t movi_size, uint32_t riff_size);
+
+    uint8_t *buf;
+    size_t buf_size;
+    size_t fill;
+    FILE *file;
+    FILE *index;
+    char index_path[96];
+    uint64_t file_pos;   // bytes already written to file
+    uint32_t movi_bytes; // chunk bytes after the 'movi' fourcc
+    uint32_t frames;
+    uint16_t width;
+    uint16_t height;
+};
+
+#endif // AVI_WRITER_H
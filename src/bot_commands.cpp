@@ -0,0 +1,356 @@
+#include "bot_commands.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Nesting beyond this is not something the Bot API sends
+#define JSON_MAX_DEPTH 16
+
+namespace
+{
+
+// Walks the JSON in place; every reader returns false when the input ends or
+// does not fit, which also covers a body cut off by the caller's buffer
+struct Cursor
+{
+    const char *p;
+    const char *end;
+
+    void skipSpace()
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+            p++;
+    }
+
+    bool take(char c)
+    {
+        skipSpace();
+        if (p < end && *p == c)
+        {
+            p++;
+            return true;
+        }
+        return false;
+    }
+
+    bool peek(char c)
+    {
+        skipSpace();
+        return p < end && *p == c;
+    }
+
+    bool literal(const char *word)
+    {
+        skipSpace();
+        size_t n = strlen(word);
+        if ((size_t)(end - p) < n || memcmp(p, word, n) != 0)
+            return false;
+        p += n;
+        return true;
+    }
+};
+
+void putChar(char *out, size_t cap, size_t &len, char c)
+{
+    if (out && len + 1 < cap)
+        out[len++] = c;
+}
+
+void putUtf8(char *out, size_t cap, size_t &len, unsigned cp)
+{
+    if (cp < 0x80)
+    {
+        putChar(out, cap, len, (char)cp);
+    }
+    else if (cp < 0x800)
+    {
+        putChar(out, cap, len, (char)(0xC0 | cp >> 6));
+        putChar(out, cap, len, (char)(0x80 | (cp & 0x3F)));
+    }
+    else
+    {
+        putChar(out, cap, len, (char)(0xE0 | cp >> 12));
+        putChar(out, cap, len, (char)(0x80 | ((cp >> 6) & 0x3F)));
+        putChar(out, cap, len, (char)(0x80 | (cp & 0x3F)));
+    }
+}
+
+// Decodes a string into out (cut off at cap, may be NULL to skip it)
+bool readString(Cursor &c, char *out, size_t cap)
+{
+    size_t len = 0;
+    if (!c.take('"'))
+        return false;
+    while (c.p < c.end)
+    {
+        char ch = *c.p++;
+        if (ch == '"')
+        {
+            if (out && cap)
+                out[len] = '\0';
+            return true;
+        }
+        if (ch != '\\')
+        {
+            putChar(out, cap, len, ch);
+            continue;
+        }
+        if (c.p >= c.end)
+            return false;
+        char esc = *c.p++;
+        switch (esc)
+        {
+        case 'n':
+            putChar(out, cap, len, '\n');
+            break;
+        case 't':
+            putChar(out, cap, len, '\t');
+            break;
+        case 'r':
+        case 'b':
+        case 'f':
+            break;
+        case 'u':
+        {
+            if (c.end - c.p < 4)
+                return false;
+            char hex[5] = {c.p[0], c.p[1], c.p[2], c.p[3], 0};
+            char *hex_end;
+            unsigned cp = strtoul(hex, &hex_end, 16);
+            if (hex_end != hex + 4)
+                return false;
+            c.p += 4;
+            // Emoji and other surrogate pairs do not matter for commands
+            putUtf8(out, cap, len, cp >= 0xD800 && cp < 0xE000 ? '?' : cp);
+            break;
+        }
+        default: // '"', '\\' and '/'
+            putChar(out, cap, len, esc);
+            break;
+        }
+    }
+    return false;
+}
+
+bool readInt(Cursor &c, int64_t *value)
+{
+    c.skipSpace();
+    const char *start = c.p;
+    if (c.p < c.end && *c.p == '-')
+        c.p++;
+    while (c.p < c.end && isdigit((unsigned char)*c.p))
+        c.p++;
+    // A number running into the end of the buffer may be cut off
+    if (c.p == start || c.p >= c.end)
+        return false;
+    *value = strtoll(start, NULL, 10);
+    return true;
+}
+
+bool skipValue(Cursor &c, int depth);
+
+bool skipMembers(Cursor &c, char close, int depth)
+{
+    if (c.take(close))
+        return true;
+    do
+    {
+        if (close == '}' && (!readString(c, NULL, 0) || !c.take(':')))
+            return false;
+        if (!skipValue(c, depth + 1))
+            return false;
+    } while (c.take(','));
+    return c.take(close);
+}
+
+bool skipValue(Cursor &c, int depth)
+{
+    if (depth > JSON_MAX_DEPTH)
+        return false;
+    c.skipSpace();
+    if (c.p >= c.end)
+        return false;
+    switch (*c.p)
+    {
+    case '"':
+        return readString(c, NULL, 0);
+    case '{':
+        c.p++;
+        return skipMembers(c, '}', depth);
+    case '[':
+        c.p++;
+        return skipMembers(c, ']', depth);
+    case 't':
+        return c.literal("true");
+    case 'f':
+        return c.literal("false");
+    case 'n':
+        return c.literal("null");
+    default:
+    {
+        // Numbers, including fractions and exponents nobody sends here
+        const char *start = c.p;
+        while (c.p < c.end && (isdigit((unsigned char)*c.p) || strchr("+-.eE", *c.p)))
+            c.p++;
+        return c.p > start && c.p < c.end;
+    }
+    }
+}
+
+// Calls member(key) for every key of an object; member reads the value
+template <typename F> bool readObject(Cursor &c, int depth, F member)
+{
+    if (depth > JSON_MAX_DEPTH || !c.take('{'))
+        return false;
+    if (c.take('}'))
+        return true;
+    do
+    {
+        char key[16];
+        if (!readString(c, key, sizeof(key)) || !c.take(':') || !member(key))
+            return false;
+    } while (c.take(','));
+    return c.take('}');
+}
+
+bool readChat(Cursor &c, int depth, BotUpdate &u)
+{
+    return readObject(c, depth, [&](const char *key) {
+        return strcmp(key, "id") == 0 ? readInt(c, &u.chat_id) : skipValue(c, depth + 1);
+    });
+}
+
+bool readMessage(Cursor &c, int depth, BotUpdate &u)
+{
+    return readObject(c, depth, [&](const char *key) {
+        if (strcmp(key, "chat") == 0)
+            return readChat(c, depth + 1, u);
+        if (strcmp(key, "date") == 0)
+            return readInt(c, &u.date);
+        if (strcmp(key, "text") == 0)
+            return readString(c, u.text, sizeof(u.text));
+        return skipValue(c, depth + 1);
+    });
+}
+
+bool readUpdate(Cursor &c, BotUpdate &u, int64_t *last_id)
+{
+    memset(&u, 0, sizeof(u));
+    return readObject(c, 2, [&](const char *key) {
+        if (strcmp(key, "update_id") == 0)
+        {
+            if (!readInt(c, &u.update_id))
+                return false;
+            if (u.update_id > *last_id)
+                *last_id = u.update_id;
+            return true;
+        }
+        if (strcmp(key, "message") == 0)
+            return readMessage(c, 3, u);
+        return skipValue(c, 3);
+    });
+}
+
+} // namespace
+
+int parseBotUpdates(const char *body, size_t len, BotUpdate *out, int max, int64_t *last_id)
+{
+    Cursor c = {body, body + len};
+    bool ok = false;
+    int count = 0;
+    bool done = false;
+
+    // {"ok":true,"result":[{update},...]}; the order of the two is not fixed
+    bool parsed = readObject(c, 0, [&](const char *key) {
+        if (strcmp(key, "ok") == 0)
+        {
+            ok = c.literal("true");
+            return ok || c.literal("false");
+        }
+        if (strcmp(key, "result") != 0 || done)
+            return skipValue(c, 1);
+
+        done = true;
+        if (!c.take('['))
+            return false;
+        if (c.take(']'))
+            return true;
+        do
+        {
+            BotUpdate u;
+            if (!readUpdate(c, u, last_id))
+                return false;
+            if (count < max)
+                out[count++] = u;
+        } while (c.take(','));
+        return c.take(']');
+    });
+
+    // A cut-off body still yields its complete entries
+    if (!done || (parsed && !ok))
+        return -1;
+    return count;
+}
+
+BotCommand parseBotCommand(const char *text, int *arg)
+{
+    *arg = -1;
+    while (*text == ' ')
+        text++;
+    if (*text != '/')
+        return BOT_NONE;
+    text++;
+
+    char name[16];
+    size_t n = 0;
+    while (*text && *text != ' ' && *text != '@' && *text != '\n')
+    {
+        if (n + 1 < sizeof(name))
+            name[n++] = tolower((unsigned char)*text);
+        text++;
+    }
+    name[n] = '\0';
+    // In groups commands come as /photo@bot_name
+    while (*text && *text != ' ' && *text != '\n')
+        text++;
+    while (*text == ' ')
+        text++;
+    if (isdigit((unsigned char)*text))
+        *arg = atoi(text);
+
+    static const struct
+    {
+        const char *name;
+        BotCommand command;
+    } names[] = {
+        {"photo", BOT_PHOTO},     {"burst", BOT_BURST}, {"status", BOT_STATUS},
+        {"quality", BOT_QUALITY}, {"help", BOT_HELP},   {"start", BOT_HELP},
+    };
+    for (const auto &entry : names)
+    {
+        if (strcmp(name, entry.name) == 0)
+            return entry.command;
+    }
+    return BOT_UNKNOWN;
+}
+
+const char *botCommandName(BotCommand command)
+{
+    switch (command)
+    {
+    case BOT_PHOTO:
+        return "photo";
+    case BOT_BURST:
+        return "burst";
+    case BOT_STATUS:
+        return "status";
+    case BOT_QUALITY:
+        return "quality";
+    case BOT_HELP:
+        return "help";
+    case BOT_UNKNOWN:
+        return "unknown";
+    default:
+        return "none";
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef BOT_COMMANDS_H
+#define BOT_COMMANDS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Longest message text kept per update, including the terminator; commands
+// are short, anything longer is cut off
+#define BOT_TEXT_MAX 64
+
+enum BotCommand
+{
+    BOT_NONE, // not a command
+    BOT_PHOTO,
+    BOT_BURST,
+    BOT_STATUS,
+    BOT_QUALITY,
+    BOT_HELP,
+    BOT_UNKNOWN,
+};
+
+struct BotUpdate
+{
+    int64_t update_id;
+    int64_t chat_id; // 0 when the update is not a message
+    int64_t date;    // message time, Unix seconds
+    char text[BOT_TEXT_MAX];
+};
+
+// Parses a getUpdates answer. Complete entries of "result" go into out,
+// messages and other updates alike so their ids get acknowledged; parsing
+// stops at the first entry that is cut off. Returns the number of entries,
+// or -1 when the body is not a successful answer. *last_id receives the
+// highest update_id seen, also from an entry that was cut off, so an update
+// too large for the caller's buffer can be skipped.
+int parseBotUpdates(const char *body, size_t len, BotUpdate *out, int max, int64_t *last_id);
+
+// "/burst 5" gives BOT_BURST and *arg 5, "/photo@camera_bot" BOT_PHOTO.
+// *arg is -1 without a number after the command.
+BotCommand parseBotCommand(const char *text, int *arg);
+
+const char *botCommandName(BotCommand command);
+
+#endif // BOT_COMMANDS_H
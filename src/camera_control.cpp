@@ -0,0 +1,333 @@
+#include "camera_control.h"
+#include <Preferences.h>
+#include <limits.h>
+#include "camera_http_server.h"
+
+// Bumped whenever CameraSettings changes layout; older blobs are ignored
+#define CAMERA_SETTINGS_VERSION 1
+
+struct FrameSizeName
+{
+  framesize_t size;
+  const char *name;
+};
+
+static const FrameSizeName frame_sizes[] = {
+    {FRAMESIZE_QQVGA, "qqvga"}, // 160x120
+    {FRAMESIZE_QVGA, "qvga"},   // 320x240
+    {FRAMESIZE_CIF, "cif"},     // 400x296
+    {FRAMESIZE_HVGA, "hvga"},   // 480x320
+    {FRAMESIZE_VGA, "vga"},     // 640x480
+    {FRAMESIZE_SVGA, "svga"},   // 800x600
+    {FRAMESIZE_XGA, "xga"},     // 1024x768
+    {FRAMESIZE_HD, "hd"},       // 1280x720
+    {FRAMESIZE_SXGA, "sxga"},   // 1280x1024
+    {FRAMESIZE_UXGA, "uxga"},   // 1600x1200
+};
+
+static const char *frameSizeName(framesize_t size)
+{
+  for (const FrameSizeName &f : frame_sizes)
+  {
+    if (f.size == size)
+    {
+      return f.name;
+    }
+  }
+  return "other";
+}
+
+static bool parseFrameSize(const char *name, framesize_t &size)
+{
+  for (const FrameSizeName &f : frame_sizes)
+  {
+    if (strcasecmp(f.name, name) == 0)
+    {
+      size = f.size;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Small frames from the newest buffer: least time between exposure and the
+// viewer, at the cost of detail
+static void lowLatencyProfile(CameraSettings &c)
+{
+  c.frame_size = FRAMESIZE_QVGA;
+  c.quality = 14;
+  c.fb_count = 2;
+  c.grab_latest = true;
+}
+
+// Large, finely quantized frames; fewer of them fit through the link
+static void highQualityProfile(CameraSettings &c)
+{
+  c.frame_size = FRAMESIZE_SXGA;
+  c.quality = 8;
+  c.fb_count = 2;
+  c.grab_latest = false;
+}
+
+struct CameraProfile
+{
+  const char *name;
+  void (*apply)(CameraSettings &c); // on top of the defaults
+};
+
+static const CameraProfile profiles[] = {
+    {"default", NULL},
+    {"low-latency", lowLatencyProfile},
+    {"high-quality", highQualityProfile},
+};
+
+static char profile_name[16] = "default";
+
+bool cameraProfile(const char *name, CameraSettings &settings)
+{
+  for (const CameraProfile &p : profiles)
+  {
+    if (strcmp(p.name, name) == 0)
+    {
+      settings = defaultCameraSettings();
+      if (p.apply)
+      {
+        p.apply(settings);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *getCameraProfileName()
+{
+  return profile_name;
+}
+
+bool loadCameraSettings(CameraSettings &settings)
+{
+  Preferences prefs;
+  if (!prefs.begin(CAMERA_SETTINGS_NAMESPACE, true))
+  {
+    return false;
+  }
+  bool ok = prefs.getUChar("version", 0) == CAMERA_SETTINGS_VERSION &&
+            prefs.getBytesLength("settings") == sizeof(CameraSettings);
+  if (ok)
+  {
+    prefs.getBytes("settings", &settings, sizeof(CameraSettings));
+    prefs.getString("profile", profile_name, sizeof(profile_name));
+  }
+  prefs.end();
+  return ok;
+}
+
+bool saveCameraSettings(const CameraSettings &settings, const char *profile)
+{
+  strlcpy(profile_name, profile, sizeof(profile_name));
+
+  Preferences prefs;
+  if (!prefs.begin(CAMERA_SETTINGS_NAMESPACE, false))
+  {
+    return false;
+  }
+  bool ok = prefs.putBytes("settings", &settings, sizeof(CameraSettings)) == sizeof(CameraSettings) &&
+            prefs.putString("profile", profile_name) > 0 &&
+            prefs.putUChar("version", CAMERA_SETTINGS_VERSION) == 1;
+  prefs.end();
+  if (!ok)
+  {
+    Logger::getInstance().warning("Could not save camera settings to NVS");
+  }
+  return ok;
+}
+
+void clearCameraSettings()
+{
+  strlcpy(profile_name, "default", sizeof(profile_name));
+
+  Preferences prefs;
+  if (prefs.begin(CAMERA_SETTINGS_NAMESPACE, false))
+  {
+    prefs.clear();
+    prefs.end();
+  }
+}
+
+// True if key is present; out is INT_MIN when its value is not a number
+static bool queryInt(const char *query, const char *key, int &out)
+{
+  char value[12];
+  if (httpd_query_key_value(query, key, value, sizeof(value)) != ESP_OK)
+  {
+    return false;
+  }
+  char *end;
+  long parsed = strtol(value, &end, 10);
+  out = (end == value || *end != '\0') ? INT_MIN : (int)parsed; // long is 32-bit here, strtol saturates
+  return true;
+}
+
+// Applies the query's overrides to c; returns false with error set on a bad value
+static bool parseOverrides(const char *query, CameraSettings &c, bool &any, const char *&error)
+{
+  char value[16];
+  int v;
+  any = false;
+
+  if (httpd_query_key_value(query, "framesize", value, sizeof(value)) == ESP_OK)
+  {
+    if (!parseFrameSize(value, c.frame_size))
+    {
+      error = "unknown framesize";
+      return false;
+    }
+    any = true;
+  }
+  if (httpd_query_key_value(query, "grab", value, sizeof(value)) == ESP_OK)
+  {
+    c.grab_latest = strcmp(value, "latest") == 0;
+    any = true;
+  }
+
+  // Range-checked while still an int: the fields are narrower and would wrap
+#define INT_FIELD(key, field, lo, hi)                 \
+  if (queryInt(query, key, v))                        \
+  {                                                   \
+    if (v < (lo) || v > (hi))                         \
+    {                                                 \
+      error = key " must be " #lo " to " #hi;         \
+      return false;                                   \
+    }                                                 \
+    c.field = v;                                      \
+    any = true;                                       \
+  }
+  INT_FIELD("quality", quality, 4, 63)
+  INT_FIELD("brightness", brightness, -2, 2)
+  INT_FIELD("contrast", contrast, -2, 2)
+  INT_FIELD("saturation", saturation, -2, 2)
+  INT_FIELD("awb", awb, 0, 1)
+  INT_FIELD("aec", aec, 0, 1)
+  INT_FIELD("aec2", aec2, 0, 1)
+  INT_FIELD("ae_level", ae_level, -2, 2)
+  INT_FIELD("aec_value", aec_value, 0, 1200)
+  INT_FIELD("agc", agc, 0, 1)
+  INT_FIELD("agc_gain", agc_gain, 0, 30)
+  INT_FIELD("gainceiling", gainceiling, 0, 6)
+  INT_FIELD("vflip", vflip, 0, 1)
+  INT_FIELD("hmirror", hmirror, 0, 1)
+  INT_FIELD("fb_count", fb_count, 1, 3)
+#undef INT_FIELD
+
+  if (queryInt(query, "xclk", v))
+  {
+    if (v < 8 || v > 20)
+    {
+      error = "xclk must be 8 to 20 (MHz)";
+      return false;
+    }
+    c.xclk_hz = (uint32_t)v * 1000000u;
+    any = true;
+  }
+  return true;
+}
+
+static esp_err_t sendControl(httpd_req_t *req, bool success, const char *error, const CameraReconfig *reconfig)
+{
+  CameraSettings c = getCameraSettings();
+
+  // Built in the request arena rather than a heap JSON document; every value
+  // is a number or one of our own names, so nothing needs escaping
+  ArenaScope scope(httpScratch());
+  StrBuilder out(httpScratch(), 1024);
+  out.appendf("{\"success\":%s", success ? "true" : "false");
+  if (error)
+  {
+    out.appendf(",\"message\":\"%s\"", error);
+  }
+  else if (!success && reconfig)
+  {
+    out.appendf(",\"message\":\"%s\"", reconfig->restored ? "reconfiguration failed, previous settings kept"
+                                                              : "reconfiguration failed, camera did not restart");
+  }
+  out.appendf(",\"profile\":\"%s\"", profile_name);
+  out.appendf(",\"settings\":{\"framesize\":\"%s\",\"quality\":%u,\"brightness\":%d,\"contrast\":%d,"
+              "\"saturation\":%d,\"awb\":%s,\"aec\":%s,\"aec2\":%s,\"ae_level\":%d,\"aec_value\":%u,"
+              "\"agc\":%s,\"agc_gain\":%u,\"gainceiling\":%u,\"vflip\":%s,\"hmirror\":%s,\"xclk\":%lu,"
+              "\"fb_count\":%u,\"grab\":\"%s\"}",
+              frameSizeName(c.frame_size), c.quality, c.brightness, c.contrast, c.saturation,
+              c.awb ? "true" : "false", c.aec ? "true" : "false", c.aec2 ? "true" : "false", c.ae_level,
+              c.aec_value, c.agc ? "true" : "false", c.agc_gain, c.gainceiling, c.vflip ? "true" : "false",
+              c.hmirror ? "true" : "false", (unsigned long)(c.xclk_hz / 1000000), c.fb_count,
+              c.grab_latest ? "latest" : "empty");
+
+  if (reconfig)
+  {
+    out.appendf(",\"reinit\":%s,\"reconfig_ms\":%.3f", reconfig->reinit ? "true" : "false",
+                reconfig->elapsed_us / 1000.0);
+  }
+  out.append(",\"profiles\":[");
+  bool first = true;
+  for (const CameraProfile &p : profiles)
+  {
+    out.appendf("%s\"%s\"", first ? "" : ",", p.name);
+    first = false;
+  }
+  out.append("]}");
+
+  if (!success)
+  {
+    httpd_resp_set_status(req, error ? "400 Bad Request" : "500 Internal Server Error");
+  }
+  else if (out.truncated())
+  {
+    httpd_resp_set_status(req, "500 Internal Server Error");
+  }
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  return httpd_resp_send(req, out.c_str(), out.length());
+}
+
+esp_err_t control_handler(httpd_req_t *req)
+{
+  char query[256];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK)
+  {
+    return sendControl(req, true, NULL, NULL);
+  }
+
+  CameraSettings next = getCameraSettings();
+  const char *error = NULL;
+  char value[16];
+  bool from_profile = false;
+
+  // A profile replaces everything; individual fields then refine it
+  if (httpd_query_key_value(query, "profile", value, sizeof(value)) == ESP_OK)
+  {
+    if (!cameraProfile(value, next))
+    {
+      return sendControl(req, false, "unknown profile", NULL);
+    }
+    from_profile = true;
+  }
+
+  bool overrides;
+  if (!parseOverrides(query, next, overrides, error))
+  {
+    return sendControl(req, false, error, NULL);
+  }
+  if (!from_profile && !overrides)
+  {
+    return sendControl(req, true, NULL, NULL);
+  }
+  const char *profile = overrides ? "custom" : value;
+
+  CameraReconfig reconfig = {};
+  if (!applyCameraSettings(next, &reconfig))
+  {
+    return sendControl(req, false, NULL, &reconfig);
+  }
+  saveCameraSettings(getCameraSettings(), profile);
+  return sendControl(req, true, NULL, &reconfig);
+}
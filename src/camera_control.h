@@ -0,0 +1,26 @@
+#ifndef CAMERA_CONTROL_H
+#define CAMERA_CONTROL_H
+
+#include <Arduino.h>
+#include "esp_http_server.h"
+#include "camera_setup.h"
+
+// NVS namespace holding the settings chosen through /control
+#define CAMERA_SETTINGS_NAMESPACE "camera"
+
+// Fills settings with a named profile ("default", "low-latency",
+// "high-quality"); false for an unknown name
+bool cameraProfile(const char *name, CameraSettings &settings);
+const char *getCameraProfileName();
+
+// Settings saved by the last successful /control change, if any
+bool loadCameraSettings(CameraSettings &settings);
+bool saveCameraSettings(const CameraSettings &settings, const char *profile);
+void clearCameraSettings();
+
+// GET /control reports the current settings. Query parameters change them
+// as one reconfiguration and save the result to NVS, e.g.
+// /control?profile=low-latency or /control?framesize=svga&quality=12&fb_count=1
+esp_err_t control_handler(httpd_req_t *req);
+
+#endif // CAMERA_CONTROL_H
@@ -1,32 +1,103 @@
 
 #include "camera_http_server.h"
+// Generated from web/ by scripts/embed_web.py
+#include "web_assets.h"
+#include "esp_heap_caps.h"
+#include "wifi_link.h"
 
 // Variable to store HTTP server
 httpd_handle_t camera_httpd = NULL;
 
+static ScratchArena request_scratch(NULL, 0);
+
+ScratchArena &httpScratch()
+{
+  return request_scratch;
+}
+
+// Serves a gzip-compressed UI asset straight from flash; user_ctx is its WebAsset
 esp_err_t index_handler(httpd_req_t *req)
 {
-  httpd_resp_set_type(req, "text/html");
-  String page = "<html><head><title>ESP32-CAM Stream</title></head><body>";
-  page += "<h1>ESP32-CAM VideoStream</h1>";
-  page += "<img src='/stream' width='640' height='480'>";
-  page += "</body></html>";
-  return httpd_resp_send(req, &page[0], page.length());
+  const WebAsset *asset = (const WebAsset *)req->user_ctx;
+  httpd_resp_set_hdr(req, "Cache-Control", "public, max-age=604800");
+  httpd_resp_set_hdr(req, "ETag", asset->etag);
+
+  char if_none_match[40];
+  if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+      strcmp(if_none_match, asset->etag) == 0)
+  {
+    httpd_resp_set_status(req, "304 Not Modified");
+    return httpd_resp_send(req, NULL, 0);
+  }
+
+  httpd_resp_set_type(req, asset->mime);
+  httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+  return httpd_resp_send(req, (const char *)asset->data, asset->len);
+}
+
+// Time from request to the first complete frame, [0] live capture, [1] snapshot cache
+struct FirstFrameStats
+{
+  uint32_t count;
+  uint32_t last_us;
+  uint64_t total_us;
+};
+static FirstFrameStats first_frame[2];
+static uint32_t snapshot_served = 0;
+static uint32_t snapshot_not_modified = 0;
+
+// Part of every snapshot ETag. The cache sequence starts over at each boot,
+// so without it a client could revalidate a frame from before a reset.
+static uint32_t etag_salt = 0;
+
+static void recordFirstFrame(bool cached, int64_t started_us)
+{
+  FirstFrameStats &f = first_frame[cached ? 1 : 0];
+  f.last_us = (uint32_t)(esp_timer_get_time() - started_us);
+  f.total_us += f.last_us;
+  f.count++;
+}
+
+static const char *_STREAM_CONTENT_TYPE = "multipart/x-mixed-replace; boundary=123456789000000000000987654321";
+static const char *_STREAM_BOUNDARY = "\r\n--123456789000000000000987654321\r\n";
+static const char *_STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp: %u.%06u\r\n\r\n";
+
+// Sends one MJPEG part: header, JPEG data and the boundary. The capture time
+// goes into X-Timestamp so the viewer can derive FPS and latency.
+static esp_err_t sendStreamPart(httpd_req_t *req, const uint8_t *jpg, size_t len, int64_t captured_us)
+{
+  char part_buf[96];
+  size_t hlen = snprintf(part_buf, sizeof(part_buf), _STREAM_PART, len, (unsigned)(captured_us / 1000000),
+                         (unsigned)(captured_us % 1000000));
+  TRACE_BEGIN(TRACE_STREAM_FRAME, (uint32_t)captured_us);
+  TRACE_BEGIN(TRACE_STREAM_HEADER, hlen);
+  esp_err_t res = httpd_resp_send_chunk(req, part_buf, hlen);
+  TRACE_END(TRACE_STREAM_HEADER, res);
+  if (res == ESP_OK)
+  {
+    TRACE_BEGIN(TRACE_STREAM_JPEG, len);
+    res = httpd_resp_send_chunk(req, (const char *)jpg, len);
+    TRACE_END(TRACE_STREAM_JPEG, res);
+  }
+  if (res == ESP_OK)
+  {
+    TRACE_BEGIN(TRACE_STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
+    res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
+    TRACE_END(TRACE_STREAM_BOUNDARY, res);
+  }
+  TRACE_END(TRACE_STREAM_FRAME, res);
+  return res;
 }
 
 esp_err_t stream_handler(httpd_req_t *req)
 {
+  int64_t started_us = esp_timer_get_time();
   camera_fb_t *fb = NULL;
   esp_err_t res = ESP_OK;
   size_t _jpg_buf_len = 0;
   uint8_t *_jpg_buf = NULL;
-  char *part_buf[64];
 
   // Set headers for MJPEG stream - modified for better compatibility
-  static const char *_STREAM_CONTENT_TYPE = "multipart/x-mixed-replace; boundary=123456789000000000000987654321";
-  static const char *_STREAM_BOUNDARY = "\r\n--123456789000000000000987654321\r\n";
-  static const char *_STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n";
-
   httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
   httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
   httpd_resp_set_hdr(req, "Cache-Control", "no-cache, no-store, must-revalidate");
@@ -36,10 +107,74 @@ esp_err_t stream_handler(httpd_req_t *req)
 
   Logger::getInstance().info("Stream requested");
 
-  while (true)
+  // Static-scene saver, /stream?saver=0 sends every frame;
+  // /stream?cache=0 waits for a live capture instead of the cached frame;
+  // /stream?scale=2|4|8 sends a reduced copy from the scaled encoder
+  bool saver = true;
+  bool use_cache = true;
+  int scale = 1;
+  char query[64];
+  char value[4];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK)
   {
-    // Get frame from camera
-    fb = esp_camera_fb_get();
+    if (httpd_query_key_value(query, "saver", value, sizeof(value)) == ESP_OK)
+    {
+      saver = atoi(value) != 0;
+    }
+    if (httpd_query_key_value(query, "cache", value, sizeof(value)) == ESP_OK)
+    {
+      use_cache = atoi(value) != 0;
+    }
+    if (httpd_query_key_value(query, "scale", value, sizeof(value)) == ESP_OK)
+    {
+      scale = atoi(value);
+    }
+  }
+  if (scale != 1 && !isStreamScale(scale))
+  {
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "scale must be 2, 4 or 8");
+    return ESP_FAIL;
+  }
+  if (scale > 1 && !scaledStreamBegin(scale))
+  {
+    httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Scaled stream unavailable");
+    return ESP_FAIL;
+  }
+  // The cache holds full-size frames only
+  use_cache = use_cache && scale == 1;
+  SceneDetector scene;
+
+  // The supervisor bumps the generation when streaming stalls
+  uint32_t generation = supervisorGeneration(COMPONENT_STREAM);
+  supervisorBusy(COMPONENT_STREAM);
+  // Wakes CPU, radio and sensor before the first capture
+  powerDemandBegin(DEMAND_STREAM);
+
+  // Paint the current frame right away if the cache has a fresh one, live
+  // frames follow from there. A stale frame is not sent: it would show the
+  // scene as it was when the camera last ran.
+  bool first_sent = false;
+  int64_t painted_us = 0;
+  int stale_skips = 0; // bounded, in case the clock is set back meanwhile
+  const Snapshot *snap = use_cache ? snapshotAcquire(SNAPSHOT_MAX_AGE_MS) : NULL;
+  if (snap)
+  {
+    painted_us = snap->captured_us;
+    res = sendStreamPart(req, snap->buf, snap->len, snap->captured_us);
+    snapshotRelease(snap);
+    if (res == ESP_OK)
+    {
+      recordFirstFrame(true, started_us);
+      first_sent = true;
+    }
+  }
+
+  // Ends when the link drops instead of blocking in send until TCP gives up
+  while (res == ESP_OK && supervisorGeneration(COMPONENT_STREAM) == generation && wifiLinkUp())
+  {
+    // Get frame from camera, or its reduced copy
+    fb = scale > 1 ? scaledCapture(scale) : cameraCapture();
     if (!fb)
     {
       Logger::getInstance().error("Camera frame capture failed");
@@ -54,31 +189,42 @@ esp_err_t stream_handler(httpd_req_t *req)
         _jpg_buf = fb->buf;
       }
 
-      // Send MJPEG part header
-      if (res == ESP_OK)
+      // The driver can still hand out the frame that was just painted from
+      // the cache, or an older one; skip those rather than repeat or rewind
+      int64_t fb_us = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+      if (painted_us && fb_us <= painted_us && stale_skips++ < 3)
+      {
+        scale > 1 ? scaledRelease(fb) : cameraRelease(fb);
+        supervisorBeat(COMPONENT_STREAM);
+        continue;
+      }
+
+      // Nothing changed in view: skip the frame and poll the sensor at a lower rate
+      if (saver && !scene.shouldSend(_jpg_buf_len, millis()))
       {
-        size_t hlen = snprintf((char *)part_buf, 64, _STREAM_PART, _jpg_buf_len);
-        res = httpd_resp_send_chunk(req, (const char *)part_buf, hlen);
+        scale > 1 ? scaledRelease(fb) : cameraRelease(fb);
+        supervisorBeat(COMPONENT_STREAM);
+        vTaskDelay(pdMS_TO_TICKS(SCENE_IDLE_POLL_MS));
+        continue;
       }
 
-      // Send JPEG data
+      // Send MJPEG part header, JPEG data and boundary
       if (res == ESP_OK)
       {
-        res = httpd_resp_send_chunk(req, (const char *)_jpg_buf, _jpg_buf_len);
+        res = sendStreamPart(req, _jpg_buf, _jpg_buf_len, fb_us);
         if (res == ESP_OK)
         {
           Serial.printf("Frame sent: %u bytes\n", _jpg_buf_len);
+          if (!first_sent)
+          {
+            recordFirstFrame(false, started_us);
+            first_sent = true;
+          }
         }
       }
 
-      // Send boundary between MJPEG parts
-      if (res == ESP_OK)
-      {
-        res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
-      }
-
       // Return frame buffer
-      esp_camera_fb_return(fb);
+      scale > 1 ? scaledRelease(fb) : cameraRelease(fb);
 
       // Check if client disconnected
       if (res != ESP_OK)
@@ -86,9 +232,19 @@ esp_err_t stream_handler(httpd_req_t *req)
         Logger::getInstance().error("Client disconnected or streaming error");
         break;
       }
+      supervisorBeat(COMPONENT_STREAM);
     }
+
+    // Fairness point for other tasks at the same priority
+    vTaskDelay(1);
   }
 
+  if (scale > 1)
+  {
+    scaledStreamEnd(scale);
+  }
+  powerDemandEnd(DEMAND_STREAM);
+  supervisorIdle(COMPONENT_STREAM);
   return res;
 }
 
@@ -102,17 +258,74 @@ esp_err_t capture_handler(httpd_req_t *req)
   httpd_resp_set_type(req, "application/json");
   httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
 
-  char response[100];
-  if (success)
+  // Delivery happens in the background; report where the outbox stands
+  OutboxStats outbox = getOutboxStats();
+  char response[160];
+  snprintf(response, sizeof(response), "{\"success\":%s,\"message\":\"%s\",\"outbox_depth\":%u,\"breaker\":\"%s\"}",
+           success ? "true" : "false", success ? "Photo captured and queued for Telegram" : "Failed to capture photo",
+           outbox.depth, CircuitBreaker::stateName(outbox.breaker));
+
+  return httpd_resp_send(req, response, strlen(response));
+}
+
+// Latest frame from the snapshot cache, revalidated through ETag / If-None-Match
+esp_err_t snapshot_handler(httpd_req_t *req)
+{
+  camera_fb_t *fb = NULL;
+  const Snapshot *snap = snapshotAcquire(SNAPSHOT_MAX_AGE_MS);
+  if (!snap)
   {
-    snprintf(response, sizeof(response), "{\"success\":true,\"message\":\"Photo captured and sent to Telegram\"}");
+    // Cache is cold or stale; a capture refreshes it
+    fb = cameraCapture();
+    if (!fb)
+    {
+      Logger::getInstance().error("Camera frame capture failed");
+      httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Capture failed");
+      return ESP_FAIL;
+    }
+    snap = snapshotAcquire(SNAPSHOT_MAX_AGE_MS);
+    if (snap)
+    {
+      cameraRelease(fb);
+      fb = NULL;
+    }
+  }
+
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+  esp_err_t res;
+  if (snap)
+  {
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"%08x-%08x\"", (unsigned)etag_salt, (unsigned)snap->seq);
+    httpd_resp_set_hdr(req, "ETag", etag);
+
+    char if_none_match[64];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        strstr(if_none_match, etag))
+    {
+      snapshot_not_modified++;
+      httpd_resp_set_status(req, "304 Not Modified");
+      res = httpd_resp_send(req, NULL, 0);
+    }
+    else
+    {
+      snapshot_served++;
+      httpd_resp_set_type(req, "image/jpeg");
+      res = httpd_resp_send(req, (const char *)snap->buf, snap->len);
+    }
+    snapshotRelease(snap);
   }
   else
   {
-    snprintf(response, sizeof(response), "{\"success\":false,\"message\":\"Failed to capture or send photo\"}");
+    // No PSRAM for the cache: serve the capture itself, without an ETag
+    snapshot_served++;
+    httpd_resp_set_type(req, "image/jpeg");
+    res = httpd_resp_send(req, (const char *)fb->buf, fb->len);
+    cameraRelease(fb);
   }
-
-  return httpd_resp_send(req, response, strlen(response));
+  return res;
 }
 
 esp_err_t health_handler(httpd_req_t *req)
@@ -123,8 +336,251 @@ esp_err_t health_handler(httpd_req_t *req)
   return httpd_resp_send(req, "OK", 2);
 }
 
+// Opt-in multicast mode: /multicast?enable=1&fec=8
+esp_err_t multicast_handler(httpd_req_t *req)
+{
+  char query[64];
+  char value[8];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK)
+  {
+    if (httpd_query_key_value(query, "fec", value, sizeof(value)) == ESP_OK)
+    {
+      setMulticastParityGroup(constrain(atoi(value), 0, 255));
+    }
+    if (httpd_query_key_value(query, "enable", value, sizeof(value)) == ESP_OK)
+    {
+      setMulticastEnabled(atoi(value) != 0);
+    }
+  }
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+  char response[128];
+  snprintf(response, sizeof(response), "{\"enabled\":%s,\"group\":\"%s\",\"port\":%d,\"fec\":%u}",
+           isMulticastEnabled() ? "true" : "false", MCAST_GROUP, MCAST_PORT, getMulticastParityGroup());
+  return httpd_resp_send(req, response, strlen(response));
+}
+
+// Event trigger for the microSD recorder: /record?seconds=30
+esp_err_t record_handler(httpd_req_t *req)
+{
+  char query[32];
+  char value[8];
+  uint32_t seconds = 30;
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+      httpd_query_key_value(query, "seconds", value, sizeof(value)) == ESP_OK)
+  {
+    seconds = constrain(atoi(value), 1, 3600);
+  }
+
+  bool started = triggerRecording(seconds * 1000);
+  RecorderStats stats = getRecorderStats();
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+  char response[200];
+  snprintf(response, sizeof(response),
+           "{\"success\":%s,\"files\":%u,\"failed\":%u,\"open_failed\":%u,\"frames\":%u,\"dropped\":%u,"
+           "\"write_kbps\":%u}",
+           started ? "true" : "false", stats.files, stats.files_failed, stats.open_failed, stats.frames_written,
+           stats.frames_dropped, stats.last_write_kbps);
+  return httpd_resp_send(req, response, strlen(response));
+}
+
+// Text/timestamp overlay: /overlay?enable=1&quality=12&fps=10, or
+// /overlay?bench=30 to compare it with the direct JPEG path
+esp_err_t overlay_handler(httpd_req_t *req)
+{
+  char query[64];
+  char value[8];
+  int bench_frames = 0;
+  bool ok = true;
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK)
+  {
+    if (httpd_query_key_value(query, "quality", value, sizeof(value)) == ESP_OK)
+    {
+      setOverlayQuality(atoi(value));
+    }
+    if (httpd_query_key_value(query, "fps", value, sizeof(value)) == ESP_OK)
+    {
+      setOverlayFps(atoi(value));
+    }
+    if (httpd_query_key_value(query, "enable", value, sizeof(value)) == ESP_OK)
+    {
+      ok = setOverlayEnabled(atoi(value) != 0);
+    }
+    if (httpd_query_key_value(query, "bench", value, sizeof(value)) == ESP_OK)
+    {
+      bench_frames = constrain(atoi(value), 1, 300);
+    }
+  }
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+  char response[256];
+  int len = snprintf(response, sizeof(response), "{\"success\":%s,\"enabled\":%s,\"quality\":%u,\"fps\":%u",
+                     ok ? "true" : "false", isOverlayEnabled() ? "true" : "false", getOverlayQuality(),
+                     getOverlayFps());
+
+  OverlayBenchmark bench;
+  if (bench_frames && runOverlayBenchmark(bench_frames, bench))
+  {
+    len += snprintf(response + len, sizeof(response) - len,
+                    ",\"bench\":{\"frames\":%d,\"direct_fps\":%.1f,\"overlay_fps\":%.1f,\"direct_bytes\":%u,"
+                    "\"overlay_bytes\":%u,\"draw_us\":%u,\"encode_us\":%u}",
+                    bench_frames, bench.direct_fps, bench.overlay_fps, bench.direct_bytes, bench.overlay_bytes,
+                    bench.draw_us, bench.encode_us);
+  }
+  len += snprintf(response + len, sizeof(response) - len, "}");
+  return httpd_resp_send(req, response, len);
+}
+
+// Time-lapse mode: /timelapse?enable=1&interval=60&batch=10
+esp_err_t timelapse_handler(httpd_req_t *req)
+{
+  char query[64];
+  char value[8];
+  bool ok = true;
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK)
+  {
+    TimelapseStats current = getTimelapseStats();
+    bool enable = current.enabled;
+    uint32_t interval = current.interval_s;
+    uint8_t batch = current.batch;
+    bool changed = false;
+    if (httpd_query_key_value(query, "interval", value, sizeof(value)) == ESP_OK)
+    {
+      interval = atoi(value);
+      changed = true;
+    }
+    if (httpd_query_key_value(query, "batch", value, sizeof(value)) == ESP_OK)
+    {
+      batch = constrain(atoi(value), 1, 255);
+      changed = true;
+    }
+    if (httpd_query_key_value(query, "enable", value, sizeof(value)) == ESP_OK)
+    {
+      enable = atoi(value) != 0;
+      changed = true;
+    }
+    if (changed)
+    {
+      ok = setTimelapse(enable, interval, batch);
+    }
+  }
+
+  TimelapseStats s = getTimelapseStats();
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+  char response[320];
+  int len = snprintf(response, sizeof(response),
+                     "{\"success\":%s,\"enabled\":%s,\"interval\":%u,\"batch\":%u,\"captures\":%u,\"pending\":%u,"
+                     "\"uploaded\":%u,\"dropped\":%u,\"wake_to_done_ms\":%u,\"wake_to_done_avg_ms\":%u,"
+                     "\"capture_mj\":%.0f,\"upload_mj_per_frame\":%.0f,\"avg_ma\":%u}",
+                     ok ? "true" : "false", s.enabled ? "true" : "false", s.interval_s, s.batch, s.captures,
+                     s.pending, s.uploaded, s.dropped, s.last_wake_to_done_ms, s.avg_wake_to_done_ms,
+                     s.last_capture_mj, s.upload_mj_per_frame, s.avg_ma);
+  return httpd_resp_send(req, response, len);
+}
+
+static bool sendTraceChunk(const void *data, size_t len, void *ctx)
+{
+  return httpd_resp_send_chunk((httpd_req_t *)ctx, (const char *)data, len) == ESP_OK;
+}
+
+// Frame-lifecycle trace: /trace?enable=1 starts recording, /trace?enable=0
+// stops it, /trace?clear=1 empties the rings; /trace alone downloads them
+// for tools/trace_convert
+esp_err_t trace_handler(httpd_req_t *req)
+{
+  char query[32];
+  char value[4];
+  bool dump = true;
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK)
+  {
+    if (httpd_query_key_value(query, "clear", value, sizeof(value)) == ESP_OK && atoi(value))
+    {
+      traceClear();
+      dump = false;
+    }
+    if (httpd_query_key_value(query, "enable", value, sizeof(value)) == ESP_OK)
+    {
+      traceSetEnabled(atoi(value) != 0);
+      dump = false;
+    }
+  }
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+  if (dump)
+  {
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"esp32cam.trace\"");
+    if (!traceDump(sendTraceChunk, req))
+    {
+      return ESP_FAIL;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+  }
+
+  TraceStats s = getTraceStats();
+  httpd_resp_set_type(req, "application/json");
+  char response[128];
+  int len = snprintf(response, sizeof(response),
+                     "{\"enabled\":%s,\"events\":%u,\"overwritten\":%u,\"capacity\":%u,\"tasks\":%u}",
+                     s.enabled ? "true" : "false", (unsigned)s.recorded, (unsigned)s.overwritten,
+                     (unsigned)s.capacity, (unsigned)s.tasks);
+  return httpd_resp_send(req, response, len);
+}
+
+static void addStreamStats(JsonDocument &stats)
+{
+  stats["stream_frames_suppressed"] = SceneDetector::framesSuppressed();
+  stats["stream_bytes_saved"] = SceneDetector::bytesSaved();
+  for (int cached = 0; cached < 2; cached++)
+  {
+    const FirstFrameStats &f = first_frame[cached];
+    const char *prefix = cached ? "stream_first_frame_cached_" : "stream_first_frame_live_";
+    stats[String(prefix) + "count"] = f.count;
+    stats[String(prefix) + "last_us"] = f.last_us;
+    stats[String(prefix) + "avg_us"] = f.count ? (uint32_t)(f.total_us / f.count) : 0;
+  }
+  FrameCheckStats check = getFrameCheckStats();
+  uint32_t rejected = 0;
+  for (int i = 0; i < JPEG_STATUS_COUNT; i++)
+  {
+    rejected += check.rejected[i];
+  }
+  stats["jpeg_checked"] = check.checked;
+  stats["jpeg_rejected"] = rejected;
+  stats["jpeg_rejected_truncated"] = check.rejected[JPEG_TRUNCATED];
+  stats["jpeg_check_avg_us"] = check.avg_us;
+  stats["jpeg_check_max_us"] = check.max_us;
+  stats["jpeg_trimmed_bytes"] = check.trimmed_bytes;
+  stats["snapshot_served"] = snapshot_served;
+  stats["snapshot_not_modified"] = snapshot_not_modified;
+  stats["http_scratch_peak"] = request_scratch.peak();
+  stats["http_scratch_failures"] = request_scratch.failures();
+}
+
 void startHttpServer()
 {
+  Logger::getInstance().addStatsProvider(addStreamStats);
+  supervisorRegister(COMPONENT_STREAM, 15000, NULL);
+  // Wi-Fi is up by now, so this comes from the hardware RNG
+  etag_salt = esp_random();
+
+  // Allocated once for the server's lifetime
+  void *scratch = heap_caps_malloc(HTTP_SCRATCH_BYTES, MALLOC_CAP_SPIRAM);
+  if (!scratch)
+  {
+    scratch = malloc(HTTP_SCRATCH_BYTES);
+  }
+  request_scratch = ScratchArena(scratch, HTTP_SCRATCH_BYTES);
+
   httpd_config_t config = HTTPD_DEFAULT_CONFIG();
 
   // Increase buffer size to handle larger headers
@@ -137,13 +593,6 @@ void startHttpServer()
 
   config.server_port = 80;
 
-  // Configure main page handler
-  httpd_uri_t index_uri = {
-      .uri = "/",
-      .method = HTTP_GET,
-      .handler = index_handler,
-      .user_ctx = NULL};
-
   // Configure stream handler
   httpd_uri_t stream_uri = {
       .uri = "/stream",
@@ -157,19 +606,84 @@ void startHttpServer()
       .handler = capture_handler,
       .user_ctx = NULL};
 
+  httpd_uri_t snapshot_uri = {
+      .uri = "/snapshot.jpg",
+      .method = HTTP_GET,
+      .handler = snapshot_handler,
+      .user_ctx = NULL};
+
+  httpd_uri_t update_uri = {
+      .uri = "/update",
+      .method = HTTP_POST,
+      .handler = update_handler,
+      .user_ctx = NULL};
+
   httpd_uri_t health_uri = {
       .uri = "/health",
       .method = HTTP_GET,
       .handler = health_handler,
       .user_ctx = NULL};
 
+  httpd_uri_t multicast_uri = {
+      .uri = "/multicast",
+      .method = HTTP_GET,
+      .handler = multicast_handler,
+      .user_ctx = NULL};
+
+  httpd_uri_t overlay_uri = {
+      .uri = "/overlay",
+      .method = HTTP_GET,
+      .handler = overlay_handler,
+      .user_ctx = NULL};
+
+  httpd_uri_t control_uri = {
+      .uri = "/control",
+      .method = HTTP_GET,
+      .handler = control_handler,
+      .user_ctx = NULL};
+
+  httpd_uri_t timelapse_uri = {
+      .uri = "/timelapse",
+      .method = HTTP_GET,
+      .handler = timelapse_handler,
+      .user_ctx = NULL};
+
+  httpd_uri_t record_uri = {
+      .uri = "/record",
+      .method = HTTP_GET,
+      .handler = record_handler,
+      .user_ctx = NULL};
+
+  httpd_uri_t trace_uri = {
+      .uri = "/trace",
+      .method = HTTP_GET,
+      .handler = trace_handler,
+      .user_ctx = NULL};
+
   // Start HTTP server
   Logger::getInstance().info("Webserver start");
   if (httpd_start(&camera_httpd, &config) == ESP_OK)
   {
     httpd_register_uri_handler(camera_httpd, &health_uri);
-    httpd_register_uri_handler(camera_httpd, &index_uri);
+    // Embedded UI, one handler per asset ("/" is index.html)
+    for (size_t i = 0; i < web_asset_count; i++)
+    {
+      httpd_uri_t asset_uri = {
+          .uri = web_assets[i].uri,
+          .method = HTTP_GET,
+          .handler = index_handler,
+          .user_ctx = (void *)&web_assets[i]};
+      httpd_register_uri_handler(camera_httpd, &asset_uri);
+    }
     httpd_register_uri_handler(camera_httpd, &stream_uri);
+    httpd_register_uri_handler(camera_httpd, &snapshot_uri);
     httpd_register_uri_handler(camera_httpd, &shot_uri);
+    httpd_register_uri_handler(camera_httpd, &multicast_uri);
+    httpd_register_uri_handler(camera_httpd, &record_uri);
+    httpd_register_uri_handler(camera_httpd, &overlay_uri);
+    httpd_register_uri_handler(camera_httpd, &control_uri);
+    httpd_register_uri_handler(camera_httpd, &timelapse_uri);
+    httpd_register_uri_handler(camera_httpd, &trace_uri);
+    httpd_register_uri_handler(camera_httpd, &update_uri);
   }
 }
\ No newline at end of file
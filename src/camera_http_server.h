@@ -16,12 +16,40 @@
 #include <libb64/cencode.h>
 #include "telegram_utils.h"
 #include "logger.h"
+#include "camera_setup.h"
+#include "task_supervisor.h"
+#include "multicast_streamer.h"
+#include "sd_recorder.h"
+#include "scene_detector.h"
+#include "power_governor.h"
+#include "snapshot_cache.h"
+#include "ota_update.h"
+#include "overlay_pipeline.h"
+#include "scaled_stream.h"
+#include "camera_control.h"
+#include "timelapse.h"
+#include "scratch_arena.h"
+#include "trace.h"
+
+// Scratch for the request being handled. Every handler runs on the server's
+// one task, so they share it; an ArenaScope in the handler gives back what it
+// took once the response is out.
+#ifndef HTTP_SCRATCH_BYTES
+#define HTTP_SCRATCH_BYTES 4096
+#endif
 
 void startHttpServer();
+ScratchArena &httpScratch();
 
 esp_err_t index_handler(httpd_req_t *req);
 esp_err_t stream_handler(httpd_req_t *req);
+esp_err_t snapshot_handler(httpd_req_t *req);
 esp_err_t capture_handler(httpd_req_t *req);
 esp_err_t health_handler(httpd_req_t *req);
+esp_err_t multicast_handler(httpd_req_t *req);
+esp_err_t record_handler(httpd_req_t *req);
+esp_err_t overlay_handler(httpd_req_t *req);
+esp_err_t timelapse_handler(httpd_req_t *req);
+esp_err_t trace_handler(httpd_req_t *req);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,565 @@
+#include "camera_setup.h"
+#include "task_supervisor.h"
+#include "power_governor.h"
+#include "snapshot_cache.h"
+#include "overlay_pipeline.h"
+#include "camera_control.h"
+#include "esp_timer.h"
+#include "trace.h"
+
+static camera_config_t config;
+static CameraSettings settings;
+static portMUX_TYPE camera_mux = portMUX_INITIALIZER_UNLOCKED;
+static int frames_out = 0;
+static volatile bool restarting = false;
+static volatile bool paused = false;
+// Serializes /control, /quality, the supervisor restart and format switches
+static SemaphoreHandle_t reconfig_lock = NULL;
+
+static portMUX_TYPE check_mux = portMUX_INITIALIZER_UNLOCKED;
+static FrameCheckStats check_stats;
+static uint64_t check_total_us = 0;
+
+CameraSettings defaultCameraSettings()
+{
+  CameraSettings d;
+  d.frame_size = FRAMESIZE_VGA; // 640x480
+  d.quality = 10;               // 0-63, lower is higher quality
+  d.brightness = 0;
+  d.contrast = 0;
+  d.saturation = 0;
+  d.awb = true;
+  d.aec = true;
+  d.aec2 = true;
+  d.ae_level = 0;
+  d.aec_value = 300;
+  d.agc = true;
+  d.agc_gain = 0;
+  d.gainceiling = 0;
+  d.vflip = true; // 180 degree rotation needs hmirror as well
+  d.hmirror = false;
+  d.xclk_hz = 20000000;
+  d.fb_count = psramFound() ? 2 : 1;
+  d.grab_latest = false;
+  return d;
+}
+
+// Keeps settings within what the sensor and the available memory allow
+static void clampSettings(CameraSettings &c)
+{
+  framesize_t max_size = psramFound() ? FRAMESIZE_UXGA : FRAMESIZE_SVGA;
+  c.frame_size = (framesize_t)constrain((int)c.frame_size, (int)FRAMESIZE_QQVGA, (int)max_size);
+  c.quality = constrain(c.quality, 4, 63);
+  c.brightness = constrain(c.brightness, -2, 2);
+  c.contrast = constrain(c.contrast, -2, 2);
+  c.saturation = constrain(c.saturation, -2, 2);
+  c.ae_level = constrain(c.ae_level, -2, 2);
+  c.aec_value = constrain(c.aec_value, 0, 1200);
+  c.agc_gain = constrain(c.agc_gain, 0, 30);
+  c.gainceiling = constrain(c.gainceiling, 0, 6);
+  c.xclk_hz = constrain(c.xclk_hz, 8000000, 20000000);
+  c.fb_count = constrain(c.fb_count, 1, psramFound() ? 3 : 1);
+  c.grab_latest = c.grab_latest && c.fb_count > 1;
+}
+
+// Frame size and buffer count the driver gets for c in the current format
+static framesize_t driverFrameSize(const CameraSettings &c)
+{
+  if (config.pixel_format == PIXFORMAT_JPEG)
+  {
+    return c.frame_size;
+  }
+  return min(c.frame_size, CAMERA_RGB565_MAX_FRAMESIZE);
+}
+
+static uint8_t driverFbCount(const CameraSettings &c)
+{
+  if (config.pixel_format == PIXFORMAT_JPEG)
+  {
+    return c.fb_count;
+  }
+  return min(c.fb_count, (uint8_t)CAMERA_RGB565_MAX_FB_COUNT);
+}
+
+// Fields only esp_camera_init() can change
+static void applyDriverSettings()
+{
+  config.xclk_freq_hz = settings.xclk_hz;
+  config.frame_size = driverFrameSize(settings);
+  config.jpeg_quality = settings.quality;
+  config.fb_count = driverFbCount(settings);
+  config.fb_location = psramFound() ? CAMERA_FB_IN_PSRAM : CAMERA_FB_IN_DRAM;
+  config.grab_mode = settings.grab_latest && config.fb_count > 1 ? CAMERA_GRAB_LATEST : CAMERA_GRAB_WHEN_EMPTY;
+}
+
+static void buildConfig()
+{
+  config.ledc_channel = LEDC_CHANNEL_0;
+  config.ledc_timer = LEDC_TIMER_0;
+  config.pin_d0 = Y2_GPIO_NUM;
+  config.pin_d1 = Y3_GPIO_NUM;
+  config.pin_d2 = Y4_GPIO_NUM;
+  config.pin_d3 = Y5_GPIO_NUM;
+  config.pin_d4 = Y6_GPIO_NUM;
+  config.pin_d5 = Y7_GPIO_NUM;
+  config.pin_d6 = Y8_GPIO_NUM;
+  config.pin_d7 = Y9_GPIO_NUM;
+  config.pin_xclk = XCLK_GPIO_NUM;
+  config.pin_pclk = PCLK_GPIO_NUM;
+  config.pin_vsync = VSYNC_GPIO_NUM;
+  config.pin_href = HREF_GPIO_NUM;
+  config.pin_sscb_sda = SIOD_GPIO_NUM;
+  config.pin_sscb_scl = SIOC_GPIO_NUM;
+  config.pin_pwdn = PWDN_GPIO_NUM;
+  config.pin_reset = RESET_GPIO_NUM;
+  config.pixel_format = PIXFORMAT_JPEG;
+  applyDriverSettings();
+}
+
+static void applySensorSettings()
+{
+  // Add camera sensor settings adjustment
+  sensor_t *s = esp_camera_sensor_get();
+  if (s)
+  {
+    // Set camera parameters
+    s->set_framesize(s, driverFrameSize(settings));
+    s->set_quality(s, settings.quality);
+    s->set_brightness(s, settings.brightness);
+    s->set_contrast(s, settings.contrast);
+    s->set_saturation(s, settings.saturation);
+    s->set_special_effect(s, 0);             // 0 = no effect
+    s->set_whitebal(s, settings.awb);
+    s->set_awb_gain(s, settings.awb);
+    s->set_wb_mode(s, 0);                    // 0 = auto mode
+    s->set_exposure_ctrl(s, settings.aec);
+    s->set_aec2(s, settings.aec2);
+    s->set_ae_level(s, settings.ae_level);
+    s->set_aec_value(s, settings.aec_value); // used while auto exposure is off
+    s->set_gain_ctrl(s, settings.agc);
+    s->set_agc_gain(s, settings.agc_gain);   // used while auto gain is off
+    s->set_gainceiling(s, (gainceiling_t)settings.gainceiling);
+    s->set_bpc(s, 1);                        // 1 = enable black pixel correction
+    s->set_wpc(s, 1);                        // 1 = enable white pixel correction
+    s->set_raw_gma(s, 1);                    // 1 = enable gamma correction
+    s->set_lenc(s, 1);                       // 1 = enable lens correction
+    s->set_hmirror(s, settings.hmirror);
+    s->set_dcw(s, 1);                        // 1 = enable downsize
+    s->set_colorbar(s, 0);                   // 0 = disable color bar test
+    s->set_vflip(s, settings.vflip);
+
+    Logger::getInstance().info("Camera sensor settings adjusted");
+  }
+}
+
+static void recoverCapture()
+{
+  restartCamera();
+}
+
+bool initCamera()
+{
+  // Settings chosen through /control survive reboots
+  settings = defaultCameraSettings();
+  bool loaded = loadCameraSettings(settings);
+  if (loaded)
+  {
+    Logger::getInstance().info(String("Camera settings loaded, profile ") + getCameraProfileName());
+  }
+  clampSettings(settings);
+  buildConfig();
+  reconfig_lock = xSemaphoreCreateMutex();
+  supervisorRegister(COMPONENT_CAPTURE, 5000, recoverCapture);
+
+  // Camera initialization
+  esp_err_t err = esp_camera_init(&config);
+  if (err != ESP_OK && loaded)
+  {
+    // A saved setting the driver cannot satisfy would otherwise fail every boot
+    Logger::getInstance().errorf("Camera initialization with the saved settings failed: 0x%x, trying defaults",
+                                 (unsigned)err);
+    settings = defaultCameraSettings();
+    clampSettings(settings);
+    applyDriverSettings();
+    err = esp_camera_init(&config);
+    if (err == ESP_OK)
+    {
+      clearCameraSettings();
+      Logger::getInstance().warning("Saved camera settings dropped, running with defaults");
+    }
+  }
+  if (err != ESP_OK)
+  {
+    Logger::getInstance().error("Issue with camera initialization: 0x" + String(err, HEX));
+    return false;
+  }
+
+  Logger::getInstance().info("Camera initialized successfully");
+  applySensorSettings();
+  return true;
+}
+
+// Caller has set restarting or paused; waits until every frame buffer is back
+static bool waitForFrames(const char *what)
+{
+  uint32_t start = millis();
+  while (true)
+  {
+    portENTER_CRITICAL(&camera_mux);
+    int out = frames_out;
+    portEXIT_CRITICAL(&camera_mux);
+    if (out == 0)
+    {
+      return true;
+    }
+    if (millis() - start > 5000)
+    {
+      Logger::getInstance().errorf("%s aborted, %d frames still in use", what, out);
+      return false;
+    }
+    delay(10);
+  }
+}
+
+// Takes the reconfiguration lock, stops new captures and waits for the ones
+// in flight, so the driver and the sensor registers can be changed as one
+// step. Every successful hold ends with releaseCaptures().
+static bool holdCaptures(const char *what)
+{
+  if (reconfig_lock == NULL || xSemaphoreTake(reconfig_lock, pdMS_TO_TICKS(10000)) != pdTRUE)
+  {
+    Logger::getInstance().errorf("%s aborted, another reconfiguration is still running", what);
+    return false;
+  }
+
+  portENTER_CRITICAL(&camera_mux);
+  restarting = true;
+  portEXIT_CRITICAL(&camera_mux);
+
+  if (!waitForFrames(what))
+  {
+    portENTER_CRITICAL(&camera_mux);
+    restarting = false;
+    portEXIT_CRITICAL(&camera_mux);
+    xSemaphoreGive(reconfig_lock);
+    return false;
+  }
+  return true;
+}
+
+static void releaseCaptures()
+{
+  portENTER_CRITICAL(&camera_mux);
+  restarting = false;
+  portEXIT_CRITICAL(&camera_mux);
+  xSemaphoreGive(reconfig_lock);
+}
+
+static esp_err_t reinitDriver()
+{
+  esp_camera_deinit();
+  applyDriverSettings();
+  esp_err_t err = esp_camera_init(&config);
+  if (err == ESP_OK)
+  {
+    applySensorSettings();
+  }
+  return err;
+}
+
+bool restartCamera()
+{
+  // The driver frees its frame buffers on deinit, wait for them to come back
+  if (!holdCaptures("Camera restart"))
+  {
+    return false;
+  }
+
+  esp_err_t err = reinitDriver();
+  releaseCaptures();
+
+  if (err != ESP_OK)
+  {
+    Logger::getInstance().error("Camera reinitialization failed: 0x" + String(err, HEX));
+    return false;
+  }
+  Logger::getInstance().info("Camera restarted");
+  return true;
+}
+
+CameraSettings getCameraSettings()
+{
+  return settings;
+}
+
+bool applyCameraSettings(const CameraSettings &requested, CameraReconfig *result)
+{
+  CameraSettings next = requested;
+  clampSettings(next);
+
+  if (result)
+  {
+    result->reinit = false;
+    result->elapsed_us = 0;
+    result->restored = true;
+  }
+
+  int64_t start = esp_timer_get_time();
+  // Register writes to a powered-down sensor would be lost
+  powerEnsureSensorAwake();
+  if (!holdCaptures("Camera reconfiguration"))
+  {
+    return false;
+  }
+
+  // Buffers are sized for the frame size at init, so growing it needs a
+  // reinit. Compared under the hold, as another caller may have just finished.
+  bool reinit = next.xclk_hz != settings.xclk_hz || driverFbCount(next) != config.fb_count ||
+                next.grab_latest != settings.grab_latest || driverFrameSize(next) > config.frame_size;
+  bool resized = driverFrameSize(next) != driverFrameSize(settings);
+  if (result)
+  {
+    result->reinit = reinit;
+  }
+
+  CameraSettings previous = settings;
+  settings = next;
+  esp_err_t err = ESP_OK;
+  if (reinit)
+  {
+    err = reinitDriver();
+    if (err != ESP_OK)
+    {
+      settings = previous;
+      esp_err_t back = reinitDriver();
+      if (back != ESP_OK)
+      {
+        // The capture supervisor keeps retrying the restart from here
+        Logger::getInstance().errorf("Camera could not be restored after a failed reconfiguration: 0x%x",
+                                     (unsigned)back);
+        if (result)
+        {
+          result->restored = false;
+        }
+      }
+    }
+  }
+  else
+  {
+    applySensorSettings();
+    // Frames already queued were captured at the old size
+    for (int i = 0; resized && i < config.fb_count; i++)
+    {
+      camera_fb_t *fb = esp_camera_fb_get();
+      if (fb)
+      {
+        esp_camera_fb_return(fb);
+      }
+    }
+  }
+  releaseCaptures();
+
+  uint32_t elapsed_us = esp_timer_get_time() - start;
+  if (result)
+  {
+    result->elapsed_us = elapsed_us;
+  }
+  if (err != ESP_OK)
+  {
+    Logger::getInstance().errorf("Camera reconfiguration failed: 0x%x, previous settings kept", (unsigned)err);
+    return false;
+  }
+  Logger::getInstance().infof("Camera reconfigured in %lu ms%s", (unsigned long)(elapsed_us / 1000),
+                              reinit ? " (driver reinitialized)" : "");
+  return true;
+}
+
+bool cameraPause()
+{
+  portENTER_CRITICAL(&camera_mux);
+  paused = true;
+  portEXIT_CRITICAL(&camera_mux);
+  if (!waitForFrames("Camera pause"))
+  {
+    paused = false;
+    return false;
+  }
+  Logger::getInstance().info("Camera paused");
+  return true;
+}
+
+void cameraResume()
+{
+  paused = false;
+  Logger::getInstance().info("Camera resumed");
+}
+
+bool setCameraPixelFormat(pixformat_t format)
+{
+  if (config.pixel_format == format)
+  {
+    return true;
+  }
+  if (!holdCaptures("Pixel format change"))
+  {
+    return false;
+  }
+  if (config.pixel_format == format)
+  {
+    // Switched by another caller while this one waited
+    releaseCaptures();
+    return true;
+  }
+
+  pixformat_t previous = config.pixel_format;
+  config.pixel_format = format;
+  esp_err_t err = reinitDriver();
+  if (err != ESP_OK)
+  {
+    // Leave the driver running as it was rather than deinitialized
+    config.pixel_format = previous;
+    esp_err_t back = reinitDriver();
+    if (back != ESP_OK)
+    {
+      Logger::getInstance().errorf("Camera could not be restored after a failed format change: 0x%x",
+                                   (unsigned)back);
+    }
+  }
+  releaseCaptures();
+
+  if (err != ESP_OK)
+  {
+    Logger::getInstance().errorf("Camera format change failed: 0x%x, previous format kept", (unsigned)err);
+    return false;
+  }
+  Logger::getInstance().infof("Camera restarted in %s, frame size %d, %u buffers",
+                              format == PIXFORMAT_JPEG ? "JPEG" : "RGB565", (int)config.frame_size,
+                              (unsigned)config.fb_count);
+  return true;
+}
+
+static camera_fb_t *tracedFbGet()
+{
+  TRACE_BEGIN(TRACE_FB_GET, 0);
+  camera_fb_t *fb = esp_camera_fb_get();
+  TRACE_END(TRACE_FB_GET, fb ? traceFrameId(fb->timestamp) : 0);
+  return fb;
+}
+
+camera_fb_t *sensorCapture()
+{
+  // Reserve the frame before fb_get so a restart also waits for captures in progress
+  while (true)
+  {
+    portENTER_CRITICAL(&camera_mux);
+    bool ok = !restarting && !paused;
+    if (ok)
+    {
+      frames_out++;
+    }
+    portEXIT_CRITICAL(&camera_mux);
+    if (ok)
+    {
+      break;
+    }
+    delay(10);
+  }
+
+  powerEnsureSensorAwake();
+
+  // Capture counts as stalled while fb_get keeps failing
+  supervisorBusy(COMPONENT_CAPTURE);
+  camera_fb_t *fb = tracedFbGet();
+  // After a standby the driver still holds frames from before the power-down
+  for (int i = 0; fb && !powerFrameIsFresh(fb) && i <= config.fb_count; i++)
+  {
+    esp_camera_fb_return(fb);
+    fb = tracedFbGet();
+  }
+  if (fb)
+  {
+    supervisorBeat(COMPONENT_CAPTURE);
+  }
+  supervisorIdle(COMPONENT_CAPTURE);
+
+  if (!fb)
+  {
+    portENTER_CRITICAL(&camera_mux);
+    frames_out--;
+    portEXIT_CRITICAL(&camera_mux);
+  }
+  return fb;
+}
+
+void sensorRelease(camera_fb_t *fb)
+{
+  esp_camera_fb_return(fb);
+  portENTER_CRITICAL(&camera_mux);
+  frames_out--;
+  portEXIT_CRITICAL(&camera_mux);
+}
+
+// Truncated frames show up under PSRAM pressure; they break viewers and
+// waste the upload, so they never leave this file
+static bool frameIsIntact(camera_fb_t *fb)
+{
+  if (fb->format != PIXFORMAT_JPEG)
+  {
+    return true;
+  }
+  int64_t start = esp_timer_get_time();
+  JpegInfo info;
+  JpegStatus status = jpegScan(fb->buf, fb->len, &info);
+  uint32_t elapsed_us = (uint32_t)(esp_timer_get_time() - start);
+
+  size_t padding = status == JPEG_OK ? fb->len - info.end : 0;
+  fb->len -= padding;
+
+  portENTER_CRITICAL(&check_mux);
+  check_stats.checked++;
+  check_stats.rejected[status] += status != JPEG_OK;
+  check_stats.trimmed_bytes += padding;
+  check_stats.last_us = elapsed_us;
+  check_stats.max_us = max(check_stats.max_us, elapsed_us);
+  check_total_us += elapsed_us;
+  portEXIT_CRITICAL(&check_mux);
+  return status == JPEG_OK;
+}
+
+FrameCheckStats getFrameCheckStats()
+{
+  portENTER_CRITICAL(&check_mux);
+  FrameCheckStats s = check_stats;
+  s.avg_us = s.checked ? check_total_us / s.checked : 0;
+  portEXIT_CRITICAL(&check_mux);
+  return s;
+}
+
+camera_fb_t *cameraCapture()
+{
+  // With the overlay on, consumers get its re-encoded frames; otherwise the
+  // sensor's JPEG is handed out directly
+  camera_fb_t *fb = NULL;
+  if (!overlayCapture(&fb))
+  {
+    fb = sensorCapture();
+    for (int retry = 0; fb && !frameIsIntact(fb); retry++)
+    {
+      sensorRelease(fb);
+      fb = retry < CAMERA_BAD_FRAME_RETRIES ? sensorCapture() : NULL;
+    }
+  }
+  if (fb)
+  {
+    snapshotStore(fb);
+  }
+  return fb;
+}
+
+void cameraRelease(camera_fb_t *fb)
+{
+  if (!overlayRelease(fb))
+  {
+    sensorRelease(fb);
+  }
+}
@@ -0,0 +1,127 @@
+#ifndef CAMERA_SETUP_H
+#define CAMERA_SETUP_H
+
+#include <Arduino.h>
+#include "esp_camera.h"
+#include "logger.h"
+#include "jpeg_scan.h"
+
+// Further captures tried when the driver hands out a corrupt JPEG
+#ifndef CAMERA_BAD_FRAME_RETRIES
+#define CAMERA_BAD_FRAME_RETRIES 2
+#endif
+
+// RGB565 takes two bytes per pixel: limits while the overlay pipeline has the
+// sensor in that format, so the frame buffers still fit in PSRAM
+#ifndef CAMERA_RGB565_MAX_FRAMESIZE
+#define CAMERA_RGB565_MAX_FRAMESIZE FRAMESIZE_SVGA
+#endif
+#ifndef CAMERA_RGB565_MAX_FB_COUNT
+#define CAMERA_RGB565_MAX_FB_COUNT 2
+#endif
+
+// Camera settings for ESP32-CAM AI-THINKER
+#define PWDN_GPIO_NUM 32
+#define RESET_GPIO_NUM -1
+#define XCLK_GPIO_NUM 0
+#define SIOD_GPIO_NUM 26
+#define SIOC_GPIO_NUM 27
+#define Y9_GPIO_NUM 35
+#define Y8_GPIO_NUM 34
+#define Y7_GPIO_NUM 39
+#define Y6_GPIO_NUM 36
+#define Y5_GPIO_NUM 21
+#define Y4_GPIO_NUM 19
+#define Y3_GPIO_NUM 18
+#define Y2_GPIO_NUM 5
+#define VSYNC_GPIO_NUM 25
+#define HREF_GPIO_NUM 23
+#define PCLK_GPIO_NUM 22
+
+// Sensor and driver settings that can be changed at runtime through /control
+struct CameraSettings
+{
+  framesize_t frame_size;
+  uint8_t quality; // JPEG, 4-63, lower is higher quality
+  int8_t brightness; // -2 to 2
+  int8_t contrast;
+  int8_t saturation;
+  bool awb;
+  bool aec;
+  bool aec2;
+  int8_t ae_level;    // -2 to 2
+  uint16_t aec_value; // manual exposure, 0 to 1200
+  bool agc;
+  uint8_t agc_gain;    // manual gain, 0 to 30
+  uint8_t gainceiling; // 0 to 6
+  bool vflip;
+  bool hmirror;
+  // Changing these reinitializes the driver
+  uint32_t xclk_hz;
+  uint8_t fb_count;
+  bool grab_latest; // hand out the newest buffer instead of the oldest
+};
+
+struct CameraReconfig
+{
+  bool reinit;
+  uint32_t elapsed_us;
+  bool restored; // after a failure: false if the driver did not come back up
+};
+
+CameraSettings defaultCameraSettings();
+CameraSettings getCameraSettings();
+
+// Applies every setting as one step: captures are held while the sensor is
+// reprogrammed, and the driver is reinitialized only for XCLK, buffer count,
+// grab mode or a frame size larger than the buffers were allocated for. On
+// failure the previous settings are restored.
+bool applyCameraSettings(const CameraSettings &settings, CameraReconfig *result);
+
+// Initializes the camera driver and applies the sensor settings. If the
+// driver rejects the settings saved in NVS, it is tried once more with the
+// defaults, and the saved record is dropped when that works.
+bool initCamera();
+
+// Deinitializes and reinitializes the driver once every outstanding frame
+// buffer has been returned. Captures issued meanwhile wait for the restart.
+bool restartCamera();
+
+// Holds every capture until cameraResume(), e.g. while an OTA update owns the
+// flash. Returns once all frames in flight are back, false on timeout.
+bool cameraPause();
+void cameraResume();
+
+// Switches the sensor output format (restarting the driver), e.g. to RGB565
+// for the overlay pipeline. Frame size and buffer count are held within the
+// CAMERA_RGB565_* limits while a raw format is active; the settings keep the
+// requested values and apply in full again with JPEG. If the driver does not
+// come up in the new format it is brought back in the previous one.
+bool setCameraPixelFormat(pixformat_t format);
+
+// esp_camera_fb_get / esp_camera_fb_return wrappers used by every consumer,
+// so restarts can wait for frames in flight and capture stalls are supervised.
+// While the overlay pipeline runs these return its JPEG frames instead. NULL
+// also when CAMERA_BAD_FRAME_RETRIES further captures were corrupt as well.
+camera_fb_t *cameraCapture();
+void cameraRelease(camera_fb_t *fb);
+
+// Every JPEG from the sensor is checked with jpegScan() before a consumer
+// sees it; corrupt or truncated ones are dropped and counted here
+struct FrameCheckStats
+{
+  uint32_t checked;
+  uint32_t rejected[JPEG_STATUS_COUNT]; // by reason; [JPEG_OK] stays 0
+  uint32_t last_us;
+  uint32_t max_us;
+  uint32_t avg_us;
+  uint32_t trimmed_bytes; // padding after EOI cut off
+};
+
+FrameCheckStats getFrameCheckStats();
+
+// Raw sensor frames, for the overlay pipeline only
+camera_fb_t *sensorCapture();
+void sensorRelease(camera_fb_t *fb);
+
+#endif // CAMERA_SETUP_H
@@ -1,11 +1,18 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+// Name the camera logs under and stamps onto overlay frames
+#ifndef DEVICE_NAME
+#define DEVICE_NAME "ESP32-CAM-01"
+#endif
+
 // Only declare the variables, don't initialize them
 extern const char *ssid;
 extern const char *password;
 extern const char *tg_bot_token;
 extern const char *tg_chat_id;
 extern const char *logger_url;
+// Shared secret for signing OTA images; updates are refused while it is empty
+extern const char *ota_secret;
 
 #endif // CONFIG_H
\ No newline at end of file
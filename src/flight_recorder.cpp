@@ -0,0 +1,111 @@
+#include "flight_recorder.h"
+#include <string.h>
+
+// Marks a ring that has been initialised since the last power-on
+#define FLIGHT_RING_MAGIC 0x464C5452u // "FLTR"
+
+#define SLOT_CRC_BYTES offsetof(FlightRing::Slot, crc)
+
+FlightRecorder::FlightRecorder(FlightRing *ring) : ring(ring), next_seq(1), torn(0)
+{
+}
+
+uint32_t FlightRecorder::crc32(const void *data, size_t len)
+{
+    // CRC-32 (IEEE), four bits at a time to keep the table at 64 bytes
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= p[i];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+        crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+void FlightRecorder::clear()
+{
+    memset(ring->slots, 0, sizeof(ring->slots));
+    ring->magic = FLIGHT_RING_MAGIC;
+    next_seq = 1;
+}
+
+size_t FlightRecorder::recover(Event *out, size_t max_out)
+{
+    torn = 0;
+    size_t valid = 0;
+    uint8_t order[FLIGHT_RECORDER_SLOTS];
+
+    // After power-on the ring is garbage; nothing to recover
+    if (ring->magic == FLIGHT_RING_MAGIC)
+    {
+        for (size_t i = 0; i < FLIGHT_RECORDER_SLOTS; i++)
+        {
+            const FlightRing::Slot &s = ring->slots[i];
+            if (s.seq == 0 && s.crc == 0)
+            {
+                continue; // never written
+            }
+            if (s.seq == 0 || s.len >= FLIGHT_RECORDER_TEXT_LEN || crc32(&s, SLOT_CRC_BYTES) != s.crc)
+            {
+                torn++;
+                continue;
+            }
+
+            // Insertion sort by sequence number
+            size_t j = valid++;
+            while (j > 0 && ring->slots[order[j - 1]].seq > s.seq)
+            {
+                order[j] = order[j - 1];
+                j--;
+            }
+            order[j] = (uint8_t)i;
+        }
+    }
+
+    // Keep the newest events when out is smaller than the ring
+    size_t skip = valid > max_out ? valid - max_out : 0;
+    size_t n = 0;
+    for (size_t k = skip; k < valid; k++)
+    {
+        const FlightRing::Slot &s = ring->slots[order[k]];
+        Event &e = out[n++];
+        e.seq = s.seq;
+        e.uptime_ms = s.uptime_ms;
+        e.level = s.level;
+        memcpy(e.text, s.text, s.len);
+        e.text[s.len] = '\0';
+    }
+
+    clear();
+    return n;
+}
+
+void FlightRecorder::record(uint8_t level, uint32_t uptime_ms, const char *message)
+{
+    uint32_t seq = __atomic_fetch_add(&next_seq, 1, __ATOMIC_RELAXED);
+
+    // Built off to the side with zeroed padding so the CRC is reproducible
+    FlightRing::Slot rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.seq = seq;
+    rec.uptime_ms = uptime_ms;
+    rec.level = level;
+    size_t len = strnlen(message, FLIGHT_RECORDER_TEXT_LEN - 1);
+    memcpy(rec.text, message, len);
+    rec.len = (uint8_t)len;
+    rec.crc = crc32(&rec, SLOT_CRC_BYTES);
+
+    // Invalidate, fill, then commit; the fences keep the compiler from
+    // reordering the stores around the CRC
+    FlightRing::Slot &slot = ring->slots[seq % FLIGHT_RECORDER_SLOTS];
+    slot.crc = 0;
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    memcpy(&slot, &rec, SLOT_CRC_BYTES);
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+    slot.crc = rec.crc;
+}
@@ -0,0 +1,74 @@
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Most recent log events kept across a reset
+#ifndef FLIGHT_RECORDER_SLOTS
+#define FLIGHT_RECORDER_SLOTS 32
+#endif
+
+// Message text kept per event (including terminator)
+#ifndef FLIGHT_RECORDER_TEXT_LEN
+#define FLIGHT_RECORDER_TEXT_LEN 96
+#endif
+
+// Raw ring layout. On the device it lives in RTC slow memory
+// (RTC_NOINIT_ATTR), which survives panics, watchdog and brownout resets but
+// not power loss, so after power-on it holds garbage until recover() clears it.
+struct FlightRing
+{
+    struct Slot
+    {
+        uint32_t seq;
+        uint32_t uptime_ms;
+        uint8_t level;
+        uint8_t len;
+        uint16_t reserved;
+        char text[FLIGHT_RECORDER_TEXT_LEN];
+        uint32_t crc; // over everything above; written last
+    };
+
+    uint32_t magic;
+    Slot slots[FLIGHT_RECORDER_SLOTS];
+};
+
+// Fixed-size binary log ring that outlives a reset. record() zeroes the
+// slot's CRC, copies the event and only then stores the CRC, so a reset in
+// the middle of a write leaves a slot that fails its check and is dropped
+// on recovery; every other slot is untouched.
+class FlightRecorder
+{
+public:
+    struct Event
+    {
+        uint32_t seq;
+        uint32_t uptime_ms;
+        uint8_t level;
+        char text[FLIGHT_RECORDER_TEXT_LEN];
+    };
+
+    explicit FlightRecorder(FlightRing *ring);
+
+    // Copies the events left by the previous boot into out, oldest first,
+    // then clears the ring for this boot. Call once, before record().
+    size_t recover(Event *out, size_t max_out);
+
+    // Safe to call from several tasks; long messages are truncated
+    void record(uint8_t level, uint32_t uptime_ms, const char *message);
+
+    // Slots rejected by the last recover() because a write was cut short
+    uint32_t tornSlots() const { return torn; }
+
+    static uint32_t crc32(const void *data, size_t len);
+
+private:
+    void clear();
+
+    FlightRing *ring;
+    uint32_t next_seq;
+    uint32_t torn;
+};
+
+#endif // FLIGHT_RECORDER_H
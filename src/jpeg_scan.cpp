@@ -0,0 +1,169 @@
+#include "jpeg_scan.h"
+#include <string.h>
+
+typedef uintptr_t ScanWord;
+
+static inline uint16_t be16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static inline bool isSof(uint8_t marker)
+{
+    // C0-CF are frame headers, except DHT (C4), JPG (C8) and DAC (CC)
+    return marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+}
+
+static inline bool isBetweenScans(uint8_t marker)
+{
+    // Tables, comments and further scans of a progressive image: DHT, DNL,
+    // DQT, DRI, SOS, APPn, COM
+    return marker == 0xC4 || (marker >= 0xDA && marker <= 0xDD) || (marker >= 0xE0 && marker <= 0xEF) ||
+           marker == 0xFE;
+}
+
+static inline bool isStandalone(uint8_t marker)
+{
+    // Markers without a length field: TEM, RSTn, SOI, EOI
+    return marker == 0x01 || (marker >= 0xD0 && marker <= 0xD9);
+}
+
+JpegStatus jpegScan(const uint8_t *data, size_t len, JpegInfo *info)
+{
+    JpegInfo scratch;
+    if (!info)
+    {
+        info = &scratch;
+    }
+    memset(info, 0, sizeof(*info));
+
+    if (len < 4 || data[0] != 0xFF || data[1] != 0xD8)
+    {
+        return JPEG_NO_SOI;
+    }
+
+    // Header segments: jump from marker to marker by their lengths
+    size_t pos = 2;
+    bool have_sof = false;
+    while (true)
+    {
+        if (pos + 4 > len)
+        {
+            return JPEG_TRUNCATED;
+        }
+        if (data[pos] != 0xFF)
+        {
+            return JPEG_BAD_HEADER;
+        }
+        uint8_t marker = data[pos + 1];
+        if (marker == 0xFF)
+        {
+            // Fill byte before a marker
+            pos++;
+            continue;
+        }
+        if (marker == 0x00 || isStandalone(marker))
+        {
+            return JPEG_BAD_HEADER;
+        }
+        size_t segment = be16(data + pos + 2);
+        if (segment < 2)
+        {
+            return JPEG_BAD_HEADER;
+        }
+        if (pos + 2 + segment > len)
+        {
+            return JPEG_TRUNCATED;
+        }
+        if (isSof(marker))
+        {
+            if (segment < 8)
+            {
+                return JPEG_BAD_HEADER;
+            }
+            info->height = be16(data + pos + 5);
+            info->width = be16(data + pos + 7);
+            info->components = data[pos + 9];
+            have_sof = info->width && info->height;
+        }
+        pos += 2 + segment;
+        if (marker == 0xDA)
+        {
+            break;
+        }
+    }
+    if (!have_sof)
+    {
+        return JPEG_NO_SOF;
+    }
+
+    // Entropy-coded data: 0xFF only appears as FF00 (stuffing), RSTn or EOI.
+    // ~word has a zero byte exactly where word has 0xFF.
+    const ScanWord ones = (ScanWord)-1 / 0xFF;
+    const ScanWord highs = ones << 7;
+    while (true)
+    {
+        while (pos + sizeof(ScanWord) <= len)
+        {
+            ScanWord w;
+            memcpy(&w, data + pos, sizeof(w));
+            w = ~w;
+            if ((w - ones) & ~w & highs)
+            {
+                break;
+            }
+            pos += sizeof(w);
+        }
+        while (pos < len && data[pos] != 0xFF)
+        {
+            pos++;
+        }
+        if (pos + 1 >= len)
+        {
+            return JPEG_TRUNCATED;
+        }
+
+        uint8_t marker = data[pos + 1];
+        if (marker == 0xD9)
+        {
+            info->end = pos + 2;
+            return JPEG_OK;
+        }
+        if (marker == 0x00 || (marker >= 0xD0 && marker <= 0xD7))
+        {
+            pos += 2;
+        }
+        else if (marker == 0xFF)
+        {
+            pos++;
+        }
+        else if (isBetweenScans(marker))
+        {
+            if (pos + 4 > len)
+            {
+                return JPEG_TRUNCATED;
+            }
+            size_t segment = be16(data + pos + 2);
+            if (pos + 2 + segment > len)
+            {
+                return JPEG_TRUNCATED;
+            }
+            if (segment < 2)
+            {
+                return JPEG_BAD_MARKER;
+            }
+            pos += 2 + segment;
+        }
+        else
+        {
+            return JPEG_BAD_MARKER;
+        }
+    }
+}
+
+const char *jpegStatusName(JpegStatus status)
+{
+    static const char *names[JPEG_STATUS_COUNT] = {"ok", "no SOI", "bad header", "no SOF", "bad marker",
+                                                   "truncated"};
+    return status < JPEG_STATUS_COUNT ? names[status] : "unknown";
+}
@@ -0,0 +1,37 @@
+#ifndef JPEG_SCAN_H
+#define JPEG_SCAN_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum JpegStatus
+{
+    JPEG_OK = 0,
+    JPEG_NO_SOI,     // does not start with FFD8
+    JPEG_BAD_HEADER, // malformed marker segment before the scan
+    JPEG_NO_SOF,     // scan starts without a frame header, or 0x0 dimensions
+    JPEG_BAD_MARKER, // marker that cannot appear inside the entropy-coded data
+    JPEG_TRUNCATED,  // ends before EOI
+    JPEG_STATUS_COUNT
+};
+
+struct JpegInfo
+{
+    uint16_t width;
+    uint16_t height;
+    uint8_t components;
+    size_t end; // offset just past EOI; anything after it is padding
+};
+
+// Checks the structure of a JPEG in one pass: SOI, the header segments
+// (taking the dimensions from SOF), then the entropy-coded data up to EOI,
+// skipping tables and further scans of progressive files by their length.
+// The data is read a machine word at a time and only words containing an
+// 0xFF byte are looked at closely, since every marker starts with one. Does
+// not decode anything, so a frame with valid structure but damaged image
+// data still passes.
+JpegStatus jpegScan(const uint8_t *data, size_t len, JpegInfo *info);
+
+const char *jpegStatusName(JpegStatus status);
+
+#endif // JPEG_SCAN_H
@@ -0,0 +1,164 @@
+#include "log_dedup.h"
+#include <string.h>
+
+LogDeduplicator::LogDeduplicator() : suppressed_total(0)
+{
+    memset(table, 0, sizeof(table));
+}
+
+uint32_t LogDeduplicator::templateHash(uint8_t level, const char *message)
+{
+    // FNV-1a over the level and the message with digit runs folded to '#'
+    uint32_t hash = (2166136261u ^ level) * 16777619u;
+    bool in_digits = false;
+    for (const char *p = message; *p; p++)
+    {
+        bool digit = *p >= '0' && *p <= '9';
+        if (digit && in_digits)
+        {
+            continue;
+        }
+        in_digits = digit;
+        hash = (hash ^ (uint8_t)(digit ? '#' : *p)) * 16777619u;
+    }
+    return hash;
+}
+
+void LogDeduplicator::templateText(const char *message, char *out)
+{
+    size_t n = 0;
+    bool in_digits = false;
+    for (const char *p = message; *p && n < LOG_DEDUP_TEXT_LEN - 1; p++)
+    {
+        bool digit = *p >= '0' && *p <= '9';
+        if (digit && in_digits)
+        {
+            continue;
+        }
+        in_digits = digit;
+        out[n++] = digit ? '#' : *p;
+    }
+    out[n] = '\0';
+}
+
+// Writes the run counted so far to out and starts a new one
+void LogDeduplicator::summarize(Entry &e, Summary &out)
+{
+    out.level = e.level;
+    out.count = e.suppressed;
+    out.duration_ms = e.last_ms - e.first_ms;
+    memcpy(out.text, e.text, sizeof(out.text));
+    e.first_ms = e.last_ms;
+    e.suppressed = 0;
+}
+
+bool LogDeduplicator::admit(uint8_t level, const char *message, uint32_t now_ms, Summary &closed)
+{
+    closed.count = 0;
+    uint32_t hash = templateHash(level, message);
+    size_t home = hash % LOG_DEDUP_SLOTS;
+
+    for (size_t probe = 0; probe < LOG_DEDUP_SLOTS; probe++)
+    {
+        Entry &e = table[(home + probe) % LOG_DEDUP_SLOTS];
+        if (!e.used)
+        {
+            // First occurrence: remember it and let it through
+            e.used = true;
+            e.level = level;
+            e.hash = hash;
+            e.first_ms = now_ms;
+            e.last_ms = now_ms;
+            e.suppressed = 0;
+            templateText(message, e.text);
+            return true;
+        }
+
+        if (e.hash == hash && e.level == level)
+        {
+            if (now_ms - e.last_ms < LOG_DEDUP_WINDOW_MS)
+            {
+                e.last_ms = now_ms;
+                e.suppressed++;
+                suppressed_total++;
+                if (now_ms - e.first_ms >= LOG_DEDUP_MAX_SPAN_MS)
+                {
+                    summarize(e, closed);
+                }
+                return false;
+            }
+
+            // Quiet for a whole window without collect(): hand back the old
+            // run's summary and let this message start a new run
+            if (e.suppressed > 0)
+            {
+                summarize(e, closed);
+            }
+            e.first_ms = now_ms;
+            e.last_ms = now_ms;
+            return true;
+        }
+    }
+
+    // Table full: pass through rather than grow
+    return true;
+}
+
+// Backward-shift deletion keeps linear probing chains intact without tombstones
+void LogDeduplicator::remove(size_t i)
+{
+    table[i].used = false;
+    size_t j = i;
+    while (true)
+    {
+        j = (j + 1) % LOG_DEDUP_SLOTS;
+        if (!table[j].used)
+        {
+            return;
+        }
+
+        size_t k = table[j].hash % LOG_DEDUP_SLOTS;
+        bool stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (stays)
+        {
+            continue;
+        }
+
+        table[i] = table[j];
+        table[j].used = false;
+        i = j;
+    }
+}
+
+size_t LogDeduplicator::collect(uint32_t now_ms, Summary *out, size_t max_out, bool force)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < LOG_DEDUP_SLOTS && n < max_out;)
+    {
+        Entry &e = table[i];
+        if (!e.used)
+        {
+            i++;
+            continue;
+        }
+
+        if (force || now_ms - e.last_ms >= LOG_DEDUP_WINDOW_MS)
+        {
+            if (e.suppressed > 0)
+            {
+                summarize(e, out[n++]);
+            }
+            // An entry may shift into slot i, so look at it again
+            remove(i);
+            continue;
+        }
+
+        // Still repeating: report what has been counted, keep suppressing
+        if (e.suppressed > 0 && now_ms - e.first_ms >= LOG_DEDUP_MAX_SPAN_MS)
+        {
+            summarize(e, out[n++]);
+        }
+        i++;
+    }
+    return n;
+}
@@ -0,0 +1,79 @@
+#ifndef LOG_DEDUP_H
+#define LOG_DEDUP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Number of distinct message templates tracked at once
+#ifndef LOG_DEDUP_SLOTS
+#define LOG_DEDUP_SLOTS 32
+#endif
+
+// A repeat that comes within this long of the previous occurrence of its
+// template is counted instead of emitted; the window slides with every repeat
+#ifndef LOG_DEDUP_WINDOW_MS
+#define LOG_DEDUP_WINDOW_MS 10000
+#endif
+
+// A template that never goes quiet still gets a summary this often
+#ifndef LOG_DEDUP_MAX_SPAN_MS
+#define LOG_DEDUP_MAX_SPAN_MS 60000
+#endif
+
+// Template text kept for the summary line (including terminator)
+#ifndef LOG_DEDUP_TEXT_LEN
+#define LOG_DEDUP_TEXT_LEN 64
+#endif
+
+// Collapses repeated log messages. The key is the level plus the message
+// template, i.e. the text with every run of digits replaced by '#', so
+// "Sent 1024 bytes" and "Sent 2048 bytes" count as the same message.
+// Storage is a fixed open-addressing table; when it is full new templates
+// simply pass through undeduplicated.
+class LogDeduplicator
+{
+public:
+    struct Summary
+    {
+        uint8_t level;
+        uint32_t count;       // occurrences suppressed, 0 if there is no summary
+        uint32_t duration_ms; // from the start of the run to the last repeat
+        char text[LOG_DEDUP_TEXT_LEN];
+    };
+
+    LogDeduplicator();
+
+    // Returns true if the message should be emitted now. When this ends a
+    // run of repeats, its summary is written to closed and has to go out
+    // before the message; otherwise closed.count is 0.
+    bool admit(uint8_t level, const char *message, uint32_t now_ms, Summary &closed);
+
+    // Closes runs quiet for LOG_DEDUP_WINDOW_MS (all runs if force) and
+    // writes a summary for each one that suppressed anything. Runs longer
+    // than LOG_DEDUP_MAX_SPAN_MS are summarized too but stay open.
+    size_t collect(uint32_t now_ms, Summary *out, size_t max_out, bool force = false);
+
+    uint32_t suppressedTotal() const { return suppressed_total; }
+
+private:
+    struct Entry
+    {
+        bool used;
+        uint8_t level;
+        uint32_t hash;
+        uint32_t first_ms; // start of the run being counted
+        uint32_t last_ms;  // latest occurrence
+        uint32_t suppressed;
+        char text[LOG_DEDUP_TEXT_LEN];
+    };
+
+    static uint32_t templateHash(uint8_t level, const char *message);
+    static void templateText(const char *message, char *out);
+    static void summarize(Entry &e, Summary &out);
+    void remove(size_t index);
+
+    Entry table[LOG_DEDUP_SLOTS];
+    uint32_t suppressed_total;
+};
+
+#endif // LOG_DEDUP_H
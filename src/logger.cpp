@@ -1,9 +1,17 @@
 #include "logger.h"
 #include <time.h>
 #include <WiFi.h>
+#include "wifi_link.h"
+#include "trace.h"
+#include "mem_policy.h"
 #include <cstdarg>
+#include "task_supervisor.h"
+#include "esp_system.h"
 
-Logger::Logger(const String &url, const String &device)
+// Survives panics, watchdog and brownout resets; garbage after power-on
+RTC_NOINIT_ATTR static FlightRing flight_ring;
+
+Logger::Logger(const String &url, const String &device) : flight(&flight_ring)
 {
     logstash_url = url;
     device_name = device;
@@ -12,6 +20,16 @@ Logger::Logger(const String &url, const String &device)
     logstash_attempts = 0;
     logstash_successes = 0;
     logstash_failures = 0;
+    ship_block_total_ms = 0;
+    ship_block_max_ms = 0;
+    logship_offline = 0;
+    stats_provider_count = 0;
+    dedup_lock = xSemaphoreCreateMutex();
+    shipping_resume_ms = 0;
+
+    // Take what the previous boot left before anything is logged over it
+    recovered_events = (FlightRecorder::Event *)malloc(FLIGHT_RECORDER_SLOTS * sizeof(FlightRecorder::Event));
+    recovered_count = recovered_events ? flight.recover(recovered_events, FLIGHT_RECORDER_SLOTS) : 0;
 }
 
 Logger &Logger::getInstance()
@@ -30,6 +48,10 @@ void Logger::initialize(const String &url, const String &device, bool enable_deb
         logger.begin(enable_debug);
         logger.initialized = true;
 
+        // A hung POST blocks every task that logs; back off from Logstash instead
+        supervisorRegister(COMPONENT_LOGSHIP, 20000, []()
+                           { Logger::getInstance().suspendShipping(60000); });
+
         // Initial connection test
         logger.testLogstashConnection();
     }
@@ -95,7 +117,7 @@ void Logger::setDeviceName(const String &device)
     }
 }
 
-String Logger::logLevelToString(LogLevel level)
+const char *Logger::logLevelToString(LogLevel level)
 {
     switch (level)
     {
@@ -114,21 +136,23 @@ String Logger::logLevelToString(LogLevel level)
     }
 }
 
-void Logger::sendToSerial(LogLevel level, const String &message)
+void Logger::sendToSerial(LogLevel level, const char *message)
 {
-    String timestamp = getCurrentTimestamp();
-    Serial.println("[" + timestamp + "] [" + logLevelToString(level) + "] " + message);
+    char timestamp[16];
+    getCurrentTimestamp(timestamp, sizeof(timestamp));
+    Serial.printf("[%s] [%s] %s\n", timestamp, logLevelToString(level), message);
 }
 
-bool Logger::sendToLogstash(LogLevel level, const String &message)
+bool Logger::sendToLogstash(LogLevel level, const char *message)
 {
+    TraceScope span(TRACE_LOGSTASH_SEND);
     logstash_attempts++;
 
     if (debug_enabled)
     {
         Serial.println("\n=== LOGSTASH SEND ATTEMPT #" + String(logstash_attempts) + " ===");
-        Serial.println("Level: " + logLevelToString(level));
-        Serial.println("Message: " + message);
+        Serial.printf("Level: %s\n", logLevelToString(level));
+        Serial.printf("Message: %s\n", message);
     }
 
     // Step 1: Check WiFi connection
@@ -199,7 +223,8 @@ bool Logger::sendToLogstash(LogLevel level, const String &message)
         Serial.println("Creating JSON payload...");
     }
 
-    DynamicJsonDocument doc(2048); // Increased size for debugging
+    // Large and short-lived, so built in PSRAM
+    PsramJsonDocument doc(2048);
 
     try
     {
@@ -255,8 +280,8 @@ bool Logger::sendToLogstash(LogLevel level, const String &message)
         return false;
     }
 
-    String jsonString;
-    size_t json_size = serializeJson(doc, jsonString);
+    PooledText payload(measureJson(doc) + 1);
+    size_t json_size = payload.data() ? serializeJson(doc, payload.data(), payload.capacity()) : 0;
 
     if (debug_enabled)
     {
@@ -264,7 +289,7 @@ bool Logger::sendToLogstash(LogLevel level, const String &message)
         Serial.println("  JSON size: " + String(json_size) + " bytes");
         Serial.println("  Memory usage: " + String(doc.memoryUsage()) + " bytes");
         Serial.println("  JSON payload preview (first 200 chars):");
-        Serial.println("  " + jsonString.substring(0, 200) + (jsonString.length() > 200 ? "..." : ""));
+        Serial.printf("  %.200s%s\n", payload.data() ? payload.data() : "", json_size > 200 ? "..." : "");
     }
 
     if (json_size == 0)
@@ -284,11 +309,12 @@ bool Logger::sendToLogstash(LogLevel level, const String &message)
     if (debug_enabled)
     {
         Serial.println("Sending POST request...");
-        Serial.println("  Payload size: " + String(jsonString.length()) + " bytes");
+        Serial.println("  Payload size: " + String(json_size) + " bytes");
     }
 
     unsigned long start_time = millis();
-    int httpResponseCode = http.POST(jsonString);
+    int httpResponseCode = http.POST((uint8_t *)payload.data(), json_size);
+    span.arg = httpResponseCode;
     unsigned long request_time = millis() - start_time;
 
     if (debug_enabled)
@@ -431,19 +457,19 @@ void Logger::testLogstashConnection()
     Serial.println("=== END CONNECTION TEST ===\n");
 }
 
-String Logger::getCurrentTimestamp()
+void Logger::getCurrentTimestamp(char *buffer, size_t size)
 {
     time_t now = time(nullptr);
     if (now < 8 * 3600 * 2)
     {
         // NTP not synced yet, use millis
-        return String(millis() / 1000) + "s";
+        snprintf(buffer, size, "%lus", (unsigned long)(millis() / 1000));
+        return;
     }
 
-    struct tm *timeinfo = localtime(&now);
-    char buffer[32];
-    strftime(buffer, sizeof(buffer), "%H:%M:%S", timeinfo);
-    return String(buffer);
+    struct tm timeinfo;
+    localtime_r(&now, &timeinfo);
+    strftime(buffer, size, "%H:%M:%S", &timeinfo);
 }
 
 String Logger::getISO8601Timestamp()
@@ -469,8 +495,70 @@ String Logger::getISO8601Timestamp()
     return String(buffer);
 }
 
-void Logger::log(LogLevel level, const String &message)
+void Logger::log(LogLevel level, const char *message)
+{
+    // Summaries of windows that just closed go out before the new message
+    emitRepeatSummaries(false);
+
+    LogDeduplicator::Summary closed;
+    xSemaphoreTake(dedup_lock, portMAX_DELAY);
+    bool admitted = dedup.admit(level, message, millis(), closed);
+    xSemaphoreGive(dedup_lock);
+
+    if (closed.count > 0)
+    {
+        emitRepeatSummary(closed);
+    }
+    if (admitted)
+    {
+        emit(level, message);
+    }
+}
+
+void Logger::emitRepeatSummaries(bool force)
+{
+    LogDeduplicator::Summary summaries[4];
+    size_t count;
+    do
+    {
+        xSemaphoreTake(dedup_lock, portMAX_DELAY);
+        count = dedup.collect(millis(), summaries, 4, force);
+        xSemaphoreGive(dedup_lock);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            emitRepeatSummary(summaries[i]);
+        }
+    } while (count > 0);
+}
+
+void Logger::emitRepeatSummary(const LogDeduplicator::Summary &summary)
+{
+    char text[LOG_DEDUP_TEXT_LEN + 48];
+    snprintf(text, sizeof(text), "%s (repeated %u times in %us)", summary.text, (unsigned)summary.count,
+             (unsigned)(summary.duration_ms / 1000));
+    emit((LogLevel)summary.level, text);
+}
+
+void Logger::logf(LogLevel level, const char *fmt, va_list args)
+{
+    // Formatted on the stack; messages longer than the line are cut off
+    FixedString<LOGGER_LINE_MAX> line;
+    line.vappendf(fmt, args);
+    log(level, line.c_str());
+}
+
+void Logger::flushRepeats()
 {
+    emitRepeatSummaries(false);
+}
+
+void Logger::emit(LogLevel level, const char *message, bool record)
+{
+    if (record)
+    {
+        flight.record(level, millis(), message);
+    }
     sendToSerial(level, message);
 
     // Add delay between serial and logstash to avoid conflicts
@@ -479,28 +567,113 @@ void Logger::log(LogLevel level, const String &message)
         delay(10);
     }
 
-    if (!logstash_url.isEmpty())
+    if (!logstash_url.isEmpty() && !wifiLinkUp())
+    {
+        // Kept in the flight recorder and on serial; not worth a timeout per line
+        logship_offline++;
+    }
+    else if (!logstash_url.isEmpty() && (long)(millis() - shipping_resume_ms) >= 0)
     {
+        supervisorBusy(COMPONENT_LOGSHIP);
+        unsigned long start = millis();
         sendToLogstash(level, message);
+        unsigned long blocked = millis() - start;
+        supervisorBeat(COMPONENT_LOGSHIP);
+        supervisorIdle(COMPONENT_LOGSHIP);
+
+        ship_block_total_ms += blocked;
+        if (blocked > ship_block_max_ms)
+        {
+            ship_block_max_ms = blocked;
+        }
+    }
+}
+
+static const char *resetReasonName(esp_reset_reason_t reason)
+{
+    switch (reason)
+    {
+    case ESP_RST_POWERON:
+        return "power-on";
+    case ESP_RST_EXT:
+        return "external pin";
+    case ESP_RST_SW:
+        return "software restart";
+    case ESP_RST_PANIC:
+        return "panic";
+    case ESP_RST_INT_WDT:
+        return "interrupt watchdog";
+    case ESP_RST_TASK_WDT:
+        return "task watchdog";
+    case ESP_RST_WDT:
+        return "watchdog";
+    case ESP_RST_DEEPSLEEP:
+        return "deep sleep wake";
+    case ESP_RST_BROWNOUT:
+        return "brownout";
+    case ESP_RST_SDIO:
+        return "SDIO";
+    default:
+        return "unknown";
     }
 }
 
+// Ships the reset reason and the events recovered from RTC memory; call once
+// the network is up
+void Logger::reportPreviousBoot()
+{
+    esp_reset_reason_t reason = esp_reset_reason();
+    bool crashed = reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT || reason == ESP_RST_TASK_WDT ||
+                   reason == ESP_RST_WDT || reason == ESP_RST_BROWNOUT;
+
+    String summary = "Reset reason: " + String(resetReasonName(reason)) + " (" + String((int)reason) + "), " +
+                     String(recovered_count) + " events recovered from the previous boot";
+    if (flight.tornSlots())
+    {
+        summary += ", " + String(flight.tornSlots()) + " cut short by the reset";
+    }
+    log(crashed ? ERROR : INFO, summary.c_str());
+
+    for (size_t i = 0; i < recovered_count; i++)
+    {
+        const FlightRecorder::Event &e = recovered_events[i];
+        char text[FLIGHT_RECORDER_TEXT_LEN + 64];
+        snprintf(text, sizeof(text), "[previous boot +%lu.%03lus, %s] %s", (unsigned long)(e.uptime_ms / 1000),
+                 (unsigned long)(e.uptime_ms % 1000), resetReasonName(reason), e.text);
+        // Not recorded again: they already belong to the previous boot
+        emit((LogLevel)e.level, text, false);
+    }
+
+    free(recovered_events);
+    recovered_events = NULL;
+    recovered_count = 0;
+}
+
+void Logger::suspendShipping(unsigned long duration_ms)
+{
+    shipping_resume_ms = millis() + duration_ms;
+    Serial.println("WARNING: Logstash shipping suspended for " + String(duration_ms / 1000) + "s");
+}
+
 void Logger::printStatistics()
 {
     Serial.println("\n=== LOGGER STATISTICS ===");
     Serial.println("Total attempts: " + String(logstash_attempts));
     Serial.println("Successes: " + String(logstash_successes));
     Serial.println("Failures: " + String(logstash_failures));
+    Serial.println("Repeats collapsed: " + String(dedup.suppressedTotal()));
     if (logstash_attempts > 0)
     {
         float success_rate = (float)logstash_successes / logstash_attempts * 100;
         Serial.println("Success rate: " + String(success_rate, 1) + "%");
+        Serial.println("Caller blocking: avg " + String(ship_block_total_ms / logstash_attempts) + " ms, max " +
+                       String(ship_block_max_ms) + " ms");
     }
     Serial.println("========================\n");
 }
 
 // ... rest of the methods remain the same (debug, info, warning, error, critical, etc.)
-void Logger::debug(const String &message)
+void Logger::debug(const char *message)
 {
     if (debug_enabled)
     {
@@ -508,36 +681,99 @@ void Logger::debug(const String &message)
     }
 }
 
-void Logger::info(const String &message)
+void Logger::info(const char *message)
 {
     log(INFO, message);
 }
 
-void Logger::warning(const String &message)
+void Logger::warning(const char *message)
 {
     log(WARNING, message);
 }
 
-void Logger::error(const String &message)
+void Logger::error(const char *message)
 {
     log(ERROR, message);
 }
 
-void Logger::critical(const String &message)
+void Logger::critical(const char *message)
 {
     log(CRITICAL, message);
 }
 
+void Logger::debug(const String &message)
+{
+    debug(message.c_str());
+}
+
+void Logger::info(const String &message)
+{
+    info(message.c_str());
+}
+
+void Logger::warning(const String &message)
+{
+    warning(message.c_str());
+}
+
+void Logger::error(const String &message)
+{
+    error(message.c_str());
+}
+
+void Logger::critical(const String &message)
+{
+    critical(message.c_str());
+}
+
+void Logger::debugf(const char *fmt, ...)
+{
+    if (debug_enabled)
+    {
+        va_list args;
+        va_start(args, fmt);
+        logf(DEBUG, fmt, args);
+        va_end(args);
+    }
+}
+
+void Logger::infof(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    logf(INFO, fmt, args);
+    va_end(args);
+}
+
+void Logger::warningf(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    logf(WARNING, fmt, args);
+    va_end(args);
+}
+
+void Logger::errorf(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    logf(ERROR, fmt, args);
+    va_end(args);
+}
+
 // System monitoring method
 void Logger::logSystemStats()
 {
-    DynamicJsonDocument stats(512);
+    PsramJsonDocument stats(3072);
     stats["free_heap"] = ESP.getFreeHeap();
     stats["total_heap"] = ESP.getHeapSize();
     stats["min_free_heap"] = ESP.getMinFreeHeap();
     stats["max_alloc_heap"] = ESP.getMaxAllocHeap();
     stats["uptime_minutes"] = millis() / 60000;
     stats["cpu_freq_mhz"] = ESP.getCpuFreqMHz();
+    stats["logship_block_avg_ms"] = logstash_attempts > 0 ? ship_block_total_ms / logstash_attempts : 0;
+    stats["logship_block_max_ms"] = ship_block_max_ms;
+    stats["logship_offline"] = logship_offline;
 
     if (WiFi.status() == WL_CONNECTED)
     {
@@ -549,10 +785,29 @@ void Logger::logSystemStats()
         stats["wifi_connected"] = false;
     }
 
-    String statsJson;
-    serializeJson(stats, statsJson);
+    for (int i = 0; i < stats_provider_count; i++)
+    {
+        stats_providers[i](stats);
+    }
 
-    info("System stats: " + statsJson);
+    static const char prefix[] = "System stats: ";
+    PooledText text(sizeof(prefix) + measureJson(stats));
+    if (!text.data())
+    {
+        return;
+    }
+    strcpy(text.data(), prefix);
+    serializeJson(stats, text.data() + strlen(prefix), text.capacity() - strlen(prefix));
+
+    info(text.data());
+}
+
+void Logger::addStatsProvider(StatsProvider provider)
+{
+    if (stats_provider_count < LOGGER_MAX_STATS_PROVIDERS)
+    {
+        stats_providers[stats_provider_count++] = provider;
+    }
 }
 
 // Connection test method
@@ -5,6 +5,11 @@
 #include <ArduinoJson.h>
 #include <WiFi.h>
 #include <cstdarg>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "log_dedup.h"
+#include "flight_recorder.h"
+#include "scratch_arena.h"
 
 enum LogLevel
 {
@@ -15,6 +20,16 @@ enum LogLevel
     CRITICAL = 4
 };
 
+// Adds module-specific fields to the periodic system stats
+typedef void (*StatsProvider)(JsonDocument &stats);
+
+#define LOGGER_MAX_STATS_PROVIDERS 12
+
+// Longest message the printf-style methods format, including terminator
+#ifndef LOGGER_LINE_MAX
+#define LOGGER_LINE_MAX 256
+#endif
+
 class Logger
 {
 private:
@@ -28,6 +43,29 @@ private:
     int logstash_successes;
     int logstash_failures;
 
+    // Time callers spent blocked in sendToLogstash
+    unsigned long ship_block_total_ms;
+    unsigned long ship_block_max_ms;
+
+    // Lines not shipped because the Wi-Fi link was down
+    unsigned long logship_offline;
+
+    StatsProvider stats_providers[LOGGER_MAX_STATS_PROVIDERS];
+    int stats_provider_count;
+
+    // Logstash shipping is skipped until this time after a stall
+    unsigned long shipping_resume_ms;
+
+    // Collapses repeated messages into counted summaries
+    LogDeduplicator dedup;
+    SemaphoreHandle_t dedup_lock;
+
+    // Last events kept in RTC memory across resets, and what the previous
+    // boot left there until it has been shipped
+    FlightRecorder flight;
+    FlightRecorder::Event *recovered_events;
+    size_t recovered_count;
+
     // Private constructor for singleton
     Logger(const String &url = "", const String &device = "ESP32-CAM");
 
@@ -36,15 +74,19 @@ private:
     Logger &operator=(const Logger &) = delete;
 
     // Private helper methods
-    String logLevelToString(LogLevel level);
-    void sendToSerial(LogLevel level, const String &message);
-    bool sendToLogstash(LogLevel level, const String &message);
-    String getCurrentTimestamp();
+    const char *logLevelToString(LogLevel level);
+    void sendToSerial(LogLevel level, const char *message);
+    bool sendToLogstash(LogLevel level, const char *message);
+    void getCurrentTimestamp(char *buffer, size_t size);
     String getISO8601Timestamp();
     void begin(bool enable_debug = true);
     void setLogstashUrl(const String &url);
     void setDeviceName(const String &device);
-    void log(LogLevel level, const String &message);
+    void log(LogLevel level, const char *message);
+    void logf(LogLevel level, const char *fmt, va_list args);
+    void emit(LogLevel level, const char *message, bool record = true);
+    void emitRepeatSummaries(bool force);
+    void emitRepeatSummary(const LogDeduplicator::Summary &summary);
 
 public:
     // Singleton instance getter
@@ -55,17 +97,31 @@ public:
                            const String &device = "ESP32-CAM",
                            bool enable_debug = true);
 
-    // Public logging methods
+    // Public logging methods. Literals go through the const char * overloads
+    // and the *f variants format on the stack, so neither touches the heap.
+    void debug(const char *message);
+    void info(const char *message);
+    void warning(const char *message);
+    void error(const char *message);
+    void critical(const char *message);
     void debug(const String &message);
     void info(const String &message);
     void warning(const String &message);
     void error(const String &message);
     void critical(const String &message);
+    void debugf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+    void infof(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+    void warningf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+    void errorf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
 
     // Utility methods
     void testLogstashConnection();
     void printStatistics();
     void logSystemStats();
+    void addStatsProvider(StatsProvider provider);
+    void flushRepeats();
+    void reportPreviousBoot();
+    void suspendShipping(unsigned long duration_ms);
     bool isLogstashConnected();
 };
 
@@ -0,0 +1,82 @@
+#ifndef MCAST_PROTOCOL_H
+#define MCAST_PROTOCOL_H
+
+// Wire format shared by the multicast sender and the host receiver library.
+// Plain C++ so it can be compiled off-device (see tools/mcast_receiver).
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MCAST_MAGIC 0x4D4A // "MJ"
+#define MCAST_VERSION 1
+#define MCAST_HEADER_LEN 20
+
+// Largest frame a receiver reassembles; it allocates this much per frame in
+// flight, so a forged header must not be able to ask for more
+#ifndef MCAST_MAX_FRAME_LEN
+#define MCAST_MAX_FRAME_LEN (4UL * 1024 * 1024)
+#endif
+
+// Set on parity datagrams; frag_index then carries the parity group number
+#define MCAST_FLAG_PARITY 0x01
+
+// Every datagram starts with this header, encoded big-endian:
+//   magic(2) version(1) flags(1) frame_id(4) frame_len(4)
+//   frag_index(2) frag_count(2) frag_size(2) parity_group(1) reserved(1)
+// Data fragments are frag_size bytes except the last one. A parity datagram
+// is the XOR of parity_group consecutive data fragments (zero padded to
+// frag_size) and lets a receiver rebuild one lost fragment in that group.
+struct McastHeader
+{
+  uint8_t flags;
+  uint32_t frame_id;
+  uint32_t frame_len;
+  uint16_t frag_index;
+  uint16_t frag_count;
+  uint16_t frag_size;
+  uint8_t parity_group; // 0 = no FEC
+};
+
+inline void mcastEncodeHeader(const McastHeader &h, uint8_t *p)
+{
+  p[0] = MCAST_MAGIC >> 8;
+  p[1] = MCAST_MAGIC & 0xFF;
+  p[2] = MCAST_VERSION;
+  p[3] = h.flags;
+  p[4] = h.frame_id >> 24;
+  p[5] = h.frame_id >> 16;
+  p[6] = h.frame_id >> 8;
+  p[7] = h.frame_id & 0xFF;
+  p[8] = h.frame_len >> 24;
+  p[9] = h.frame_len >> 16;
+  p[10] = h.frame_len >> 8;
+  p[11] = h.frame_len & 0xFF;
+  p[12] = h.frag_index >> 8;
+  p[13] = h.frag_index & 0xFF;
+  p[14] = h.frag_count >> 8;
+  p[15] = h.frag_count & 0xFF;
+  p[16] = h.frag_size >> 8;
+  p[17] = h.frag_size & 0xFF;
+  p[18] = h.parity_group;
+  p[19] = 0;
+}
+
+inline bool mcastDecodeHeader(const uint8_t *p, size_t len, McastHeader &h)
+{
+  if (len < MCAST_HEADER_LEN || ((p[0] << 8) | p[1]) != MCAST_MAGIC || p[2] != MCAST_VERSION)
+  {
+    return false;
+  }
+  h.flags = p[3];
+  h.frame_id = ((uint32_t)p[4] << 24) | ((uint32_t)p[5] << 16) | ((uint32_t)p[6] << 8) | p[7];
+  h.frame_len = ((uint32_t)p[8] << 24) | ((uint32_t)p[9] << 16) | ((uint32_t)p[10] << 8) | p[11];
+  h.frag_index = (p[12] << 8) | p[13];
+  h.frag_count = (p[14] << 8) | p[15];
+  h.frag_size = (p[16] << 8) | p[17];
+  h.parity_group = p[18];
+  // frag_count must be exactly what frame_len and frag_size imply
+  return h.frag_size > 0 && h.frame_len > 0 && h.frame_len <= MCAST_MAX_FRAME_LEN &&
+         h.frag_count == (h.frame_len + h.frag_size - 1) / h.frag_size;
+}
+
+#endif // MCAST_PROTOCOL_H
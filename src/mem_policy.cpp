@@ -0,0 +1,286 @@
+#include "mem_policy.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "mbedtls/platform.h"
+#include "logger.h"
+#include "config.h"
+
+// mbedTLS can only be redirected when it was built with runtime-settable
+// allocation functions, as in ESP-IDF
+#if MEM_POLICY_ENABLED && defined(MBEDTLS_PLATFORM_MEMORY) && !defined(MBEDTLS_PLATFORM_CALLOC_MACRO)
+#define MEM_TLS_HOOKS 1
+#else
+#define MEM_TLS_HOOKS 0
+#endif
+
+// Document builds per measurement at boot
+#define MEM_BENCH_ROUNDS 16
+
+// Every block carries its size and origin, so frees can be accounted
+// without asking the heap
+struct BlockHeader
+{
+  uint32_t size;
+  uint8_t cls;
+  uint8_t psram;
+  uint16_t reserved;
+};
+static_assert(sizeof(BlockHeader) == 8, "keeps the alignment the heap gives");
+
+static MemStats stats;
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static char *text_slots = NULL;
+static uint32_t text_busy = 0; // bit per slot
+static_assert(MEM_TEXT_SLOTS <= 32, "text_busy has a bit per slot");
+
+void *memAlloc(MemClass cls, size_t size)
+{
+  size_t total = size + sizeof(BlockHeader);
+  if (total < size)
+  {
+    return NULL;
+  }
+
+  bool want_psram = MEM_POLICY_ENABLED && size >= MEM_PSRAM_MIN_BYTES;
+  void *block = want_psram ? heap_caps_malloc(total, MALLOC_CAP_SPIRAM) : NULL;
+  bool psram = block != NULL;
+  if (!block)
+  {
+    block = MEM_POLICY_ENABLED ? heap_caps_malloc(total, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) : malloc(total);
+  }
+  if (!block)
+  {
+    return NULL;
+  }
+
+  BlockHeader *header = (BlockHeader *)block;
+  header->size = size;
+  header->cls = cls;
+  header->psram = psram;
+  header->reserved = 0;
+
+  MemClassStats &s = stats.classes[cls];
+  portENTER_CRITICAL(&stats_mux);
+  s.allocs++;
+  if (psram)
+  {
+    s.psram_allocs++;
+    s.psram_bytes += size;
+    if (s.psram_bytes > s.psram_peak)
+    {
+      s.psram_peak = s.psram_bytes;
+    }
+  }
+  else if (want_psram)
+  {
+    s.fallbacks++;
+  }
+  portEXIT_CRITICAL(&stats_mux);
+  return header + 1;
+}
+
+void *memCalloc(MemClass cls, size_t count, size_t size)
+{
+  if (size && count > SIZE_MAX / size)
+  {
+    return NULL;
+  }
+  void *ptr = memAlloc(cls, count * size);
+  if (ptr)
+  {
+    memset(ptr, 0, count * size);
+  }
+  return ptr;
+}
+
+void *memRealloc(MemClass cls, void *ptr, size_t size)
+{
+  if (!ptr)
+  {
+    return memAlloc(cls, size);
+  }
+  if (!size)
+  {
+    memFree(ptr);
+    return NULL;
+  }
+  // Moves rather than resizes in place, so a block that grows past the
+  // threshold ends up in PSRAM; documents rarely reallocate
+  void *moved = memAlloc(cls, size);
+  if (moved)
+  {
+    size_t old_size = ((BlockHeader *)ptr - 1)->size;
+    memcpy(moved, ptr, min(old_size, size));
+    memFree(ptr);
+  }
+  return moved;
+}
+
+void memFree(void *ptr)
+{
+  if (!ptr)
+  {
+    return;
+  }
+  BlockHeader *header = (BlockHeader *)ptr - 1;
+  if (header->psram)
+  {
+    portENTER_CRITICAL(&stats_mux);
+    stats.classes[header->cls].psram_bytes -= header->size;
+    portEXIT_CRITICAL(&stats_mux);
+  }
+  heap_caps_free(header);
+}
+
+#if MEM_TLS_HOOKS
+static void *tlsCalloc(size_t count, size_t size)
+{
+  return memCalloc(MEM_TLS, count, size);
+}
+
+static void tlsFree(void *ptr)
+{
+  memFree(ptr);
+}
+#endif
+
+PooledText::PooledText(size_t size) : data_(NULL), capacity_(0), slot_(-1)
+{
+  if (text_slots && size <= MEM_TEXT_SLOT_BYTES)
+  {
+    portENTER_CRITICAL(&stats_mux);
+    for (int i = 0; i < MEM_TEXT_SLOTS; i++)
+    {
+      if (!(text_busy & (1u << i)))
+      {
+        text_busy |= 1u << i;
+        slot_ = i;
+        break;
+      }
+    }
+    if (slot_ < 0)
+    {
+      stats.text_misses++;
+    }
+    portEXIT_CRITICAL(&stats_mux);
+  }
+
+  if (slot_ >= 0)
+  {
+    data_ = text_slots + slot_ * MEM_TEXT_SLOT_BYTES;
+    capacity_ = MEM_TEXT_SLOT_BYTES;
+  }
+  else if ((data_ = (char *)memAlloc(MEM_TEXT, size)) != NULL)
+  {
+    capacity_ = size;
+  }
+  if (data_ && capacity_)
+  {
+    data_[0] = '\0';
+  }
+}
+
+PooledText::~PooledText()
+{
+  if (slot_ >= 0)
+  {
+    portENTER_CRITICAL(&stats_mux);
+    text_busy &= ~(1u << slot_);
+    portEXIT_CRITICAL(&stats_mux);
+  }
+  else
+  {
+    memFree(data_);
+  }
+}
+
+// What documents would use without the policy, pinned to internal RAM so the
+// comparison does not depend on the heap's own PSRAM threshold
+struct InternalJsonAllocator
+{
+  void *allocate(size_t size) { return heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT); }
+  void deallocate(void *ptr) { heap_caps_free(ptr); }
+  void *reallocate(void *ptr, size_t size)
+  {
+    return heap_caps_realloc(ptr, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  }
+};
+
+// Builds and serializes a document shaped like a Logstash line
+template <typename Document> static uint32_t benchJson()
+{
+  char message[] = "Photo queued for Telegram (23817 bytes, outbox depth 2)";
+  char out[1024];
+  int64_t start = esp_timer_get_time();
+  for (int round = 0; round < MEM_BENCH_ROUNDS; round++)
+  {
+    Document doc(2048);
+    doc["@timestamp"] = "2024-01-01T00:00:00.000Z";
+    doc["level"] = "INFO";
+    doc["message"] = message; // copied into the document, like a String
+    doc["device"] = DEVICE_NAME;
+    doc["uptime_ms"] = millis();
+    doc["free_heap"] = ESP.getFreeHeap();
+    doc["min_free_heap"] = ESP.getMinFreeHeap();
+    doc["max_alloc_heap"] = ESP.getMaxAllocHeap();
+    doc["memory_usage_percent"] = 41.5f;
+    doc["chip_model"] = ESP.getChipModel();
+    doc["cpu_freq_mhz"] = ESP.getCpuFreqMHz();
+    doc["wifi_rssi"] = -61;
+    doc["logger_attempts"] = round;
+    doc["logger_success_rate"] = 99.2f;
+    serializeJson(doc, out, sizeof(out));
+  }
+  return (uint32_t)((esp_timer_get_time() - start) / MEM_BENCH_ROUNDS);
+}
+
+MemStats getMemStats()
+{
+  portENTER_CRITICAL(&stats_mux);
+  MemStats s = stats;
+  portEXIT_CRITICAL(&stats_mux);
+  return s;
+}
+
+static void addMemStats(JsonDocument &doc)
+{
+  MemStats s = getMemStats();
+  uint32_t held = 0;
+  uint32_t fallbacks = 0;
+  for (int cls = 0; cls < MEM_CLASS_COUNT; cls++)
+  {
+    held += s.classes[cls].psram_bytes;
+    fallbacks += s.classes[cls].fallbacks;
+  }
+  doc["mem_internal_free_boot"] = s.internal_free_boot;
+  doc["mem_psram_held"] = held;
+  doc["mem_json_psram_peak"] = s.classes[MEM_JSON].psram_peak;
+  doc["mem_tls_psram_peak"] = s.classes[MEM_TLS].psram_peak;
+  doc["mem_text_psram_peak"] = s.classes[MEM_TEXT].psram_peak;
+  doc["mem_fallbacks"] = fallbacks;
+  doc["mem_text_misses"] = s.text_misses;
+  doc["mem_json_internal_us"] = s.json_internal_us;
+  doc["mem_json_psram_us"] = s.json_psram_us;
+}
+
+void startMemPolicy()
+{
+  stats.internal_free_boot = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+
+#if MEM_TLS_HOOKS
+  mbedtls_platform_set_calloc_free(tlsCalloc, tlsFree);
+#endif
+
+#if MEM_POLICY_ENABLED
+  // Never freed; a pool in internal RAM would defeat its purpose
+  text_slots = (char *)heap_caps_malloc(MEM_TEXT_SLOTS * MEM_TEXT_SLOT_BYTES, MALLOC_CAP_SPIRAM);
+#endif
+
+  // Warm up, then time the same document from each heap
+  benchJson<BasicJsonDocument<InternalJsonAllocator>>();
+  stats.json_internal_us = benchJson<BasicJsonDocument<InternalJsonAllocator>>();
+  stats.json_psram_us = benchJson<PsramJsonDocument>();
+
+  Logger::getInstance().addStatsProvider(addMemStats);
+}
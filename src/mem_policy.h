@@ -0,0 +1,101 @@
+#ifndef MEM_POLICY_H
+#define MEM_POLICY_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// Decides where heap buffers that tolerate slower memory live. Large JSON
+// documents, mbedTLS record and certificate buffers and the logger's
+// payloads go to PSRAM; allocations below MEM_PSRAM_MIN_BYTES (bignum limbs,
+// short strings) stay in internal RAM, where they are faster and where DMA
+// buffers for the camera and Wi-Fi have to be. Without PSRAM everything
+// falls back to internal RAM.
+
+// 0 leaves every buffer in internal RAM, for comparing headroom and speed
+#ifndef MEM_POLICY_ENABLED
+#define MEM_POLICY_ENABLED 1
+#endif
+
+#ifndef MEM_PSRAM_MIN_BYTES
+#define MEM_PSRAM_MIN_BYTES 512
+#endif
+
+// Text buffers kept in PSRAM for payloads that are built, sent and dropped
+#ifndef MEM_TEXT_SLOTS
+#define MEM_TEXT_SLOTS 3
+#endif
+#ifndef MEM_TEXT_SLOT_BYTES
+#define MEM_TEXT_SLOT_BYTES 4096
+#endif
+
+enum MemClass : uint8_t
+{
+  MEM_JSON,
+  MEM_TLS,
+  MEM_TEXT,
+  MEM_CLASS_COUNT
+};
+
+struct MemClassStats
+{
+  uint32_t allocs;
+  uint32_t psram_allocs;
+  uint32_t fallbacks; // meant for PSRAM, placed in internal RAM
+  uint32_t psram_bytes; // held in PSRAM now, i.e. internal RAM spared
+  uint32_t psram_peak;
+};
+
+struct MemStats
+{
+  MemClassStats classes[MEM_CLASS_COUNT];
+  uint32_t text_misses; // pooled text that had to come from the heap
+  uint32_t internal_free_boot; // before any of the above was allocated
+  // Building and serializing a log document, internal vs. PSRAM
+  uint32_t json_internal_us;
+  uint32_t json_psram_us;
+};
+
+// Installs the mbedTLS allocation hooks and allocates the text pool. Call
+// first thing in setup(): blocks mbedTLS allocated before the hooks cannot be
+// freed through them.
+void startMemPolicy();
+
+// Free with memFree() only
+void *memAlloc(MemClass cls, size_t size);
+void *memCalloc(MemClass cls, size_t count, size_t size);
+void *memRealloc(MemClass cls, void *ptr, size_t size);
+void memFree(void *ptr);
+
+MemStats getMemStats();
+
+// Allocator for ArduinoJson documents
+struct PsramJsonAllocator
+{
+  void *allocate(size_t size) { return memAlloc(MEM_JSON, size); }
+  void deallocate(void *ptr) { memFree(ptr); }
+  void *reallocate(void *ptr, size_t size) { return memRealloc(MEM_JSON, ptr, size); }
+};
+typedef BasicJsonDocument<PsramJsonAllocator> PsramJsonDocument;
+
+// A text buffer from the pool for as long as it is in scope. Requests larger
+// than a slot, or made while every slot is taken, come from memAlloc()
+// instead; data() is NULL only when that fails too.
+class PooledText
+{
+public:
+  explicit PooledText(size_t size = MEM_TEXT_SLOT_BYTES);
+  ~PooledText();
+
+  PooledText(const PooledText &) = delete;
+  PooledText &operator=(const PooledText &) = delete;
+
+  char *data() { return data_; }
+  size_t capacity() const { return capacity_; }
+
+private:
+  char *data_;
+  size_t capacity_;
+  int slot_; // -1 when allocated
+};
+
+#endif // MEM_POLICY_H
@@ -0,0 +1,166 @@
+#include "multicast_streamer.h"
+#include "lwip/sockets.h"
+#include "power_governor.h"
+#include "wifi_link.h"
+
+static volatile bool mcast_enabled = false;
+static volatile uint8_t mcast_parity_group = MCAST_PARITY_GROUP;
+static TaskHandle_t mcast_task = NULL;
+
+static uint8_t mcast_packet[MCAST_HEADER_LEN + MCAST_FRAG_SIZE];
+static uint8_t mcast_parity[MCAST_FRAG_SIZE];
+
+static void sendDatagram(int sock, const struct sockaddr_in &dest, size_t len)
+{
+  // lwIP reports ENOMEM when the Wi-Fi TX queue is full; give it one tick to drain
+  for (int attempt = 0; attempt < 2; attempt++)
+  {
+    if (sendto(sock, mcast_packet, len, 0, (const struct sockaddr *)&dest, sizeof(dest)) >= 0)
+    {
+      return;
+    }
+    vTaskDelay(1);
+  }
+}
+
+static void sendFrame(int sock, const struct sockaddr_in &dest, uint32_t frame_id, const uint8_t *buf, size_t len)
+{
+  if (len == 0 || len > MCAST_MAX_FRAME_LEN)
+  {
+    // Receivers would reject every datagram of it
+    return;
+  }
+
+  McastHeader h;
+  h.frame_id = frame_id;
+  h.frame_len = len;
+  h.frag_size = MCAST_FRAG_SIZE;
+  h.frag_count = (len + MCAST_FRAG_SIZE - 1) / MCAST_FRAG_SIZE;
+  h.parity_group = mcast_parity_group;
+
+  uint8_t group_fill = 0;
+  for (uint16_t i = 0; i < h.frag_count; i++)
+  {
+    size_t offset = (size_t)i * MCAST_FRAG_SIZE;
+    size_t chunk = min((size_t)MCAST_FRAG_SIZE, len - offset);
+
+    h.flags = 0;
+    h.frag_index = i;
+    mcastEncodeHeader(h, mcast_packet);
+    memcpy(mcast_packet + MCAST_HEADER_LEN, buf + offset, chunk);
+    sendDatagram(sock, dest, MCAST_HEADER_LEN + chunk);
+
+    if (h.parity_group == 0)
+    {
+      continue;
+    }
+
+    // Accumulate the XOR parity of this group, short fragments count as zero padded
+    if (group_fill == 0)
+    {
+      memset(mcast_parity, 0, sizeof(mcast_parity));
+    }
+    for (size_t b = 0; b < chunk; b++)
+    {
+      mcast_parity[b] ^= buf[offset + b];
+    }
+    group_fill++;
+
+    if (group_fill == h.parity_group || i + 1 == h.frag_count)
+    {
+      h.flags = MCAST_FLAG_PARITY;
+      h.frag_index = i / h.parity_group;
+      mcastEncodeHeader(h, mcast_packet);
+      memcpy(mcast_packet + MCAST_HEADER_LEN, mcast_parity, MCAST_FRAG_SIZE);
+      sendDatagram(sock, dest, MCAST_HEADER_LEN + MCAST_FRAG_SIZE);
+      group_fill = 0;
+    }
+  }
+}
+
+static void multicastTask(void *arg)
+{
+  int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  uint8_t ttl = 1; // stay on the local segment
+  setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+
+  struct sockaddr_in dest = {};
+  dest.sin_family = AF_INET;
+  dest.sin_port = htons(MCAST_PORT);
+  inet_aton(MCAST_GROUP, &dest.sin_addr);
+
+  uint32_t frame_id = 0;
+  while (true)
+  {
+    if (!mcast_enabled)
+    {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+    if (!wifiLinkUp())
+    {
+      // Nothing reaches the group without a link; no point capturing
+      wifiLinkWait(1000);
+      continue;
+    }
+
+    camera_fb_t *fb = cameraCapture();
+    if (!fb)
+    {
+      Logger::getInstance().error("Camera frame capture failed");
+      vTaskDelay(pdMS_TO_TICKS(100));
+      continue;
+    }
+
+    // Sent once to the group, so the cost does not depend on the viewer count
+    if (fb->format == PIXFORMAT_JPEG)
+    {
+      sendFrame(sock, dest, frame_id++, fb->buf, fb->len);
+    }
+    cameraRelease(fb);
+  }
+}
+
+void startMulticastStreamer()
+{
+  xTaskCreate(multicastTask, "mcast", 4096, NULL, 5, &mcast_task);
+}
+
+void setMulticastEnabled(bool enabled)
+{
+  if (enabled == mcast_enabled)
+  {
+    return;
+  }
+
+  // The multicast group counts as one stream client while enabled
+  enabled ? powerDemandBegin(DEMAND_STREAM) : powerDemandEnd(DEMAND_STREAM);
+  mcast_enabled = enabled;
+  if (enabled)
+  {
+    Logger::getInstance().info("Multicast streaming enabled to " MCAST_GROUP ":" + String(MCAST_PORT));
+    if (mcast_task)
+    {
+      xTaskNotifyGive(mcast_task);
+    }
+  }
+  else
+  {
+    Logger::getInstance().info("Multicast streaming disabled");
+  }
+}
+
+bool isMulticastEnabled()
+{
+  return mcast_enabled;
+}
+
+void setMulticastParityGroup(uint8_t group)
+{
+  mcast_parity_group = group;
+}
+
+uint8_t getMulticastParityGroup()
+{
+  return mcast_parity_group;
+}
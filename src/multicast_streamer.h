@@ -0,0 +1,39 @@
+#ifndef MULTICAST_STREAMER_H
+#define MULTICAST_STREAMER_H
+
+#include <Arduino.h>
+#include "esp_camera.h"
+#include "mcast_protocol.h"
+#include "logger.h"
+#include "camera_setup.h"
+
+// Destination group and port for multicast frames
+#ifndef MCAST_GROUP
+#define MCAST_GROUP "239.255.0.1"
+#endif
+#ifndef MCAST_PORT
+#define MCAST_PORT 5010
+#endif
+
+// Payload bytes per datagram, sized to stay below a 1500-byte MTU
+#ifndef MCAST_FRAG_SIZE
+#define MCAST_FRAG_SIZE 1400
+#endif
+
+// Data fragments per parity datagram (0 disables FEC)
+#ifndef MCAST_PARITY_GROUP
+#define MCAST_PARITY_GROUP 8
+#endif
+
+// Creates the (idle) multicast sender task. Nothing is transmitted until
+// setMulticastEnabled(true) is called, e.g. from the /multicast endpoint.
+void startMulticastStreamer();
+
+void setMulticastEnabled(bool enabled);
+bool isMulticastEnabled();
+
+// Changes the FEC group size at runtime, 0 turns parity off
+void setMulticastParityGroup(uint8_t group);
+uint8_t getMulticastParityGroup();
+
+#endif // MULTICAST_STREAMER_H
@@ -0,0 +1,556 @@
+#include "ota_stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(ESP_PLATFORM)
+#include "esp_heap_caps.h"
+#include "esp32/rom/miniz.h"
+#include "mbedtls/version.h"
+#include "mbedtls/sha256.h"
+#if MBEDTLS_VERSION_NUMBER < 0x03000000
+#define mbedtls_sha256_starts mbedtls_sha256_starts_ret
+#define mbedtls_sha256_update mbedtls_sha256_update_ret
+#define mbedtls_sha256_finish mbedtls_sha256_finish_ret
+#endif
+#define OTA_WINDOW_SIZE TINFL_LZ_DICT_SIZE
+#else
+#include <zlib.h>
+#include <openssl/evp.h>
+#define OTA_WINDOW_SIZE 32768
+#endif
+
+// gzip member header flags (RFC 1952)
+#define GZIP_FHCRC 0x02
+#define GZIP_FEXTRA 0x04
+#define GZIP_FNAME 0x08
+#define GZIP_FCOMMENT 0x10
+
+// SHA-256 block size and the HMAC pads (RFC 2104)
+#define HMAC_BLOCK 64
+#define HMAC_IPAD 0x36
+#define HMAC_OPAD 0x5c
+
+OtaStream::OtaStream(PageWriter writer, void *ctx)
+    : writer(writer), writer_ctx(ctx), err(NULL), gzip(false), started(false), inflate_done(false),
+      header_len(0), header_done(false), trailer_len(0), page(NULL), page_fill(0), inflater(NULL),
+      window(NULL), window_pos(0), sha(NULL), mac(NULL), mac_failed(false), bytes_in(0), bytes_out(0), pages(0),
+      held_bytes(0), peak_bytes(0)
+{
+    memset(mac_key, 0, sizeof(mac_key));
+}
+
+OtaStream::~OtaStream()
+{
+    free(page);
+    free(window);
+#if defined(ESP_PLATFORM)
+    free(inflater);
+#else
+    if (inflater)
+    {
+        inflateEnd((z_stream *)inflater);
+        free(inflater);
+    }
+#endif
+    hashFree(sha);
+    hashFree(mac);
+    memset(mac_key, 0, sizeof(mac_key));
+}
+
+void *OtaStream::hashBegin()
+{
+#if defined(ESP_PLATFORM)
+    mbedtls_sha256_context *ctx = (mbedtls_sha256_context *)allocate(sizeof(mbedtls_sha256_context), false);
+    if (ctx)
+    {
+        mbedtls_sha256_init(ctx);
+        mbedtls_sha256_starts(ctx, 0);
+    }
+    return ctx;
+#else
+    EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+    if (ctx)
+    {
+        EVP_DigestInit_ex(ctx, EVP_sha256(), NULL);
+    }
+    return ctx;
+#endif
+}
+
+void OtaStream::hashUpdate(void *ctx, const uint8_t *data, size_t len)
+{
+#if defined(ESP_PLATFORM)
+    mbedtls_sha256_update((mbedtls_sha256_context *)ctx, data, len);
+#else
+    EVP_DigestUpdate((EVP_MD_CTX *)ctx, data, len);
+#endif
+}
+
+void OtaStream::hashFinish(void *ctx, uint8_t digest[32])
+{
+#if defined(ESP_PLATFORM)
+    mbedtls_sha256_finish((mbedtls_sha256_context *)ctx, digest);
+#else
+    EVP_DigestFinal_ex((EVP_MD_CTX *)ctx, digest, NULL);
+#endif
+}
+
+void OtaStream::hashFree(void *ctx)
+{
+    if (!ctx)
+    {
+        return;
+    }
+#if defined(ESP_PLATFORM)
+    mbedtls_sha256_free((mbedtls_sha256_context *)ctx);
+    free(ctx);
+#else
+    EVP_MD_CTX_free((EVP_MD_CTX *)ctx);
+#endif
+}
+
+void *OtaStream::allocate(size_t size, bool prefer_external)
+{
+    void *p = NULL;
+#if defined(ESP_PLATFORM)
+    // The inflate window is only touched by the CPU, so PSRAM is fine for it;
+    // free() releases either kind of allocation
+    if (prefer_external)
+    {
+        p = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    }
+#else
+    (void)prefer_external;
+#endif
+    if (!p)
+    {
+        p = malloc(size);
+    }
+    if (p)
+    {
+        held_bytes += size;
+        if (held_bytes > peak_bytes)
+        {
+            peak_bytes = held_bytes;
+        }
+    }
+    return p;
+}
+
+bool OtaStream::begin(bool use_gzip, const uint8_t *key, size_t key_len)
+{
+    gzip = use_gzip;
+
+    // Flash writes cannot source from PSRAM while the cache is off, keep pages internal
+    page = (uint8_t *)allocate(OTA_PAGE_SIZE, false);
+    if (!page)
+    {
+        return fail("out of memory for page buffer");
+    }
+
+    sha = hashBegin();
+    if (!sha)
+    {
+        return fail("out of memory for hash");
+    }
+
+    if (key)
+    {
+        // Keys longer than a block are hashed first (RFC 2104)
+        if (key_len > HMAC_BLOCK)
+        {
+            hashUpdate(sha, key, key_len);
+            hashFinish(sha, mac_key);
+            hashFree(sha);
+            sha = hashBegin();
+        }
+        else
+        {
+            memcpy(mac_key, key, key_len);
+        }
+        mac = hashBegin();
+        if (!sha || !mac)
+        {
+            return fail("out of memory for hash");
+        }
+        uint8_t pad[HMAC_BLOCK];
+        for (int i = 0; i < HMAC_BLOCK; i++)
+        {
+            pad[i] = mac_key[i] ^ HMAC_IPAD;
+        }
+        hashUpdate(mac, pad, sizeof(pad));
+    }
+
+    if (gzip)
+    {
+        window = (uint8_t *)allocate(OTA_WINDOW_SIZE, true);
+#if defined(ESP_PLATFORM)
+        inflater = allocate(sizeof(tinfl_decompressor), true);
+        if (inflater)
+        {
+            tinfl_init((tinfl_decompressor *)inflater);
+        }
+#else
+        inflater = allocate(sizeof(z_stream), false);
+        if (inflater)
+        {
+            memset(inflater, 0, sizeof(z_stream));
+            // Negative window bits: raw deflate, the gzip wrapper is parsed here
+            if (inflateInit2((z_stream *)inflater, -15) != Z_OK)
+            {
+                free(inflater);
+                inflater = NULL;
+            }
+        }
+#endif
+        if (!window || !inflater)
+        {
+            return fail("out of memory for inflater");
+        }
+    }
+
+    started = true;
+    return true;
+}
+
+bool OtaStream::fail(const char *message)
+{
+    if (!err)
+    {
+        err = message;
+    }
+    return false;
+}
+
+bool OtaStream::flushPage()
+{
+    if (page_fill == 0)
+    {
+        return true;
+    }
+    if (!writer(writer_ctx, page, page_fill))
+    {
+        return fail("flash write failed");
+    }
+    pages++;
+    page_fill = 0;
+    return true;
+}
+
+bool OtaStream::emit(const uint8_t *data, size_t len)
+{
+    hashUpdate(sha, data, len);
+    if (mac)
+    {
+        hashUpdate(mac, data, len);
+    }
+    bytes_out += len;
+
+    while (len > 0)
+    {
+        size_t n = OTA_PAGE_SIZE - page_fill;
+        if (n > len)
+        {
+            n = len;
+        }
+        memcpy(page + page_fill, data, n);
+        page_fill += n;
+        data += n;
+        len -= n;
+        if (page_fill == OTA_PAGE_SIZE && !flushPage())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns the header length once the whole header is in data, 0 if more bytes
+// are needed. Sets err on a malformed header.
+size_t OtaStream::parseGzipHeader(const uint8_t *data, size_t len)
+{
+    if (len < 10)
+    {
+        return 0;
+    }
+    if (data[0] != 0x1f || data[1] != 0x8b || data[2] != 8)
+    {
+        fail("not a gzip (deflate) image");
+        return 0;
+    }
+
+    uint8_t flags = data[3];
+    size_t pos = 10;
+    if (flags & GZIP_FEXTRA)
+    {
+        if (len < pos + 2)
+        {
+            return 0;
+        }
+        pos += 2 + (data[pos] | (data[pos + 1] << 8));
+    }
+    for (uint8_t field = GZIP_FNAME; field <= GZIP_FCOMMENT; field <<= 1)
+    {
+        if (flags & field)
+        {
+            // Zero-terminated string
+            while (pos < len && data[pos] != 0)
+            {
+                pos++;
+            }
+            if (pos >= len)
+            {
+                return 0;
+            }
+            pos++;
+        }
+    }
+    if (flags & GZIP_FHCRC)
+    {
+        pos += 2;
+    }
+    return pos <= len ? pos : 0;
+}
+
+bool OtaStream::consumeTrailer(const uint8_t *data, size_t len)
+{
+    size_t n = sizeof(trailer) - trailer_len;
+    if (n > len)
+    {
+        n = len;
+    }
+    memcpy(trailer + trailer_len, data, n);
+    trailer_len += n;
+    if (len > n)
+    {
+        return fail("data after end of gzip stream");
+    }
+    return true;
+}
+
+bool OtaStream::inflateInput(const uint8_t *data, size_t len)
+{
+#if defined(ESP_PLATFORM)
+    tinfl_decompressor *d = (tinfl_decompressor *)inflater;
+    while (!inflate_done)
+    {
+        size_t in_bytes = len;
+        size_t out_bytes = OTA_WINDOW_SIZE - window_pos;
+        tinfl_status status = tinfl_decompress(d, data, &in_bytes, window, window + window_pos, &out_bytes,
+                                               TINFL_FLAG_HAS_MORE_INPUT);
+        data += in_bytes;
+        len -= in_bytes;
+
+        if (out_bytes && !emit(window + window_pos, out_bytes))
+        {
+            return false;
+        }
+        // The window wraps; tinfl keeps back-references inside it
+        window_pos = (window_pos + out_bytes) & (OTA_WINDOW_SIZE - 1);
+
+        if (status < TINFL_STATUS_DONE)
+        {
+            return fail("corrupt deflate stream");
+        }
+        if (status == TINFL_STATUS_DONE)
+        {
+            inflate_done = true;
+        }
+        else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && len == 0)
+        {
+            return true;
+        }
+    }
+#else
+    z_stream *z = (z_stream *)inflater;
+    z->next_in = (Bytef *)data;
+    z->avail_in = len;
+    while (!inflate_done && (z->avail_in > 0 || window_pos == OTA_WINDOW_SIZE))
+    {
+        z->next_out = window;
+        z->avail_out = OTA_WINDOW_SIZE;
+        int status = inflate(z, Z_NO_FLUSH);
+        size_t out_bytes = OTA_WINDOW_SIZE - z->avail_out;
+        if (out_bytes && !emit(window, out_bytes))
+        {
+            return false;
+        }
+        // A full window may mean more output is pending without new input
+        window_pos = out_bytes;
+
+        if (status == Z_STREAM_END)
+        {
+            inflate_done = true;
+        }
+        else if (status != Z_OK && status != Z_BUF_ERROR)
+        {
+            return fail("corrupt deflate stream");
+        }
+        else if (out_bytes == 0 && z->avail_in == 0)
+        {
+            break;
+        }
+    }
+    data = z->next_in;
+    len = z->avail_in;
+#endif
+    return len == 0 || consumeTrailer(data, len);
+}
+
+bool OtaStream::feed(const uint8_t *data, size_t len)
+{
+    if (!started || err)
+    {
+        return fail("stream not started");
+    }
+    bytes_in += len;
+
+    if (!gzip)
+    {
+        return emit(data, len);
+    }
+
+    if (!header_done)
+    {
+        // Buffer until the variable-length header is complete
+        size_t n = sizeof(header) - header_len;
+        if (n > len)
+        {
+            n = len;
+        }
+        memcpy(header + header_len, data, n);
+        size_t header_size = parseGzipHeader(header, header_len + n);
+        if (err)
+        {
+            return false;
+        }
+        if (header_size == 0)
+        {
+            if (header_len + n == sizeof(header))
+            {
+                return fail("gzip header too long");
+            }
+            header_len += n;
+            return true;
+        }
+
+        // Skip the header bytes that came in with this piece
+        size_t used = header_size - header_len;
+        header_done = true;
+        data += used;
+        len -= used;
+    }
+
+    if (inflate_done)
+    {
+        return consumeTrailer(data, len);
+    }
+    return inflateInput(data, len);
+}
+
+bool OtaStream::finish(const uint8_t expected_sha256[32], const uint8_t *expected_mac)
+{
+    if (err)
+    {
+        return false;
+    }
+
+    if (gzip)
+    {
+        if (!inflate_done)
+        {
+            return fail("truncated gzip image");
+        }
+        // The hash below is authoritative; ISIZE is a cheap early sanity check.
+        // Older ROM inflaters may keep trailer bytes in their bit buffer.
+        if (trailer_len == sizeof(trailer))
+        {
+            uint32_t isize = trailer[4] | (trailer[5] << 8) | (trailer[6] << 16) | ((uint32_t)trailer[7] << 24);
+            if (isize != (uint32_t)bytes_out)
+            {
+                return fail("decoded size does not match gzip trailer");
+            }
+        }
+    }
+
+    if (!flushPage())
+    {
+        return false;
+    }
+
+    uint8_t digest[32];
+    hashFinish(sha, digest);
+    if (memcmp(digest, expected_sha256, sizeof(digest)) != 0)
+    {
+        return fail("SHA-256 mismatch");
+    }
+
+    if (mac)
+    {
+        // HMAC = H((key ^ opad) || H((key ^ ipad) || image))
+        uint8_t inner[32];
+        hashFinish(mac, inner);
+        void *outer = hashBegin();
+        if (!outer)
+        {
+            return fail("out of memory for hash");
+        }
+        uint8_t pad[HMAC_BLOCK];
+        for (int i = 0; i < HMAC_BLOCK; i++)
+        {
+            pad[i] = mac_key[i] ^ HMAC_OPAD;
+        }
+        hashUpdate(outer, pad, sizeof(pad));
+        hashUpdate(outer, inner, sizeof(inner));
+        hashFinish(outer, digest);
+        hashFree(outer);
+
+        // Compared in constant time, so the response time does not leak a prefix
+        uint8_t diff = expected_mac ? 0 : 1;
+        for (size_t i = 0; expected_mac && i < sizeof(digest); i++)
+        {
+            diff |= digest[i] ^ expected_mac[i];
+        }
+        if (diff)
+        {
+            mac_failed = true;
+            return fail(expected_mac ? "HMAC mismatch" : "HMAC required");
+        }
+    }
+    return true;
+}
+
+bool OtaStream::parseSha256(const char *hex, uint8_t out[32])
+{
+    for (int i = 0; i < 64; i++)
+    {
+        char c = hex[i];
+        int v;
+        if (c >= '0' && c <= '9')
+        {
+            v = c - '0';
+        }
+        else if (c >= 'a' && c <= 'f')
+        {
+            v = c - 'a' + 10;
+        }
+        else if (c >= 'A' && c <= 'F')
+        {
+            v = c - 'A' + 10;
+        }
+        else
+        {
+            return false;
+        }
+        if (i % 2 == 0)
+        {
+            out[i / 2] = v << 4;
+        }
+        else
+        {
+            out[i / 2] |= v;
+        }
+    }
+    return hex[64] == '\0';
+}
@@ -0,0 +1,108 @@
+#ifndef OTA_STREAM_H
+#define OTA_STREAM_H
+
+// Streaming firmware image decoder for OTA updates, free of Arduino
+// dependencies so the host benchmark in tools/ota_bench runs the same code.
+//
+// Input arrives in whatever pieces the network delivers. A gzip image is
+// inflated on the fly through a 32 KB window (the deflate dictionary), plain
+// images pass straight through. Output is collected into OTA_PAGE_SIZE blocks
+// and handed to the page writer one flash page at a time; only the last page
+// may be short. A SHA-256 over the decoded image is checked in finish(), and
+// with a key also an HMAC-SHA256 (RFC 2104), so only someone holding the key
+// can produce an image that is accepted.
+//
+// On ESP32 the inflater is the ROM copy of miniz (tinfl) and SHA-256 comes
+// from mbedTLS; the host build uses zlib and OpenSSL instead.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef OTA_PAGE_SIZE
+#define OTA_PAGE_SIZE 4096
+#endif
+
+class OtaStream
+{
+public:
+    // Writes one page of decoded image; returns false to abort the update
+    typedef bool (*PageWriter)(void *ctx, const uint8_t *data, size_t len);
+
+    OtaStream(PageWriter writer, void *ctx);
+    ~OtaStream();
+
+    // Allocates the working buffers; gzip selects the inflating path. With a
+    // key, finish() also requires the image's HMAC-SHA256 under that key.
+    bool begin(bool gzip, const uint8_t *mac_key = NULL, size_t mac_key_len = 0);
+    bool feed(const uint8_t *data, size_t len);
+
+    // Flushes the last page and compares the image hash with expected_sha256,
+    // and the HMAC with expected_mac when begin() was given a key
+    bool finish(const uint8_t expected_sha256[32], const uint8_t *expected_mac = NULL);
+
+    const char *error() const { return err; }
+    uint64_t bytesIn() const { return bytes_in; }
+    uint64_t bytesOut() const { return bytes_out; }
+    uint32_t pagesWritten() const { return pages; }
+
+    // finish() failed because the HMAC was missing or wrong
+    bool unauthorized() const { return mac_failed; }
+
+    // Largest amount of memory the decoder held at once
+    size_t peakBytes() const { return peak_bytes; }
+
+    // Parses "0123abcd..." (64 hex digits) into a 32-byte digest or HMAC
+    static bool parseSha256(const char *hex, uint8_t out[32]);
+
+private:
+    bool fail(const char *message);
+    bool emit(const uint8_t *data, size_t len);
+    bool flushPage();
+    size_t parseGzipHeader(const uint8_t *data, size_t len);
+    bool inflateInput(const uint8_t *data, size_t len);
+    bool consumeTrailer(const uint8_t *data, size_t len);
+    void *allocate(size_t size, bool prefer_external);
+    void *hashBegin();
+    static void hashUpdate(void *ctx, const uint8_t *data, size_t len);
+    static void hashFinish(void *ctx, uint8_t digest[32]);
+    static void hashFree(void *ctx);
+
+    PageWriter writer;
+    void *writer_ctx;
+    const char *err;
+
+    bool gzip;
+    bool started;
+    bool inflate_done;
+
+    // gzip header, buffered until complete
+    uint8_t header[256];
+    size_t header_len;
+    bool header_done;
+
+    // CRC32 and ISIZE after the deflate stream
+    uint8_t trailer[8];
+    size_t trailer_len;
+
+    uint8_t *page;
+    size_t page_fill;
+
+    void *inflater; // tinfl_decompressor or z_stream
+    uint8_t *window;
+    size_t window_pos;
+
+    void *sha; // mbedtls_sha256_context or EVP_MD_CTX
+
+    // HMAC: inner hash over (key ^ ipad) and the image, NULL without a key
+    void *mac;
+    uint8_t mac_key[64]; // the key zero-padded to one SHA-256 block
+    bool mac_failed;
+
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint32_t pages;
+    size_t held_bytes;
+    size_t peak_bytes;
+};
+
+#endif // OTA_STREAM_H
@@ -0,0 +1,178 @@
+#include "ota_update.h"
+#include "ota_stream.h"
+#include "config.h"
+#include "camera_setup.h"
+#include "power_governor.h"
+#include "esp_ota_ops.h"
+#include "esp_heap_caps.h"
+
+struct OtaTarget
+{
+  esp_ota_handle_t handle;
+  bool write_failed; // flash error, as opposed to a bad image
+};
+
+static bool writeOtaPage(void *ctx, const uint8_t *data, size_t len)
+{
+  OtaTarget *target = (OtaTarget *)ctx;
+  target->write_failed = esp_ota_write(target->handle, data, len) != ESP_OK;
+  return !target->write_failed;
+}
+
+static esp_err_t sendResult(httpd_req_t *req, const char *status, const char *json)
+{
+  httpd_resp_set_status(req, status);
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  return httpd_resp_send(req, json, strlen(json));
+}
+
+static esp_err_t sendError(httpd_req_t *req, const char *status, const char *message)
+{
+  Logger::getInstance().error(String("OTA update failed: ") + message);
+  char response[128];
+  snprintf(response, sizeof(response), "{\"success\":false,\"message\":\"%s\"}", message);
+  return sendResult(req, status, response);
+}
+
+esp_err_t update_handler(httpd_req_t *req)
+{
+  uint8_t expected_sha[32];
+  char value[72];
+  if (httpd_req_get_hdr_value_str(req, "X-Firmware-SHA256", value, sizeof(value)) != ESP_OK ||
+      !OtaStream::parseSha256(value, expected_sha))
+  {
+    return sendError(req, "400 Bad Request", "X-Firmware-SHA256 header with 64 hex digits required");
+  }
+
+  // The hash only catches corruption; the HMAC proves who built the image
+  if (!ota_secret || !ota_secret[0])
+  {
+    return sendError(req, "403 Forbidden", "OTA disabled, ota_secret is not set");
+  }
+  uint8_t expected_mac[32];
+  if (httpd_req_get_hdr_value_str(req, "X-Firmware-HMAC", value, sizeof(value)) != ESP_OK ||
+      !OtaStream::parseSha256(value, expected_mac))
+  {
+    return sendError(req, "401 Unauthorized", "X-Firmware-HMAC header with 64 hex digits required");
+  }
+
+  bool gzip = false;
+  if (httpd_req_get_hdr_value_str(req, "Content-Encoding", value, sizeof(value)) == ESP_OK)
+  {
+    gzip = strstr(value, "gzip") != NULL;
+  }
+  char query[32];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+      httpd_query_key_value(query, "gzip", value, sizeof(value)) == ESP_OK)
+  {
+    gzip = atoi(value) != 0;
+  }
+
+  const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+  if (!partition)
+  {
+    return sendError(req, "500 Internal Server Error", "no OTA partition");
+  }
+
+  Logger::getInstance().info("OTA update started: " + String(req->content_len) + " bytes" +
+                             (gzip ? " (gzip)" : "") + " into " + partition->label);
+
+  // Frame buffers stay allocated, but nothing captures or streams meanwhile
+  if (!cameraPause())
+  {
+    return sendError(req, "503 Service Unavailable", "camera busy");
+  }
+  powerDemandBegin(DEMAND_JOB);
+
+  uint32_t start_ms = millis();
+  size_t heap_before = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+  size_t heap_min = heap_before;
+
+  OtaTarget target = {0, false};
+  // Sequential writes: each sector is erased just before it is written
+  esp_err_t err = esp_ota_begin(partition, OTA_WITH_SEQUENTIAL_WRITES, &target.handle);
+  const char *failure = err == ESP_OK ? NULL : "esp_ota_begin failed";
+  // Failures of this device rather than of the upload answer 500
+  bool device_error = failure != NULL;
+
+  OtaStream stream(writeOtaPage, &target);
+  if (!failure && !stream.begin(gzip, (const uint8_t *)ota_secret, strlen(ota_secret)))
+  {
+    failure = stream.error();
+    device_error = true; // out of memory
+  }
+
+  uint8_t buf[OTA_RECV_CHUNK];
+  size_t remaining = req->content_len;
+  int timeouts = 0;
+  while (!failure && remaining > 0)
+  {
+    int n = httpd_req_recv(req, (char *)buf, min(remaining, sizeof(buf)));
+    if (n == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < 3)
+    {
+      continue;
+    }
+    if (n <= 0)
+    {
+      failure = "connection lost";
+      break;
+    }
+    timeouts = 0;
+    remaining -= n;
+    if (!stream.feed(buf, n))
+    {
+      failure = stream.error();
+    }
+    heap_min = min(heap_min, heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+  }
+
+  if (!failure && !stream.finish(expected_sha, expected_mac))
+  {
+    failure = stream.error();
+  }
+  if (!failure && esp_ota_end(target.handle) != ESP_OK)
+  {
+    // esp_ota_end also validates the app image header and checksum
+    failure = "image validation failed";
+  }
+  else if (failure && target.handle)
+  {
+    esp_ota_abort(target.handle);
+  }
+  if (!failure && esp_ota_set_boot_partition(partition) != ESP_OK)
+  {
+    failure = "cannot select boot partition";
+    device_error = true;
+  }
+
+  powerDemandEnd(DEMAND_JOB);
+  if (failure)
+  {
+    cameraResume();
+    const char *status = "400 Bad Request";
+    if (stream.unauthorized())
+    {
+      status = "401 Unauthorized";
+    }
+    else if (device_error || target.write_failed)
+    {
+      status = "500 Internal Server Error";
+    }
+    return sendError(req, status, failure);
+  }
+
+  uint32_t elapsed_ms = millis() - start_ms;
+  char response[200];
+  snprintf(response, sizeof(response),
+           "{\"success\":true,\"received\":%llu,\"written\":%llu,\"ms\":%u,\"decoder_peak\":%u,\"heap_peak\":%u}",
+           (unsigned long long)stream.bytesIn(), (unsigned long long)stream.bytesOut(), elapsed_ms,
+           (unsigned)stream.peakBytes(), (unsigned)(heap_before - heap_min));
+  Logger::getInstance().info("OTA update done in " + String(elapsed_ms) + " ms, " + String(response));
+  sendResult(req, "200 OK", response);
+
+  // Let the response go out before rebooting into the new image
+  delay(1000);
+  esp_restart();
+  return ESP_OK;
+}
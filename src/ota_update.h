@@ -0,0 +1,21 @@
+#ifndef OTA_UPDATE_H
+#define OTA_UPDATE_H
+
+#include <Arduino.h>
+#include "esp_http_server.h"
+#include "logger.h"
+
+// Receive buffer per httpd_req_recv call, about one TCP segment
+#ifndef OTA_RECV_CHUNK
+#define OTA_RECV_CHUNK 1436
+#endif
+
+// POST /update: streams a firmware image into the inactive OTA partition.
+// The body may be gzip-compressed (Content-Encoding: gzip or ?gzip=1) and
+// X-Firmware-SHA256 must carry the hex SHA-256 of the uncompressed image and
+// X-Firmware-HMAC its hex HMAC-SHA256 under ota_secret; an image without a
+// valid HMAC is never made bootable. Captures are paused for the duration;
+// the device reboots on success.
+esp_err_t update_handler(httpd_req_t *req);
+
+#endif // OTA_UPDATE_H
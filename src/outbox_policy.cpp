@@ -0,0 +1,95 @@
+#include "outbox_policy.h"
+
+uint32_t outboxBackoffMs(uint8_t attempts, uint32_t random)
+{
+    uint32_t cap = OUTBOX_BACKOFF_BASE_MS;
+    for (uint8_t i = 1; i < attempts && cap < OUTBOX_BACKOFF_MAX_MS; i++)
+    {
+        cap *= 2;
+    }
+    if (cap > OUTBOX_BACKOFF_MAX_MS)
+    {
+        cap = OUTBOX_BACKOFF_MAX_MS;
+    }
+    uint32_t half = cap / 2;
+    return half + random % (cap - half + 1);
+}
+
+CircuitBreaker::CircuitBreaker()
+    : current(CLOSED), consecutive_failures(0), cooldown_ms(BREAKER_COOLDOWN_MS), open_until_ms(0), open_count(0),
+      probe_in_flight(false)
+{
+}
+
+const char *CircuitBreaker::stateName(State state)
+{
+    switch (state)
+    {
+    case CLOSED:
+        return "closed";
+    case OPEN:
+        return "open";
+    case HALF_OPEN:
+        return "half-open";
+    }
+    return "unknown";
+}
+
+bool CircuitBreaker::allow(uint32_t now_ms)
+{
+    if (current == OPEN)
+    {
+        if ((int32_t)(now_ms - open_until_ms) < 0)
+        {
+            return false;
+        }
+        current = HALF_OPEN;
+        probe_in_flight = false;
+    }
+    if (current == HALF_OPEN)
+    {
+        if (probe_in_flight)
+        {
+            return false;
+        }
+        probe_in_flight = true;
+    }
+    return true;
+}
+
+void CircuitBreaker::open(uint32_t now_ms, uint32_t duration_ms)
+{
+    current = OPEN;
+    open_until_ms = now_ms + duration_ms;
+    probe_in_flight = false;
+    open_count++;
+}
+
+void CircuitBreaker::onSuccess()
+{
+    current = CLOSED;
+    consecutive_failures = 0;
+    cooldown_ms = BREAKER_COOLDOWN_MS;
+    probe_in_flight = false;
+}
+
+void CircuitBreaker::onFailure(uint32_t now_ms, uint32_t retry_after_ms)
+{
+    consecutive_failures++;
+
+    if (current == HALF_OPEN)
+    {
+        // The probe failed: the outage is still on, wait longer this time
+        cooldown_ms = cooldown_ms * 2 > BREAKER_COOLDOWN_MAX_MS ? BREAKER_COOLDOWN_MAX_MS : cooldown_ms * 2;
+        open(now_ms, retry_after_ms > cooldown_ms ? retry_after_ms : cooldown_ms);
+    }
+    else if (retry_after_ms > 0)
+    {
+        // Rate limited: the server said how long every request has to wait
+        open(now_ms, retry_after_ms);
+    }
+    else if (current == CLOSED && consecutive_failures >= BREAKER_FAILURE_THRESHOLD)
+    {
+        open(now_ms, cooldown_ms);
+    }
+}
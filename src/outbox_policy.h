@@ -0,0 +1,73 @@
+#ifndef OUTBOX_POLICY_H
+#define OUTBOX_POLICY_H
+
+#include <stdint.h>
+
+// Retry delay after the first failure; doubles per attempt up to the max
+#ifndef OUTBOX_BACKOFF_BASE_MS
+#define OUTBOX_BACKOFF_BASE_MS 2000
+#endif
+#ifndef OUTBOX_BACKOFF_MAX_MS
+#define OUTBOX_BACKOFF_MAX_MS 300000
+#endif
+
+// Consecutive failures that open the breaker, and how long it stays open
+// (doubling after every failed probe up to the max)
+#ifndef BREAKER_FAILURE_THRESHOLD
+#define BREAKER_FAILURE_THRESHOLD 5
+#endif
+#ifndef BREAKER_COOLDOWN_MS
+#define BREAKER_COOLDOWN_MS 30000
+#endif
+#ifndef BREAKER_COOLDOWN_MAX_MS
+#define BREAKER_COOLDOWN_MAX_MS 600000
+#endif
+
+// Delay before retry number `attempts` (1 = after the first failure):
+// exponential with equal jitter, i.e. half the capped delay plus a random
+// part of the other half, so devices that failed together spread out.
+uint32_t outboxBackoffMs(uint8_t attempts, uint32_t random);
+
+// Stops delivery attempts while the API keeps failing. Closed lets every
+// request through; after BREAKER_FAILURE_THRESHOLD consecutive failures it
+// opens for a cooldown, then lets a single probe through (half-open). The
+// probe's outcome closes it again or reopens it with a longer cooldown.
+// Times are millis()-style and may wrap.
+class CircuitBreaker
+{
+public:
+    enum State
+    {
+        CLOSED,
+        OPEN,
+        HALF_OPEN
+    };
+
+    CircuitBreaker();
+
+    // True if a request may be sent now; in half-open only one at a time
+    bool allow(uint32_t now_ms);
+
+    void onSuccess();
+    // retry_after_ms from a rate-limit response holds every request that long
+    void onFailure(uint32_t now_ms, uint32_t retry_after_ms = 0);
+
+    State state() const { return current; }
+    // When an open breaker lets the next probe through
+    uint32_t reopensAt() const { return open_until_ms; }
+    uint32_t opens() const { return open_count; }
+
+    static const char *stateName(State state);
+
+private:
+    void open(uint32_t now_ms, uint32_t duration_ms);
+
+    State current;
+    uint32_t consecutive_failures;
+    uint32_t cooldown_ms;
+    uint32_t open_until_ms;
+    uint32_t open_count;
+    bool probe_in_flight;
+};
+
+#endif // OUTBOX_POLICY_H
@@ -0,0 +1,405 @@
+#include "overlay_pipeline.h"
+#include "camera_setup.h"
+#include "fb_gfx.h"
+#include "img_converters.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/event_groups.h"
+#include <time.h>
+
+// Toggled per published frame: waiters for frame n+1 block on the bit the
+// previous frame cleared, so none of them can see a stale "new frame" signal
+#define FRAME_BIT(seq) (1 << ((seq) & 1))
+
+#define OVERLAY_WAIT_MS 2000
+#define OVERLAY_BAR_HEIGHT 26
+
+struct OverlaySlot
+{
+  camera_fb_t fb; // what consumers receive
+  uint8_t *buf;
+  size_t len;
+  bool overflow;
+  int refs; // -1 while the encoder fills the slot
+};
+
+static OverlaySlot slots[OVERLAY_SLOTS];
+static portMUX_TYPE overlay_mux = portMUX_INITIALIZER_UNLOCKED;
+static EventGroupHandle_t frame_events = NULL;
+static TaskHandle_t overlay_task = NULL;
+
+static volatile bool active = false;  // consumers are routed through the overlay
+static volatile bool running = false; // the encoder publishes frames
+static int latest = -1;
+static volatile uint32_t published = 0;
+static volatile uint32_t last_request_ms = 0;
+
+static char device[32] = "ESP32-CAM";
+static volatile uint8_t quality = OVERLAY_QUALITY;
+static volatile uint8_t fps = OVERLAY_FPS;
+
+static uint32_t frames_encoded = 0;
+static uint32_t frames_dropped = 0;
+static uint64_t draw_us_total = 0;
+static uint64_t encode_us_total = 0;
+static uint32_t last_jpeg_bytes = 0;
+
+static void drawOverlay(camera_fb_t *raw)
+{
+  fb_data_t fbd;
+  fbd.width = raw->width;
+  fbd.height = raw->height;
+  fbd.bytes_per_pixel = 2;
+  fbd.format = FB_RGB565;
+  fbd.data = raw->buf;
+
+  char when[24];
+  time_t now = time(nullptr);
+  if (now >= 8 * 3600 * 2)
+  {
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&now));
+  }
+  else
+  {
+    // No NTP time yet
+    snprintf(when, sizeof(when), "up %lus", millis() / 1000);
+  }
+
+  char text[64];
+  snprintf(text, sizeof(text), "%s  %s", device, when);
+  fb_gfx_fillRect(&fbd, 0, 0, fbd.width, OVERLAY_BAR_HEIGHT, 0x0000);
+  fb_gfx_print(&fbd, 4, 4, 0xFFFF, text);
+}
+
+static size_t writeJpeg(void *arg, size_t index, const void *data, size_t len)
+{
+  OverlaySlot *slot = (OverlaySlot *)arg;
+  if (!data || len == 0)
+  {
+    return 0;
+  }
+  if (index + len > OVERLAY_JPEG_CAPACITY)
+  {
+    slot->overflow = true;
+    return 0;
+  }
+  memcpy(slot->buf + index, data, len);
+  slot->len = index + len;
+  return len;
+}
+
+static int claimSlot()
+{
+  int slot = -1;
+  portENTER_CRITICAL(&overlay_mux);
+  for (int i = 0; i < OVERLAY_SLOTS; i++)
+  {
+    if (i != latest && slots[i].refs == 0)
+    {
+      slots[i].refs = -1;
+      slot = i;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&overlay_mux);
+  return slot;
+}
+
+static void publish(int slot, bool ok)
+{
+  uint32_t seq = 0;
+  portENTER_CRITICAL(&overlay_mux);
+  slots[slot].refs = 0;
+  if (ok)
+  {
+    latest = slot;
+    seq = ++published;
+  }
+  portEXIT_CRITICAL(&overlay_mux);
+
+  if (ok)
+  {
+    xEventGroupClearBits(frame_events, FRAME_BIT(seq + 1));
+    xEventGroupSetBits(frame_events, FRAME_BIT(seq));
+  }
+}
+
+static void overlayTask(void *arg)
+{
+  TickType_t last_wake = xTaskGetTickCount();
+  while (true)
+  {
+    if (!running)
+    {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      last_wake = xTaskGetTickCount();
+      continue;
+    }
+    if (millis() - last_request_ms > OVERLAY_IDLE_MS)
+    {
+      // Nobody is watching; keep the sensor and this core free
+      vTaskDelay(pdMS_TO_TICKS(20));
+      last_wake = xTaskGetTickCount();
+      continue;
+    }
+
+    camera_fb_t *raw = sensorCapture();
+    if (!raw)
+    {
+      vTaskDelay(pdMS_TO_TICKS(100));
+      continue;
+    }
+    if (raw->format != PIXFORMAT_RGB565)
+    {
+      // Left over from before the format switch
+      sensorRelease(raw);
+      continue;
+    }
+
+    int slot = claimSlot();
+    if (slot < 0)
+    {
+      // Every slot is still being sent
+      frames_dropped++;
+      sensorRelease(raw);
+      vTaskDelay(1);
+      continue;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    drawOverlay(raw);
+    int64_t t1 = esp_timer_get_time();
+
+    OverlaySlot &s = slots[slot];
+    s.len = 0;
+    s.overflow = false;
+    bool ok = frame2jpg_cb(raw, quality, writeJpeg, &s) && !s.overflow && s.len > 0;
+    int64_t t2 = esp_timer_get_time();
+
+    s.fb.buf = s.buf;
+    s.fb.len = s.len;
+    s.fb.width = raw->width;
+    s.fb.height = raw->height;
+    s.fb.format = PIXFORMAT_JPEG;
+    s.fb.timestamp = raw->timestamp;
+    sensorRelease(raw);
+    publish(slot, ok);
+
+    if (ok)
+    {
+      frames_encoded++;
+      draw_us_total += t1 - t0;
+      encode_us_total += t2 - t1;
+      last_jpeg_bytes = s.len;
+    }
+    else
+    {
+      frames_dropped++;
+    }
+
+    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(1000 / max((int)fps, 1)));
+  }
+}
+
+bool overlayCapture(camera_fb_t **fb)
+{
+  if (!active)
+  {
+    return false;
+  }
+
+  last_request_ms = millis();
+  uint32_t start_seq = published;
+  uint32_t start_ms = millis();
+  while (active)
+  {
+    // The next frame published after this call
+    xEventGroupWaitBits(frame_events, FRAME_BIT(start_seq + 1), pdFALSE, pdFALSE, pdMS_TO_TICKS(100));
+
+    portENTER_CRITICAL(&overlay_mux);
+    bool fresh = published != start_seq && latest >= 0;
+    if (fresh)
+    {
+      slots[latest].refs++;
+      *fb = &slots[latest].fb;
+    }
+    portEXIT_CRITICAL(&overlay_mux);
+    if (fresh)
+    {
+      return true;
+    }
+
+    if (millis() - start_ms > OVERLAY_WAIT_MS)
+    {
+      *fb = NULL;
+      return true;
+    }
+    last_request_ms = millis();
+  }
+
+  // Switched off while waiting: fall back to the direct path
+  return false;
+}
+
+bool overlayRelease(camera_fb_t *fb)
+{
+  for (int i = 0; i < OVERLAY_SLOTS; i++)
+  {
+    if (fb == &slots[i].fb)
+    {
+      portENTER_CRITICAL(&overlay_mux);
+      slots[i].refs--;
+      portEXIT_CRITICAL(&overlay_mux);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool setOverlayEnabled(bool enabled)
+{
+  if (enabled == active)
+  {
+    return true;
+  }
+
+  if (enabled)
+  {
+    for (int i = 0; i < OVERLAY_SLOTS; i++)
+    {
+      if (!slots[i].buf)
+      {
+        slots[i].buf = (uint8_t *)heap_caps_malloc(OVERLAY_JPEG_CAPACITY, MALLOC_CAP_SPIRAM);
+        if (!slots[i].buf)
+        {
+          Logger::getInstance().error("Overlay needs PSRAM for its frame slots");
+          return false;
+        }
+      }
+    }
+
+    xEventGroupClearBits(frame_events, FRAME_BIT(0) | FRAME_BIT(1));
+    latest = -1;
+    last_request_ms = millis();
+    // Consumers wait for encoded frames from here on
+    active = true;
+    if (!setCameraPixelFormat(PIXFORMAT_RGB565))
+    {
+      active = false;
+      return false;
+    }
+    running = true;
+    xTaskNotifyGive(overlay_task);
+    Logger::getInstance().info("Overlay enabled (quality " + String(quality) + ", " + String(fps) + " fps)");
+    return true;
+  }
+
+  // The restart waits for the encoder to hand back its raw frame
+  running = false;
+  bool ok = setCameraPixelFormat(PIXFORMAT_JPEG);
+  active = false;
+  // Wake consumers still waiting so they take the direct path
+  xEventGroupSetBits(frame_events, FRAME_BIT(0) | FRAME_BIT(1));
+  Logger::getInstance().info("Overlay disabled");
+  return ok;
+}
+
+bool isOverlayEnabled()
+{
+  return active;
+}
+
+void setOverlayQuality(uint8_t q)
+{
+  quality = constrain(q, 1, 63);
+}
+
+uint8_t getOverlayQuality()
+{
+  return quality;
+}
+
+void setOverlayFps(uint8_t f)
+{
+  fps = constrain(f, 1, 30);
+}
+
+uint8_t getOverlayFps()
+{
+  return fps;
+}
+
+static float measureCaptures(int frames, uint32_t &avg_bytes)
+{
+  uint64_t bytes = 0;
+  int got = 0;
+  int64_t start = esp_timer_get_time();
+  for (int i = 0; i < frames; i++)
+  {
+    camera_fb_t *fb = cameraCapture();
+    if (fb)
+    {
+      bytes += fb->len;
+      got++;
+      cameraRelease(fb);
+    }
+  }
+  int64_t elapsed = esp_timer_get_time() - start;
+  avg_bytes = got ? bytes / got : 0;
+  return elapsed > 0 ? got * 1000000.0f / elapsed : 0;
+}
+
+bool runOverlayBenchmark(int frames, OverlayBenchmark &result)
+{
+  if (active)
+  {
+    return false;
+  }
+
+  result.direct_fps = measureCaptures(frames, result.direct_bytes);
+
+  if (!setOverlayEnabled(true))
+  {
+    return false;
+  }
+  // Let the pipeline fill before timing it
+  uint32_t ignored;
+  measureCaptures(2, ignored);
+
+  uint32_t frames_before = frames_encoded;
+  uint64_t draw_before = draw_us_total;
+  uint64_t encode_before = encode_us_total;
+  result.overlay_fps = measureCaptures(frames, result.overlay_bytes);
+  uint32_t encoded = frames_encoded - frames_before;
+  result.draw_us = encoded ? (draw_us_total - draw_before) / encoded : 0;
+  result.encode_us = encoded ? (encode_us_total - encode_before) / encoded : 0;
+
+  setOverlayEnabled(false);
+  Logger::getInstance().info("Overlay benchmark: direct " + String(result.direct_fps, 1) + " fps, overlay " +
+                             String(result.overlay_fps, 1) + " fps (draw " + String(result.draw_us) + " us, encode " +
+                             String(result.encode_us) + " us)");
+  return true;
+}
+
+static void addOverlayStats(JsonDocument &stats)
+{
+  stats["overlay_enabled"] = (bool)active;
+  if (frames_encoded)
+  {
+    stats["overlay_frames"] = frames_encoded;
+    stats["overlay_dropped"] = frames_dropped;
+    stats["overlay_draw_us"] = (uint32_t)(draw_us_total / frames_encoded);
+    stats["overlay_encode_us"] = (uint32_t)(encode_us_total / frames_encoded);
+    stats["overlay_jpeg_bytes"] = last_jpeg_bytes;
+  }
+}
+
+void startOverlayPipeline(const char *device_name)
+{
+  strlcpy(device, device_name, sizeof(device));
+  frame_events = xEventGroupCreate();
+  Logger::getInstance().addStatsProvider(addOverlayStats);
+
+  // Encoding is pure CPU work; keep it off the core that runs Wi-Fi
+  xTaskCreatePinnedToCore(overlayTask, "overlay", 6144, NULL, 4, &overlay_task, OVERLAY_CORE);
+}
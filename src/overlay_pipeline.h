@@ -0,0 +1,66 @@
+#ifndef OVERLAY_PIPELINE_H
+#define OVERLAY_PIPELINE_H
+
+#include <Arduino.h>
+#include "esp_camera.h"
+#include "logger.h"
+
+// JPEG quality (0-63, lower is better) and frame rate cap of overlaid frames
+#ifndef OVERLAY_QUALITY
+#define OVERLAY_QUALITY 12
+#endif
+#ifndef OVERLAY_FPS
+#define OVERLAY_FPS 10
+#endif
+
+// Encoded frames in flight: one being encoded, the rest being sent
+#ifndef OVERLAY_SLOTS
+#define OVERLAY_SLOTS 3
+#endif
+#ifndef OVERLAY_JPEG_CAPACITY
+#define OVERLAY_JPEG_CAPACITY (128 * 1024)
+#endif
+
+// Encoder core; Wi-Fi and lwIP run on core 0
+#ifndef OVERLAY_CORE
+#define OVERLAY_CORE 1
+#endif
+
+// The encoder stops capturing when nobody asked for a frame this long
+#ifndef OVERLAY_IDLE_MS
+#define OVERLAY_IDLE_MS 2000
+#endif
+
+// Creates the (idle) encoder task; device_name is drawn next to the time
+void startOverlayPipeline(const char *device_name);
+
+// Switches the sensor to RGB565 and routes cameraCapture() through the
+// encoder, or back to the direct JPEG path. Restarts the camera driver.
+bool setOverlayEnabled(bool enabled);
+bool isOverlayEnabled();
+
+void setOverlayQuality(uint8_t quality);
+uint8_t getOverlayQuality();
+void setOverlayFps(uint8_t fps);
+uint8_t getOverlayFps();
+
+struct OverlayBenchmark
+{
+  float direct_fps;
+  float overlay_fps;
+  uint32_t direct_bytes;  // average JPEG size
+  uint32_t overlay_bytes;
+  uint32_t draw_us;       // average per overlaid frame
+  uint32_t encode_us;
+};
+
+// Captures `frames` frames through the direct path, then through the
+// overlay, and compares them. The overlay must be off when called.
+bool runOverlayBenchmark(int frames, OverlayBenchmark &result);
+
+// cameraCapture()/cameraRelease() hooks. overlayCapture returns false when
+// the overlay is off; overlayRelease returns false for frames it does not own.
+bool overlayCapture(camera_fb_t **fb);
+bool overlayRelease(camera_fb_t *fb);
+
+#endif // OVERLAY_PIPELINE_H
@@ -0,0 +1,302 @@
+#include "power_governor.h"
+#include "camera_setup.h"
+#include "esp_wifi.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "esp_sleep.h"
+#include "trace.h"
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
+static const char *state_names[POWER_STATE_COUNT] = {"active", "idle", "standby", "sleep"};
+static const uint16_t state_ma[POWER_STATE_COUNT] = {GOVERNOR_ACTIVE_MA, GOVERNOR_IDLE_MA, GOVERNOR_STANDBY_MA,
+                                                       GOVERNOR_SLEEP_MA};
+
+static SemaphoreHandle_t governor_lock = NULL;
+static volatile PowerState state = POWER_ACTIVE;
+static int demand[DEMAND_COUNT];
+static volatile uint32_t last_activity_ms = 0;
+
+// Residency per state, for the energy estimate
+static uint32_t state_entered_ms = 0;
+static uint64_t state_time_ms[POWER_STATE_COUNT];
+
+// Wake-latency measurement: set on wake, cleared by the first fresh frame
+static volatile int64_t wake_started_us = 0;
+static int64_t sensor_woken_us = 0;
+static uint32_t last_wake_latency_ms = 0;
+static uint32_t max_wake_latency_ms = 0;
+static uint32_t wakes = 0;
+static volatile bool wake_report_pending = false;
+static uint32_t light_sleeps = 0;
+
+static void setCpuMhz(uint32_t mhz)
+{
+#if CONFIG_PM_ENABLE
+  // With the PM component, DFS may still drop below this when everything is idle
+  esp_pm_config_esp32_t pm = {};
+  pm.max_freq_mhz = mhz;
+  pm.min_freq_mhz = GOVERNOR_IDLE_CPU_MHZ;
+  pm.light_sleep_enable = false;
+  esp_err_t err = esp_pm_configure(&pm);
+  if (err == ESP_OK)
+  {
+    // DFS switches the clock on its own from here, so the cycle counter
+    // cannot be converted with a single factor
+    traceUseTimerClock(pm.max_freq_mhz != pm.min_freq_mhz);
+    traceClockChanged();
+    return;
+  }
+#endif
+  traceUseTimerClock(false);
+  setCpuFrequencyMhz(mhz);
+  // The cycle counter runs at the new clock from here on
+  traceClockChanged();
+}
+
+static void setSensorPower(bool on)
+{
+  if (PWDN_GPIO_NUM >= 0)
+  {
+    // PWDN is active high; the OV2640 keeps its registers in power-down
+    gpio_set_level((gpio_num_t)PWDN_GPIO_NUM, on ? 0 : 1);
+  }
+}
+
+// Caller holds governor_lock. Returns the previous state; logging is left to
+// the caller so a slow log sink never sits inside the wake path.
+static PowerState enterState(PowerState next)
+{
+  PowerState prev = state;
+  if (next == prev)
+  {
+    return prev;
+  }
+
+  uint32_t now = millis();
+  state_time_ms[prev] += now - state_entered_ms;
+  state_entered_ms = now;
+
+  if (next == POWER_ACTIVE)
+  {
+    setCpuMhz(GOVERNOR_ACTIVE_CPU_MHZ);
+    esp_wifi_set_ps(WIFI_PS_NONE);
+  }
+  else if (prev == POWER_ACTIVE)
+  {
+    setCpuMhz(GOVERNOR_IDLE_CPU_MHZ);
+    esp_wifi_set_ps(WIFI_PS_MIN_MODEM);
+  }
+
+  // The sensor is powered in active and idle only
+  bool sensor_on = next < POWER_STANDBY;
+  if (sensor_on != (prev < POWER_STANDBY))
+  {
+    setSensorPower(sensor_on);
+  }
+
+  state = next;
+  return prev;
+}
+
+static void logTransition(PowerState prev, PowerState next)
+{
+  if (prev != next)
+  {
+    Logger::getInstance().infof("Power state: %s -> %s (~%u mA)", state_names[prev], state_names[next],
+                                (unsigned)state_ma[next]);
+  }
+}
+
+static PowerState wake()
+{
+  if (state == POWER_STANDBY)
+  {
+    // Anything captured before this instant predates the power-down
+    sensor_woken_us = esp_timer_get_time();
+    wake_started_us = sensor_woken_us;
+  }
+  return enterState(POWER_ACTIVE);
+}
+
+void powerDemandBegin(PowerDemand kind)
+{
+  if (!governor_lock)
+  {
+    return;
+  }
+  xSemaphoreTake(governor_lock, portMAX_DELAY);
+  demand[kind]++;
+  last_activity_ms = millis();
+  PowerState prev = wake();
+  xSemaphoreGive(governor_lock);
+  logTransition(prev, POWER_ACTIVE);
+}
+
+void powerDemandEnd(PowerDemand kind)
+{
+  if (!governor_lock)
+  {
+    return;
+  }
+  xSemaphoreTake(governor_lock, portMAX_DELAY);
+  if (demand[kind] > 0)
+  {
+    demand[kind]--;
+  }
+  last_activity_ms = millis();
+  xSemaphoreGive(governor_lock);
+}
+
+void powerEnsureSensorAwake()
+{
+  last_activity_ms = millis();
+  if (state != POWER_STANDBY || !governor_lock)
+  {
+    return;
+  }
+  xSemaphoreTake(governor_lock, portMAX_DELAY);
+  PowerState prev = wake();
+  xSemaphoreGive(governor_lock);
+  logTransition(prev, POWER_ACTIVE);
+}
+
+bool powerFrameIsFresh(const camera_fb_t *fb)
+{
+  int64_t started = wake_started_us;
+  if (!started)
+  {
+    return true;
+  }
+
+  // Buffers filled before power-down are still queued; skip them
+  int64_t frame_us = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+  if (frame_us < sensor_woken_us)
+  {
+    return false;
+  }
+
+  uint32_t latency_ms = (uint32_t)((esp_timer_get_time() - started) / 1000);
+  wake_started_us = 0;
+  last_wake_latency_ms = latency_ms;
+  if (latency_ms > max_wake_latency_ms)
+  {
+    max_wake_latency_ms = latency_ms;
+  }
+  wakes++;
+  // Reported by the governor task, not on the capture path
+  wake_report_pending = true;
+  return true;
+}
+
+PowerState getPowerState()
+{
+  return state;
+}
+
+uint32_t powerLightSleep(uint32_t duration_ms)
+{
+  if (!governor_lock)
+  {
+    return 0;
+  }
+  // Held across the sleep so the governor task cannot change state meanwhile
+  xSemaphoreTake(governor_lock, portMAX_DELAY);
+  if (demand[DEMAND_STREAM] > 0 || demand[DEMAND_JOB] > 0)
+  {
+    xSemaphoreGive(governor_lock);
+    return 0;
+  }
+  enterState(POWER_SLEEP);
+
+  // PSRAM sits on VDD_SDIO; keep it powered so queued frames survive
+  esp_sleep_pd_config(ESP_PD_DOMAIN_VDDSDIO, ESP_PD_OPTION_ON);
+  esp_sleep_enable_timer_wakeup((uint64_t)duration_ms * 1000);
+  int64_t start = esp_timer_get_time();
+  esp_err_t err = esp_light_sleep_start();
+  uint32_t slept_ms = (uint32_t)((esp_timer_get_time() - start) / 1000);
+  traceClockChanged();
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+
+  enterState(POWER_STANDBY);
+  if (err == ESP_OK)
+  {
+    light_sleeps++;
+  }
+  xSemaphoreGive(governor_lock);
+  return err == ESP_OK ? slept_ms : 0;
+}
+
+static void addPowerStats(JsonDocument &stats)
+{
+  uint32_t now = millis();
+  PowerState current = state;
+  uint64_t total_ms = 0;
+  uint64_t ma_ms = 0;
+  for (int i = 0; i < POWER_STATE_COUNT; i++)
+  {
+    uint64_t ms = state_time_ms[i] + (i == current ? now - state_entered_ms : 0);
+    total_ms += ms;
+    ma_ms += ms * state_ma[i];
+  }
+
+  stats["power_state"] = state_names[current];
+  stats["power_est_ma"] = state_ma[current];
+  stats["power_avg_ma"] = total_ms ? (uint32_t)(ma_ms / total_ms) : 0;
+  stats["power_est_mah"] = (float)ma_ms / 3600000.0f;
+  stats["power_stream_clients"] = demand[DEMAND_STREAM];
+  stats["power_jobs"] = demand[DEMAND_JOB];
+  stats["wake_count"] = wakes;
+  stats["light_sleeps"] = light_sleeps;
+  stats["wake_latency_ms"] = last_wake_latency_ms;
+  stats["wake_latency_max_ms"] = max_wake_latency_ms;
+}
+
+static void governorTask(void *arg)
+{
+  while (true)
+  {
+    vTaskDelay(pdMS_TO_TICKS(500));
+
+    if (wake_report_pending)
+    {
+      wake_report_pending = false;
+      Logger::getInstance().infof("Woke from standby, first frame after %lu ms", (unsigned long)last_wake_latency_ms);
+    }
+
+    xSemaphoreTake(governor_lock, portMAX_DELAY);
+    bool demanded = demand[DEMAND_STREAM] > 0 || demand[DEMAND_JOB] > 0;
+    uint32_t quiet_ms = millis() - last_activity_ms;
+    PowerState prev = state;
+    PowerState next = prev;
+    if (!demanded)
+    {
+      if (quiet_ms >= GOVERNOR_STANDBY_DELAY_MS)
+      {
+        next = POWER_STANDBY;
+      }
+      else if (quiet_ms >= GOVERNOR_IDLE_DELAY_MS && prev == POWER_ACTIVE)
+      {
+        next = POWER_IDLE;
+      }
+    }
+    enterState(next);
+    xSemaphoreGive(governor_lock);
+    logTransition(prev, next);
+  }
+}
+
+void startPowerGovernor()
+{
+  governor_lock = xSemaphoreCreateMutex();
+  last_activity_ms = millis();
+  state_entered_ms = millis();
+
+  // Boot runs at full speed with the sensor on; make that explicit
+  setCpuMhz(GOVERNOR_ACTIVE_CPU_MHZ);
+  esp_wifi_set_ps(WIFI_PS_NONE);
+
+  Logger::getInstance().addStatsProvider(addPowerStats);
+  xTaskCreate(governorTask, "governor", 3072, NULL, 2, NULL);
+}
@@ -0,0 +1,78 @@
+#ifndef POWER_GOVERNOR_H
+#define POWER_GOVERNOR_H
+
+#include <Arduino.h>
+#include "esp_camera.h"
+#include "logger.h"
+
+// No demand for this long drops CPU clock and enables Wi-Fi modem sleep
+#ifndef GOVERNOR_IDLE_DELAY_MS
+#define GOVERNOR_IDLE_DELAY_MS 5000
+#endif
+
+// No demand for this long also puts the sensor into power-down
+#ifndef GOVERNOR_STANDBY_DELAY_MS
+#define GOVERNOR_STANDBY_DELAY_MS 60000
+#endif
+
+#ifndef GOVERNOR_ACTIVE_CPU_MHZ
+#define GOVERNOR_ACTIVE_CPU_MHZ 240
+#endif
+#ifndef GOVERNOR_IDLE_CPU_MHZ
+#define GOVERNOR_IDLE_CPU_MHZ 80
+#endif
+
+// Rough board current per state at 5 V, used for the energy estimate
+#ifndef GOVERNOR_ACTIVE_MA
+#define GOVERNOR_ACTIVE_MA 240
+#endif
+#ifndef GOVERNOR_IDLE_MA
+#define GOVERNOR_IDLE_MA 120
+#endif
+#ifndef GOVERNOR_STANDBY_MA
+#define GOVERNOR_STANDBY_MA 85
+#endif
+#ifndef GOVERNOR_SLEEP_MA
+#define GOVERNOR_SLEEP_MA 8
+#endif
+
+enum PowerState
+{
+  POWER_ACTIVE = 0,
+  POWER_IDLE,
+  POWER_STANDBY,
+  POWER_SLEEP, // light sleep, only inside powerLightSleep()
+  POWER_STATE_COUNT
+};
+
+enum PowerDemand
+{
+  DEMAND_STREAM = 0, // a viewer is connected
+  DEMAND_JOB,        // an upload or recording is pending
+  DEMAND_COUNT
+};
+
+// Declares work that needs full performance. The first demand wakes the
+// device synchronously, so the caller can capture right after it returns.
+void powerDemandBegin(PowerDemand kind);
+void powerDemandEnd(PowerDemand kind);
+
+// Called by cameraCapture(): wakes the sensor if a capture arrives while in
+// standby. powerFrameIsFresh() rejects frames queued before the power-down and
+// closes the wake-latency measurement on the first fresh one.
+void powerEnsureSensorAwake();
+bool powerFrameIsFresh(const camera_fb_t *fb);
+
+PowerState getPowerState();
+
+// Light-sleeps the whole chip for duration_ms with the sensor powered down
+// and PSRAM retained; Wi-Fi should be stopped first. Returns the time slept,
+// or 0 without sleeping while any demand is held (e.g. a stream viewer).
+// The device wakes in standby, so the next powerDemandBegin() powers the
+// sensor up again.
+uint32_t powerLightSleep(uint32_t duration_ms);
+
+// Starts the governor task that steps down after the idle delays
+void startPowerGovernor();
+
+#endif // POWER_GOVERNOR_H
@@ -0,0 +1,550 @@
+#include "rtsp_server.h"
+#include "lwip/sockets.h"
+#include "esp_system.h"
+#include <strings.h>
+#include "esp_timer.h"
+#include "power_governor.h"
+#include "wifi_link.h"
+
+#define RTP_PT_JPEG 26
+#define RTP_HEADER_LEN 12
+#define RTP_JPEG_HEADER_LEN 8
+#define RTP_RESTART_HEADER_LEN 4
+#define RTP_QTABLE_HEADER_LEN 4
+
+// Parsed view into a baseline JPEG, pointing into the frame buffer
+struct JpegScan
+{
+  uint16_t width;
+  uint16_t height;
+  uint8_t type;               // RFC 2435 type: 0 = 4:2:2, 1 = 4:2:0
+  uint16_t restart_interval;  // 0 when the frame has no DRI segment
+  const uint8_t *qtables[2];  // 64-byte luma and chroma tables
+  const uint8_t *data;        // entropy-coded scan data
+  size_t data_len;
+};
+
+struct RtspSession
+{
+  int sock;
+  uint32_t id;
+  bool set_up; // SETUP gave rtp_addr; PLAY is refused before that
+  bool playing;
+  uint32_t last_request_ms; // for RTSP_SESSION_TIMEOUT_S
+  struct sockaddr_in rtp_addr;
+  char rx[512];
+  size_t rx_len;
+};
+
+static RtspSession sessions[RTSP_MAX_SESSIONS];
+static int rtp_sock = -1;
+static uint16_t rtp_seq = 0;
+static uint32_t rtp_ssrc = 0;
+static uint8_t rtp_packet[RTSP_MTU];
+
+// Walks the JPEG markers up to SOS and collects what RFC 2435 carries out of band
+static bool parseJpeg(const uint8_t *buf, size_t len, JpegScan &out)
+{
+  memset(&out, 0, sizeof(out));
+  if (len < 4 || buf[0] != 0xFF || buf[1] != 0xD8)
+  {
+    return false;
+  }
+
+  bool have_sof = false;
+  size_t pos = 2;
+  while (pos + 4 <= len)
+  {
+    if (buf[pos] != 0xFF)
+    {
+      return false;
+    }
+
+    uint8_t marker = buf[pos + 1];
+    if (marker == 0xFF)
+    {
+      // Fill byte before a marker
+      pos++;
+      continue;
+    }
+
+    size_t seglen = (buf[pos + 2] << 8) | buf[pos + 3];
+    const uint8_t *seg = buf + pos + 4;
+    size_t seg_end = pos + 2 + seglen;
+    if (seglen < 2 || seg_end > len)
+    {
+      return false;
+    }
+
+    switch (marker)
+    {
+    case 0xDB: // DQT, possibly several tables per segment
+      for (size_t p = 0; p + 65 <= seglen - 2; p += 65)
+      {
+        if ((seg[p] >> 4) != 0)
+        {
+          return false; // 16-bit tables are not representable with Q=255
+        }
+        uint8_t tq = seg[p] & 0x0F;
+        if (tq < 2)
+        {
+          out.qtables[tq] = seg + p + 1;
+        }
+      }
+      break;
+
+    case 0xC0: // SOF0, baseline only
+      if (seglen < 17 || seg[5] != 3)
+      {
+        return false;
+      }
+      out.height = (seg[1] << 8) | seg[2];
+      out.width = (seg[3] << 8) | seg[4];
+      if (seg[7] == 0x21)
+      {
+        out.type = 0;
+      }
+      else if (seg[7] == 0x22)
+      {
+        out.type = 1;
+      }
+      else
+      {
+        return false;
+      }
+      if (seg[10] != 0x11 || seg[13] != 0x11)
+      {
+        return false;
+      }
+      have_sof = true;
+      break;
+
+    case 0xDD: // DRI
+      out.restart_interval = (seg[0] << 8) | seg[1];
+      break;
+
+    case 0xDA: // SOS, scan data follows the header up to EOI
+    {
+      size_t end = len;
+      while (end > seg_end + 2 && !(buf[end - 2] == 0xFF && buf[end - 1] == 0xD9))
+      {
+        end--; // driver buffers may carry padding after EOI
+      }
+      if (end <= seg_end + 2)
+      {
+        return false;
+      }
+      out.data = buf + seg_end;
+      out.data_len = end - 2 - seg_end;
+      return have_sof && out.qtables[0] && out.qtables[1] &&
+             out.width <= 2040 && out.height <= 2040;
+    }
+
+    default:
+      if (marker >= 0xC1 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+      {
+        return false; // progressive / lossless / arithmetic coding
+      }
+      break;
+    }
+
+    pos = seg_end;
+  }
+
+  return false;
+}
+
+static void sendToPlayingSessions(const uint8_t *pkt, size_t len)
+{
+  for (int i = 0; i < RTSP_MAX_SESSIONS; i++)
+  {
+    if (sessions[i].sock >= 0 && sessions[i].playing)
+    {
+      sendto(rtp_sock, pkt, len, 0, (struct sockaddr *)&sessions[i].rtp_addr, sizeof(sessions[i].rtp_addr));
+    }
+  }
+}
+
+// Fragments one frame into RTP/JPEG packets; each packet is built once and
+// sent to every playing session.
+static void sendRtpFrame(const JpegScan &jpg, uint32_t timestamp)
+{
+  size_t offset = 0;
+  while (offset < jpg.data_len)
+  {
+    uint8_t *p = rtp_packet;
+
+    // RTP header, marker bit set on the last fragment
+    p[0] = 0x80;
+    p[1] = RTP_PT_JPEG;
+    p[2] = rtp_seq >> 8;
+    p[3] = rtp_seq & 0xFF;
+    p[4] = timestamp >> 24;
+    p[5] = timestamp >> 16;
+    p[6] = timestamp >> 8;
+    p[7] = timestamp & 0xFF;
+    p[8] = rtp_ssrc >> 24;
+    p[9] = rtp_ssrc >> 16;
+    p[10] = rtp_ssrc >> 8;
+    p[11] = rtp_ssrc & 0xFF;
+    p += RTP_HEADER_LEN;
+
+    // JPEG header, Q=255 means quantization tables are sent in-band
+    p[0] = 0;
+    p[1] = offset >> 16;
+    p[2] = offset >> 8;
+    p[3] = offset & 0xFF;
+    p[4] = jpg.type | (jpg.restart_interval ? 64 : 0);
+    p[5] = 255;
+    p[6] = jpg.width / 8;
+    p[7] = jpg.height / 8;
+    p += RTP_JPEG_HEADER_LEN;
+
+    if (jpg.restart_interval)
+    {
+      p[0] = jpg.restart_interval >> 8;
+      p[1] = jpg.restart_interval & 0xFF;
+      p[2] = 0xFF; // F=1, L=1, restart count 0x3FFF
+      p[3] = 0xFF;
+      p += RTP_RESTART_HEADER_LEN;
+    }
+
+    if (offset == 0)
+    {
+      p[0] = 0;   // MBZ
+      p[1] = 0;   // 8-bit precision for both tables
+      p[2] = 0;
+      p[3] = 128; // two 64-byte tables
+      memcpy(p + 4, jpg.qtables[0], 64);
+      memcpy(p + 4 + 64, jpg.qtables[1], 64);
+      p += RTP_QTABLE_HEADER_LEN + 128;
+    }
+
+    size_t header_len = p - rtp_packet;
+    size_t chunk = min((size_t)(RTSP_MTU - header_len), jpg.data_len - offset);
+    memcpy(p, jpg.data + offset, chunk);
+    offset += chunk;
+
+    if (offset >= jpg.data_len)
+    {
+      rtp_packet[1] |= 0x80;
+    }
+
+    sendToPlayingSessions(rtp_packet, header_len + chunk);
+    rtp_seq++;
+  }
+}
+
+// Case-insensitive lookup of a header value in a request; returns NULL if absent
+static const char *findHeader(const char *req, const char *name, char *value, size_t value_len)
+{
+  size_t name_len = strlen(name);
+  const char *line = strstr(req, "\r\n");
+  while (line)
+  {
+    line += 2;
+    if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':')
+    {
+      const char *v = line + name_len + 1;
+      while (*v == ' ')
+      {
+        v++;
+      }
+      size_t n = strcspn(v, "\r\n");
+      n = min(n, value_len - 1);
+      memcpy(value, v, n);
+      value[n] = '\0';
+      return value;
+    }
+    line = strstr(line, "\r\n");
+  }
+  return NULL;
+}
+
+static void sendResponse(RtspSession &s, int cseq, const char *status, const char *headers, const char *body)
+{
+  char resp[768];
+  size_t body_len = body ? strlen(body) : 0;
+  int n = snprintf(resp, sizeof(resp), "RTSP/1.0 %s\r\nCSeq: %d\r\n%s", status, cseq, headers ? headers : "");
+  if (body_len)
+  {
+    n += snprintf(resp + n, sizeof(resp) - n, "Content-Length: %u\r\n\r\n%s", (unsigned)body_len, body);
+  }
+  else
+  {
+    n += snprintf(resp + n, sizeof(resp) - n, "\r\n");
+  }
+  send(s.sock, resp, min(n, (int)sizeof(resp) - 1), 0);
+}
+
+// Each playing session counts as a stream client for the power governor
+static void setPlaying(RtspSession &s, bool playing)
+{
+  if (playing != s.playing)
+  {
+    playing ? powerDemandBegin(DEMAND_STREAM) : powerDemandEnd(DEMAND_STREAM);
+  }
+  s.playing = playing;
+}
+
+static void handleRequest(RtspSession &s, const char *req)
+{
+  char method[16] = {0};
+  char uri[128] = {0};
+  char value[128];
+  char headers[256];
+
+  sscanf(req, "%15s %127s", method, uri);
+  int cseq = findHeader(req, "CSeq", value, sizeof(value)) ? atoi(value) : 0;
+  // Any request counts as a keep-alive
+  s.last_request_ms = millis();
+
+  if (strcmp(method, "OPTIONS") == 0)
+  {
+    sendResponse(s, cseq, "200 OK", "Public: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN, GET_PARAMETER\r\n", NULL);
+  }
+  else if (strcmp(method, "GET_PARAMETER") == 0)
+  {
+    // The usual keep-alive; no parameters are reported
+    snprintf(headers, sizeof(headers), "Session: %08X\r\n", (unsigned)s.id);
+    sendResponse(s, cseq, "200 OK", headers, NULL);
+  }
+  else if (strcmp(method, "DESCRIBE") == 0)
+  {
+    struct sockaddr_in local;
+    socklen_t local_len = sizeof(local);
+    getsockname(s.sock, (struct sockaddr *)&local, &local_len);
+    char ip[16];
+    inet_ntoa_r(local.sin_addr, ip, sizeof(ip));
+
+    char sdp[256];
+    snprintf(sdp, sizeof(sdp),
+             "v=0\r\no=- %u 1 IN IP4 %s\r\ns=ESP32-CAM\r\nt=0 0\r\n"
+             "m=video 0 RTP/AVP %d\r\nc=IN IP4 0.0.0.0\r\na=control:track1\r\n",
+             (unsigned)rtp_ssrc, ip, RTP_PT_JPEG);
+    snprintf(headers, sizeof(headers), "Content-Base: %s/\r\nContent-Type: application/sdp\r\n", uri);
+    sendResponse(s, cseq, "200 OK", headers, sdp);
+  }
+  else if (strcmp(method, "SETUP") == 0)
+  {
+    const char *transport = findHeader(req, "Transport", value, sizeof(value));
+    const char *ports = transport ? strstr(transport, "client_port=") : NULL;
+    if (!transport || strstr(transport, "RTP/AVP/TCP") || !ports)
+    {
+      sendResponse(s, cseq, "461 Unsupported Transport", NULL, NULL);
+      return;
+    }
+
+    int rtp_port = atoi(ports + strlen("client_port="));
+    struct sockaddr_in peer;
+    socklen_t peer_len = sizeof(peer);
+    getpeername(s.sock, (struct sockaddr *)&peer, &peer_len);
+    s.rtp_addr = peer;
+    s.rtp_addr.sin_port = htons(rtp_port);
+    s.set_up = true;
+
+    snprintf(headers, sizeof(headers),
+             "Transport: RTP/AVP;unicast;client_port=%d-%d;server_port=%d-%d\r\nSession: %08X;timeout=%d\r\n",
+             rtp_port, rtp_port + 1, RTSP_RTP_PORT, RTSP_RTP_PORT + 1, (unsigned)s.id, RTSP_SESSION_TIMEOUT_S);
+    sendResponse(s, cseq, "200 OK", headers, NULL);
+  }
+  else if (strcmp(method, "PLAY") == 0)
+  {
+    if (!s.set_up)
+    {
+      sendResponse(s, cseq, "455 Method Not Valid in This State", "Allow: OPTIONS, DESCRIBE, SETUP, TEARDOWN\r\n",
+                   NULL);
+      return;
+    }
+    snprintf(headers, sizeof(headers), "Session: %08X\r\nRange: npt=0.000-\r\n", (unsigned)s.id);
+    sendResponse(s, cseq, "200 OK", headers, NULL);
+    setPlaying(s, true);
+    Logger::getInstance().info("RTSP session started playing");
+  }
+  else if (strcmp(method, "TEARDOWN") == 0)
+  {
+    snprintf(headers, sizeof(headers), "Session: %08X\r\n", (unsigned)s.id);
+    sendResponse(s, cseq, "200 OK", headers, NULL);
+    setPlaying(s, false);
+    s.set_up = false;
+  }
+  else
+  {
+    sendResponse(s, cseq, "405 Method Not Allowed",
+                 "Allow: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN, GET_PARAMETER\r\n", NULL);
+  }
+}
+
+static void closeSession(RtspSession &s)
+{
+  close(s.sock);
+  s.sock = -1;
+  setPlaying(s, false);
+  Logger::getInstance().info("RTSP client disconnected");
+}
+
+static void readSession(RtspSession &s)
+{
+  int n = recv(s.sock, s.rx + s.rx_len, sizeof(s.rx) - 1 - s.rx_len, 0);
+  if (n <= 0)
+  {
+    closeSession(s);
+    return;
+  }
+  s.rx_len += n;
+  s.rx[s.rx_len] = '\0';
+
+  // Handle every complete request in the buffer
+  char *end;
+  while ((end = strstr(s.rx, "\r\n\r\n")) != NULL)
+  {
+    *end = '\0';
+    handleRequest(s, s.rx);
+    size_t consumed = end + 4 - s.rx;
+    memmove(s.rx, s.rx + consumed, s.rx_len - consumed + 1);
+    s.rx_len -= consumed;
+  }
+
+  if (s.rx_len >= sizeof(s.rx) - 1)
+  {
+    Logger::getInstance().warning("RTSP request too large, dropping client");
+    closeSession(s);
+  }
+}
+
+static void acceptSession(int listen_sock)
+{
+  int sock = accept(listen_sock, NULL, NULL);
+  if (sock < 0)
+  {
+    return;
+  }
+
+  for (int i = 0; i < RTSP_MAX_SESSIONS; i++)
+  {
+    if (sessions[i].sock < 0)
+    {
+      sessions[i].sock = sock;
+      sessions[i].id = esp_random();
+      sessions[i].set_up = false;
+      sessions[i].playing = false;
+      sessions[i].last_request_ms = millis();
+      sessions[i].rx_len = 0;
+      Logger::getInstance().info("RTSP client connected");
+      return;
+    }
+  }
+
+  Logger::getInstance().warning("RTSP session limit reached, rejecting client");
+  close(sock);
+}
+
+static void rtspTask(void *arg)
+{
+  int listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  rtp_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+  addr.sin_port = htons(RTSP_RTP_PORT);
+  bind(rtp_sock, (struct sockaddr *)&addr, sizeof(addr));
+
+  int reuse = 1;
+  setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  addr.sin_port = htons(RTSP_PORT);
+  if (bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_sock, 2) < 0)
+  {
+    Logger::getInstance().error("RTSP server failed to bind port " + String(RTSP_PORT));
+    close(listen_sock);
+    close(rtp_sock);
+    vTaskDelete(NULL);
+    return;
+  }
+
+  Logger::getInstance().info("RTSP server listening on port " + String(RTSP_PORT));
+
+  while (true)
+  {
+    fd_set rfds;
+    FD_ZERO(&rfds);
+    FD_SET(listen_sock, &rfds);
+    int maxfd = listen_sock;
+    bool playing = false;
+    for (int i = 0; i < RTSP_MAX_SESSIONS; i++)
+    {
+      if (sessions[i].sock >= 0)
+      {
+        FD_SET(sessions[i].sock, &rfds);
+        maxfd = max(maxfd, sessions[i].sock);
+        playing |= sessions[i].playing;
+      }
+    }
+
+    // No captures while the link is down; sessions resume or time out
+    bool streaming = playing && wifiLinkUp();
+
+    // Poll the control sockets briefly while streaming, otherwise block longer
+    struct timeval tv = {0, streaming ? 1000 : 200000};
+    if (select(maxfd + 1, &rfds, NULL, NULL, &tv) > 0)
+    {
+      if (FD_ISSET(listen_sock, &rfds))
+      {
+        acceptSession(listen_sock);
+      }
+      for (int i = 0; i < RTSP_MAX_SESSIONS; i++)
+      {
+        if (sessions[i].sock >= 0 && FD_ISSET(sessions[i].sock, &rfds))
+        {
+          readSession(sessions[i]);
+        }
+      }
+    }
+
+    // A client that vanished without TEARDOWN would otherwise keep its slot
+    // and its RTP stream forever
+    uint32_t now = millis();
+    for (int i = 0; i < RTSP_MAX_SESSIONS; i++)
+    {
+      if (sessions[i].sock >= 0 && now - sessions[i].last_request_ms > RTSP_SESSION_TIMEOUT_S * 1000UL)
+      {
+        Logger::getInstance().warning("RTSP session timed out");
+        closeSession(sessions[i]);
+      }
+    }
+
+    if (!streaming)
+    {
+      continue;
+    }
+
+    // One capture feeds every playing session
+    camera_fb_t *fb = cameraCapture();
+    if (!fb)
+    {
+      Logger::getInstance().error("Camera frame capture failed");
+      continue;
+    }
+
+    JpegScan jpg;
+    if (fb->format == PIXFORMAT_JPEG && parseJpeg(fb->buf, fb->len, jpg))
+    {
+      uint32_t timestamp = (uint32_t)(esp_timer_get_time() * 9 / 100); // 90 kHz clock
+      sendRtpFrame(jpg, timestamp);
+    }
+    cameraRelease(fb);
+  }
+}
+
+void startRtspServer()
+{
+  for (int i = 0; i < RTSP_MAX_SESSIONS; i++)
+  {
+    sessions[i].sock = -1;
+  }
+  rtp_ssrc = esp_random();
+  rtp_seq = esp_random() & 0xFFFF;
+
+  xTaskCreate(rtspTask, "rtsp", 6144, NULL, 5, NULL);
+}
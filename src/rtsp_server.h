@@ -0,0 +1,37 @@
+#ifndef RTSP_SERVER_H
+#define RTSP_SERVER_H
+
+#include <Arduino.h>
+#include "esp_camera.h"
+#include "logger.h"
+#include "camera_setup.h"
+
+// RTSP control port and the local UDP port RTP packets are sent from
+#ifndef RTSP_PORT
+#define RTSP_PORT 554
+#endif
+#ifndef RTSP_RTP_PORT
+#define RTSP_RTP_PORT 5004
+#endif
+
+// Maximum number of simultaneous RTSP sessions sharing the camera output
+#ifndef RTSP_MAX_SESSIONS
+#define RTSP_MAX_SESSIONS 4
+#endif
+
+// A session without any request for this long is closed; clients keep it
+// alive with GET_PARAMETER or OPTIONS
+#ifndef RTSP_SESSION_TIMEOUT_S
+#define RTSP_SESSION_TIMEOUT_S 60
+#endif
+
+// Largest RTP datagram we emit (RTP + JPEG headers + payload)
+#ifndef RTSP_MTU
+#define RTSP_MTU 1400
+#endif
+
+// Starts the RTSP server task. Every PLAYing session receives the same
+// RTP/JPEG (RFC 2435) packets built from the camera frame buffer.
+void startRtspServer();
+
+#endif // RTSP_SERVER_H
@@ -0,0 +1,350 @@
+#include "scaled_stream.h"
+#include "camera_setup.h"
+#include "img_converters.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "freertos/event_groups.h"
+
+// Two bits per scale, toggled per published frame like the overlay's: a
+// waiter for frame n+1 blocks on the bit frame n cleared
+#define FRAME_BIT(i, seq) (1 << ((i) * 2 + ((seq) & 1)))
+
+#define SCALED_WAIT_MS 2000
+
+struct ScaledSlot
+{
+  camera_fb_t fb; // what viewers receive
+  uint8_t *buf;
+  size_t len;
+  bool overflow;
+  int refs; // -1 while the encoder fills the slot
+};
+
+struct ScaleState
+{
+  ScaledSlot slots[SCALED_STREAM_SLOTS];
+  int latest;
+  volatile uint32_t published;
+  int viewers;
+
+  // Decoded RGB565 frame, grown when the sensor resolution grows
+  uint8_t *rgb;
+  size_t rgb_capacity;
+
+  uint32_t frames;
+  uint32_t dropped;
+  uint64_t decode_us_total;
+  uint64_t encode_us_total;
+  uint32_t last_jpeg_bytes;
+};
+
+struct ScaleKeys
+{
+  const char *viewers;
+  const char *frames;
+  const char *dropped;
+  const char *decode_us;
+  const char *encode_us;
+  const char *jpeg_bytes;
+};
+
+static const ScaleKeys stat_keys[SCALED_STREAM_SCALES] = {
+    {"scaled2_viewers", "scaled2_frames", "scaled2_dropped", "scaled2_decode_us", "scaled2_encode_us",
+     "scaled2_jpeg_bytes"},
+    {"scaled4_viewers", "scaled4_frames", "scaled4_dropped", "scaled4_decode_us", "scaled4_encode_us",
+     "scaled4_jpeg_bytes"},
+    {"scaled8_viewers", "scaled8_frames", "scaled8_dropped", "scaled8_decode_us", "scaled8_encode_us",
+     "scaled8_jpeg_bytes"},
+};
+
+static ScaleState scales[SCALED_STREAM_SCALES];
+static portMUX_TYPE scaled_mux = portMUX_INITIALIZER_UNLOCKED;
+static EventGroupHandle_t frame_events = NULL;
+static TaskHandle_t scaled_task = NULL;
+static volatile int total_viewers = 0;
+
+// 2 -> 0, 4 -> 1, 8 -> 2; the index plus one is the decoder's scale shift
+static int scaleIndex(int scale)
+{
+  switch (scale)
+  {
+  case 2:
+    return 0;
+  case 4:
+    return 1;
+  case 8:
+    return 2;
+  default:
+    return -1;
+  }
+}
+
+bool isStreamScale(int scale)
+{
+  return scaleIndex(scale) >= 0;
+}
+
+static size_t writeJpeg(void *arg, size_t index, const void *data, size_t len)
+{
+  ScaledSlot *slot = (ScaledSlot *)arg;
+  if (!data || len == 0)
+  {
+    return 0;
+  }
+  if (index + len > SCALED_STREAM_JPEG_CAPACITY)
+  {
+    slot->overflow = true;
+    return 0;
+  }
+  memcpy(slot->buf + index, data, len);
+  slot->len = index + len;
+  return len;
+}
+
+static int claimSlot(ScaleState &s)
+{
+  int slot = -1;
+  portENTER_CRITICAL(&scaled_mux);
+  for (int i = 0; i < SCALED_STREAM_SLOTS; i++)
+  {
+    if (i != s.latest && s.slots[i].refs == 0)
+    {
+      s.slots[i].refs = -1;
+      slot = i;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&scaled_mux);
+  return slot;
+}
+
+static void publish(int index, int slot, bool ok)
+{
+  ScaleState &s = scales[index];
+  uint32_t seq = 0;
+  portENTER_CRITICAL(&scaled_mux);
+  s.slots[slot].refs = 0;
+  if (ok)
+  {
+    s.latest = slot;
+    seq = ++s.published;
+  }
+  portEXIT_CRITICAL(&scaled_mux);
+
+  if (ok)
+  {
+    xEventGroupClearBits(frame_events, FRAME_BIT(index, seq + 1));
+    xEventGroupSetBits(frame_events, FRAME_BIT(index, seq));
+  }
+}
+
+// Decodes the shared frame straight at 1/2, 1/4 or 1/8 size, so the full
+// frame never exists in RGB (at 1/8 only the DC coefficients are used), and
+// encodes the result
+static void deriveFrame(int index, const camera_fb_t *src)
+{
+  ScaleState &s = scales[index];
+  int shift = index + 1;
+  uint16_t width = src->width >> shift;
+  uint16_t height = src->height >> shift;
+  size_t rgb_len = (size_t)width * height * 2;
+  if (rgb_len > s.rgb_capacity)
+  {
+    heap_caps_free(s.rgb);
+    s.rgb = (uint8_t *)heap_caps_malloc(rgb_len, MALLOC_CAP_SPIRAM);
+    s.rgb_capacity = s.rgb ? rgb_len : 0;
+  }
+
+  int slot = s.rgb ? claimSlot(s) : -1;
+  if (slot < 0)
+  {
+    // No decode buffer, or every slot is still being sent
+    s.dropped++;
+    return;
+  }
+
+  int64_t t0 = esp_timer_get_time();
+  bool ok = jpg2rgb565(src->buf, src->len, s.rgb, (jpg_scale_t)shift);
+  int64_t t1 = esp_timer_get_time();
+
+  ScaledSlot &out = s.slots[slot];
+  out.len = 0;
+  out.overflow = false;
+  ok = ok && fmt2jpg_cb(s.rgb, rgb_len, width, height, PIXFORMAT_RGB565, SCALED_STREAM_QUALITY, writeJpeg, &out) &&
+       !out.overflow && out.len > 0;
+  int64_t t2 = esp_timer_get_time();
+
+  out.fb.buf = out.buf;
+  out.fb.len = out.len;
+  out.fb.width = width;
+  out.fb.height = height;
+  out.fb.format = PIXFORMAT_JPEG;
+  out.fb.timestamp = src->timestamp;
+  publish(index, slot, ok);
+
+  if (ok)
+  {
+    s.frames++;
+    s.decode_us_total += t1 - t0;
+    s.encode_us_total += t2 - t1;
+    s.last_jpeg_bytes = out.len;
+  }
+  else
+  {
+    s.dropped++;
+  }
+}
+
+static void scaledTask(void *arg)
+{
+  TickType_t last_wake = xTaskGetTickCount();
+  while (true)
+  {
+    if (total_viewers == 0)
+    {
+      // Only scaled viewers wake the encoder
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      last_wake = xTaskGetTickCount();
+      continue;
+    }
+
+    // One capture feeds every scale in use
+    camera_fb_t *src = cameraCapture();
+    if (!src)
+    {
+      vTaskDelay(pdMS_TO_TICKS(100));
+      continue;
+    }
+    if (src->format == PIXFORMAT_JPEG)
+    {
+      for (int i = 0; i < SCALED_STREAM_SCALES; i++)
+      {
+        if (scales[i].viewers > 0)
+        {
+          deriveFrame(i, src);
+        }
+      }
+    }
+    cameraRelease(src);
+
+    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(1000 / SCALED_STREAM_FPS));
+  }
+}
+
+bool scaledStreamBegin(int scale)
+{
+  int index = scaleIndex(scale);
+  if (index < 0 || !scaled_task)
+  {
+    return false;
+  }
+
+  ScaleState &s = scales[index];
+  for (int i = 0; i < SCALED_STREAM_SLOTS; i++)
+  {
+    // Only ever touched here, on the HTTP server's task
+    if (!s.slots[i].buf)
+    {
+      s.slots[i].buf = (uint8_t *)heap_caps_malloc(SCALED_STREAM_JPEG_CAPACITY, MALLOC_CAP_SPIRAM);
+      if (!s.slots[i].buf)
+      {
+        Logger::getInstance().error("Scaled stream needs PSRAM for its frame slots");
+        return false;
+      }
+    }
+  }
+
+  portENTER_CRITICAL(&scaled_mux);
+  s.viewers++;
+  total_viewers++;
+  portEXIT_CRITICAL(&scaled_mux);
+  xTaskNotifyGive(scaled_task);
+  return true;
+}
+
+void scaledStreamEnd(int scale)
+{
+  int index = scaleIndex(scale);
+  if (index < 0)
+  {
+    return;
+  }
+  portENTER_CRITICAL(&scaled_mux);
+  scales[index].viewers--;
+  total_viewers--;
+  portEXIT_CRITICAL(&scaled_mux);
+}
+
+camera_fb_t *scaledCapture(int scale)
+{
+  int index = scaleIndex(scale);
+  if (index < 0)
+  {
+    return NULL;
+  }
+
+  // The next frame published after this call
+  ScaleState &s = scales[index];
+  uint32_t start_seq = s.published;
+  xEventGroupWaitBits(frame_events, FRAME_BIT(index, start_seq + 1), pdFALSE, pdFALSE,
+                      pdMS_TO_TICKS(SCALED_WAIT_MS));
+
+  camera_fb_t *fb = NULL;
+  portENTER_CRITICAL(&scaled_mux);
+  if (s.published != start_seq && s.latest >= 0)
+  {
+    s.slots[s.latest].refs++;
+    fb = &s.slots[s.latest].fb;
+  }
+  portEXIT_CRITICAL(&scaled_mux);
+  return fb;
+}
+
+void scaledRelease(camera_fb_t *fb)
+{
+  for (int i = 0; i < SCALED_STREAM_SCALES; i++)
+  {
+    for (int j = 0; j < SCALED_STREAM_SLOTS; j++)
+    {
+      if (fb == &scales[i].slots[j].fb)
+      {
+        portENTER_CRITICAL(&scaled_mux);
+        scales[i].slots[j].refs--;
+        portEXIT_CRITICAL(&scaled_mux);
+        return;
+      }
+    }
+  }
+}
+
+static void addScaledStats(JsonDocument &stats)
+{
+  for (int i = 0; i < SCALED_STREAM_SCALES; i++)
+  {
+    const ScaleState &s = scales[i];
+    const ScaleKeys &k = stat_keys[i];
+    if (s.frames == 0)
+    {
+      continue;
+    }
+    stats[k.viewers] = s.viewers;
+    stats[k.frames] = s.frames;
+    stats[k.dropped] = s.dropped;
+    stats[k.decode_us] = (uint32_t)(s.decode_us_total / s.frames);
+    stats[k.encode_us] = (uint32_t)(s.encode_us_total / s.frames);
+    stats[k.jpeg_bytes] = s.last_jpeg_bytes;
+  }
+}
+
+void startScaledStream()
+{
+  for (int i = 0; i < SCALED_STREAM_SCALES; i++)
+  {
+    scales[i].latest = -1;
+  }
+  frame_events = xEventGroupCreate();
+  Logger::getInstance().addStatsProvider(addScaledStats);
+
+  // Decoding and encoding are pure CPU work; keep them off the core that runs Wi-Fi
+  xTaskCreatePinnedToCore(scaledTask, "scaled", 6144, NULL, 4, &scaled_task, SCALED_STREAM_CORE);
+}
@@ -0,0 +1,52 @@
+#ifndef SCALED_STREAM_H
+#define SCALED_STREAM_H
+
+#include <Arduino.h>
+#include "esp_camera.h"
+#include "logger.h"
+
+// JPEG quality of the derived streams (1-100, higher is better). Small
+// frames for weak links can afford to be coarse.
+#ifndef SCALED_STREAM_QUALITY
+#define SCALED_STREAM_QUALITY 50
+#endif
+
+// Frame rate cap of the derived streams
+#ifndef SCALED_STREAM_FPS
+#define SCALED_STREAM_FPS 10
+#endif
+
+// Encoded frames in flight per scale: one being encoded, the rest being sent
+#ifndef SCALED_STREAM_SLOTS
+#define SCALED_STREAM_SLOTS 3
+#endif
+#ifndef SCALED_STREAM_JPEG_CAPACITY
+#define SCALED_STREAM_JPEG_CAPACITY (48 * 1024)
+#endif
+
+// Encoder core; Wi-Fi and lwIP run on core 0
+#ifndef SCALED_STREAM_CORE
+#define SCALED_STREAM_CORE 1
+#endif
+
+// 1/2, 1/4 and 1/8 of the sensor resolution
+#define SCALED_STREAM_SCALES 3
+
+// Creates the (idle) encoder task
+void startScaledStream();
+
+// True for the scales /stream?scale= accepts: 2, 4 and 8
+bool isStreamScale(int scale);
+
+// A viewer of the given scale joins or leaves. The encoder runs only while
+// at least one viewer is registered, and only for the scales in use.
+bool scaledStreamBegin(int scale);
+void scaledStreamEnd(int scale);
+
+// Waits for the next frame of that scale, NULL on timeout. Each frame is
+// decoded and encoded once, however many viewers share it; release it with
+// scaledRelease().
+camera_fb_t *scaledCapture(int scale);
+void scaledRelease(camera_fb_t *fb);
+
+#endif // SCALED_STREAM_H
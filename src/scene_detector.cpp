@@ -0,0 +1,49 @@
+#include "scene_detector.h"
+#include <atomic>
+
+// Shared by every stream connection
+static std::atomic<uint32_t> frames_suppressed(0);
+static std::atomic<uint64_t> bytes_saved(0);
+
+SceneDetector::SceneDetector()
+    : has_ref(false), ref_len(0), last_sent_ms(0), quiet_frames(0)
+{
+}
+
+bool SceneDetector::shouldSend(size_t len, uint32_t now_ms)
+{
+    size_t delta = len > ref_len ? len - ref_len : ref_len - len;
+    bool changed = !has_ref || delta * 1000 > ref_len * SCENE_SIZE_DELTA_PERMILLE;
+
+    if (changed)
+    {
+        quiet_frames = 0;
+    }
+    else if (quiet_frames < SCENE_STATIC_FRAMES)
+    {
+        quiet_frames++;
+    }
+
+    if (changed || !isStatic() || now_ms - last_sent_ms >= SCENE_KEEPALIVE_MS)
+    {
+        // Frames that are sent become the new reference, so slow drift still triggers
+        has_ref = true;
+        ref_len = len;
+        last_sent_ms = now_ms;
+        return true;
+    }
+
+    frames_suppressed.fetch_add(1, std::memory_order_relaxed);
+    bytes_saved.fetch_add(len, std::memory_order_relaxed);
+    return false;
+}
+
+uint32_t SceneDetector::framesSuppressed()
+{
+    return frames_suppressed.load(std::memory_order_relaxed);
+}
+
+uint64_t SceneDetector::bytesSaved()
+{
+    return bytes_saved.load(std::memory_order_relaxed);
+}
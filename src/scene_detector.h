@@ -0,0 +1,56 @@
+#ifndef SCENE_DETECTOR_H
+#define SCENE_DETECTOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Relative JPEG size change (per mille) treated as a scene change
+#ifndef SCENE_SIZE_DELTA_PERMILLE
+#define SCENE_SIZE_DELTA_PERMILLE 25
+#endif
+
+// Consecutive quiet frames before the scene counts as static
+#ifndef SCENE_STATIC_FRAMES
+#define SCENE_STATIC_FRAMES 5
+#endif
+
+// While static, one frame per keep-alive interval still goes out
+#ifndef SCENE_KEEPALIVE_MS
+#define SCENE_KEEPALIVE_MS 2000
+#endif
+
+// Capture period while static; bounds how long a change takes to be noticed
+#ifndef SCENE_IDLE_POLL_MS
+#define SCENE_IDLE_POLL_MS 100
+#endif
+
+// Cheap static-scene detector for one stream. Compares each JPEG's size
+// against the last frame that was sent: JPEG size tracks scene detail
+// closely, while sensor noise alone changes it by well under
+// SCENE_SIZE_DELTA_PERMILLE. The compressed bytes themselves differ between
+// any two captures, so comparing them cannot tell a change from noise. A
+// change that keeps the size within the threshold shows up by the next
+// keep-alive frame at the latest.
+class SceneDetector
+{
+public:
+    SceneDetector();
+
+    // Takes the JPEG size of each captured frame. Returns false when the
+    // frame can be skipped; skipped frames are added to the global savings
+    // counters.
+    bool shouldSend(size_t len, uint32_t now_ms);
+
+    bool isStatic() const { return quiet_frames >= SCENE_STATIC_FRAMES; }
+
+    static uint32_t framesSuppressed();
+    static uint64_t bytesSaved();
+
+private:
+    bool has_ref;
+    size_t ref_len;
+    uint32_t last_sent_ms;
+    uint16_t quiet_frames;
+};
+
+#endif // SCENE_DETECTOR_H
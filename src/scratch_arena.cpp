@@ -0,0 +1,122 @@
+#include "scratch_arena.h"
+#include <stdio.h>
+#include <string.h>
+
+ScratchArena::ScratchArena(void *buffer, size_t capacity)
+    : base_((uint8_t *)buffer), capacity_(buffer ? capacity : 0), used_(0), peak_(0), failures_(0)
+{
+}
+
+void *ScratchArena::alloc(size_t size, size_t align)
+{
+    uintptr_t start = (uintptr_t)base_ + used_;
+    size_t pad = (align - start % align) % align;
+    if (size > capacity_ - used_ || pad > capacity_ - used_ - size)
+    {
+        failures_++;
+        return NULL;
+    }
+    void *p = base_ + used_ + pad;
+    used_ += pad + size;
+    if (used_ > peak_)
+    {
+        peak_ = used_;
+    }
+    return p;
+}
+
+void ScratchArena::rewind(size_t mark)
+{
+    if (mark < used_)
+    {
+        used_ = mark;
+    }
+}
+
+StrBuilder::StrBuilder(char *buffer, size_t capacity)
+    : buf_(buffer), cap_(capacity), len_(0), truncated_(false), empty_(0)
+{
+    if (!buf_ || cap_ == 0)
+    {
+        buf_ = &empty_;
+        cap_ = 1;
+    }
+    buf_[0] = 0;
+}
+
+StrBuilder::StrBuilder(ScratchArena &arena, size_t capacity) : len_(0), truncated_(false), empty_(0)
+{
+    if (capacity > arena.available())
+    {
+        capacity = arena.available();
+    }
+    buf_ = (char *)arena.alloc(capacity, 1);
+    cap_ = capacity;
+    if (!buf_ || cap_ == 0)
+    {
+        buf_ = &empty_;
+        cap_ = 1;
+    }
+    buf_[0] = 0;
+}
+
+StrBuilder &StrBuilder::append(const char *text, size_t len)
+{
+    size_t room = cap_ - 1 - len_;
+    if (len > room)
+    {
+        len = room;
+        truncated_ = true;
+    }
+    memcpy(buf_ + len_, text, len);
+    len_ += len;
+    buf_[len_] = 0;
+    return *this;
+}
+
+StrBuilder &StrBuilder::append(const char *text)
+{
+    return text ? append(text, strlen(text)) : *this;
+}
+
+StrBuilder &StrBuilder::append(char c)
+{
+    return append(&c, 1);
+}
+
+StrBuilder &StrBuilder::vappendf(const char *fmt, va_list args)
+{
+    size_t room = cap_ - len_;
+    int n = vsnprintf(buf_ + len_, room, fmt, args);
+    if (n < 0)
+    {
+        buf_[len_] = 0;
+        truncated_ = true;
+    }
+    else if ((size_t)n >= room)
+    {
+        len_ = cap_ - 1;
+        truncated_ = true;
+    }
+    else
+    {
+        len_ += n;
+    }
+    return *this;
+}
+
+StrBuilder &StrBuilder::appendf(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vappendf(fmt, args);
+    va_end(args);
+    return *this;
+}
+
+void StrBuilder::clear()
+{
+    len_ = 0;
+    truncated_ = false;
+    buf_[0] = 0;
+}
@@ -0,0 +1,100 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+// Bump-pointer allocator over a fixed buffer for memory that only lives as
+// long as one request or job. alloc() moves a pointer forward and nothing is
+// freed individually; reset() (or rewinding an ArenaScope) releases
+// everything at once, so the heap never sees these allocations and cannot
+// fragment from them. Not thread-safe: each task owns its own arena.
+class ScratchArena
+{
+public:
+    ScratchArena(void *buffer, size_t capacity);
+
+    // NULL when the arena is full; the failure is counted
+    void *alloc(size_t size, size_t align = sizeof(void *));
+
+    // Everything allocated after mark() is released by rewind()
+    size_t mark() const { return used_; }
+    void rewind(size_t mark);
+    void reset() { rewind(0); }
+
+    size_t used() const { return used_; }
+    size_t available() const { return capacity_ - used_; }
+    size_t capacity() const { return capacity_; }
+    size_t peak() const { return peak_; } // highest used() since construction
+    uint32_t failures() const { return failures_; }
+
+private:
+    uint8_t *base_;
+    size_t capacity_;
+    size_t used_;
+    size_t peak_;
+    uint32_t failures_;
+};
+
+// Releases what was allocated from the arena during its lifetime
+class ArenaScope
+{
+public:
+    explicit ArenaScope(ScratchArena &arena) : arena_(arena), mark_(arena.mark()) {}
+    ~ArenaScope() { arena_.rewind(mark_); }
+
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+
+private:
+    ScratchArena &arena_;
+    size_t mark_;
+};
+
+// Fixed-capacity, always terminated string for building messages, paths and
+// headers without the heap. Appends that do not fit are cut off and set
+// truncated() rather than failing.
+class StrBuilder
+{
+public:
+    StrBuilder(char *buffer, size_t capacity);
+
+    // Takes up to `capacity` bytes from the arena, or whatever is left
+    StrBuilder(ScratchArena &arena, size_t capacity);
+
+    StrBuilder(const StrBuilder &) = delete;
+    StrBuilder &operator=(const StrBuilder &) = delete;
+
+    StrBuilder &append(const char *text);
+    StrBuilder &append(const char *text, size_t len);
+    StrBuilder &append(char c);
+    StrBuilder &appendf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+    StrBuilder &vappendf(const char *fmt, va_list args);
+
+    void clear();
+    const char *c_str() const { return buf_; }
+    size_t length() const { return len_; }
+    size_t capacity() const { return cap_; }
+    bool truncated() const { return truncated_; }
+
+private:
+    char *buf_;
+    size_t cap_; // including the terminator
+    size_t len_;
+    bool truncated_;
+    char empty_; // stands in for the buffer when the arena had no room
+};
+
+// StrBuilder with its storage inline, for the stack or a static
+template <size_t N>
+class FixedString : public StrBuilder
+{
+public:
+    FixedString() : StrBuilder(storage_, N) {}
+
+private:
+    char storage_[N];
+};
+
+#endif // SCRATCH_ARENA_H
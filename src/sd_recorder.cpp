@@ -0,0 +1,215 @@
+#include "sd_recorder.h"
+#include "SD_MMC.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "power_governor.h"
+#include <time.h>
+
+// A captured frame waiting for the writer; data == NULL ends the recording
+struct RecorderItem
+{
+  uint8_t *data;
+  size_t len;
+  uint16_t width;
+  uint16_t height;
+};
+
+static bool sd_ready = false;
+static volatile uint32_t record_until_ms = 0;
+static volatile bool recording = false;
+static QueueHandle_t record_queue = NULL;
+static TaskHandle_t capture_task = NULL;
+static RecorderStats stats = {};
+
+static void makeFileName(char *path, size_t len)
+{
+  time_t now = time(nullptr);
+  if (now >= 8 * 3600 * 2)
+  {
+    struct tm *timeinfo = localtime(&now);
+    strftime(path, len, "/sdcard/rec_%Y%m%d_%H%M%S.avi", timeinfo);
+  }
+  else
+  {
+    // NTP not synced yet
+    snprintf(path, len, "/sdcard/rec_boot_%lu.avi", millis());
+  }
+}
+
+// Copies frames to PSRAM and hands them to the writer, so a slow SD card
+// never holds a camera frame buffer
+static void recorderCaptureTask(void *arg)
+{
+  const TickType_t period = pdMS_TO_TICKS(1000 / RECORDER_FPS);
+  TickType_t last_wake = xTaskGetTickCount();
+
+  while (true)
+  {
+    if (!recording)
+    {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      last_wake = xTaskGetTickCount();
+      continue;
+    }
+
+    if ((int32_t)(millis() - record_until_ms) >= 0)
+    {
+      recording = false;
+      powerDemandEnd(DEMAND_JOB);
+      RecorderItem end = {NULL, 0, 0, 0};
+      xQueueSend(record_queue, &end, portMAX_DELAY);
+      continue;
+    }
+
+    camera_fb_t *fb = cameraCapture();
+    if (fb && fb->format == PIXFORMAT_JPEG)
+    {
+      uint8_t *copy = (uint8_t *)heap_caps_malloc(fb->len, MALLOC_CAP_SPIRAM);
+      if (copy)
+      {
+        memcpy(copy, fb->buf, fb->len);
+        RecorderItem item = {copy, fb->len, (uint16_t)fb->width, (uint16_t)fb->height};
+        if (xQueueSend(record_queue, &item, 0) != pdTRUE)
+        {
+          heap_caps_free(copy);
+          stats.frames_dropped++;
+        }
+      }
+      else
+      {
+        stats.frames_dropped++;
+      }
+    }
+    if (fb)
+    {
+      cameraRelease(fb);
+    }
+
+    vTaskDelayUntil(&last_wake, period);
+  }
+}
+
+static void recorderWriterTask(void *arg)
+{
+  AviWriter *writer = NULL;
+  uint8_t *block = NULL;
+  char path[64];
+  uint32_t started_ms = 0;
+  uint32_t write_us = 0;
+
+  while (true)
+  {
+    RecorderItem item;
+    xQueueReceive(record_queue, &item, portMAX_DELAY);
+
+    if (item.data == NULL)
+    {
+      if (writer)
+      {
+        uint32_t duration = millis() - started_ms;
+        uint64_t bytes = writer->bytesWritten();
+        if (writer->close(duration))
+        {
+          stats.files++;
+        }
+        else
+        {
+          stats.files_failed++;
+          Logger::getInstance().error("Recording " + String(path) + " could not be finalized, the file is damaged");
+        }
+        stats.last_write_kbps = write_us ? (uint32_t)(bytes * 1000 / write_us) : 0;
+        Logger::getInstance().info("Recording saved: " + String(path) + ", " + String(writer->frameCount()) +
+                                   " frames, " + String((uint32_t)(bytes / 1024)) + " KB, SD write " +
+                                   String(stats.last_write_kbps) + " KB/s, dropped " + String(stats.frames_dropped));
+        delete writer;
+        writer = NULL;
+        heap_caps_free(block);
+        block = NULL;
+      }
+      continue;
+    }
+
+    if (!writer)
+    {
+      // The SDMMC driver only streams from DMA-capable RAM, keep the block buffer internal
+      block = (uint8_t *)heap_caps_malloc(RECORDER_WRITE_BLOCK, MALLOC_CAP_DMA);
+      if (block)
+      {
+        writer = new AviWriter(block, RECORDER_WRITE_BLOCK);
+        makeFileName(path, sizeof(path));
+        if (!writer->open(path, item.width, item.height, RECORDER_FPS, RECORDER_PREALLOC_BYTES))
+        {
+          stats.open_failed++;
+          Logger::getInstance().error("Failed to create recording " + String(path));
+          delete writer;
+          writer = NULL;
+          heap_caps_free(block);
+          block = NULL;
+        }
+      }
+      started_ms = millis();
+      write_us = 0;
+    }
+
+    if (writer)
+    {
+      int64_t t0 = esp_timer_get_time();
+      if (writer->addFrame(item.data, item.len))
+      {
+        stats.frames_written++;
+      }
+      else
+      {
+        stats.frames_dropped++;
+      }
+      write_us += esp_timer_get_time() - t0;
+    }
+    heap_caps_free(item.data);
+  }
+}
+
+bool startSdRecorder()
+{
+  // 1-bit mode keeps GPIO4 (flash LED), GPIO12 and GPIO13 free
+  if (!SD_MMC.begin("/sdcard", true) || SD_MMC.cardType() == CARD_NONE)
+  {
+    Logger::getInstance().warning("No microSD card, recording disabled");
+    return false;
+  }
+
+  Logger::getInstance().info("microSD mounted, " + String((uint32_t)(SD_MMC.cardSize() / (1024 * 1024))) + " MB");
+
+  record_queue = xQueueCreate(RECORDER_QUEUE_DEPTH, sizeof(RecorderItem));
+  xTaskCreate(recorderCaptureTask, "rec_capture", 3072, NULL, 4, &capture_task);
+  xTaskCreate(recorderWriterTask, "rec_writer", 4096, NULL, 3, NULL);
+  sd_ready = true;
+  return true;
+}
+
+bool triggerRecording(uint32_t duration_ms)
+{
+  if (!sd_ready)
+  {
+    return false;
+  }
+
+  record_until_ms = millis() + duration_ms;
+  if (!recording)
+  {
+    powerDemandBegin(DEMAND_JOB);
+    recording = true;
+    Logger::getInstance().info("Recording started for " + String(duration_ms / 1000) + " s");
+    xTaskNotifyGive(capture_task);
+  }
+  return true;
+}
+
+bool isRecording()
+{
+  return recording;
+}
+
+RecorderStats getRecorderStats()
+{
+  return stats;
+}
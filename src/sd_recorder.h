@@ -0,0 +1,47 @@
+#ifndef SD_RECORDER_H
+#define SD_RECORDER_H
+
+#include <Arduino.h>
+#include "esp_camera.h"
+#include "avi_writer.h"
+#include "logger.h"
+#include "camera_setup.h"
+
+// Recording frame rate and how many captured frames may wait for the SD card
+#ifndef RECORDER_FPS
+#define RECORDER_FPS 10
+#endif
+#ifndef RECORDER_QUEUE_DEPTH
+#define RECORDER_QUEUE_DEPTH 8
+#endif
+
+// Size of the aligned write block and of the space reserved per new file
+#ifndef RECORDER_WRITE_BLOCK
+#define RECORDER_WRITE_BLOCK (16 * 1024)
+#endif
+#ifndef RECORDER_PREALLOC_BYTES
+#define RECORDER_PREALLOC_BYTES (8 * 1024 * 1024)
+#endif
+
+// Mounts the microSD card (1-bit mode) and starts the capture and writer tasks.
+// Returns false when no card is present; recording requests are then refused.
+bool startSdRecorder();
+
+// Records for duration_ms from now, extending a recording already in progress
+bool triggerRecording(uint32_t duration_ms);
+
+bool isRecording();
+
+struct RecorderStats
+{
+  uint32_t files;        // finalized and playable
+  uint32_t files_failed; // could not be finalized, likely unplayable
+  uint32_t open_failed;  // could not be created on the card
+  uint32_t frames_written;
+  uint32_t frames_dropped; // queue full, SD card fell behind
+  uint32_t last_write_kbps;
+};
+
+RecorderStats getRecorderStats();
+
+#endif // SD_RECORDER_H
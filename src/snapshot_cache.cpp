@@ -0,0 +1,104 @@
+#include "snapshot_cache.h"
+#include "esp_heap_caps.h"
+
+struct SnapshotSlot
+{
+  Snapshot snap;
+  size_t capacity;
+  int refs; // -1 while the writer fills the slot
+};
+
+static SnapshotSlot slots[SNAPSHOT_SLOTS];
+static int current = -1;
+static uint32_t next_seq = 1;
+static uint32_t last_store_ms = 0;
+static portMUX_TYPE snapshot_mux = portMUX_INITIALIZER_UNLOCKED;
+
+void snapshotStore(const camera_fb_t *fb)
+{
+  if (fb->format != PIXFORMAT_JPEG)
+  {
+    return;
+  }
+
+  uint32_t now = millis();
+  int slot = -1;
+  portENTER_CRITICAL(&snapshot_mux);
+  if (current < 0 || now - last_store_ms >= SNAPSHOT_REFRESH_MS)
+  {
+    // Any slot nobody is reading, other than the one being served
+    for (int i = 0; i < SNAPSHOT_SLOTS; i++)
+    {
+      if (i != current && slots[i].refs == 0)
+      {
+        slot = i;
+        slots[i].refs = -1;
+        last_store_ms = now;
+        break;
+      }
+    }
+  }
+  portEXIT_CRITICAL(&snapshot_mux);
+  if (slot < 0)
+  {
+    return;
+  }
+
+  SnapshotSlot &s = slots[slot];
+  if (s.capacity < fb->len)
+  {
+    // Grow in 16 KB steps so small size changes do not reallocate
+    size_t capacity = (fb->len + 16383) & ~(size_t)16383;
+    heap_caps_free(s.snap.buf);
+    s.snap.buf = (uint8_t *)heap_caps_malloc(capacity, MALLOC_CAP_SPIRAM);
+    s.capacity = s.snap.buf ? capacity : 0;
+  }
+
+  bool filled = s.snap.buf != NULL;
+  if (filled)
+  {
+    memcpy(s.snap.buf, fb->buf, fb->len);
+    s.snap.len = fb->len;
+    s.snap.width = fb->width;
+    s.snap.height = fb->height;
+    s.snap.captured_ms = now;
+    s.snap.captured_us = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+  }
+
+  portENTER_CRITICAL(&snapshot_mux);
+  s.refs = 0;
+  if (filled)
+  {
+    s.snap.seq = next_seq++;
+    current = slot;
+  }
+  portEXIT_CRITICAL(&snapshot_mux);
+}
+
+const Snapshot *snapshotAcquire(uint32_t max_age_ms)
+{
+  uint32_t now = millis();
+  const Snapshot *snap = NULL;
+  portENTER_CRITICAL(&snapshot_mux);
+  if (current >= 0 && now - slots[current].snap.captured_ms <= max_age_ms)
+  {
+    slots[current].refs++;
+    snap = &slots[current].snap;
+  }
+  portEXIT_CRITICAL(&snapshot_mux);
+  return snap;
+}
+
+void snapshotRelease(const Snapshot *snap)
+{
+  portENTER_CRITICAL(&snapshot_mux);
+  for (int i = 0; i < SNAPSHOT_SLOTS; i++)
+  {
+    if (&slots[i].snap == snap && slots[i].refs > 0)
+    {
+      slots[i].refs--;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&snapshot_mux);
+}
@@ -0,0 +1,42 @@
+#ifndef SNAPSHOT_CACHE_H
+#define SNAPSHOT_CACHE_H
+
+#include <Arduino.h>
+#include "esp_camera.h"
+
+// Minimum time between copies into the cache, bounds the memcpy cost
+#ifndef SNAPSHOT_REFRESH_MS
+#define SNAPSHOT_REFRESH_MS 100
+#endif
+
+// /snapshot.jpg serves the cached frame while it is younger than this
+#ifndef SNAPSHOT_MAX_AGE_MS
+#define SNAPSHOT_MAX_AGE_MS 1000
+#endif
+
+// Cached frames live in PSRAM; readers hold a slot while sending it
+#ifndef SNAPSHOT_SLOTS
+#define SNAPSHOT_SLOTS 3
+#endif
+
+struct Snapshot
+{
+  uint8_t *buf;
+  size_t len;
+  uint16_t width;
+  uint16_t height;
+  uint32_t seq; // changes with every stored frame, used as the ETag
+  uint32_t captured_ms;
+  int64_t captured_us; // driver capture timestamp
+};
+
+// Copies the frame into the cache, at most once per SNAPSHOT_REFRESH_MS.
+// Called by cameraCapture() so every consumer keeps the cache warm.
+void snapshotStore(const camera_fb_t *fb);
+
+// Returns the newest cached frame if it is at most max_age_ms old, or NULL.
+// The frame stays valid until snapshotRelease().
+const Snapshot *snapshotAcquire(uint32_t max_age_ms);
+void snapshotRelease(const Snapshot *snap);
+
+#endif // SNAPSHOT_CACHE_H
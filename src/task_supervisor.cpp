@@ -0,0 +1,222 @@
+#include "task_supervisor.h"
+#include "scratch_arena.h"
+
+static const char *component_names[COMPONENT_COUNT] = {"capture", "stream", "upload", "logship", "wifi"};
+
+struct ComponentState
+{
+  uint32_t stall_timeout_ms; // 0 = not supervised
+  RecoveryAction recover;
+  int busy;
+  uint32_t last_beat_ms;
+  uint32_t last_demand_ms;
+  volatile uint32_t generation;
+  uint32_t recoveries;
+};
+
+static ComponentState components[COMPONENT_COUNT];
+static portMUX_TYPE supervisor_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Stalls found by the supervisor, logged by the reporter task. Logging can
+// mean a Logstash POST of several seconds, which the supervisor must not wait
+// for at its priority and on its small stack.
+struct StallEvent
+{
+  uint8_t component;
+  uint32_t silent_ms;
+};
+static QueueHandle_t stall_events = NULL;
+
+// Previous run-time counters, to turn totals into per-interval CPU load
+#define SUPERVISOR_MAX_TASKS 32
+static UBaseType_t prev_task_number[SUPERVISOR_MAX_TASKS];
+static uint32_t prev_task_runtime[SUPERVISOR_MAX_TASKS];
+static int prev_task_count = 0;
+static uint32_t prev_total_runtime = 0;
+
+void supervisorRegister(SupervisedComponent c, uint32_t stall_timeout_ms, RecoveryAction recover)
+{
+  portENTER_CRITICAL(&supervisor_mux);
+  components[c].stall_timeout_ms = stall_timeout_ms;
+  components[c].recover = recover;
+  components[c].last_beat_ms = millis();
+  portEXIT_CRITICAL(&supervisor_mux);
+}
+
+void supervisorBusy(SupervisedComponent c)
+{
+  uint32_t now = millis();
+  portENTER_CRITICAL(&supervisor_mux);
+  ComponentState &s = components[c];
+  // A healthy, idle component starts its stall clock now
+  if (s.busy == 0 && (int32_t)(s.last_demand_ms - s.last_beat_ms) <= 0)
+  {
+    s.last_beat_ms = now;
+  }
+  s.busy++;
+  s.last_demand_ms = now;
+  portEXIT_CRITICAL(&supervisor_mux);
+}
+
+void supervisorIdle(SupervisedComponent c)
+{
+  portENTER_CRITICAL(&supervisor_mux);
+  if (components[c].busy > 0)
+  {
+    components[c].busy--;
+  }
+  portEXIT_CRITICAL(&supervisor_mux);
+}
+
+void supervisorBeat(SupervisedComponent c)
+{
+  uint32_t now = millis();
+  portENTER_CRITICAL(&supervisor_mux);
+  components[c].last_beat_ms = now;
+  portEXIT_CRITICAL(&supervisor_mux);
+}
+
+uint32_t supervisorGeneration(SupervisedComponent c)
+{
+  return components[c].generation;
+}
+
+static void checkStalls()
+{
+  uint32_t now = millis();
+  for (int i = 0; i < COMPONENT_COUNT; i++)
+  {
+    ComponentState &s = components[i];
+
+    portENTER_CRITICAL(&supervisor_mux);
+    bool demanded = s.busy > 0 || (int32_t)(s.last_demand_ms - s.last_beat_ms) > 0;
+    uint32_t silent_ms = now - s.last_beat_ms;
+    bool stalled = s.stall_timeout_ms && demanded && silent_ms > s.stall_timeout_ms;
+    if (stalled)
+    {
+      // Give the recovery a full timeout before judging again
+      s.generation++;
+      s.recoveries++;
+      s.last_beat_ms = now;
+      s.last_demand_ms = now;
+    }
+    portEXIT_CRITICAL(&supervisor_mux);
+
+    if (stalled)
+    {
+      if (s.recover)
+      {
+        s.recover();
+      }
+      // Dropped when the reporter is behind; recoveries_* still counts it
+      StallEvent event = {(uint8_t)i, silent_ms};
+      xQueueSend(stall_events, &event, 0);
+    }
+  }
+}
+
+static void reportTasks()
+{
+#if (configUSE_TRACE_FACILITY == 1)
+  UBaseType_t count = uxTaskGetNumberOfTasks();
+  TaskStatus_t *tasks = (TaskStatus_t *)malloc(count * sizeof(TaskStatus_t));
+  if (!tasks)
+  {
+    return;
+  }
+
+  uint32_t total_runtime = 0;
+  count = uxTaskGetSystemState(tasks, count, &total_runtime);
+  uint32_t total_delta = total_runtime - prev_total_runtime;
+
+  FixedString<SUPERVISOR_REPORT_MAX> report;
+  report.append("Task stats (cpu%, free stack bytes):");
+  for (UBaseType_t i = 0; i < count; i++)
+  {
+    report.appendf(" %s", tasks[i].pcTaskName);
+#if (configGENERATE_RUN_TIME_STATS == 1)
+    uint32_t prev = 0;
+    for (int j = 0; j < prev_task_count; j++)
+    {
+      if (prev_task_number[j] == tasks[i].xTaskNumber)
+      {
+        prev = prev_task_runtime[j];
+        break;
+      }
+    }
+    uint32_t cpu = total_delta ? (uint32_t)((uint64_t)(tasks[i].ulRunTimeCounter - prev) * 100 / total_delta) : 0;
+    report.appendf("=%u%%/", (unsigned)cpu);
+#else
+    report.append('=');
+#endif
+    // ESP-IDF reports the high-water mark in bytes
+    report.appendf("%u", (unsigned)tasks[i].usStackHighWaterMark);
+  }
+
+  prev_task_count = min((int)count, SUPERVISOR_MAX_TASKS);
+  for (int j = 0; j < prev_task_count; j++)
+  {
+    prev_task_number[j] = tasks[j].xTaskNumber;
+    prev_task_runtime[j] = tasks[j].ulRunTimeCounter;
+  }
+  prev_total_runtime = total_runtime;
+  free(tasks);
+
+  Logger::getInstance().info(report.c_str());
+#endif
+}
+
+static void addSupervisorStats(JsonDocument &stats)
+{
+  for (int i = 0; i < COMPONENT_COUNT; i++)
+  {
+    if (components[i].stall_timeout_ms)
+    {
+      stats[String("recoveries_") + component_names[i]] = components[i].recoveries;
+    }
+  }
+}
+
+// Only checks and recovers; never logs, so it cannot block on Logstash
+static void supervisorTask(void *arg)
+{
+  while (true)
+  {
+    vTaskDelay(pdMS_TO_TICKS(SUPERVISOR_CHECK_MS));
+    checkStalls();
+  }
+}
+
+// Logs what the supervisor found and the periodic task report
+static void reporterTask(void *arg)
+{
+  uint32_t last_report = millis();
+  while (true)
+  {
+    uint32_t since = millis() - last_report;
+    TickType_t wait = since >= SUPERVISOR_REPORT_MS ? 0 : pdMS_TO_TICKS(SUPERVISOR_REPORT_MS - since);
+    StallEvent event;
+    if (xQueueReceive(stall_events, &event, wait) == pdTRUE)
+    {
+      Logger::getInstance().warningf("Stall detected in %s: no progress for %lu ms, recovered",
+                                     component_names[event.component], (unsigned long)event.silent_ms);
+    }
+
+    if (millis() - last_report >= SUPERVISOR_REPORT_MS)
+    {
+      reportTasks();
+      last_report = millis();
+    }
+  }
+}
+
+void startTaskSupervisor()
+{
+  Logger::getInstance().addStatsProvider(addSupervisorStats);
+  stall_events = xQueueCreate(COMPONENT_COUNT, sizeof(StallEvent));
+
+  // Above the workers it watches, so a spinning task cannot starve it
+  xTaskCreate(supervisorTask, "supervisor", 3072, NULL, configMAX_PRIORITIES - 5, NULL);
+  // Low priority and a stack sized for a Logstash POST, like other loggers
+  xTaskCreate(reporterTask, "sup_report", 8192, NULL, 1, NULL);
+}
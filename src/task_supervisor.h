@@ -0,0 +1,49 @@
+#ifndef TASK_SUPERVISOR_H
+#define TASK_SUPERVISOR_H
+
+#include <Arduino.h>
+#include "logger.h"
+
+// How often heartbeats are checked and task telemetry is reported
+#ifndef SUPERVISOR_CHECK_MS
+#define SUPERVISOR_CHECK_MS 1000
+#endif
+#ifndef SUPERVISOR_REPORT_MS
+#define SUPERVISOR_REPORT_MS 60000
+#endif
+
+// Longest task report line; tasks that do not fit are cut off
+#ifndef SUPERVISOR_REPORT_MAX
+#define SUPERVISOR_REPORT_MAX 768
+#endif
+
+enum SupervisedComponent
+{
+  COMPONENT_CAPTURE = 0,
+  COMPONENT_STREAM,
+  COMPONENT_UPLOAD,
+  COMPONENT_LOGSHIP,
+  COMPONENT_WIFI,
+  COMPONENT_COUNT
+};
+
+// Called from the supervisor task when a component is found stalled
+typedef void (*RecoveryAction)();
+
+// A component is stalled when it has been asked to work (supervisorBusy)
+// and has not reported progress (supervisorBeat) for stall_timeout_ms.
+void supervisorRegister(SupervisedComponent c, uint32_t stall_timeout_ms, RecoveryAction recover);
+
+void supervisorBusy(SupervisedComponent c);
+void supervisorIdle(SupervisedComponent c);
+void supervisorBeat(SupervisedComponent c);
+
+// Bumped on every recovery; long-running loops remember the value they
+// started with and bail out when it changes.
+uint32_t supervisorGeneration(SupervisedComponent c);
+
+// Starts the supervisor task, which checks for stalls and recovers, and a
+// low-priority reporter that logs them with per-task CPU and stack telemetry
+void startTaskSupervisor();
+
+#endif // TASK_SUPERVISOR_H
@@ -0,0 +1,417 @@
+#include "telegram_commands.h"
+#include <WiFiClientSecure.h>
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#include "bot_commands.h"
+#include "camera_control.h"
+#include "outbox_policy.h"
+#include "scratch_arena.h"
+#include "telegram_utils.h"
+#include "wifi_link.h"
+
+// Request header and response body of one poll
+#define COMMAND_SCRATCH_BYTES (TELEGRAM_POLL_BODY_MAX + 512)
+#define COMMAND_REQUEST_MAX 384
+#define COMMAND_REPLY_MAX 512
+
+// Headers and body follow the status line closely; this only guards a
+// connection that stalls halfway through an answer
+#define COMMAND_READ_TIMEOUT_MS 5000
+
+static char bot_token[64];
+static char chat_id[24];
+static int64_t chat_id_value = 0;
+static ScratchArena poll_scratch(NULL, 0);
+
+// Kept open between polls; the stand-in used for testing speaks plain HTTP
+static WiFiClientSecure secure_client;
+static WiFiClient plain_client;
+
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+static TelegramCommandStats counters;
+static uint64_t photo_latency_total_ms = 0;
+static uint32_t photo_latency_count = 0;
+
+static void count(uint32_t &counter)
+{
+  portENTER_CRITICAL(&stats_mux);
+  counter++;
+  portEXIT_CRITICAL(&stats_mux);
+}
+
+// Outbox hook: a photo asked for by a command reached Telegram
+static void onDelivered(OutboxKind kind, uint32_t requested_ms, uint32_t delivered_ms)
+{
+  if (kind != OUTBOX_PHOTO)
+  {
+    return;
+  }
+  uint32_t latency = delivered_ms - requested_ms;
+  portENTER_CRITICAL(&stats_mux);
+  counters.photo_latency_last_ms = latency;
+  counters.photo_latency_max_ms = max(counters.photo_latency_max_ms, latency);
+  photo_latency_total_ms += latency;
+  photo_latency_count++;
+  portEXIT_CRITICAL(&stats_mux);
+}
+
+// Reads one header line without the line end; false on timeout
+static bool readLine(WiFiClient &client, char *line, size_t cap)
+{
+  size_t n = client.readBytesUntil('\n', line, cap - 1);
+  line[n] = '\0';
+  if (n > 0 && line[n - 1] == '\r')
+  {
+    line[--n] = '\0';
+  }
+  return n > 0 || client.connected();
+}
+
+// One getUpdates round trip on the kept-alive connection. Returns the HTTP
+// status, or 0 when no answer arrived. The body is cut off at cap - 1 bytes;
+// the rest is read and dropped so the connection stays usable.
+static int pollOnce(WiFiClient &client, int64_t offset, char *body, size_t cap, size_t *body_len)
+{
+  *body_len = 0;
+  if (!client.connected())
+  {
+    client.stop();
+    if (!client.connect(TELEGRAM_API_HOST, TELEGRAM_API_PORT))
+    {
+      return 0;
+    }
+    count(counters.connects);
+  }
+
+  StrBuilder request(poll_scratch, COMMAND_REQUEST_MAX);
+  request.appendf("GET /bot%s/getUpdates?offset=%lld&limit=%d&timeout=%d&allowed_updates=%%5B%%22message%%22%%5D "
+                  "HTTP/1.1\r\n"
+                  "Host: " TELEGRAM_API_HOST "\r\n"
+                  "User-Agent: ESP32-CAM\r\n"
+                  "Connection: keep-alive\r\n\r\n",
+                  bot_token, (long long)offset, TELEGRAM_POLL_LIMIT, TELEGRAM_POLL_TIMEOUT_S);
+  if (request.truncated() || client.write((const uint8_t *)request.c_str(), request.length()) != request.length())
+  {
+    client.stop();
+    return 0;
+  }
+
+  // Telegram answers as soon as a message arrives, or after the poll timeout
+  uint32_t start = millis();
+  while (client.available() == 0)
+  {
+    if (!client.connected() || !wifiLinkUp() || millis() - start > (TELEGRAM_POLL_TIMEOUT_S + 10) * 1000UL)
+    {
+      client.stop();
+      return 0;
+    }
+    delay(20);
+  }
+
+  client.setTimeout(COMMAND_READ_TIMEOUT_MS);
+  char line[128];
+  readLine(client, line, sizeof(line));
+  const char *space = strchr(line, ' ');
+  int status = space ? atoi(space + 1) : 0;
+
+  long content_length = -1;
+  bool keep_open = true;
+  while (readLine(client, line, sizeof(line)) && line[0])
+  {
+    if (strncasecmp(line, "Content-Length:", 15) == 0)
+    {
+      content_length = atol(line + 15);
+    }
+    else if (strncasecmp(line, "Connection:", 11) == 0 && strstr(line + 11, "close"))
+    {
+      keep_open = false;
+    }
+  }
+
+  // Without a length the body ends with the connection
+  size_t len = 0;
+  long remaining = content_length;
+  uint32_t last_data = millis();
+  while (remaining != 0 && millis() - last_data < COMMAND_READ_TIMEOUT_MS)
+  {
+    int avail = client.available();
+    if (avail <= 0)
+    {
+      if (!client.connected())
+      {
+        break;
+      }
+      delay(5);
+      continue;
+    }
+    size_t want = remaining > 0 ? min((size_t)avail, (size_t)remaining) : (size_t)avail;
+    uint8_t drop[64];
+    uint8_t *to = len + 1 < cap ? (uint8_t *)body + len : drop;
+    size_t room = len + 1 < cap ? cap - 1 - len : sizeof(drop);
+    int n = client.read(to, min(want, room));
+    if (n <= 0)
+    {
+      break;
+    }
+    if (to != drop)
+    {
+      len += n;
+    }
+    if (remaining > 0)
+    {
+      remaining -= n;
+    }
+    last_data = millis();
+  }
+  body[len] = '\0';
+  *body_len = len;
+
+  if (!keep_open || remaining != 0)
+  {
+    client.stop();
+  }
+  return status;
+}
+
+static void reply(const char *text)
+{
+  sendMessageToTelegram(bot_token, chat_id, text);
+}
+
+static void takePhotos(int photos, uint32_t received_ms)
+{
+  for (int i = 0; i < photos; i++)
+  {
+    if (i > 0)
+    {
+      vTaskDelay(pdMS_TO_TICKS(TELEGRAM_BURST_GAP_MS));
+    }
+    // Captured right away; only the first photo of a burst is timed
+    if (!sendPhotoToTelegram(bot_token, chat_id, i == 0 ? received_ms : 0))
+    {
+      reply("Capture failed");
+      return;
+    }
+    if (i == 0)
+    {
+      portENTER_CRITICAL(&stats_mux);
+      counters.capture_last_ms = millis() - received_ms;
+      portEXIT_CRITICAL(&stats_mux);
+    }
+  }
+}
+
+static void replyStatus()
+{
+  OutboxStats outbox = getOutboxStats();
+  WifiLinkStats link = getWifiLinkStats();
+  TelegramCommandStats bot = getTelegramCommandStats();
+  IPAddress ip = WiFi.localIP();
+
+  FixedString<COMMAND_REPLY_MAX> text;
+  text.appendf("Up %lu min, IP %u.%u.%u.%u, RSSI %d dBm, %lu Wi-Fi losses\n", (unsigned long)(millis() / 60000),
+               ip[0], ip[1], ip[2], ip[3], (int)link.rssi, (unsigned long)link.losses);
+  text.appendf("Heap %u free (min %u), PSRAM %u free\n", (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMinFreeHeap(),
+               (unsigned)ESP.getFreePsram());
+  text.appendf("JPEG quality %u, outbox %u queued, breaker %s", (unsigned)getCameraSettings().quality,
+               (unsigned)outbox.depth, CircuitBreaker::stateName(outbox.breaker));
+  if (bot.photo_latency_last_ms)
+  {
+    text.appendf("\nLast /photo: queued in %lu ms, delivered in %lu ms (avg %lu)",
+                 (unsigned long)bot.capture_last_ms, (unsigned long)bot.photo_latency_last_ms,
+                 (unsigned long)bot.photo_latency_avg_ms);
+  }
+  reply(text.c_str());
+}
+
+static void setQuality(int quality)
+{
+  FixedString<96> text;
+  CameraSettings next = getCameraSettings();
+  if (quality < 0)
+  {
+    text.appendf("JPEG quality is %u (4-63, lower is better)", (unsigned)next.quality);
+  }
+  else if (quality < 4 || quality > 63)
+  {
+    text.append("Quality must be 4-63, lower is better");
+  }
+  else
+  {
+    next.quality = quality;
+    if (applyCameraSettings(next, NULL))
+    {
+      // Kept like a /control change
+      saveCameraSettings(getCameraSettings(), "custom");
+      text.appendf("JPEG quality set to %d", quality);
+    }
+    else
+    {
+      text.append("Could not apply the quality");
+    }
+  }
+  reply(text.c_str());
+}
+
+static void handleUpdate(const BotUpdate &u, uint32_t received_ms)
+{
+  int arg;
+  BotCommand command = parseBotCommand(u.text, &arg);
+  if (u.chat_id == 0 || command == BOT_NONE)
+  {
+    return;
+  }
+  if (u.chat_id != chat_id_value)
+  {
+    // Anyone can find the bot; only the configured chat controls the camera
+    count(counters.unauthorized);
+    Logger::getInstance().warningf("Ignoring /%s from chat %lld", botCommandName(command), (long long)u.chat_id);
+    return;
+  }
+  time_t now = time(nullptr);
+  if (now > 8 * 3600 * 2 && u.date > 0 && now - u.date > TELEGRAM_COMMAND_MAX_AGE_S)
+  {
+    count(counters.stale);
+    Logger::getInstance().infof("Skipping /%s sent %lld s ago", botCommandName(command), (long long)(now - u.date));
+    return;
+  }
+
+  count(counters.commands);
+  Logger::getInstance().infof("Telegram command /%s", botCommandName(command));
+  switch (command)
+  {
+  case BOT_PHOTO:
+    takePhotos(1, received_ms);
+    break;
+  case BOT_BURST:
+    takePhotos(arg > 0 ? min(arg, TELEGRAM_BURST_MAX) : TELEGRAM_BURST_DEFAULT, received_ms);
+    break;
+  case BOT_STATUS:
+    replyStatus();
+    break;
+  case BOT_QUALITY:
+    setQuality(arg);
+    break;
+  case BOT_HELP:
+    reply("/photo - take a photo\n/burst [n] - take n photos (up to 10)\n/status - uptime, link and memory\n"
+          "/quality [4-63] - show or set JPEG quality, lower is better");
+    break;
+  default:
+    reply("Unknown command, try /help");
+    break;
+  }
+}
+
+static void commandTask(void *arg)
+{
+  WiFiClient &client = TELEGRAM_API_TLS ? secure_client : plain_client;
+  // IMPORTANT: Skip certificate validation - necessary for ESP32 to connect to HTTPS
+  secure_client.setInsecure();
+
+  int64_t offset = 0; // first update not yet acknowledged
+  uint8_t failures = 0;
+  BotUpdate updates[TELEGRAM_POLL_LIMIT];
+  while (true)
+  {
+    if (!wifiLinkUp())
+    {
+      client.stop();
+      wifiLinkWait(60000);
+      continue;
+    }
+
+    ArenaScope scope(poll_scratch);
+    char *body = (char *)poll_scratch.alloc(TELEGRAM_POLL_BODY_MAX + 1, 1);
+    if (!body)
+    {
+      vTaskDelay(pdMS_TO_TICKS(1000));
+      continue;
+    }
+    size_t body_len = 0;
+    int status = pollOnce(client, offset, body, TELEGRAM_POLL_BODY_MAX + 1, &body_len);
+    uint32_t received_ms = millis();
+    count(counters.polls);
+
+    int64_t last_id = offset - 1;
+    int n = status == 200 ? parseBotUpdates(body, body_len, updates, TELEGRAM_POLL_LIMIT, &last_id) : -1;
+    if (n < 0)
+    {
+      count(counters.poll_errors);
+      client.stop();
+      failures = failures < 255 ? failures + 1 : 255;
+      // 401/404: wrong token; 409: a webhook or another poller owns the updates
+      uint32_t delay_ms = outboxBackoffMs(failures, esp_random());
+      if (status == 401 || status == 404 || status == 409)
+      {
+        delay_ms = max(delay_ms, (uint32_t)60000);
+      }
+      Logger::getInstance().warningf("Telegram getUpdates failed (HTTP %d), next poll in %lu s", status,
+                                     (unsigned long)(delay_ms / 1000));
+      vTaskDelay(pdMS_TO_TICKS(delay_ms));
+      continue;
+    }
+    failures = 0;
+
+    // The next request acknowledges everything up to here. An update cut off
+    // by the body buffer is refetched, unless nothing before it fit
+    if (n > 0)
+    {
+      offset = updates[n - 1].update_id + 1;
+    }
+    else if (last_id >= offset)
+    {
+      offset = last_id + 1;
+    }
+    for (int i = 0; i < n; i++)
+    {
+      handleUpdate(updates[i], received_ms);
+    }
+  }
+}
+
+static void addCommandStats(JsonDocument &stats)
+{
+  TelegramCommandStats s = getTelegramCommandStats();
+  stats["bot_polls"] = s.polls;
+  stats["bot_poll_errors"] = s.poll_errors;
+  stats["bot_connects"] = s.connects;
+  stats["bot_commands"] = s.commands;
+  stats["bot_stale"] = s.stale;
+  stats["bot_unauthorized"] = s.unauthorized;
+  if (s.photo_latency_last_ms)
+  {
+    stats["bot_capture_ms"] = s.capture_last_ms;
+    stats["bot_photo_latency_ms"] = s.photo_latency_last_ms;
+    stats["bot_photo_latency_avg_ms"] = s.photo_latency_avg_ms;
+    stats["bot_photo_latency_max_ms"] = s.photo_latency_max_ms;
+  }
+}
+
+bool startTelegramCommands(const char *tg_bot_token, const char *tg_chat_id)
+{
+  strlcpy(bot_token, tg_bot_token, sizeof(bot_token));
+  strlcpy(chat_id, tg_chat_id, sizeof(chat_id));
+  chat_id_value = strtoll(tg_chat_id, NULL, 10);
+
+  // Allocated once and kept, so polls leave the heap alone
+  void *scratch = heap_caps_malloc(COMMAND_SCRATCH_BYTES, MALLOC_CAP_SPIRAM);
+  if (!scratch)
+  {
+    scratch = malloc(COMMAND_SCRATCH_BYTES);
+  }
+  poll_scratch = ScratchArena(scratch, COMMAND_SCRATCH_BYTES);
+
+  outboxOnDelivered(onDelivered);
+  Logger::getInstance().addStatsProvider(addCommandStats);
+  // TLS handshakes need the larger stack
+  return xTaskCreate(commandTask, "tg_commands", 10240, NULL, 2, NULL) == pdPASS;
+}
+
+TelegramCommandStats getTelegramCommandStats()
+{
+  portENTER_CRITICAL(&stats_mux);
+  TelegramCommandStats s = counters;
+  s.photo_latency_avg_ms = photo_latency_count ? photo_latency_total_ms / photo_latency_count : 0;
+  portEXIT_CRITICAL(&stats_mux);
+  return s;
+}
@@ -0,0 +1,58 @@
+#ifndef TELEGRAM_COMMANDS_H
+#define TELEGRAM_COMMANDS_H
+
+#include <Arduino.h>
+#include "logger.h"
+
+// Seconds Telegram holds a getUpdates request open waiting for a message
+#ifndef TELEGRAM_POLL_TIMEOUT_S
+#define TELEGRAM_POLL_TIMEOUT_S 25
+#endif
+
+// Updates fetched per request, and the body buffer they have to fit in
+#ifndef TELEGRAM_POLL_LIMIT
+#define TELEGRAM_POLL_LIMIT 4
+#endif
+#ifndef TELEGRAM_POLL_BODY_MAX
+#define TELEGRAM_POLL_BODY_MAX 3072
+#endif
+
+// Commands older than this (by the message date, once NTP time is known)
+// are acknowledged but not run, e.g. a /burst sent while the camera was off
+#ifndef TELEGRAM_COMMAND_MAX_AGE_S
+#define TELEGRAM_COMMAND_MAX_AGE_S 120
+#endif
+
+// /burst takes this many photos without a number, and at most the max
+#ifndef TELEGRAM_BURST_DEFAULT
+#define TELEGRAM_BURST_DEFAULT 3
+#endif
+#ifndef TELEGRAM_BURST_MAX
+#define TELEGRAM_BURST_MAX 10
+#endif
+#ifndef TELEGRAM_BURST_GAP_MS
+#define TELEGRAM_BURST_GAP_MS 250
+#endif
+
+struct TelegramCommandStats
+{
+  uint32_t polls;
+  uint32_t poll_errors;
+  uint32_t connects; // new connections; the rest reused the open one
+  uint32_t commands;
+  uint32_t stale;        // older than TELEGRAM_COMMAND_MAX_AGE_S, not run
+  uint32_t unauthorized; // from chats other than tg_chat_id, ignored
+  uint32_t capture_last_ms;       // command received to photo queued
+  uint32_t photo_latency_last_ms; // command received to photo delivered
+  uint32_t photo_latency_avg_ms;
+  uint32_t photo_latency_max_ms;
+};
+
+// Starts the task that long-polls getUpdates over one kept-alive connection
+// and runs /photo, /burst [n], /status and /quality [4-63] sent from
+// tg_chat_id. Photos and replies go out through the outbox.
+bool startTelegramCommands(const char *tg_bot_token, const char *tg_chat_id);
+
+TelegramCommandStats getTelegramCommandStats();
+
+#endif // TELEGRAM_COMMANDS_H
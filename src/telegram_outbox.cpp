@@ -0,0 +1,574 @@
+#include "telegram_outbox.h"
+#include "telegram_utils.h"
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#include "wifi_link.h"
+#if TELEGRAM_OUTBOX_SPILL
+#include <LittleFS.h>
+#endif
+
+// Internal heap kept free when a photo has to be copied without PSRAM
+#define OUTBOX_DRAM_RESERVE 32768
+
+// Longest warning collected while outbox_lock is held
+#define OUTBOX_LOG_MAX 256
+
+struct OutboxEntry
+{
+  bool used;
+  bool sending; // owned by the delivery task until the attempt returns
+  OutboxKind kind;
+  uint32_t id; // enqueue order, also the spill file name
+  char token[64];
+  char chat_id[24];
+  uint8_t *data; // NULL while the entry only exists on flash
+  size_t len;
+  uint32_t enqueued_ms;
+  uint32_t requested_ms; // 0 unless the caller tracks delivery
+  uint32_t next_attempt_ms;
+  uint8_t attempts;
+};
+
+static OutboxEntry entries[TELEGRAM_OUTBOX_SLOTS];
+static SemaphoreHandle_t outbox_lock = NULL;
+static TaskHandle_t outbox_task = NULL;
+static CircuitBreaker breaker;
+static uint32_t next_id = 1;
+static size_t bytes_held = 0;
+
+static OutboxStats counters;
+static OutboxDeliveredHook delivered_hook = NULL;
+static uint64_t latency_total_ms = 0;
+
+// Everything one delivery attempt builds, released when it returns
+static ScratchArena job_scratch(NULL, 0);
+
+#if TELEGRAM_OUTBOX_SPILL
+#define OUTBOX_SPILL_DIR "/outbox"
+#define OUTBOX_SPILL_MAGIC 0x5842544Fu // "OTBX"
+
+struct SpillHeader
+{
+  uint32_t magic;
+  uint8_t kind;
+  char token[64];
+  char chat_id[24];
+  uint32_t len;
+};
+
+static bool spill_mounted = false;
+
+static void spillPath(uint32_t id, char *path, size_t size)
+{
+  snprintf(path, size, OUTBOX_SPILL_DIR "/%lu", (unsigned long)id);
+}
+
+static bool spillWrite(const OutboxEntry &e, const uint8_t *data)
+{
+  if (!spill_mounted)
+  {
+    return false;
+  }
+  char path[24];
+  spillPath(e.id, path, sizeof(path));
+  File f = LittleFS.open(path, FILE_WRITE);
+  if (!f)
+  {
+    return false;
+  }
+  SpillHeader h = {};
+  h.magic = OUTBOX_SPILL_MAGIC;
+  h.kind = e.kind;
+  memcpy(h.token, e.token, sizeof(h.token));
+  memcpy(h.chat_id, e.chat_id, sizeof(h.chat_id));
+  h.len = e.len;
+  bool ok = f.write((const uint8_t *)&h, sizeof(h)) == sizeof(h) && f.write(data, e.len) == e.len;
+  f.close();
+  if (!ok)
+  {
+    LittleFS.remove(path);
+  }
+  return ok;
+}
+
+static uint8_t *spillLoad(uint32_t id, size_t len)
+{
+  char path[24];
+  spillPath(id, path, sizeof(path));
+  File f = LittleFS.open(path, FILE_READ);
+  if (!f)
+  {
+    return NULL;
+  }
+  uint8_t *buf = (uint8_t *)heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+  if (!buf)
+  {
+    buf = (uint8_t *)malloc(len);
+  }
+  if (buf && (!f.seek(sizeof(SpillHeader)) || f.read(buf, len) != len))
+  {
+    free(buf);
+    buf = NULL;
+  }
+  f.close();
+  return buf;
+}
+
+static void spillRemove(uint32_t id)
+{
+  if (spill_mounted)
+  {
+    char path[24];
+    spillPath(id, path, sizeof(path));
+    LittleFS.remove(path);
+  }
+}
+
+// Picks up entries the previous boot did not deliver; they stay on flash
+// and are read back when their turn comes
+static void spillRestore()
+{
+  File dir = LittleFS.open(OUTBOX_SPILL_DIR);
+  if (!dir || !dir.isDirectory())
+  {
+    LittleFS.mkdir(OUTBOX_SPILL_DIR);
+    return;
+  }
+
+  int restored = 0;
+  File f;
+  while ((f = dir.openNextFile()))
+  {
+    const char *name = f.name();
+    const char *slash = strrchr(name, '/');
+    uint32_t id = atoi(slash ? slash + 1 : name);
+    SpillHeader h;
+    bool valid = id > 0 && f.read((uint8_t *)&h, sizeof(h)) == sizeof(h) && h.magic == OUTBOX_SPILL_MAGIC &&
+                 f.size() == sizeof(h) + h.len;
+    f.close();
+
+    OutboxEntry *slot = NULL;
+    for (int i = 0; valid && !slot && i < TELEGRAM_OUTBOX_SLOTS; i++)
+    {
+      slot = entries[i].used ? NULL : &entries[i];
+    }
+    if (!slot)
+    {
+      spillRemove(id);
+      continue;
+    }
+
+    slot->used = true;
+    slot->kind = (OutboxKind)h.kind;
+    slot->id = id;
+    memcpy(slot->token, h.token, sizeof(slot->token));
+    slot->token[sizeof(slot->token) - 1] = '\0';
+    memcpy(slot->chat_id, h.chat_id, sizeof(slot->chat_id));
+    slot->chat_id[sizeof(slot->chat_id) - 1] = '\0';
+    slot->len = h.len;
+    slot->enqueued_ms = millis();
+    slot->requested_ms = 0;
+    slot->next_attempt_ms = slot->enqueued_ms;
+    next_id = max(next_id, id + 1);
+    restored++;
+  }
+  if (restored)
+  {
+    Logger::getInstance().infof("Telegram outbox restored %d entries from flash", restored);
+  }
+}
+#endif
+
+// Callers hold outbox_lock
+static void freeEntry(OutboxEntry &e)
+{
+  if (e.data)
+  {
+    heap_caps_free(e.data);
+    bytes_held -= e.len;
+  }
+#if TELEGRAM_OUTBOX_SPILL
+  spillRemove(e.id);
+#endif
+  memset(&e, 0, sizeof(e));
+}
+
+static OutboxEntry *oldestEntry(bool photos_only)
+{
+  OutboxEntry *oldest = NULL;
+  for (int i = 0; i < TELEGRAM_OUTBOX_SLOTS; i++)
+  {
+    OutboxEntry &e = entries[i];
+    if (e.used && !e.sending && (!photos_only || e.kind == OUTBOX_PHOTO) && (!oldest || e.id < oldest->id))
+    {
+      oldest = &e;
+    }
+  }
+  return oldest;
+}
+
+// The warning goes into log, which callers emit once outbox_lock is released
+static void dropEntry(OutboxEntry &e, const char *why, StrBuilder &log)
+{
+  log.appendf("%sTelegram outbox dropped %s #%lu: %s", log.length() ? "; " : "",
+              e.kind == OUTBOX_PHOTO ? "photo" : "message", (unsigned long)e.id, why);
+  freeEntry(e);
+}
+
+static void logWarnings(const StrBuilder &log)
+{
+  if (log.length())
+  {
+    Logger::getInstance().warning(log.c_str());
+  }
+}
+
+static uint8_t *allocPayload(size_t len)
+{
+  if (bytes_held + len > TELEGRAM_OUTBOX_BYTES)
+  {
+    return NULL;
+  }
+  uint8_t *buf = (uint8_t *)heap_caps_malloc(len, MALLOC_CAP_SPIRAM);
+  if (!buf && heap_caps_get_largest_free_block(MALLOC_CAP_8BIT) > len + OUTBOX_DRAM_RESERVE)
+  {
+    buf = (uint8_t *)malloc(len);
+  }
+  return buf;
+}
+
+bool outboxEnqueue(OutboxKind kind, const char *tg_bot_token, const char *tg_chat_id, const uint8_t *data,
+                   size_t len, uint32_t requested_ms)
+{
+  if (!outbox_lock)
+  {
+    Logger::getInstance().error("Telegram outbox not started");
+    return false;
+  }
+  if (len == 0)
+  {
+    return false;
+  }
+
+  FixedString<OUTBOX_LOG_MAX> log;
+  xSemaphoreTake(outbox_lock, portMAX_DELAY);
+
+  OutboxEntry *slot = NULL;
+  for (int i = 0; !slot && i < TELEGRAM_OUTBOX_SLOTS; i++)
+  {
+    slot = entries[i].used ? NULL : &entries[i];
+  }
+  if (!slot)
+  {
+    // Newer photos are worth more than old ones
+    slot = oldestEntry(true);
+    if (!slot)
+    {
+      slot = oldestEntry(false);
+    }
+    if (!slot)
+    {
+      counters.dropped++;
+      xSemaphoreGive(outbox_lock);
+      Logger::getInstance().error("Telegram outbox full, every entry is being sent");
+      return false;
+    }
+    counters.dropped++;
+    dropEntry(*slot, "outbox full", log);
+  }
+
+  uint8_t *copy = allocPayload(len);
+#if !TELEGRAM_OUTBOX_SPILL
+  // Without flash to fall back on, older photos give up their memory
+  OutboxEntry *victim;
+  while (!copy && (victim = oldestEntry(true)) != NULL)
+  {
+    counters.dropped++;
+    dropEntry(*victim, "out of outbox memory", log);
+    copy = allocPayload(len);
+  }
+  if (!copy)
+  {
+    counters.dropped++;
+    xSemaphoreGive(outbox_lock);
+    logWarnings(log);
+    Logger::getInstance().errorf("Telegram outbox has no memory for %u bytes", (unsigned)len);
+    return false;
+  }
+#endif
+
+  slot->used = true;
+  slot->sending = false;
+  slot->kind = kind;
+  slot->id = next_id++;
+  strlcpy(slot->token, tg_bot_token, sizeof(slot->token));
+  strlcpy(slot->chat_id, tg_chat_id, sizeof(slot->chat_id));
+  slot->len = len;
+  slot->enqueued_ms = millis();
+  slot->requested_ms = requested_ms;
+  slot->next_attempt_ms = slot->enqueued_ms;
+  slot->attempts = 0;
+  slot->data = copy;
+  if (copy)
+  {
+    memcpy(copy, data, len);
+    bytes_held += len;
+  }
+
+#if TELEGRAM_OUTBOX_SPILL
+  // Written through so the entry survives a reboot; flash-only if PSRAM is full
+  if (!spillWrite(*slot, data) && !copy)
+  {
+    memset(slot, 0, sizeof(*slot));
+    counters.dropped++;
+    xSemaphoreGive(outbox_lock);
+    logWarnings(log);
+    Logger::getInstance().error("Telegram outbox full and flash spill failed");
+    return false;
+  }
+#endif
+
+  counters.enqueued++;
+  xSemaphoreGive(outbox_lock);
+  logWarnings(log);
+
+  xTaskNotifyGive(outbox_task);
+  return true;
+}
+
+static void expireEntries(uint32_t now, StrBuilder &log)
+{
+  for (int i = 0; i < TELEGRAM_OUTBOX_SLOTS; i++)
+  {
+    OutboxEntry &e = entries[i];
+    if (e.used && !e.sending && now - e.enqueued_ms > TELEGRAM_OUTBOX_MAX_AGE_MS)
+    {
+      counters.expired++;
+      dropEntry(e, "expired", log);
+    }
+  }
+}
+
+// Makes at most one delivery attempt; returns how long to wait before the next
+static uint32_t deliverNext()
+{
+  if (!wifiLinkUp())
+  {
+    // Woken by onLinkChange when the link is back
+    return 60000;
+  }
+
+  ArenaScope job(job_scratch);
+  uint32_t now = millis();
+  uint32_t wait_ms = 60000;
+  StrBuilder log(job_scratch, OUTBOX_LOG_MAX);
+  xSemaphoreTake(outbox_lock, portMAX_DELAY);
+  expireEntries(now, log);
+
+  // Oldest entry whose backoff has run out
+  OutboxEntry *due = NULL;
+  for (int i = 0; i < TELEGRAM_OUTBOX_SLOTS; i++)
+  {
+    OutboxEntry &e = entries[i];
+    if (!e.used)
+    {
+      continue;
+    }
+    int32_t until = (int32_t)(e.next_attempt_ms - now);
+    if (until <= 0)
+    {
+      due = !due || e.id < due->id ? &e : due;
+    }
+    else
+    {
+      wait_ms = min(wait_ms, (uint32_t)until);
+    }
+  }
+  if (!due || !breaker.allow(now))
+  {
+    if (due)
+    {
+      wait_ms = max((int32_t)(breaker.reopensAt() - now), (int32_t)100);
+    }
+    xSemaphoreGive(outbox_lock);
+    logWarnings(log);
+    return wait_ms;
+  }
+  due->sending = true;
+  uint8_t *payload = due->data;
+  xSemaphoreGive(outbox_lock);
+  logWarnings(log);
+  log.clear();
+
+#if TELEGRAM_OUTBOX_SPILL
+  if (!payload)
+  {
+    payload = spillLoad(due->id, due->len);
+  }
+#endif
+
+  TelegramResult result = {TELEGRAM_REJECTED, 0, 0};
+  if (payload)
+  {
+    supervisorBusy(COMPONENT_UPLOAD);
+    powerDemandBegin(DEMAND_JOB);
+    result = due->kind == OUTBOX_PHOTO
+                 ? telegramPostPhoto(job_scratch, due->token, due->chat_id, payload, due->len)
+                 : telegramPostMessage(job_scratch, due->token, due->chat_id, (const char *)payload);
+    powerDemandEnd(DEMAND_JOB);
+    supervisorIdle(COMPONENT_UPLOAD);
+  }
+  if (payload != due->data)
+  {
+    free(payload);
+  }
+
+  now = millis();
+  StrBuilder info(job_scratch, OUTBOX_LOG_MAX);
+  xSemaphoreTake(outbox_lock, portMAX_DELAY);
+  due->sending = false;
+  due->attempts++;
+  const char *what = due->kind == OUTBOX_PHOTO ? "photo" : "message";
+  OutboxKind kind = due->kind;
+  uint32_t requested_ms = 0;
+  if (result.status == TELEGRAM_OK)
+  {
+    requested_ms = due->requested_ms;
+    breaker.onSuccess();
+    uint32_t latency = now - due->enqueued_ms;
+    counters.delivered++;
+    counters.latency_last_ms = latency;
+    counters.latency_max_ms = max(counters.latency_max_ms, latency);
+    latency_total_ms += latency;
+    info.appendf("Telegram %s #%lu delivered after %u attempt(s), %lu ms in the outbox", what,
+                 (unsigned long)due->id, due->attempts, (unsigned long)latency);
+    freeEntry(*due);
+  }
+  else if (!payload)
+  {
+    // A local storage error says nothing about the API, so the breaker is left alone
+    counters.spill_lost++;
+    dropEntry(*due, "spill file unreadable", log);
+  }
+  else if (result.status == TELEGRAM_REJECTED)
+  {
+    // The API answered, so it is reachable; retrying would not help
+    breaker.onSuccess();
+    counters.rejected++;
+    dropEntry(*due, "rejected by the API", log);
+  }
+  else
+  {
+    breaker.onFailure(now, result.retry_after_ms);
+    counters.retries++;
+    uint32_t delay_ms = max(outboxBackoffMs(due->attempts, esp_random()), result.retry_after_ms);
+    due->next_attempt_ms = now + delay_ms;
+    log.appendf("Telegram %s #%lu failed (HTTP %d), retry %u in %lu s, breaker %s", what, (unsigned long)due->id,
+                result.http_code, due->attempts, (unsigned long)(delay_ms / 1000),
+                CircuitBreaker::stateName(breaker.state()));
+  }
+  xSemaphoreGive(outbox_lock);
+
+  if (requested_ms && delivered_hook)
+  {
+    delivered_hook(kind, requested_ms, now);
+  }
+  if (info.length())
+  {
+    Logger::getInstance().info(info.c_str());
+  }
+  logWarnings(log);
+  return 0;
+}
+
+static void outboxTask(void *arg)
+{
+  while (true)
+  {
+    uint32_t wait_ms = deliverNext();
+    if (wait_ms > 0)
+    {
+      // New entries wake the task early
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms));
+    }
+  }
+}
+
+OutboxStats getOutboxStats()
+{
+  xSemaphoreTake(outbox_lock, portMAX_DELAY);
+  OutboxStats s = counters;
+  s.depth = 0;
+  for (int i = 0; i < TELEGRAM_OUTBOX_SLOTS; i++)
+  {
+    s.depth += entries[i].used;
+  }
+  s.bytes = bytes_held;
+  s.latency_avg_ms = counters.delivered ? latency_total_ms / counters.delivered : 0;
+  s.breaker = breaker.state();
+  s.breaker_opens = breaker.opens();
+  xSemaphoreGive(outbox_lock);
+  return s;
+}
+
+static void addOutboxStats(JsonDocument &stats)
+{
+  OutboxStats s = getOutboxStats();
+  stats["outbox_depth"] = s.depth;
+  stats["outbox_bytes"] = s.bytes;
+  stats["outbox_delivered"] = s.delivered;
+  stats["outbox_retries"] = s.retries;
+  stats["outbox_dropped"] = s.dropped;
+  stats["outbox_expired"] = s.expired;
+  stats["outbox_rejected"] = s.rejected;
+  stats["outbox_spill_lost"] = s.spill_lost;
+  stats["outbox_latency_avg_ms"] = s.latency_avg_ms;
+  stats["outbox_latency_max_ms"] = s.latency_max_ms;
+  stats["telegram_breaker"] = CircuitBreaker::stateName(s.breaker);
+  stats["telegram_breaker_opens"] = s.breaker_opens;
+  stats["outbox_scratch_peak"] = job_scratch.peak();
+  stats["outbox_scratch_failures"] = job_scratch.failures();
+}
+
+static void onLinkChange(bool up)
+{
+  if (up && outbox_task)
+  {
+    xTaskNotifyGive(outbox_task);
+  }
+}
+
+void outboxOnDelivered(OutboxDeliveredHook hook)
+{
+  delivered_hook = hook;
+}
+
+bool startTelegramOutbox()
+{
+  outbox_lock = xSemaphoreCreateMutex();
+
+  // Allocated once and kept, so delivery attempts leave the heap alone
+  void *scratch = heap_caps_malloc(TELEGRAM_SCRATCH_BYTES, MALLOC_CAP_SPIRAM);
+  if (!scratch)
+  {
+    scratch = malloc(TELEGRAM_SCRATCH_BYTES);
+  }
+  job_scratch = ScratchArena(scratch, TELEGRAM_SCRATCH_BYTES);
+
+#if TELEGRAM_OUTBOX_SPILL
+  spill_mounted = LittleFS.begin(true);
+  if (spill_mounted)
+  {
+    spillRestore();
+  }
+  else
+  {
+    Logger::getInstance().warning("LittleFS unavailable, Telegram outbox kept in memory only");
+  }
+#endif
+
+  Logger::getInstance().addStatsProvider(addOutboxStats);
+  wifiLinkSubscribe(onLinkChange);
+  // TLS handshakes need the larger stack
+  return xTaskCreate(outboxTask, "tg_outbox", 10240, NULL, 2, &outbox_task) == pdPASS;
+}
@@ -0,0 +1,70 @@
+#ifndef TELEGRAM_OUTBOX_H
+#define TELEGRAM_OUTBOX_H
+
+#include <Arduino.h>
+#include "logger.h"
+#include "outbox_policy.h"
+
+// Photos and messages waiting for delivery, and the PSRAM they may use
+#ifndef TELEGRAM_OUTBOX_SLOTS
+#define TELEGRAM_OUTBOX_SLOTS 16
+#endif
+#ifndef TELEGRAM_OUTBOX_BYTES
+#define TELEGRAM_OUTBOX_BYTES (768 * 1024)
+#endif
+
+// Undelivered entries are dropped after this long
+#ifndef TELEGRAM_OUTBOX_MAX_AGE_MS
+#define TELEGRAM_OUTBOX_MAX_AGE_MS (60UL * 60 * 1000)
+#endif
+
+// 1 also writes every entry to LittleFS (the "spiffs" partition), so the
+// outbox survives a reboot and can hold more than TELEGRAM_OUTBOX_BYTES
+#ifndef TELEGRAM_OUTBOX_SPILL
+#define TELEGRAM_OUTBOX_SPILL 0
+#endif
+
+enum OutboxKind
+{
+  OUTBOX_PHOTO,
+  OUTBOX_MESSAGE,
+};
+
+struct OutboxStats
+{
+  uint32_t depth;
+  uint32_t bytes; // held in PSRAM
+  uint32_t enqueued;
+  uint32_t delivered;
+  uint32_t retries;
+  uint32_t dropped;  // evicted to make room
+  uint32_t expired;  // older than TELEGRAM_OUTBOX_MAX_AGE_MS
+  uint32_t rejected; // refused by the API (4xx)
+  uint32_t spill_lost; // spill file could not be read back
+  uint32_t latency_last_ms; // enqueue to delivery
+  uint32_t latency_avg_ms;
+  uint32_t latency_max_ms;
+  CircuitBreaker::State breaker;
+  uint32_t breaker_opens;
+};
+
+// Called on the delivery task after an entry queued with a requested_ms was
+// delivered, e.g. to measure command-to-photo latency
+typedef void (*OutboxDeliveredHook)(OutboxKind kind, uint32_t requested_ms, uint32_t delivered_ms);
+
+// Starts the delivery task; entries can be queued before Wi-Fi is up
+bool startTelegramOutbox();
+
+// Copies data into the outbox (messages include their terminator). When it
+// is full the oldest photo makes room. Returns false if nothing could be queued.
+// requested_ms, if not 0, is when the entry was asked for and is handed to
+// the delivered hook; it is not kept across a reboot.
+bool outboxEnqueue(OutboxKind kind, const char *tg_bot_token, const char *tg_chat_id, const uint8_t *data,
+                   size_t len, uint32_t requested_ms = 0);
+
+// One hook; a later call replaces it
+void outboxOnDelivered(OutboxDeliveredHook hook);
+
+OutboxStats getOutboxStats();
+
+#endif // TELEGRAM_OUTBOX_H
@@ -1,196 +1,404 @@
 #include "telegram_utils.h"
+#include "wifi_link.h"
+#include "trace.h"
 
-bool sendPhotoToTelegram(const char *tg_bot_token, const char *tg_chat_id)
+#define TELEGRAM_RESPONSE_TIMEOUT_MS 10000
+#define TELEGRAM_BODY_MAX 1024
+#define TELEGRAM_HEADER_MAX 384
+
+static TelegramResult result(TelegramStatus status, int http_code = 0, uint32_t retry_after_ms = 0)
 {
-  camera_fb_t *fb = NULL;
-  bool success = false;
+  TelegramResult r = {status, http_code, retry_after_ms};
+  return r;
+}
 
-  // Capture photo
-  Logger::getInstance().info("Capturing photo");
-  fb = esp_camera_fb_get();
-  if (!fb)
-  {
-    Logger::getInstance().error("Camera capture failed");
-    return false;
-  }
+// Nothing was sent; the request is dropped rather than sent cut off
+static TelegramResult scratchExhausted()
+{
+  Logger::getInstance().error("Telegram request does not fit its scratch arena");
+  return result(TELEGRAM_REJECTED);
+}
 
-  Logger::getInstance().info("Photo captured, size: " + String(fb->len) + " bytes");
+struct TelegramPart
+{
+  const uint8_t *data;
+  size_t len;
+};
 
-  // Create secure WiFi client
-  WiFiClientSecure client;
+static TelegramPart part(const StrBuilder &s)
+{
+  TelegramPart p = {(const uint8_t *)s.c_str(), s.length()};
+  return p;
+}
 
-  // IMPORTANT: Skip certificate validation - necessary for ESP32 to connect to HTTPS
-  client.setInsecure();
+static TelegramPart part(const uint8_t *data, size_t len)
+{
+  TelegramPart p = {data, len};
+  return p;
+}
 
-  Logger::getInstance().info("Connecting to api.telegram.org...");
+// Sends the parts back to back as one POST body and classifies the API's answer
+static TelegramResult telegramRequest(ScratchArena &scratch, const char *path, const char *content_type,
+                                      const TelegramPart *parts, size_t count)
+{
+  uint32_t generation = supervisorGeneration(COMPONENT_UPLOAD);
 
-  // Connect to Telegram API server (HTTPS)
-  if (!client.connect("api.telegram.org", 443))
+  if (!wifiLinkUp())
   {
-    Logger::getInstance().error("Connection failed");
-    esp_camera_fb_return(fb);
-    return false;
+    Logger::getInstance().error("WiFi not connected, cannot reach Telegram");
+    return result(TELEGRAM_RETRY);
   }
 
-  Logger::getInstance().info("Connected to api.telegram.org");
-
-  // Construct the URL path (not the full URL with protocol)
-  String path = "/bot";
-  path += tg_bot_token;
-  path += "/sendPhoto?chat_id=";
-  path += tg_chat_id;
-
-  // Create a boundary for multipart/form-data
-  String boundary = "ESP32CAM-";
-  boundary += String(millis());
-
-  // Construct form data for the photo
-  String head = "--" + boundary + "\r\n";
-  head += "Content-Disposition: form-data; name=\"photo\"; filename=\"esp32cam.jpg\"\r\n";
-  head += "Content-Type: image/jpeg\r\n\r\n";
-
-  String tail = "\r\n--" + boundary + "--\r\n";
-
-  // Calculate content length
-  uint32_t imageLen = fb->len;
-  uint32_t headLen = head.length();
-  uint32_t tailLen = tail.length();
-  uint32_t totalLen = headLen + imageLen + tailLen;
-
-  // Sends the header strings directly over the TCP/SSL connection to the server
-  client.print("POST " + path + " HTTP/1.1\r\n");
-  client.print("Host: api.telegram.org\r\n");
-  client.print("User-Agent: ESP32-CAM\r\n");
-  client.print("Content-Length: " + String(totalLen) + "\r\n");
-  client.print("Content-Type: multipart/form-data; boundary=" + boundary + "\r\n");
-  client.print("Connection: close\r\n\r\n");
+  ArenaScope scope(scratch);
+  uint32_t total_len = 0;
+  for (size_t p = 0; p < count; p++)
+  {
+    total_len += parts[p].len;
+  }
+  StrBuilder header(scratch, TELEGRAM_HEADER_MAX);
+  header.appendf("POST %s HTTP/1.1\r\n"
+                 "Host: " TELEGRAM_API_HOST "\r\n"
+                 "User-Agent: ESP32-CAM\r\n"
+                 "Content-Length: %lu\r\n"
+                 "Content-Type: %s\r\n"
+                 "Connection: close\r\n\r\n",
+                 path, (unsigned long)total_len, content_type);
+  char *response = (char *)scratch.alloc(TELEGRAM_BODY_MAX + 1, 1);
+  if (header.truncated() || !response)
+  {
+    return scratchExhausted();
+  }
 
-  // Send form data header
-  client.print(head);
+  // Both derive from WiFiClient; the stand-in used for testing speaks plain HTTP
+  WiFiClientSecure secure_client;
+  WiFiClient plain_client;
+  WiFiClient &client = TELEGRAM_API_TLS ? secure_client : plain_client;
 
-  // Send JPEG data in chunks
-  uint8_t *fbBuf = fb->buf;
-  size_t fbLen = fb->len;
-  size_t chunkSize = 1024;
+  // IMPORTANT: Skip certificate validation - necessary for ESP32 to connect to HTTPS
+  secure_client.setInsecure();
 
-  Logger::getInstance().info("Sending photo data...");
+  Logger::getInstance().info("Connecting to " TELEGRAM_API_HOST "...");
 
-  for (size_t i = 0; i < fbLen; i += chunkSize)
+  // Connect to Telegram API server
+  TRACE_BEGIN(TRACE_TELEGRAM_CONNECT, 0);
+  bool connected = client.connect(TELEGRAM_API_HOST, TELEGRAM_API_PORT);
+  TRACE_END(TRACE_TELEGRAM_CONNECT, connected);
+  if (!connected)
   {
-    size_t currentChunkSize = min(chunkSize, fbLen - i);
-    size_t bytesWritten = client.write(fbBuf + i, currentChunkSize);
-
-    if (bytesWritten != currentChunkSize)
-    {
-      Logger::getInstance().error("Failed to send all bytes in chunk");
-    }
+    Logger::getInstance().error("Connection failed");
+    return result(TELEGRAM_RETRY);
+  }
 
-    // A small delay can help with stability
-    delay(1);
+  // The whole header in one write, i.e. one TLS record
+  TRACE_BEGIN(TRACE_TELEGRAM_UPLOAD, header.length() + total_len);
+  if (client.write((const uint8_t *)header.c_str(), header.length()) != header.length())
+  {
+    Logger::getInstance().error("Failed to send the request header");
+    client.stop();
+    TRACE_END(TRACE_TELEGRAM_UPLOAD, 0);
+    return result(TELEGRAM_RETRY);
+  }
 
-    // Print progress every ~100KB
-    if (i % (chunkSize * 100) == 0)
+  // Send the body in chunks
+  size_t chunk_size = 1024;
+  for (size_t p = 0; p < count; p++)
+  {
+    const TelegramPart &body = parts[p];
+    for (size_t i = 0; i < body.len; i += chunk_size)
     {
-      Logger::getInstance().info("Sent " + String(i) + " bytes of " + String(fbLen));
+      size_t current = min(chunk_size, body.len - i);
+      if (!wifiLinkUp())
+      {
+        // Retried once the link is back rather than after the TCP timeout
+        Logger::getInstance().error("WiFi link lost during upload");
+        client.stop();
+        TRACE_END(TRACE_TELEGRAM_UPLOAD, 0);
+        return result(TELEGRAM_RETRY);
+      }
+      if (client.write(body.data + i, current) != current)
+      {
+        Logger::getInstance().error("Failed to send all bytes in chunk");
+        client.stop();
+        TRACE_END(TRACE_TELEGRAM_UPLOAD, 0);
+        return result(TELEGRAM_RETRY);
+      }
+
+      // A small delay can help with stability
+      delay(1);
+      supervisorBeat(COMPONENT_UPLOAD);
+
+      // Print progress every ~100KB of a photo
+      if (body.len > chunk_size && i % (chunk_size * 100) == 0)
+      {
+        Logger::getInstance().infof("Sent %u bytes of %u", (unsigned)i, (unsigned)body.len);
+      }
     }
   }
 
-  // Send form data footer
-  client.print(tail);
-  Logger::getInstance().info("Photo data sent, waiting for response...");
+  TRACE_END(TRACE_TELEGRAM_UPLOAD, 1);
+  TraceScope response_span(TRACE_TELEGRAM_RESPONSE);
 
   // Wait for the server's response
-  unsigned long timeout = millis() + 10000; // 10 second timeout
+  unsigned long start = millis();
   while (client.available() == 0)
   {
-    if (millis() > timeout)
+    if (millis() - start > TELEGRAM_RESPONSE_TIMEOUT_MS || supervisorGeneration(COMPONENT_UPLOAD) != generation ||
+        !client.connected() || !wifiLinkUp())
     {
       Logger::getInstance().error("Response timeout");
       client.stop();
-      esp_camera_fb_return(fb);
-      return false;
+      return result(TELEGRAM_RETRY);
     }
     delay(100);
   }
 
-  // Read the response
-  Logger::getInstance().info("Reading response...");
-  String responseStatus = client.readStringUntil('\n');
-  Logger::getInstance().info("Status: " + responseStatus);
+  // "HTTP/1.1 200 OK"
+  char status_line[64];
+  size_t n = client.readBytesUntil('\n', status_line, sizeof(status_line) - 1);
+  status_line[n] = '\0';
+  const char *space = strchr(status_line, ' ');
+  int http_code = space ? atoi(space + 1) : 0;
+  response_span.arg = http_code;
 
-  // Skip HTTP headers
-  while (client.connected())
+  // Skip HTTP headers, using the body buffer for each line
+  while (client.connected() || client.available())
   {
-    String line = client.readStringUntil('\n');
-    if (line == "\r")
+    n = client.readBytesUntil('\n', response, TELEGRAM_BODY_MAX);
+    if (n == 0 || (n == 1 && response[0] == '\r'))
     {
-      // End of headers
       break;
     }
   }
 
   // Read response body
-  String response = "";
-  while (client.available())
+  size_t body_len = 0;
+  while ((client.connected() || client.available()) && body_len < TELEGRAM_BODY_MAX &&
+         millis() - start < TELEGRAM_RESPONSE_TIMEOUT_MS)
   {
-    char c = client.read();
-    response += c;
+    if (client.available())
+    {
+      response[body_len++] = (char)client.read();
+    }
+    else
+    {
+      delay(10);
+    }
   }
-
-  Logger::getInstance().info("Response body: " + response);
-
-  // Check for success (basic check)
-  success = response.indexOf("\"ok\":true") > 0;
-
-  // Clean up
+  response[body_len] = '\0';
   client.stop();
-  esp_camera_fb_return(fb);
 
-  Logger::getInstance().info(success ? "Photo sent successfully!" : "Failed to send photo");
+  Logger::getInstance().infof("Telegram response %d: %s", http_code, response);
 
-  return success;
+  if (http_code == 200 && strstr(response, "\"ok\":true"))
+  {
+    return result(TELEGRAM_OK, http_code);
+  }
+  if (http_code == 429)
+  {
+    // {"ok":false,"error_code":429,...,"parameters":{"retry_after":35}}
+    const char *at = strstr(response, "\"retry_after\":");
+    uint32_t retry_after_s = at ? atoi(at + 14) : 0;
+    return result(TELEGRAM_RETRY, http_code, retry_after_s * 1000);
+  }
+  if (http_code == 0 || http_code >= 500)
+  {
+    return result(TELEGRAM_RETRY, http_code);
+  }
+  return result(TELEGRAM_REJECTED, http_code);
 }
 
-bool sendMessageToTelegram(const char *tg_bot_token, const char *tg_chat_id, const char *message)
+TelegramResult telegramPostPhoto(ScratchArena &scratch, const char *tg_bot_token, const char *tg_chat_id,
+                                 const uint8_t *jpeg, size_t len)
 {
-  if (WiFi.status() != WL_CONNECTED)
+  ArenaScope scope(scratch);
+
+  // Construct the URL path (not the full URL with protocol)
+  StrBuilder path(scratch, 128);
+  path.appendf("/bot%s/sendPhoto?chat_id=%s", tg_bot_token, tg_chat_id);
+
+  // Create a boundary for multipart/form-data
+  char boundary[24];
+  snprintf(boundary, sizeof(boundary), "ESP32CAM-%lu", (unsigned long)millis());
+  StrBuilder content_type(scratch, 64);
+  content_type.appendf("multipart/form-data; boundary=%s", boundary);
+
+  // Construct form data for the photo
+  StrBuilder head(scratch, 160);
+  head.appendf("--%s\r\n"
+               "Content-Disposition: form-data; name=\"photo\"; filename=\"esp32cam.jpg\"\r\n"
+               "Content-Type: image/jpeg\r\n\r\n",
+               boundary);
+  StrBuilder tail(scratch, 40);
+  tail.appendf("\r\n--%s--\r\n", boundary);
+
+  if (path.truncated() || content_type.truncated() || head.truncated() || tail.truncated())
   {
-    Logger::getInstance().error("WiFi not connected, cannot send message");
-    return false;
+    return scratchExhausted();
   }
 
-  Logger::getInstance().info("Preparing to send message to Telegram");
+  Logger::getInstance().infof("Sending photo, %u bytes", (unsigned)len);
+  TelegramPart parts[] = {part(head), part(jpeg, len), part(tail)};
+  return telegramRequest(scratch, path.c_str(), content_type.c_str(), parts, 3);
+}
 
-  HTTPClient http;
-  char url[150];
-  snprintf(url, sizeof(url), "https://api.telegram.org/bot%s/sendMessage", tg_bot_token);
+TelegramResult telegramPostMediaGroup(ScratchArena &scratch, const char *tg_bot_token, const char *tg_chat_id,
+                                      const uint8_t *const *jpegs, const size_t *lens, size_t count,
+                                      const char *caption)
+{
+  if (count == 1)
+  {
+    return telegramPostPhoto(scratch, tg_bot_token, tg_chat_id, jpegs[0], lens[0]);
+  }
+  count = min(count, (size_t)TELEGRAM_MEDIA_GROUP_MAX);
+
+  ArenaScope scope(scratch);
+  StrBuilder path(scratch, 128);
+  path.appendf("/bot%s/sendMediaGroup", tg_bot_token);
+
+  char boundary[24];
+  snprintf(boundary, sizeof(boundary), "ESP32CAM-%lu", (unsigned long)millis());
+  StrBuilder content_type(scratch, 64);
+  content_type.appendf("multipart/form-data; boundary=%s", boundary);
+
+  // chat_id and the album description, whose entries refer to the file parts
+  StrBuilder head(scratch, 256 + 64 * count + (caption ? 2 * strlen(caption) : 0));
+  head.appendf("--%s\r\nContent-Disposition: form-data; name=\"chat_id\"\r\n\r\n%s\r\n"
+               "--%s\r\nContent-Disposition: form-data; name=\"media\"\r\n\r\n[",
+               boundary, tg_chat_id, boundary);
+  for (size_t i = 0; i < count; i++)
+  {
+    head.appendf("%s{\"type\":\"photo\",\"media\":\"attach://p%u\"", i ? "," : "", (unsigned)i);
+    if (i == 0 && caption)
+    {
+      head.append(",\"caption\":\"");
+      for (const char *c = caption; *c; c++)
+      {
+        if (*c == '"' || *c == '\\')
+        {
+          head.append('\\');
+        }
+        head.append(*c);
+      }
+      head.append('"');
+    }
+    head.append('}');
+  }
+  head.append("]\r\n");
+
+  // One header before each photo; the next header closes the previous part.
+  // They share one builder, whose buffer never moves, so the parts can point
+  // into it while it grows.
+  StrBuilder headers(scratch, 128 * count);
+  TelegramPart parts[2 * TELEGRAM_MEDIA_GROUP_MAX + 2];
+  size_t n = 0;
+  size_t total = 0;
+  parts[n++] = part(head);
+  for (size_t i = 0; i < count; i++)
+  {
+    size_t from = headers.length();
+    headers.appendf("%s--%s\r\nContent-Disposition: form-data; name=\"p%u\"; filename=\"p%u.jpg\"\r\n"
+                    "Content-Type: image/jpeg\r\n\r\n",
+                    i ? "\r\n" : "", boundary, (unsigned)i, (unsigned)i);
+    parts[n++] = part((const uint8_t *)headers.c_str() + from, headers.length() - from);
+    parts[n++] = part(jpegs[i], lens[i]);
+    total += lens[i];
+  }
+  StrBuilder tail(scratch, 40);
+  tail.appendf("\r\n--%s--\r\n", boundary);
+  parts[n++] = part(tail);
 
-  Logger::getInstance().info("Beginning HTTP connection");
-  if (!http.begin(url))
+  if (path.truncated() || content_type.truncated() || head.truncated() || headers.truncated() || tail.truncated())
   {
-    Logger::getInstance().info("Failed to begin HTTP connection");
-    return false;
+    return scratchExhausted();
   }
 
-  http.addHeader("Content-Type", "application/x-www-form-urlencoded");
+  Logger::getInstance().infof("Sending album of %u photos, %u bytes", (unsigned)count, (unsigned)total);
+  return telegramRequest(scratch, path.c_str(), content_type.c_str(), parts, n);
+}
 
-  char postData[200];
-  snprintf(postData, sizeof(postData), "chat_id=%s&text=%s&parse_mode=HTML",
-           tg_chat_id, message);
+static bool urlSafe(char c)
+{
+  return isalnum((unsigned char)c) || c == '-' || c == '_' || c == '.' || c == '~';
+}
 
-  Logger::getInstance().info("Sending HTTP POST request");
-  int httpResponseCode = http.POST(postData);
+static size_t urlEncodedLength(const char *text)
+{
+  size_t len = 0;
+  for (const char *p = text; *p; p++)
+  {
+    len += urlSafe(*p) ? 1 : 3;
+  }
+  return len;
+}
 
-  if (httpResponseCode > 0)
+static void urlEncode(StrBuilder &out, const char *text)
+{
+  static const char hex[] = "0123456789ABCDEF";
+  for (const char *p = text; *p; p++)
   {
-    Logger::getInstance().info("HTTP Response code: " + httpResponseCode);
-    http.end();
-    return true;
+    char c = *p;
+    if (urlSafe(c))
+    {
+      out.append(c);
+    }
+    else
+    {
+      out.append('%');
+      out.append(hex[(uint8_t)c >> 4]);
+      out.append(hex[(uint8_t)c & 0x0F]);
+    }
   }
-  else
+}
+
+TelegramResult telegramPostMessage(ScratchArena &scratch, const char *tg_bot_token, const char *tg_chat_id,
+                                   const char *message)
+{
+  ArenaScope scope(scratch);
+  StrBuilder path(scratch, 128);
+  path.appendf("/bot%s/sendMessage", tg_bot_token);
+
+  // Sized exactly, so a long message takes only what it needs
+  StrBuilder form(scratch, urlEncodedLength(tg_chat_id) + urlEncodedLength(message) + 32);
+  form.append("chat_id=");
+  urlEncode(form, tg_chat_id);
+  form.append("&text=");
+  urlEncode(form, message);
+  form.append("&parse_mode=HTML");
+
+  if (path.truncated() || form.truncated())
+  {
+    return scratchExhausted();
+  }
+
+  Logger::getInstance().info("Sending message to Telegram");
+  TelegramPart parts[] = {part(form)};
+  return telegramRequest(scratch, path.c_str(), "application/x-www-form-urlencoded", parts, 1);
+}
+
+bool sendPhotoToTelegram(const char *tg_bot_token, const char *tg_chat_id, uint32_t requested_ms)
+{
+  // Capture photo
+  Logger::getInstance().info("Capturing photo");
+  TRACE_BEGIN(TRACE_PHOTO_CAPTURE, 0);
+  camera_fb_t *fb = cameraCapture();
+  TRACE_END(TRACE_PHOTO_CAPTURE, fb ? traceFrameId(fb->timestamp) : 0);
+  if (!fb)
   {
-    Logger::getInstance().error("Error on HTTP request. Error code: " + httpResponseCode);
-    http.end();
+    Logger::getInstance().error("Camera capture failed");
     return false;
   }
-}
\ No newline at end of file
+
+  Logger::getInstance().infof("Photo captured, size: %u bytes", (unsigned)fb->len);
+
+  // The outbox keeps its own copy, so the frame buffer goes straight back
+  TRACE_BEGIN(TRACE_PHOTO_ENQUEUE, fb->len);
+  bool queued = outboxEnqueue(OUTBOX_PHOTO, tg_bot_token, tg_chat_id, fb->buf, fb->len, requested_ms);
+  TRACE_END(TRACE_PHOTO_ENQUEUE, queued);
+  cameraRelease(fb);
+  return queued;
+}
+
+bool sendMessageToTelegram(const char *tg_bot_token, const char *tg_chat_id, const char *message)
+{
+  return outboxEnqueue(OUTBOX_MESSAGE, tg_bot_token, tg_chat_id, (const uint8_t *)message, strlen(message) + 1);
+}
@@ -6,11 +6,66 @@
 #include "esp_camera.h"
 #include <HTTPClient.h>
 #include "logger.h"
+#include "camera_setup.h"
+#include "task_supervisor.h"
+#include "power_governor.h"
+#include "telegram_outbox.h"
+#include "scratch_arena.h"
 
-// Function to send a photo from the ESP32-CAM to Telegram
-bool sendPhotoToTelegram(const char *tg_bot_token, const char *tg_chat_id);
+// Bot API endpoint; point it at tools/telegram_sink (TLS off) for testing
+#ifndef TELEGRAM_API_HOST
+#define TELEGRAM_API_HOST "api.telegram.org"
+#endif
+#ifndef TELEGRAM_API_PORT
+#define TELEGRAM_API_PORT 443
+#endif
+#ifndef TELEGRAM_API_TLS
+#define TELEGRAM_API_TLS 1
+#endif
 
-// Function to send a text message to Telegram
+// sendMediaGroup takes 2 to 10 photos per album
+#define TELEGRAM_MEDIA_GROUP_MAX 10
+
+// Job arena a caller should give each request: URL path, multipart headers,
+// the HTTP request header and the response body. Texts too long for it are
+// rejected instead of being sent cut off.
+#ifndef TELEGRAM_SCRATCH_BYTES
+#define TELEGRAM_SCRATCH_BYTES 6144
+#endif
+
+enum TelegramStatus
+{
+  TELEGRAM_OK,
+  TELEGRAM_RETRY,    // network error, 5xx or rate limit: worth trying again
+  TELEGRAM_REJECTED, // the API refused the request itself
+};
+
+struct TelegramResult
+{
+  TelegramStatus status;
+  int http_code; // 0 if no response arrived
+  uint32_t retry_after_ms;
+};
+
+// Single delivery attempts; the outbox decides about retries. Every string
+// the request needs comes from scratch and is released again on return.
+TelegramResult telegramPostPhoto(ScratchArena &scratch, const char *tg_bot_token, const char *tg_chat_id,
+                                 const uint8_t *jpeg, size_t len);
+TelegramResult telegramPostMessage(ScratchArena &scratch, const char *tg_bot_token, const char *tg_chat_id,
+                                   const char *message);
+
+// Sends up to TELEGRAM_MEDIA_GROUP_MAX photos as one album in a single
+// request; the caption goes on the first photo. A single photo falls back to
+// sendPhoto without caption.
+TelegramResult telegramPostMediaGroup(ScratchArena &scratch, const char *tg_bot_token, const char *tg_chat_id,
+                                      const uint8_t *const *jpegs, const size_t *lens, size_t count,
+                                      const char *caption);
+
+// Captures a photo and queues it for delivery to Telegram; requested_ms is
+// passed on to the outbox's delivered hook
+bool sendPhotoToTelegram(const char *tg_bot_token, const char *tg_chat_id, uint32_t requested_ms = 0);
+
+// Queues a text message for delivery to Telegram
 bool sendMessageToTelegram(const char *tg_bot_token, const char *tg_chat_id, const char *message);
 
 // Add more functions here if needed
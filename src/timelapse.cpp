@@ -0,0 +1,456 @@
+#include "timelapse.h"
+#include "wifi_link.h"
+#include <Preferences.h>
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "config.h"
+#include "camera_setup.h"
+#include "power_governor.h"
+#include "task_supervisor.h"
+#include "telegram_utils.h"
+#include "outbox_policy.h"
+
+#define TIMELAPSE_NAMESPACE "timelapse"
+
+// The governor's currents are board figures at 5 V
+#define TIMELAPSE_SUPPLY_V 5
+
+struct TimelapseFrame
+{
+  uint8_t *data; // PSRAM
+  size_t len;
+  time_t captured;
+};
+
+static SemaphoreHandle_t timelapse_lock = NULL;
+static TaskHandle_t timelapse_task = NULL;
+
+// Oldest first, ring of frame_count entries starting at frame_head. Only the
+// time-lapse task adds or frees frames; the lock covers readers of the stats.
+static TimelapseFrame frames[TIMELAPSE_MAX_FRAMES];
+static int frame_head = 0;
+static int frame_count = 0;
+
+static volatile bool enabled = false;
+static volatile uint32_t interval_s = TIMELAPSE_INTERVAL_S;
+static volatile uint8_t batch = TIMELAPSE_BATCH;
+
+static TimelapseStats counters;
+static uint64_t wake_to_done_total_ms = 0;
+static uint64_t energy_ma_ms = 0;
+static uint64_t energy_ms = 0;
+
+// Wi-Fi is left up until then after the mode is switched on
+static volatile uint32_t online_until_ms = 0;
+static bool wifi_off = false;
+static uint8_t failures_in_row = 0;
+static uint32_t next_upload_ms = 0;
+
+// Strings for one album request, released once it returns
+static ScratchArena job_scratch(NULL, 0);
+
+static float millijoules(uint32_t ms, uint32_t ma)
+{
+  return (float)ma * ms * TIMELAPSE_SUPPLY_V / 1000.0f;
+}
+
+// Caller holds timelapse_lock
+static void account(uint32_t ms, uint32_t ma)
+{
+  energy_ms += ms;
+  energy_ma_ms += (uint64_t)ms * ma;
+}
+
+static TimelapseFrame &frameAt(int i)
+{
+  return frames[(frame_head + i) % TIMELAPSE_MAX_FRAMES];
+}
+
+// Caller holds timelapse_lock
+static void freeOldest(int n)
+{
+  for (int i = 0; i < n && frame_count > 0; i++)
+  {
+    free(frames[frame_head].data);
+    frames[frame_head].data = NULL;
+    frame_head = (frame_head + 1) % TIMELAPSE_MAX_FRAMES;
+    frame_count--;
+  }
+}
+
+static void loadSettings()
+{
+  Preferences prefs;
+  if (!prefs.begin(TIMELAPSE_NAMESPACE, true))
+  {
+    return;
+  }
+  enabled = prefs.getBool("enabled", false);
+  interval_s = prefs.getUInt("interval", TIMELAPSE_INTERVAL_S);
+  batch = prefs.getUChar("batch", TIMELAPSE_BATCH);
+  prefs.end();
+}
+
+static bool saveSettings()
+{
+  Preferences prefs;
+  if (!prefs.begin(TIMELAPSE_NAMESPACE, false))
+  {
+    return false;
+  }
+  bool ok = prefs.putBool("enabled", enabled) == 1 && prefs.putUInt("interval", interval_s) == 4 &&
+            prefs.putUChar("batch", batch) == 1;
+  prefs.end();
+  return ok;
+}
+
+static bool wifiOn()
+{
+  if (wifi_off)
+  {
+    wifiLinkEnable(true);
+    wifi_off = false;
+  }
+  // The link task reconnects, with the cached AP when it can
+  return wifiLinkWait(TIMELAPSE_WIFI_TIMEOUT_MS);
+}
+
+static void wifiOff()
+{
+  if (!wifi_off)
+  {
+    wifiLinkEnable(false);
+    wifi_off = true;
+  }
+}
+
+// Powers the sensor up, lets exposure settle and keeps one frame in PSRAM
+static void captureFrame(int64_t woke_us)
+{
+  powerDemandBegin(DEMAND_JOB);
+
+  // JPEG size follows brightness, so it stops moving once AEC/AGC converge
+  camera_fb_t *fb = NULL;
+  size_t prev_len = 0;
+  uint32_t discarded = 0;
+  bool settled = false;
+  while ((fb = cameraCapture()) != NULL)
+  {
+    size_t diff = fb->len > prev_len ? fb->len - prev_len : prev_len - fb->len;
+    settled = prev_len > 0 && diff * 100 <= prev_len * TIMELAPSE_SETTLE_PCT;
+    if ((settled && discarded >= TIMELAPSE_WARMUP_MIN) || discarded >= TIMELAPSE_WARMUP_MAX)
+    {
+      break;
+    }
+    prev_len = fb->len;
+    cameraRelease(fb);
+    discarded++;
+  }
+
+  TimelapseFrame frame = {NULL, 0, time(nullptr)};
+  if (fb)
+  {
+    frame.data = (uint8_t *)ps_malloc(fb->len);
+    if (frame.data)
+    {
+      memcpy(frame.data, fb->buf, fb->len);
+      frame.len = fb->len;
+    }
+    cameraRelease(fb);
+  }
+  powerDemandEnd(DEMAND_JOB);
+  uint32_t wake_to_done_ms = (uint32_t)((esp_timer_get_time() - woke_us) / 1000);
+
+  bool dropped = false;
+  xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+  if (frame.data)
+  {
+    if (frame_count == TIMELAPSE_MAX_FRAMES)
+    {
+      freeOldest(1);
+      counters.dropped++;
+      dropped = true;
+    }
+    frameAt(frame_count) = frame;
+    frame_count++;
+    counters.captures++;
+    counters.last_warmup_frames = discarded;
+    counters.unsettled += settled ? 0 : 1;
+    counters.last_wake_to_done_ms = wake_to_done_ms;
+    counters.last_capture_mj = millijoules(wake_to_done_ms, GOVERNOR_ACTIVE_MA);
+    wake_to_done_total_ms += wake_to_done_ms;
+  }
+  account(wake_to_done_ms, GOVERNOR_ACTIVE_MA);
+  uint32_t pending = frame_count;
+  xSemaphoreGive(timelapse_lock);
+
+  if (!frame.data)
+  {
+    Logger::getInstance().error("Time-lapse capture failed");
+    return;
+  }
+  if (dropped)
+  {
+    Logger::getInstance().warning("Time-lapse buffer full, dropped the oldest frame");
+  }
+  Logger::getInstance().infof("Time-lapse frame %lu/%u: %u bytes after %u warm-up frames%s, wake to done %lu ms, "
+                              "~%.0f mJ",
+                              (unsigned long)pending, (unsigned)batch, (unsigned)frame.len, (unsigned)discarded,
+                              settled ? "" : " (exposure not settled)", (unsigned long)wake_to_done_ms,
+                              millijoules(wake_to_done_ms, GOVERNOR_ACTIVE_MA));
+}
+
+static void formatCaption(char *caption, size_t size, time_t first, time_t last, int count)
+{
+  int len = snprintf(caption, size, "Time-lapse, %d frames", count);
+  if (first >= 8 * 3600 * 2)
+  {
+    char from[20], to[8];
+    strftime(from, sizeof(from), "%Y-%m-%d %H:%M", localtime(&first));
+    strftime(to, sizeof(to), "%H:%M", localtime(&last));
+    snprintf(caption + len, size - len, ", %s to %s", from, to);
+  }
+}
+
+// Connects and sends the stored frames, one album per request. Returns the
+// number delivered; *failed is set when Wi-Fi or Telegram should be retried.
+static uint32_t uploadFrames(bool *failed)
+{
+  uint32_t delivered = 0;
+  *failed = !wifiOn();
+  while (!*failed)
+  {
+    const uint8_t *jpegs[TELEGRAM_MEDIA_GROUP_MAX];
+    size_t lens[TELEGRAM_MEDIA_GROUP_MAX];
+    xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+    int n = min(frame_count, TELEGRAM_MEDIA_GROUP_MAX);
+    for (int i = 0; i < n; i++)
+    {
+      jpegs[i] = frameAt(i).data;
+      lens[i] = frameAt(i).len;
+    }
+    time_t first = n ? frameAt(0).captured : 0;
+    time_t last = n ? frameAt(n - 1).captured : 0;
+    xSemaphoreGive(timelapse_lock);
+    if (n == 0)
+    {
+      break;
+    }
+
+    char caption[64];
+    formatCaption(caption, sizeof(caption), first, last, n);
+    supervisorBusy(COMPONENT_UPLOAD);
+    TelegramResult result = telegramPostMediaGroup(job_scratch, tg_bot_token, tg_chat_id, jpegs, lens, n, caption);
+    job_scratch.reset();
+    supervisorIdle(COMPONENT_UPLOAD);
+    if (result.status == TELEGRAM_RETRY)
+    {
+      *failed = true;
+      break;
+    }
+
+    // A rejected album would be rejected again; drop it like the outbox does
+    xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+    freeOldest(n);
+    if (result.status == TELEGRAM_OK)
+    {
+      counters.uploaded += n;
+      delivered += n;
+    }
+    else
+    {
+      counters.dropped += n;
+    }
+    xSemaphoreGive(timelapse_lock);
+  }
+  return delivered;
+}
+
+// Uploads, keeps Wi-Fi up for the reachability window, and books the energy
+static void uploadBatch()
+{
+  uint32_t start = millis();
+  powerDemandBegin(DEMAND_JOB);
+  bool failed;
+  uint32_t delivered = uploadFrames(&failed);
+  powerDemandEnd(DEMAND_JOB);
+  uint32_t upload_ms = millis() - start;
+
+  if (failed)
+  {
+    // Same backoff as the outbox, so an outage does not cost a connect per capture
+    failures_in_row = failures_in_row < 255 ? failures_in_row + 1 : 255;
+    next_upload_ms = millis() + outboxBackoffMs(failures_in_row, esp_random());
+  }
+  else
+  {
+    failures_in_row = 0;
+  }
+
+  float per_frame_mj = millijoules(upload_ms, GOVERNOR_ACTIVE_MA) / (delivered ? delivered : 1);
+  xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+  counters.upload_failures += failed ? 1 : 0;
+  if (delivered)
+  {
+    counters.upload_mj_per_frame = per_frame_mj;
+  }
+  account(upload_ms, GOVERNOR_ACTIVE_MA);
+  uint32_t pending = frame_count;
+  xSemaphoreGive(timelapse_lock);
+
+  if (failed)
+  {
+    Logger::getInstance().warningf("Time-lapse upload failed after %lu ms, %lu frames kept, next try in %lu s",
+                                   (unsigned long)upload_ms, (unsigned long)pending,
+                                   (unsigned long)((next_upload_ms - millis()) / 1000));
+  }
+  else
+  {
+    Logger::getInstance().infof("Time-lapse upload: %lu frames in %lu ms, ~%.0f mJ per frame",
+                                (unsigned long)delivered, (unsigned long)upload_ms, per_frame_mj);
+  }
+
+  if (wifiLinkUp())
+  {
+    // Ship the stats and let queued log events and outbox entries out
+    Logger::getInstance().logSystemStats();
+    uint32_t window_start = millis();
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TIMELAPSE_WINDOW_MS));
+    xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+    account(millis() - window_start, GOVERNOR_IDLE_MA);
+    xSemaphoreGive(timelapse_lock);
+  }
+}
+
+static void timelapseTask(void *arg)
+{
+  while (true)
+  {
+    if (!enabled)
+    {
+      // Back to normal operation: reconnect and send what is left
+      wifiOn();
+      if (frame_count > 0)
+      {
+        uploadBatch();
+      }
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+
+    int64_t woke_us = esp_timer_get_time();
+    captureFrame(woke_us);
+    if (frame_count >= batch && (int32_t)(millis() - next_upload_ms) >= 0)
+    {
+      uploadBatch();
+    }
+    if ((int32_t)(millis() - online_until_ms) >= 0)
+    {
+      wifiOff();
+    }
+
+    // Sleep out the rest of the interval
+    uint32_t elapsed_ms = (uint32_t)((esp_timer_get_time() - woke_us) / 1000);
+    uint32_t interval_ms = interval_s * 1000;
+    if (!enabled || elapsed_ms >= interval_ms)
+    {
+      continue;
+    }
+    uint32_t rest_ms = interval_ms - elapsed_ms;
+    uint32_t slept_ms = wifi_off ? powerLightSleep(rest_ms) : 0;
+    uint32_t ma = GOVERNOR_SLEEP_MA;
+    if (!slept_ms)
+    {
+      // Wi-Fi still up or a viewer holds the device awake; a settings change ends the wait
+      uint32_t start = millis();
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(rest_ms));
+      slept_ms = millis() - start;
+      ma = GOVERNOR_IDLE_MA;
+    }
+
+    xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+    account(slept_ms, ma);
+    counters.sleep_mj_per_cycle = millijoules(slept_ms, ma);
+    xSemaphoreGive(timelapse_lock);
+  }
+}
+
+bool setTimelapse(bool on, uint32_t seconds, uint8_t frames_per_batch)
+{
+  interval_s = constrain(seconds, 10, 24 * 3600);
+  batch = constrain(frames_per_batch, 1, TELEGRAM_MEDIA_GROUP_MAX);
+  if (on && !enabled)
+  {
+    online_until_ms = millis() + TIMELAPSE_ONLINE_MS;
+    xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+    energy_ms = 0;
+    energy_ma_ms = 0;
+    xSemaphoreGive(timelapse_lock);
+  }
+  enabled = on;
+  bool saved = saveSettings();
+  if (timelapse_task)
+  {
+    xTaskNotifyGive(timelapse_task);
+  }
+  Logger::getInstance().infof("Time-lapse %s, every %lu s, upload every %u frames", on ? "on" : "off",
+                              (unsigned long)interval_s, (unsigned)batch);
+  return saved;
+}
+
+TimelapseStats getTimelapseStats()
+{
+  xSemaphoreTake(timelapse_lock, portMAX_DELAY);
+  TimelapseStats s = counters;
+  s.pending = frame_count;
+  s.avg_wake_to_done_ms = counters.captures ? wake_to_done_total_ms / counters.captures : 0;
+  s.avg_ma = energy_ms ? (uint32_t)(energy_ma_ms / energy_ms) : 0;
+  xSemaphoreGive(timelapse_lock);
+  s.enabled = enabled;
+  s.interval_s = interval_s;
+  s.batch = batch;
+  return s;
+}
+
+static void addTimelapseStats(JsonDocument &stats)
+{
+  TimelapseStats s = getTimelapseStats();
+  stats["timelapse_enabled"] = s.enabled;
+  stats["timelapse_captures"] = s.captures;
+  stats["timelapse_pending"] = s.pending;
+  stats["timelapse_uploaded"] = s.uploaded;
+  stats["timelapse_upload_failures"] = s.upload_failures;
+  stats["timelapse_dropped"] = s.dropped;
+  stats["timelapse_warmup_frames"] = s.last_warmup_frames;
+  stats["timelapse_unsettled"] = s.unsettled;
+  stats["timelapse_wake_to_done_ms"] = s.last_wake_to_done_ms;
+  stats["timelapse_wake_to_done_avg_ms"] = s.avg_wake_to_done_ms;
+  stats["timelapse_capture_mj"] = s.last_capture_mj;
+  stats["timelapse_upload_mj_per_frame"] = s.upload_mj_per_frame;
+  stats["timelapse_sleep_mj"] = s.sleep_mj_per_cycle;
+  stats["timelapse_avg_ma"] = s.avg_ma;
+  stats["timelapse_scratch_peak"] = job_scratch.peak();
+}
+
+void startTimelapse()
+{
+  timelapse_lock = xSemaphoreCreateMutex();
+  loadSettings();
+
+  void *scratch = heap_caps_malloc(TELEGRAM_SCRATCH_BYTES, MALLOC_CAP_SPIRAM);
+  if (!scratch)
+  {
+    scratch = malloc(TELEGRAM_SCRATCH_BYTES);
+  }
+  job_scratch = ScratchArena(scratch, TELEGRAM_SCRATCH_BYTES);
+  if (enabled)
+  {
+    online_until_ms = millis() + TIMELAPSE_ONLINE_MS;
+    Logger::getInstance().infof("Time-lapse resumes, every %lu s, upload every %u frames", (unsigned long)interval_s,
+                                (unsigned)batch);
+  }
+
+  Logger::getInstance().addStatsProvider(addTimelapseStats);
+  // TLS uploads need the larger stack
+  xTaskCreate(timelapseTask, "timelapse", 10240, NULL, 2, &timelapse_task);
+}
@@ -0,0 +1,76 @@
+#ifndef TIMELAPSE_H
+#define TIMELAPSE_H
+
+#include <Arduino.h>
+#include "logger.h"
+
+// Defaults until changed through /timelapse (saved to NVS)
+#ifndef TIMELAPSE_INTERVAL_S
+#define TIMELAPSE_INTERVAL_S 60
+#endif
+#ifndef TIMELAPSE_BATCH
+#define TIMELAPSE_BATCH 10
+#endif
+
+// Frames kept in PSRAM while uploads fail; beyond this the oldest are dropped
+#ifndef TIMELAPSE_MAX_FRAMES
+#define TIMELAPSE_MAX_FRAMES 40
+#endif
+
+// After power-up, frames are discarded until two in a row differ in JPEG
+// size by no more than TIMELAPSE_SETTLE_PCT (exposure and gain have
+// converged), but at least WARMUP_MIN and at most WARMUP_MAX frames
+#ifndef TIMELAPSE_WARMUP_MIN
+#define TIMELAPSE_WARMUP_MIN 2
+#endif
+#ifndef TIMELAPSE_WARMUP_MAX
+#define TIMELAPSE_WARMUP_MAX 15
+#endif
+#ifndef TIMELAPSE_SETTLE_PCT
+#define TIMELAPSE_SETTLE_PCT 5
+#endif
+
+// Wi-Fi stays up this long after the mode starts and after every upload, so
+// /timelapse can still be reached to change or stop it
+#ifndef TIMELAPSE_ONLINE_MS
+#define TIMELAPSE_ONLINE_MS 120000
+#endif
+#ifndef TIMELAPSE_WINDOW_MS
+#define TIMELAPSE_WINDOW_MS 15000
+#endif
+#ifndef TIMELAPSE_WIFI_TIMEOUT_MS
+#define TIMELAPSE_WIFI_TIMEOUT_MS 20000
+#endif
+
+struct TimelapseStats
+{
+  bool enabled;
+  uint32_t interval_s;
+  uint8_t batch;
+  uint32_t captures;
+  uint32_t pending; // frames in PSRAM waiting for the next upload
+  uint32_t uploaded;
+  uint32_t upload_failures;
+  uint32_t dropped;
+  uint32_t last_warmup_frames;
+  uint32_t unsettled; // captures taken at WARMUP_MAX without settling
+  uint32_t last_wake_to_done_ms; // wake to frame stored and sensor released
+  uint32_t avg_wake_to_done_ms;
+  float last_capture_mj; // energy estimates at 5 V from the governor's currents
+  float upload_mj_per_frame;
+  float sleep_mj_per_cycle;
+  uint32_t avg_ma; // over everything since the mode started
+};
+
+// Loads the saved settings and starts the time-lapse task; it stays idle
+// until the mode is enabled
+void startTimelapse();
+
+// Turns the mode on or off and saves it, so it resumes after a reboot.
+// While on, the device light-sleeps between captures with Wi-Fi off and
+// only connects every `batch` captures to upload them as one album.
+bool setTimelapse(bool enabled, uint32_t interval_s, uint8_t batch);
+
+TimelapseStats getTimelapseStats();
+
+#endif // TIMELAPSE_H
@@ -0,0 +1,298 @@
+#include "trace.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "logger.h"
+
+static_assert((TRACE_RING_EVENTS & (TRACE_RING_EVENTS - 1)) == 0, "TRACE_RING_EVENTS must be a power of two");
+static_assert(sizeof(TraceEvent) == 12, "TraceEvent is part of the dump format");
+static_assert(portNUM_PROCESSORS <= TRACE_MAX_CORES, "one ring per core");
+
+volatile bool trace_on = false;
+
+// One ring per core, written by whatever runs there. Writers claim a slot
+// with an atomic increment of head and fill it; nothing waits, and a full
+// ring overwrites its oldest events.
+struct TraceRing
+{
+  TraceEvent *events;
+  uint32_t head;  // events written since the last clear; the slot is head & (capacity - 1)
+  uint32_t epoch; // clock_epoch at this ring's last sync
+  bool timer;     // timer_clock at this ring's last sync
+  TickType_t synced_at;
+};
+
+static TraceRing rings[portNUM_PROCESSORS];
+static uint32_t capacity = 0;
+
+// Bumped whenever the cycle counters stop meaning what the last sync said
+static volatile uint32_t clock_epoch = 1;
+
+// Stamp events with esp_timer instead of the cycle counter
+static volatile bool timer_clock = false;
+
+// Tasks get a small number on their first event; a linear scan over a few
+// pointers is cheaper than a name lookup per event
+struct TraceTask
+{
+  TaskHandle_t handle;
+  char name[TRACE_TASK_NAME_LEN];
+};
+static TraceTask tasks[TRACE_TASK_SLOTS];
+static uint8_t task_count = 0;
+static portMUX_TYPE task_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint8_t taskSlot()
+{
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  uint8_t known = __atomic_load_n(&task_count, __ATOMIC_ACQUIRE);
+  for (uint8_t i = 0; i < known; i++)
+  {
+    if (tasks[i].handle == self)
+    {
+      return i + 1;
+    }
+  }
+
+  uint8_t slot = 0;
+  portENTER_CRITICAL(&task_mux);
+  for (uint8_t i = known; i < task_count; i++)
+  {
+    if (tasks[i].handle == self)
+    {
+      slot = i + 1;
+    }
+  }
+  if (!slot && task_count < TRACE_TASK_SLOTS)
+  {
+    TraceTask &t = tasks[task_count];
+    t.handle = self;
+    strlcpy(t.name, pcTaskGetTaskName(self), sizeof(t.name));
+    slot = task_count + 1;
+    __atomic_store_n(&task_count, task_count + 1, __ATOMIC_RELEASE);
+  }
+  portEXIT_CRITICAL(&task_mux);
+  return slot;
+}
+
+static void put(TraceRing &ring, const TraceEvent &e)
+{
+  uint32_t at = __atomic_fetch_add(&ring.head, 1, __ATOMIC_RELAXED);
+  ring.events[at & (capacity - 1)] = e;
+}
+
+// Pairs this core's cycle counter with the microsecond clock. In timer mode
+// the "counter" is esp_timer itself and the sync says it ticks at 1 MHz.
+static void sync(TraceRing &ring, int core, bool timer)
+{
+  uint32_t cycles;
+  int64_t now_us;
+  do
+  {
+    cycles = ESP.getCycleCount();
+    now_us = esp_timer_get_time();
+  } while (xPortGetCoreID() != core);
+
+  TraceEvent e;
+  e.cycles = timer ? (uint32_t)now_us : cycles;
+  e.arg = (uint32_t)now_us;
+  e.id = timer ? 1 : (uint8_t)getCpuFrequencyMhz();
+  e.phase = TRACE_PHASE_SYNC;
+  e.task = (uint8_t)(now_us >> 32);
+  e.reserved = (uint8_t)(now_us >> 40);
+  ring.epoch = clock_epoch;
+  ring.timer = timer;
+  ring.synced_at = xTaskGetTickCount();
+  put(ring, e);
+}
+
+void traceRecord(uint8_t id, uint8_t phase, uint32_t arg)
+{
+  if (!capacity)
+  {
+    return;
+  }
+  uint8_t task = taskSlot();
+
+  // The counter is per core; read it on the core whose ring gets the event
+  bool timer = timer_clock;
+  int core;
+  uint32_t cycles;
+  do
+  {
+    core = xPortGetCoreID();
+    cycles = timer ? (uint32_t)esp_timer_get_time() : ESP.getCycleCount();
+  } while (xPortGetCoreID() != core);
+
+  TraceRing &ring = rings[core];
+  if (ring.epoch != clock_epoch || ring.timer != timer ||
+      xTaskGetTickCount() - ring.synced_at > pdMS_TO_TICKS(TRACE_SYNC_MS))
+  {
+    sync(ring, core, timer);
+  }
+
+  TraceEvent e;
+  e.cycles = cycles;
+  e.arg = arg;
+  e.id = id;
+  e.phase = phase;
+  e.task = task;
+  e.reserved = 0;
+  put(ring, e);
+}
+
+void traceClockChanged()
+{
+  clock_epoch++;
+}
+
+void traceUseTimerClock(bool on)
+{
+  timer_clock = on;
+}
+
+void traceSetEnabled(bool on)
+{
+  if (on && !capacity)
+  {
+    return;
+  }
+  if (on && !trace_on)
+  {
+    // Every ring starts with a fresh sync
+    clock_epoch++;
+  }
+  trace_on = on;
+}
+
+void traceClear()
+{
+  bool was_on = trace_on;
+  trace_on = false;
+  // Lets a writer that saw trace_on set finish its slot
+  vTaskDelay(pdMS_TO_TICKS(2));
+  for (int core = 0; core < portNUM_PROCESSORS; core++)
+  {
+    rings[core].head = 0;
+  }
+  clock_epoch++;
+  trace_on = was_on;
+}
+
+bool traceDump(TraceSink sink, void *ctx)
+{
+  bool was_on = trace_on;
+  trace_on = false;
+  vTaskDelay(pdMS_TO_TICKS(2));
+
+  TraceDumpHeader header = {};
+  header.magic = TRACE_MAGIC;
+  header.version = TRACE_VERSION;
+  header.event_size = sizeof(TraceEvent);
+  header.cores = portNUM_PROCESSORS;
+  header.task_count = __atomic_load_n(&task_count, __ATOMIC_ACQUIRE);
+  header.cpu_mhz = getCpuFrequencyMhz();
+  header.capacity = capacity;
+  for (int core = 0; core < portNUM_PROCESSORS; core++)
+  {
+    header.written[core] = rings[core].head;
+  }
+  header.dumped_us = esp_timer_get_time();
+
+  bool ok = sink(&header, sizeof(header), ctx);
+  for (int core = 0; ok && core < portNUM_PROCESSORS; core++)
+  {
+    const TraceRing &ring = rings[core];
+    uint32_t count = min(ring.head, capacity);
+    ok = sink(&count, sizeof(count), ctx);
+
+    // Oldest first: from the slot after head to the end, then from the start
+    uint32_t first = (ring.head - count) & (capacity - 1);
+    uint32_t to_end = min(count, capacity - first);
+    if (ok && to_end)
+    {
+      ok = sink(ring.events + first, to_end * sizeof(TraceEvent), ctx);
+    }
+    if (ok && count > to_end)
+    {
+      ok = sink(ring.events, (count - to_end) * sizeof(TraceEvent), ctx);
+    }
+  }
+  for (uint8_t i = 0; ok && i < header.task_count; i++)
+  {
+    ok = sink(tasks[i].name, TRACE_TASK_NAME_LEN, ctx);
+  }
+
+  // Time spent dumping is not in the rings; resync rather than span it
+  if (was_on)
+  {
+    clock_epoch++;
+  }
+  trace_on = was_on;
+  return ok;
+}
+
+TraceStats getTraceStats()
+{
+  TraceStats s = {};
+  s.enabled = trace_on;
+  s.capacity = capacity;
+  s.tasks = __atomic_load_n(&task_count, __ATOMIC_ACQUIRE);
+  for (int core = 0; core < portNUM_PROCESSORS; core++)
+  {
+    uint32_t head = rings[core].head;
+    s.recorded += head;
+    s.overwritten += head > capacity ? head - capacity : 0;
+  }
+  return s;
+}
+
+static void addTraceStats(JsonDocument &stats)
+{
+  TraceStats s = getTraceStats();
+  stats["trace_enabled"] = s.enabled;
+  stats["trace_events"] = s.recorded;
+  stats["trace_overwritten"] = s.overwritten;
+  stats["trace_tasks"] = s.tasks;
+}
+
+void startTrace()
+{
+  // Rings are written from several tasks at once but never freed
+  size_t events = TRACE_RING_EVENTS;
+  void *buffers[portNUM_PROCESSORS] = {};
+  for (int core = 0; core < portNUM_PROCESSORS; core++)
+  {
+    buffers[core] = heap_caps_calloc(events, sizeof(TraceEvent), MALLOC_CAP_SPIRAM);
+  }
+  if (!buffers[0] || !buffers[portNUM_PROCESSORS - 1])
+  {
+    events = TRACE_RING_EVENTS / 8;
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+      free(buffers[core]);
+      buffers[core] = calloc(events, sizeof(TraceEvent));
+    }
+  }
+  for (int core = 0; core < portNUM_PROCESSORS; core++)
+  {
+    if (!buffers[core])
+    {
+      Logger::getInstance().error("No memory for the trace rings, tracing unavailable");
+      for (int i = 0; i < portNUM_PROCESSORS; i++)
+      {
+        free(buffers[i]);
+      }
+      return;
+    }
+  }
+  for (int core = 0; core < portNUM_PROCESSORS; core++)
+  {
+    rings[core].events = (TraceEvent *)buffers[core];
+  }
+  capacity = events;
+
+  Logger::getInstance().addStatsProvider(addTraceStats);
+  Logger::getInstance().infof("Trace rings: %u events per core%s", (unsigned)capacity,
+                              TRACE_AT_BOOT ? ", recording" : ", off until /trace?enable=1");
+  traceSetEnabled(TRACE_AT_BOOT);
+}
@@ -0,0 +1,112 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+#include <sys/time.h>
+#include "trace_format.h"
+
+// Trace points compiled in (1) or out entirely (0)
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+// Record from boot instead of waiting for /trace?enable=1
+#ifndef TRACE_AT_BOOT
+#define TRACE_AT_BOOT 0
+#endif
+
+// Events per core ring, a power of two; 12 bytes each, in PSRAM (an eighth
+// of it in internal RAM without PSRAM)
+#ifndef TRACE_RING_EVENTS
+#define TRACE_RING_EVENTS 4096
+#endif
+
+// A sync event is recorded at least this often while events flow, well
+// within the 2^31 cycles a signed distance to it can span (9 s at 240 MHz)
+#ifndef TRACE_SYNC_MS
+#define TRACE_SYNC_MS 4000
+#endif
+
+struct TraceStats
+{
+  bool enabled;
+  uint32_t recorded;    // since the last clear, both cores
+  uint32_t overwritten; // lost to ring wrap-around
+  uint32_t capacity;    // per core
+  uint8_t tasks;        // entries in the task table
+};
+
+// Checked inline by the trace macros, so a disabled trace point costs one
+// load and a branch
+extern volatile bool trace_on;
+
+// Allocates the per-core rings and registers the stats; recording stays off
+// until traceSetEnabled(true) unless TRACE_AT_BOOT is set
+void startTrace();
+
+void traceSetEnabled(bool on);
+void traceClear();
+
+// Resynchronizes the cycle-counter timestamps after the CPU clock changed or
+// the chip slept (the counter stops in light sleep)
+void traceClockChanged();
+
+// Stamps events with esp_timer_get_time() instead of the cycle counter, for
+// while DFS may change the CPU clock without telling anyone. Slower per
+// event, but exact at any clock.
+void traceUseTimerClock(bool on);
+
+void traceRecord(uint8_t id, uint8_t phase, uint32_t arg);
+
+// Streams the dump described in trace_format.h to sink; recording pauses
+// meanwhile so the rings do not move under it. False when sink fails.
+typedef bool (*TraceSink)(const void *data, size_t len, void *ctx);
+bool traceDump(TraceSink sink, void *ctx);
+
+TraceStats getTraceStats();
+
+// Frames are identified by their capture time (low 32 bits, in us), the same
+// value the stream sends as X-Timestamp
+inline uint32_t traceFrameId(const struct timeval &captured)
+{
+  return (uint32_t)((int64_t)captured.tv_sec * 1000000 + captured.tv_usec);
+}
+
+#if TRACE_ENABLED
+#define TRACE_EVENT(id, phase, arg)                                                                                    \
+  do                                                                                                                   \
+  {                                                                                                                    \
+    if (__builtin_expect(trace_on, 0))                                                                                 \
+    {                                                                                                                  \
+      traceRecord((id), (phase), (arg));                                                                               \
+    }                                                                                                                  \
+  } while (0)
+#else
+#define TRACE_EVENT(id, phase, arg)                                                                                    \
+  do                                                                                                                   \
+  {                                                                                                                    \
+  } while (0)
+#endif
+
+#define TRACE_BEGIN(id, arg) TRACE_EVENT(id, TRACE_PHASE_BEGIN, arg)
+#define TRACE_END(id, arg) TRACE_EVENT(id, TRACE_PHASE_END, arg)
+#define TRACE_INSTANT(id, arg) TRACE_EVENT(id, TRACE_PHASE_INSTANT, arg)
+
+// Span over the enclosing block, for functions with many returns; set arg
+// to have it recorded with the end event
+class TraceScope
+{
+public:
+  explicit TraceScope(uint8_t id, uint32_t begin_arg = 0) : arg(0), id_(id) { TRACE_BEGIN(id, begin_arg); }
+  ~TraceScope() { TRACE_END(id_, arg); }
+
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+
+  uint32_t arg;
+
+private:
+  uint8_t id_;
+};
+
+#endif // TRACE_H
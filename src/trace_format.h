@@ -0,0 +1,98 @@
+#ifndef TRACE_FORMAT_H
+#define TRACE_FORMAT_H
+
+// Binary layout of the trace recorder's dump, shared by the recorder
+// (trace.cpp) and the host converter (tools/trace_convert). Plain C++ so it
+// can be compiled off-device. Everything is little-endian, as on the ESP32.
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TRACE_MAGIC 0x31435254u // "TRC1"
+#define TRACE_VERSION 1
+#define TRACE_MAX_CORES 2
+#define TRACE_TASK_SLOTS 16
+#define TRACE_TASK_NAME_LEN 16
+
+// Instrumented spans. Names for the host are in traceIdName(). Frame ids are
+// the capture time in us (low 32 bits); send spans begin with the byte
+// count and end with the result (esp_err_t, or 1 for success).
+enum TraceId : uint8_t
+{
+  TRACE_FB_GET = 1,        // esp_camera_fb_get; end: frame id
+  TRACE_STREAM_FRAME,      // one MJPEG part; begin: frame id
+  TRACE_STREAM_HEADER,     // httpd_resp_send_chunk of the part header
+  TRACE_STREAM_JPEG,       // ... of the JPEG data
+  TRACE_STREAM_BOUNDARY,   // ... of the boundary
+  TRACE_PHOTO_CAPTURE,     // sendPhotoToTelegram: capture; end: frame id
+  TRACE_PHOTO_ENQUEUE,     // sendPhotoToTelegram: copy into the outbox
+  TRACE_TELEGRAM_CONNECT,  // TCP connect and TLS handshake
+  TRACE_TELEGRAM_UPLOAD,   // request header and body
+  TRACE_TELEGRAM_RESPONSE, // wait for and read the answer; end: HTTP status
+  TRACE_LOGSTASH_SEND,     // Logger::sendToLogstash; end: HTTP status
+  TRACE_ID_COUNT
+};
+
+enum TracePhase : uint8_t
+{
+  TRACE_PHASE_BEGIN = 1,
+  TRACE_PHASE_END,
+  TRACE_PHASE_INSTANT,
+  // Clock anchor, recorded before the first event after enabling or a clock
+  // change and then every TRACE_SYNC_MS while events flow. cycles is the
+  // core's counter, arg the low 32 bits of esp_timer_get_time(), task and
+  // reserved bits 32-47 of it, and id the CPU clock in MHz. While frequency
+  // scaling is on, events are stamped with esp_timer instead and id is 1.
+  TRACE_PHASE_SYNC,
+};
+
+// 12 bytes per event. cycles is the CPU cycle counter of the core whose ring
+// holds the event (or esp_timer in us, see TRACE_PHASE_SYNC); it wraps every
+// 2^32 cycles (18 s at 240 MHz), which the sync events resolve.
+struct TraceEvent
+{
+  uint32_t cycles;
+  uint32_t arg;
+  uint8_t id;    // TraceId
+  uint8_t phase; // TracePhase
+  uint8_t task;  // 1-based slot in the task table, 0 when it was full
+  uint8_t reserved;
+};
+
+// The dump is this header, then for each core a uint32_t event count and
+// that many TraceEvents, oldest first, then task_count names of
+// TRACE_TASK_NAME_LEN bytes (task 1 first).
+struct TraceDumpHeader
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t event_size; // sizeof(TraceEvent)
+  uint8_t cores;
+  uint8_t task_count;
+  uint16_t cpu_mhz;  // at the time of the dump
+  uint32_t capacity; // events per core ring
+  // Events ever recorded per core; those beyond capacity were overwritten
+  uint32_t written[TRACE_MAX_CORES];
+  uint64_t dumped_us; // esp_timer_get_time() at the dump
+};
+
+inline const char *traceIdName(uint8_t id)
+{
+  static const char *const names[TRACE_ID_COUNT] = {
+      "?",
+      "fb_get",
+      "stream_frame",
+      "stream_header",
+      "stream_jpeg",
+      "stream_boundary",
+      "photo_capture",
+      "photo_enqueue",
+      "telegram_connect",
+      "telegram_upload",
+      "telegram_response",
+      "logstash_send",
+  };
+  return id < TRACE_ID_COUNT ? names[id] : "?";
+}
+
+#endif // TRACE_FORMAT_H
@@ -0,0 +1,521 @@
+#include "wifi_link.h"
+#include <WiFi.h>
+#include <sys/time.h>
+#include "esp_netif.h"
+#include "esp_netif_net_stack.h"
+#include "lwip/dhcp.h"
+#include "freertos/event_groups.h"
+#include "task_supervisor.h"
+#include "flight_recorder.h"
+
+#define WIFI_CACHE_MAGIC 0x4B4E494Cu // "LINK"
+
+// Notification bits for the link task
+#define EVENT_GOT_IP (1 << 0)
+#define EVENT_LOST (1 << 1)
+#define EVENT_ENABLE (1 << 2)
+#define EVENT_DISABLE (1 << 3)
+#define EVENT_RESTART (1 << 4)
+
+// Event group bits other tasks wait on
+#define LINK_UP_BIT (1 << 0)
+#define LINK_OFF_BIT (1 << 1)
+
+// Where and how the last link was made. The address is reused without DHCP
+// only between written_s and written_s + reuse_s (half the lease) on the
+// system clock, which keeps running through resets.
+struct WifiLinkCache
+{
+  uint32_t magic;
+  uint32_t ssid_hash; // another SSID after an update invalidates the cache
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint8_t reserved;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t netmask;
+  uint32_t dns;
+  uint32_t written_s;
+  uint32_t reuse_s;
+  uint32_t crc; // over everything above
+};
+
+// Survives panics, watchdog and software resets; garbage after power-on
+RTC_NOINIT_ATTR static WifiLinkCache cache;
+
+enum LinkState
+{
+  LINK_OFF,
+  LINK_CONNECTING,
+  LINK_BACKOFF,
+  LINK_UP,
+};
+
+static const char *state_names[] = {"off", "connecting", "backoff", "up"};
+
+static char link_ssid[33];
+static char link_password[65];
+static TaskHandle_t link_task = NULL;
+static EventGroupHandle_t link_bits = NULL;
+static WifiLinkListener listeners[WIFI_LINK_MAX_LISTENERS];
+static int listener_count = 0;
+
+static portMUX_TYPE stats_mux = portMUX_INITIALIZER_UNLOCKED;
+static WifiLinkStats counters;
+static uint64_t reconnect_total_ms = 0;
+
+// Owned by the link task
+static volatile LinkState state = LINK_OFF;
+static bool attempt_fast = false;
+static bool ip_reused = false;
+static uint32_t attempt_started_ms = 0;
+static uint32_t down_since_ms = 0;
+static uint32_t retry_at_ms = 0;
+static uint32_t renew_at_ms = 0;
+static uint8_t failures_in_row = 0;
+
+static uint32_t ssidHash(const char *ssid)
+{
+  uint32_t h = 2166136261u; // FNV-1a
+  for (const char *p = ssid; *p; p++)
+  {
+    h = (h ^ (uint8_t)*p) * 16777619u;
+  }
+  return h;
+}
+
+static uint32_t clockSeconds()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint32_t)tv.tv_sec;
+}
+
+static bool cacheValid()
+{
+  return cache.magic == WIFI_CACHE_MAGIC && cache.crc == FlightRecorder::crc32(&cache, offsetof(WifiLinkCache, crc)) &&
+         cache.ssid_hash == ssidHash(link_ssid) && cache.channel >= 1 && cache.channel <= 14;
+}
+
+// Seconds the cached address may still be used without DHCP, 0 if none
+static uint32_t leaseLeft()
+{
+  uint32_t now = clockSeconds();
+  // A clock that went backwards (not kept through the reset) proves nothing
+  if (!cacheValid() || cache.ip == 0 || now < cache.written_s || now - cache.written_s >= cache.reuse_s)
+  {
+    return 0;
+  }
+  return cache.reuse_s - (now - cache.written_s);
+}
+
+static void sealCache()
+{
+  cache.crc = FlightRecorder::crc32(&cache, offsetof(WifiLinkCache, crc));
+}
+
+static void invalidateCache()
+{
+  cache.magic = 0;
+}
+
+// Lease the DHCP server granted, 0 when the address did not come from DHCP
+static uint32_t dhcpLeaseSeconds()
+{
+  esp_netif_t *sta = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+  struct netif *n = sta ? (struct netif *)esp_netif_get_netif_impl(sta) : NULL;
+  struct dhcp *d = n ? netif_dhcp_data(n) : NULL;
+  return d && d->state == DHCP_STATE_BOUND ? d->offered_t0_lease : 0;
+}
+
+static void saveCache()
+{
+  uint32_t reuse_s = 0;
+  uint32_t written_s = clockSeconds();
+  if (ip_reused)
+  {
+    // Still living off the lease the cache already describes
+    reuse_s = cache.reuse_s;
+    written_s = cache.written_s;
+  }
+  else
+  {
+    // At most a day, whatever the server granted
+    reuse_s = min(dhcpLeaseSeconds() / 2, (uint32_t)86400);
+  }
+
+  WifiLinkCache c = {};
+  c.magic = WIFI_CACHE_MAGIC;
+  c.ssid_hash = ssidHash(link_ssid);
+  memcpy(c.bssid, WiFi.BSSID(), sizeof(c.bssid));
+  c.channel = WiFi.channel();
+  c.ip = (uint32_t)WiFi.localIP();
+  c.gateway = (uint32_t)WiFi.gatewayIP();
+  c.netmask = (uint32_t)WiFi.subnetMask();
+  c.dns = (uint32_t)WiFi.dnsIP();
+  c.written_s = written_s;
+  c.reuse_s = reuse_s;
+  cache = c;
+  sealCache();
+}
+
+static uint32_t backoffMs(uint8_t attempts)
+{
+  uint32_t delay_ms = WIFI_BACKOFF_BASE_MS;
+  for (uint8_t i = 1; i < attempts && delay_ms < WIFI_BACKOFF_MAX_MS; i++)
+  {
+    delay_ms *= 2;
+  }
+  if (delay_ms > WIFI_BACKOFF_MAX_MS)
+  {
+    delay_ms = WIFI_BACKOFF_MAX_MS;
+  }
+  // Equal jitter, like the outbox, so cameras that lost the same AP spread out
+  return delay_ms / 2 + esp_random() % (delay_ms / 2 + 1);
+}
+
+static void notifyListeners(bool up)
+{
+  for (int i = 0; i < listener_count; i++)
+  {
+    listeners[i](up);
+  }
+}
+
+static void beginAttempt()
+{
+  attempt_fast = cacheValid();
+  uint32_t lease_left = attempt_fast ? leaseLeft() : 0;
+  ip_reused = lease_left > 0;
+  if (ip_reused)
+  {
+    WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.netmask), IPAddress(cache.dns));
+  }
+  else
+  {
+    WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);
+  }
+
+  if (attempt_fast)
+  {
+    // Straight to the known AP: no scan
+    WiFi.begin(link_ssid, link_password, cache.channel, cache.bssid);
+  }
+  else
+  {
+    WiFi.begin(link_ssid, link_password);
+  }
+  state = LINK_CONNECTING;
+  attempt_started_ms = millis();
+  supervisorBusy(COMPONENT_WIFI);
+}
+
+static void linkUp(uint32_t now)
+{
+  uint32_t took = now - down_since_ms;
+  state = LINK_UP;
+  failures_in_row = 0;
+  saveCache();
+  renew_at_ms = now + leaseLeft() * 1000;
+
+  portENTER_CRITICAL(&stats_mux);
+  counters.connects++;
+  counters.fast_connects += attempt_fast ? 1 : 0;
+  counters.reconnect_last_ms = took;
+  counters.reconnect_max_ms = max(counters.reconnect_max_ms, took);
+  counters.up_since_ms = now;
+  counters.channel = cache.channel;
+  reconnect_total_ms += took;
+  portEXIT_CRITICAL(&stats_mux);
+
+  supervisorBeat(COMPONENT_WIFI);
+  supervisorIdle(COMPONENT_WIFI);
+  xEventGroupSetBits(link_bits, LINK_UP_BIT);
+  notifyListeners(true);
+
+  const char *how = !attempt_fast ? "scan and DHCP" : ip_reused ? "cached AP and address" : "cached AP, DHCP";
+  Logger::getInstance().infof("WiFi up in %lu ms (%s), IP %s, channel %u, RSSI %d dBm", (unsigned long)took, how,
+                              WiFi.localIP().toString().c_str(), (unsigned)cache.channel, (int)WiFi.RSSI());
+}
+
+static void linkDown(bool planned, uint32_t now)
+{
+  xEventGroupClearBits(link_bits, LINK_UP_BIT);
+  down_since_ms = now;
+  if (!planned)
+  {
+    portENTER_CRITICAL(&stats_mux);
+    counters.losses++;
+    portEXIT_CRITICAL(&stats_mux);
+  }
+  notifyListeners(false);
+}
+
+static void attemptFailed(uint32_t now)
+{
+  WiFi.disconnect();
+  portENTER_CRITICAL(&stats_mux);
+  counters.failed_attempts++;
+  counters.fast_fallbacks += attempt_fast ? 1 : 0;
+  portEXIT_CRITICAL(&stats_mux);
+
+  if (attempt_fast)
+  {
+    // The AP moved, changed channel or is gone: forget it and scan
+    Logger::getInstance().warning("WiFi: cached AP not reachable, scanning");
+    invalidateCache();
+    beginAttempt();
+    return;
+  }
+
+  failures_in_row = failures_in_row < 255 ? failures_in_row + 1 : 255;
+  uint32_t delay_ms = backoffMs(failures_in_row);
+  retry_at_ms = now + delay_ms;
+  state = LINK_BACKOFF;
+  // Waiting out the backoff is not a stall
+  supervisorIdle(COMPONENT_WIFI);
+  Logger::getInstance().warningf("WiFi connect attempt %u failed, next in %lu ms", (unsigned)failures_in_row,
+                                 (unsigned long)delay_ms);
+}
+
+static void switchOff(uint32_t now)
+{
+  if (state == LINK_UP)
+  {
+    linkDown(true, now);
+  }
+  WiFi.disconnect(true);
+  WiFi.mode(WIFI_OFF);
+  state = LINK_OFF;
+  supervisorIdle(COMPONENT_WIFI);
+  xEventGroupSetBits(link_bits, LINK_OFF_BIT);
+}
+
+// Deadline the current state waits for, in ticks
+static TickType_t waitTicks(uint32_t now)
+{
+  int32_t left;
+  switch (state)
+  {
+  case LINK_CONNECTING:
+    left = (int32_t)(attempt_started_ms + (attempt_fast ? WIFI_FAST_TIMEOUT_MS : WIFI_CONNECT_TIMEOUT_MS) - now);
+    break;
+  case LINK_BACKOFF:
+    left = (int32_t)(retry_at_ms - now);
+    break;
+  case LINK_UP:
+    if (!ip_reused)
+    {
+      return portMAX_DELAY;
+    }
+    left = (int32_t)(renew_at_ms - now);
+    break;
+  default:
+    return portMAX_DELAY;
+  }
+  return left > 0 ? pdMS_TO_TICKS(left) : 0;
+}
+
+static void linkTask(void *arg)
+{
+  while (true)
+  {
+    uint32_t events = 0;
+    xTaskNotifyWait(0, UINT32_MAX, &events, waitTicks(millis()));
+    uint32_t now = millis();
+    bool timed_out = events == 0;
+
+    if (events & (EVENT_DISABLE | EVENT_ENABLE))
+    {
+      // Both bits can arrive in one wait (a quick disable and enable around a
+      // sleep) and do not say which came first. The last call wins: switch
+      // off for a disable, then back on if the link is still wanted.
+      portENTER_CRITICAL(&stats_mux);
+      bool wanted = counters.enabled;
+      portEXIT_CRITICAL(&stats_mux);
+      if ((events & EVENT_DISABLE) && state != LINK_OFF)
+      {
+        switchOff(now);
+      }
+      if ((events & EVENT_ENABLE) && wanted && state == LINK_OFF)
+      {
+        xEventGroupClearBits(link_bits, LINK_OFF_BIT);
+        WiFi.mode(WIFI_STA);
+        down_since_ms = now;
+        beginAttempt();
+      }
+      continue;
+    }
+    if ((events & EVENT_RESTART) && state != LINK_OFF)
+    {
+      Logger::getInstance().warning("WiFi restart requested, reconnecting from scratch");
+      invalidateCache();
+      if (state == LINK_UP)
+      {
+        linkDown(false, now);
+      }
+      WiFi.disconnect();
+      beginAttempt();
+      continue;
+    }
+
+    switch (state)
+    {
+    case LINK_CONNECTING:
+      if (events & EVENT_GOT_IP)
+      {
+        linkUp(now);
+      }
+      else if ((events & EVENT_LOST) || timed_out)
+      {
+        attemptFailed(now);
+      }
+      break;
+    case LINK_UP:
+      if (events & EVENT_LOST)
+      {
+        Logger::getInstance().warningf("WiFi link lost after %lu s, reconnecting",
+                                       (unsigned long)((now - counters.up_since_ms) / 1000));
+        linkDown(false, now);
+        // The first retry goes out at once; most drops are a short AP hiccup
+        beginAttempt();
+      }
+      else if (timed_out && ip_reused)
+      {
+        // Half the cached lease is gone: get a fresh one from the DHCP server
+        Logger::getInstance().info("WiFi: cached lease ran out, renewing through DHCP");
+        cache.reuse_s = 0;
+        sealCache();
+        linkDown(true, now);
+        WiFi.disconnect();
+        beginAttempt();
+      }
+      break;
+    case LINK_BACKOFF:
+      if (timed_out)
+      {
+        beginAttempt();
+      }
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+static void onWifiEvent(WiFiEvent_t event, WiFiEventInfo_t info)
+{
+  uint32_t bits = 0;
+  if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP)
+  {
+    bits = EVENT_GOT_IP;
+  }
+  else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED && info.wifi_sta_disconnected.reason != WIFI_REASON_ASSOC_LEAVE)
+  {
+    // ASSOC_LEAVE is our own disconnect()
+    bits = EVENT_LOST;
+  }
+  if (bits && link_task)
+  {
+    xTaskNotify(link_task, bits, eSetBits);
+  }
+}
+
+static void addWifiStats(JsonDocument &stats)
+{
+  WifiLinkStats s = getWifiLinkStats();
+  stats["wifi_state"] = state_names[state];
+  stats["wifi_connects"] = s.connects;
+  stats["wifi_losses"] = s.losses;
+  stats["wifi_failed_attempts"] = s.failed_attempts;
+  stats["wifi_fast_connects"] = s.fast_connects;
+  stats["wifi_fast_fallbacks"] = s.fast_fallbacks;
+  stats["wifi_reconnect_ms"] = s.reconnect_last_ms;
+  stats["wifi_reconnect_avg_ms"] = s.reconnect_avg_ms;
+  stats["wifi_reconnect_max_ms"] = s.reconnect_max_ms;
+  stats["wifi_channel"] = s.channel;
+}
+
+void startWifiLink(const char *ssid, const char *password)
+{
+  strlcpy(link_ssid, ssid, sizeof(link_ssid));
+  strlcpy(link_password, password, sizeof(link_password));
+  link_bits = xEventGroupCreate();
+  xEventGroupSetBits(link_bits, LINK_OFF_BIT);
+
+  // Credentials come from config.h; nothing to write to flash per connect.
+  // Reconnects are ours, with backoff.
+  WiFi.persistent(false);
+  WiFi.setAutoReconnect(false);
+  WiFi.onEvent(onWifiEvent);
+  // Up before the services that tune the radio start
+  WiFi.mode(WIFI_STA);
+
+  supervisorRegister(COMPONENT_WIFI, 20000, wifiLinkRestart);
+  Logger::getInstance().addStatsProvider(addWifiStats);
+  xTaskCreate(linkTask, "wifi_link", 4096, NULL, 3, &link_task);
+  wifiLinkEnable(true);
+}
+
+void wifiLinkEnable(bool enabled)
+{
+  if (!link_task)
+  {
+    return;
+  }
+  portENTER_CRITICAL(&stats_mux);
+  counters.enabled = enabled;
+  portEXIT_CRITICAL(&stats_mux);
+  if (enabled)
+  {
+    xEventGroupClearBits(link_bits, LINK_OFF_BIT);
+    xTaskNotify(link_task, EVENT_ENABLE, eSetBits);
+  }
+  else
+  {
+    // Callers go to light sleep next, so wait for the radio to be off
+    xTaskNotify(link_task, EVENT_DISABLE, eSetBits);
+    xEventGroupWaitBits(link_bits, LINK_OFF_BIT, pdFALSE, pdTRUE, pdMS_TO_TICKS(2000));
+  }
+}
+
+void wifiLinkRestart()
+{
+  if (link_task)
+  {
+    xTaskNotify(link_task, EVENT_RESTART, eSetBits);
+  }
+}
+
+bool wifiLinkUp()
+{
+  return link_bits && (xEventGroupGetBits(link_bits) & LINK_UP_BIT);
+}
+
+bool wifiLinkWait(uint32_t timeout_ms)
+{
+  if (!link_bits)
+  {
+    return false;
+  }
+  return xEventGroupWaitBits(link_bits, LINK_UP_BIT, pdFALSE, pdTRUE, pdMS_TO_TICKS(timeout_ms)) & LINK_UP_BIT;
+}
+
+void wifiLinkSubscribe(WifiLinkListener listener)
+{
+  if (listener_count < WIFI_LINK_MAX_LISTENERS)
+  {
+    listeners[listener_count++] = listener;
+  }
+}
+
+WifiLinkStats getWifiLinkStats()
+{
+  portENTER_CRITICAL(&stats_mux);
+  WifiLinkStats s = counters;
+  s.reconnect_avg_ms = s.connects ? reconnect_total_ms / s.connects : 0;
+  portEXIT_CRITICAL(&stats_mux);
+  s.up = wifiLinkUp();
+  s.rssi = s.up ? WiFi.RSSI() : 0;
+  return s;
+}
@@ -0,0 +1,74 @@
+#ifndef WIFI_LINK_H
+#define WIFI_LINK_H
+
+#include <Arduino.h>
+#include "logger.h"
+
+// Delay before reconnect attempt n (1 = after the first failure): doubles
+// from the base up to the max, with jitter
+#ifndef WIFI_BACKOFF_BASE_MS
+#define WIFI_BACKOFF_BASE_MS 500
+#endif
+#ifndef WIFI_BACKOFF_MAX_MS
+#define WIFI_BACKOFF_MAX_MS 30000
+#endif
+
+// A connect attempt that has no IP after this long has failed
+#ifndef WIFI_CONNECT_TIMEOUT_MS
+#define WIFI_CONNECT_TIMEOUT_MS 10000
+#endif
+
+// An attempt with the cached BSSID, channel and address gets less time
+// before falling back to a full scan and DHCP
+#ifndef WIFI_FAST_TIMEOUT_MS
+#define WIFI_FAST_TIMEOUT_MS 3000
+#endif
+
+#define WIFI_LINK_MAX_LISTENERS 8
+
+// Called on the link task when the link comes up (has an IP) or goes down.
+// Must not block; typically it wakes a worker.
+typedef void (*WifiLinkListener)(bool up);
+
+struct WifiLinkStats
+{
+  bool up;
+  bool enabled;
+  uint32_t connects;       // links established, including the first
+  uint32_t losses;         // links lost without being switched off
+  uint32_t failed_attempts;
+  uint32_t fast_connects;  // from the RTC cache, without scan (and DHCP while the lease lasts)
+  uint32_t fast_fallbacks; // cache was stale, a full connect followed
+  uint32_t reconnect_last_ms; // from loss (or start) until the IP was there
+  uint32_t reconnect_avg_ms;
+  uint32_t reconnect_max_ms;
+  uint32_t up_since_ms;
+  int8_t rssi;
+  uint8_t channel;
+};
+
+// Starts the link task, which connects in the background and reconnects
+// with backoff whenever the link is lost. BSSID, channel and the DHCP lease
+// are kept in RTC memory, so after a reset the camera rejoins the same AP
+// without scanning and reuses its address during the first half of the lease.
+void startWifiLink(const char *ssid, const char *password);
+
+// Switches the radio on or off on purpose (e.g. time-lapse sleeping between
+// captures). Switching off tells the listeners but is not counted as a
+// loss; returns once the radio is off.
+void wifiLinkEnable(bool enabled);
+
+// Forgets the cache and reconnects from scratch; the supervisor's recovery
+void wifiLinkRestart();
+
+bool wifiLinkUp();
+
+// Blocks until the link is up; false on timeout
+bool wifiLinkWait(uint32_t timeout_ms);
+
+// Register at startup, before the link can change
+void wifiLinkSubscribe(WifiLinkListener listener);
+
+WifiLinkStats getWifiLinkStats();
+
+#endif // WIFI_LINK_H
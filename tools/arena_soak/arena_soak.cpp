@@ -0,0 +1,679 @@
+// Long-running soak of the firmware's string traffic against a model of the
+// ESP32's internal heap, with and without the scratch arenas
+// (src/scratch_arena.cpp).
+//
+// The heap model is a best-fit allocator with block headers, coalescing and
+// in-place realloc growth, sized like the internal RAM left once Wi-Fi is up.
+// On top of it runs a week of simulated traffic: Wi-Fi/lwIP buffers, a
+// trickle of long-lived allocations, log messages with their Logstash POST,
+// /control requests and Telegram uploads, each holding mbedTLS's 16 KB + 4 KB
+// record buffers while the request runs. In "String" mode the messages,
+// paths, multipart headers and response bodies are built the way Arduino
+// String does it (exact-size reallocs, temporaries for every number); in
+// "arena" mode they go through the real StrBuilder into a per-job arena, and
+// only the traffic that did not change touches the heap. Both runs see the
+// same arrivals and background traffic.
+//
+//   g++ -O2 -std=c++17 -Isrc tools/arena_soak/arena_soak.cpp src/scratch_arena.cpp -o arena_soak
+//   ./arena_soak [--days N] [--heap-kb N] [--seed N]
+//
+// Reported per simulated day and at the end: peak heap use, the smallest
+// largest-free-block seen, fragmentation (1 - largest free / total free) and
+// how many TLS handshakes could not get their contiguous buffers.
+
+#include "scratch_arena.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#define TLS_IN_BYTES (16384 + 325)  // MBEDTLS_SSL_IN_CONTENT_LEN plus record overhead
+#define TLS_OUT_BYTES (4096 + 325)  // MBEDTLS_SSL_OUT_CONTENT_LEN plus record overhead
+#define TLS_CONTEXT_BYTES 3200      // ssl context, config and handshake state
+#define JOB_SCRATCH_BYTES 6144      // TELEGRAM_SCRATCH_BYTES
+#define REQUEST_SCRATCH_BYTES 4096  // HTTP_SCRATCH_BYTES
+#define LOG_LINE_MAX 256            // LOGGER_LINE_MAX
+#define STRING_SSO 11               // Arduino String keeps this many chars inline
+
+static int failures = 0;
+
+#define CHECK(cond)                                                       \
+    do                                                                    \
+    {                                                                     \
+        if (!(cond))                                                      \
+        {                                                                 \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                   \
+        }                                                                 \
+    } while (0)
+
+// Best-fit heap over one region. Addresses are offsets; nothing is stored.
+class ModelHeap
+{
+public:
+    explicit ModelHeap(size_t capacity) : capacity_(capacity)
+    {
+        free_[0] = capacity;
+    }
+
+    size_t alloc(size_t size)
+    {
+        ops_++;
+        size_t need = blockSize(size);
+        auto best = free_.end();
+        for (auto it = free_.begin(); it != free_.end(); ++it)
+        {
+            if (it->second >= need && (best == free_.end() || it->second < best->second))
+            {
+                best = it;
+                if (it->second == need)
+                {
+                    break;
+                }
+            }
+        }
+        if (best == free_.end())
+        {
+            failed_++;
+            return 0;
+        }
+        size_t addr = best->first;
+        size_t len = best->second;
+        free_.erase(best);
+        if (len - need >= MIN_BLOCK)
+        {
+            free_[addr + need] = len - need;
+            len = need;
+        }
+        used_[addr] = len;
+        in_use_ += len;
+        peak_ = in_use_ > peak_ ? in_use_ : peak_;
+        return addr + HEADER; // never 0
+    }
+
+    void release(size_t ptr)
+    {
+        if (!ptr)
+        {
+            return;
+        }
+        ops_++;
+        size_t addr = ptr - HEADER;
+        auto it = used_.find(addr);
+        if (it == used_.end())
+        {
+            fprintf(stderr, "model heap: bad free\n");
+            abort();
+        }
+        size_t len = it->second;
+        used_.erase(it);
+        in_use_ -= len;
+        insertFree(addr, len);
+    }
+
+    // Grows in place when the next block is free, else moves; 0 on failure
+    // with the old block kept, like realloc()
+    size_t resize(size_t ptr, size_t size)
+    {
+        if (!ptr)
+        {
+            return alloc(size);
+        }
+        size_t addr = ptr - HEADER;
+        size_t len = used_.at(addr);
+        size_t need = blockSize(size);
+        if (need <= len)
+        {
+            return ptr;
+        }
+        auto next = free_.find(addr + len);
+        if (next != free_.end() && len + next->second >= need)
+        {
+            ops_++;
+            size_t total = len + next->second;
+            free_.erase(next);
+            if (total - need >= MIN_BLOCK)
+            {
+                free_[addr + need] = total - need;
+                total = need;
+            }
+            in_use_ += total - len;
+            peak_ = in_use_ > peak_ ? in_use_ : peak_;
+            used_[addr] = total;
+            return ptr;
+        }
+        size_t moved = alloc(size);
+        if (moved)
+        {
+            release(ptr);
+        }
+        return moved;
+    }
+
+    size_t largestFree() const
+    {
+        size_t largest = 0;
+        for (const auto &f : free_)
+        {
+            largest = f.second > largest ? f.second : largest;
+        }
+        return largest > HEADER ? largest - HEADER : 0;
+    }
+
+    size_t totalFree() const { return capacity_ - in_use_; }
+    size_t peak() const { return peak_; }
+    size_t inUse() const { return in_use_; }
+    uint64_t ops() const { return ops_; }
+    uint64_t failed() const { return failed_; }
+
+private:
+    static const size_t HEADER = 8;
+    static const size_t MIN_BLOCK = 16;
+
+    static size_t blockSize(size_t size)
+    {
+        size_t len = (size + 3) & ~(size_t)3;
+        return len + HEADER < MIN_BLOCK ? MIN_BLOCK : len + HEADER;
+    }
+
+    void insertFree(size_t addr, size_t len)
+    {
+        auto next = free_.find(addr + len);
+        if (next != free_.end())
+        {
+            len += next->second;
+            free_.erase(next);
+        }
+        auto prev = free_.lower_bound(addr);
+        if (prev != free_.begin())
+        {
+            --prev;
+            if (prev->first + prev->second == addr)
+            {
+                prev->second += len;
+                return;
+            }
+        }
+        free_[addr] = len;
+    }
+
+    size_t capacity_;
+    std::map<size_t, size_t> free_;
+    std::map<size_t, size_t> used_;
+    size_t in_use_ = 0;
+    size_t peak_ = 0;
+    uint64_t ops_ = 0;
+    uint64_t failed_ = 0;
+};
+
+// Arduino String's allocation pattern: inline up to STRING_SSO chars, then a
+// heap buffer reallocated to the exact new length on every concat
+class SimString
+{
+public:
+    SimString(ModelHeap &heap, const std::string &text = "") : heap_(heap) { concat(text); }
+    ~SimString() { heap_.release(ptr_); }
+    SimString(const SimString &) = delete;
+    SimString &operator=(const SimString &) = delete;
+
+    void concat(const std::string &text)
+    {
+        size_t len = len_ + text.size();
+        if (len > STRING_SSO && len + 1 > cap_)
+        {
+            size_t grown = heap_.resize(ptr_, len + 1);
+            if (!grown)
+            {
+                return; // String silently keeps the old contents
+            }
+            ptr_ = grown;
+            cap_ = len + 1;
+        }
+        len_ = len;
+    }
+
+    size_t length() const { return len_; }
+
+private:
+    ModelHeap &heap_;
+    size_t ptr_ = 0;
+    size_t cap_ = 0;
+    size_t len_ = 0;
+};
+
+// "a" + String(x) + "b" + ...: the sum helper grows piece by piece and every
+// String(x) is a temporary of its own. Returns the finished string.
+static SimString *stringSum(ModelHeap &heap, const std::vector<std::string> &pieces)
+{
+    SimString *sum = new SimString(heap, pieces[0]);
+    for (size_t i = 1; i < pieces.size(); i++)
+    {
+        bool number = !pieces[i].empty() && isdigit((unsigned char)pieces[i][0]);
+        SimString *temp = number ? new SimString(heap, pieces[i]) : NULL;
+        sum->concat(pieces[i]);
+        delete temp;
+    }
+    return sum;
+}
+
+struct Held
+{
+    uint64_t until_ms;
+    size_t ptr;
+    SimString *str;
+    bool operator>(const Held &o) const { return until_ms > o.until_ms; }
+};
+
+struct Result
+{
+    size_t peak = 0;
+    size_t min_largest = SIZE_MAX;
+    double worst_frag = 0;
+    double end_frag = 0;
+    uint32_t tls_attempts = 0;
+    uint32_t tls_failures = 0;
+    uint64_t ops = 0;
+    uint64_t failed = 0;
+    size_t job_peak = 0;
+    size_t request_peak = 0;
+    uint32_t truncated = 0;
+};
+
+class Soak
+{
+public:
+    Soak(bool arena_mode, size_t heap_bytes, uint32_t seed)
+        : arena_(arena_mode), heap_(heap_bytes), rng_(seed), timeline_(seed),
+          job_(job_buf_, sizeof(job_buf_)), request_(request_buf_, sizeof(request_buf_))
+    {
+    }
+
+    Result run(uint32_t days)
+    {
+        // Next arrival of each kind of traffic, all Poisson
+        uint64_t next_rx = 0, next_long = 0, next_log = 0, next_job = 0, next_control = 0;
+        uint64_t end_ms = (uint64_t)days * 86400000;
+        uint64_t next_sample = 0;
+        uint64_t next_day = 86400000;
+        uint32_t day = 1;
+        Result day_start;
+
+        for (uint64_t now = 0; now < end_ms;)
+        {
+            uint64_t next = std::min({next_rx, next_long, next_log, next_job, next_control, next_sample});
+            expire(next);
+            now = next;
+
+            if (now == next_rx)
+            {
+                // lwIP pbufs and Wi-Fi RX buffers: frequent, short-lived
+                hold(heap_.alloc(between(80, 1600, timeline_)), now + exponential(50));
+                next_rx = now + exponential(200);
+            }
+            else if (now == next_long)
+            {
+                // Sockets, timers, cached DNS entries: rare, long-lived
+                hold(heap_.alloc(between(32, 600, timeline_)), now + exponential(45 * 60000));
+                next_long = now + exponential(60000);
+            }
+            else if (now == next_log)
+            {
+                logMessage(now);
+                next_log = now + exponential(3000);
+            }
+            else if (now == next_job)
+            {
+                telegramJob(now);
+                next_job = now + exponential(5 * 60000);
+            }
+            else if (now == next_control)
+            {
+                controlRequest(now);
+                next_control = now + exponential(60 * 60000);
+            }
+            else
+            {
+                sample();
+                next_sample = now + 1000;
+                if (now >= next_day)
+                {
+                    report(day++, day_start);
+                    day_start = result_;
+                    next_day += 86400000;
+                }
+            }
+        }
+
+        expire(UINT64_MAX);
+        result_.peak = heap_.peak();
+        result_.ops = heap_.ops();
+        result_.failed = heap_.failed();
+        result_.job_peak = job_.peak();
+        result_.request_peak = request_.peak();
+        return result_;
+    }
+
+private:
+    size_t between(size_t lo, size_t hi) { return between(lo, hi, rng_); }
+
+    static size_t between(size_t lo, size_t hi, std::mt19937 &rng)
+    {
+        return std::uniform_int_distribution<size_t>(lo, hi)(rng);
+    }
+
+    uint64_t exponential(double mean_ms)
+    {
+        return 1 + (uint64_t)std::exponential_distribution<double>(1.0 / mean_ms)(timeline_);
+    }
+
+    std::string number(uint32_t max) { return std::to_string(between(0, max)); }
+
+    void hold(size_t ptr, uint64_t until_ms)
+    {
+        if (ptr)
+        {
+            held_.push({until_ms, ptr, NULL});
+        }
+    }
+
+    void hold(SimString *s, uint64_t until_ms) { held_.push({until_ms, 0, s}); }
+
+    void expire(uint64_t now)
+    {
+        while (!held_.empty() && held_.top().until_ms <= now)
+        {
+            Held h = held_.top();
+            held_.pop();
+            heap_.release(h.ptr);
+            delete h.str;
+        }
+    }
+
+    void sample()
+    {
+        size_t largest = heap_.largestFree();
+        size_t total = heap_.totalFree();
+        double frag = total ? 1.0 - (double)largest / total : 0;
+        result_.min_largest = largest < result_.min_largest ? largest : result_.min_largest;
+        result_.worst_frag = frag > result_.worst_frag ? frag : result_.worst_frag;
+        result_.end_frag = frag;
+    }
+
+    void report(uint32_t day, const Result &start)
+    {
+        printf("  day %2u: in use %6zu, largest free %6zu, fragmentation %4.1f%%, TLS failures %u\n", day,
+               heap_.inUse(), heap_.largestFree(), result_.end_frag * 100,
+               result_.tls_failures - start.tls_failures);
+    }
+
+    void note(const StrBuilder &s)
+    {
+        result_.truncated += s.truncated();
+    }
+
+    // A log call and the Logstash POST it triggers
+    void logMessage(uint64_t now)
+    {
+        std::vector<std::string> pieces = {"Telegram photo #", number(99999), " delivered after ", number(5),
+                                           " attempt(s), ", number(90000), " ms in the outbox"};
+        SimString *message = NULL;
+        if (arena_)
+        {
+            // Logger::infof: formatted on the stack
+            FixedString<LOG_LINE_MAX> line;
+            line.appendf("Telegram photo #%s delivered after %s attempt(s), %s ms in the outbox", pieces[1].c_str(),
+                         pieces[3].c_str(), pieces[5].c_str());
+        }
+        else
+        {
+            // info("..." + String(x) + ...), then sendToSerial's own concatenation
+            message = stringSum(heap_, pieces);
+            SimString timestamp(heap_, "12:34:56");
+            SimString level(heap_, "INFO");
+            delete stringSum(heap_, {"[", "12:34:56", "] [", "INFO", "] ", std::string(message->length(), 'x')});
+        }
+
+        // Unchanged in both modes: the JSON document, its serialization and
+        // the HTTP client, held while the POST runs
+        uint64_t post_ms = now + between(20, 400);
+        hold(heap_.alloc(2048), post_ms);
+        SimString *json = new SimString(heap_);
+        for (int i = 0; i < 12; i++)
+        {
+            json->concat(std::string(between(30, 60), 'j'));
+        }
+        hold(json, post_ms);
+        hold(heap_.alloc(between(200, 400)), post_ms);
+        if (message)
+        {
+            hold(message, post_ms);
+        }
+    }
+
+    // One sendPhoto through the outbox: TLS buffers plus the request's strings
+    void telegramJob(uint64_t now)
+    {
+        uint64_t done_ms = now + between(1500, 4000);
+        std::string token = "123456789:" + std::string(35, 'T');
+        std::string chat = "-100" + number(999999999);
+        std::string boundary = "ESP32CAM-" + number(4000000000u);
+        std::string response = "{\"ok\":true,\"result\":{\"message_id\":" + number(99999) +
+                               ",\"photo\":[{\"file_id\":\"" + std::string(between(60, 200), 'f') + "\"}]}}";
+
+        if (arena_)
+        {
+            ArenaScope scope(job_);
+            StrBuilder path(job_, 128);
+            path.appendf("/bot%s/sendPhoto?chat_id=%s", token.c_str(), chat.c_str());
+            StrBuilder content_type(job_, 64);
+            content_type.appendf("multipart/form-data; boundary=%s", boundary.c_str());
+            StrBuilder head(job_, 160);
+            head.appendf("--%s\r\nContent-Disposition: form-data; name=\"photo\"; filename=\"esp32cam.jpg\"\r\n"
+                         "Content-Type: image/jpeg\r\n\r\n",
+                         boundary.c_str());
+            StrBuilder tail(job_, 40);
+            tail.appendf("\r\n--%s--\r\n", boundary.c_str());
+            StrBuilder header(job_, 384);
+            header.appendf("POST %s HTTP/1.1\r\nHost: api.telegram.org\r\nUser-Agent: ESP32-CAM\r\n"
+                           "Content-Length: %u\r\nContent-Type: %s\r\nConnection: close\r\n\r\n",
+                           path.c_str(), (unsigned)between(20000, 60000), content_type.c_str());
+            char *body = (char *)job_.alloc(1024 + 1, 1);
+            CHECK(body != NULL);
+            if (body)
+            {
+                snprintf(body, 1025, "%s", response.c_str());
+            }
+            for (const StrBuilder *s : {&path, &content_type, &head, &tail, &header})
+            {
+                note(*s);
+            }
+            tls(now, done_ms);
+            // The response log line, cut off at the line length like Logger does
+            FixedString<LOG_LINE_MAX> line;
+            line.appendf("Telegram response 200: %s", response.c_str());
+            return;
+        }
+
+        // path, boundary, head, tail live for the whole request
+        SimString *path = stringSum(heap_, {"/bot", token, "/sendPhoto?chat_id=", chat});
+        SimString *bound = stringSum(heap_, {"ESP32CAM-", boundary.substr(9)});
+        SimString *head = stringSum(heap_, {"--", boundary, "\r\n", std::string(70, 'h'), std::string(28, 'h')});
+        SimString *tail = stringSum(heap_, {"\r\n--", boundary, "--\r\n"});
+        SimString *type = stringSum(heap_, {"multipart/form-data; boundary=", boundary});
+        tls(now, done_ms);
+        // The header lines, each a temporary
+        delete stringSum(heap_, {"POST ", std::string(path->length(), 'p'), " HTTP/1.1\r\n"});
+        delete stringSum(heap_, {"Content-Length: ", number(60000), "\r\n"});
+        delete stringSum(heap_, {"Content-Type: ", std::string(type->length(), 't'), "\r\n"});
+        // Status line, header lines and the body read a byte at a time
+        SimString *status = new SimString(heap_, "HTTP/1.1 200 OK\r");
+        for (int i = 0; i < 8; i++)
+        {
+            delete new SimString(heap_, std::string(between(10, 60), 'H'));
+        }
+        SimString *body = new SimString(heap_);
+        for (size_t i = 0; i < response.size(); i++)
+        {
+            body->concat("b");
+        }
+        delete stringSum(heap_, {"Telegram response ", "200", ": ", response});
+        for (SimString *s : {path, bound, head, tail, type, status, body})
+        {
+            hold(s, done_ms);
+        }
+    }
+
+    // mbedTLS allocates both record buffers when the handshake starts
+    void tls(uint64_t now, uint64_t done_ms)
+    {
+        (void)now;
+        result_.tls_attempts++;
+        size_t context = heap_.alloc(TLS_CONTEXT_BYTES);
+        size_t in = heap_.alloc(TLS_IN_BYTES);
+        size_t out = heap_.alloc(TLS_OUT_BYTES);
+        if (!context || !in || !out)
+        {
+            result_.tls_failures++;
+            heap_.release(context);
+            heap_.release(in);
+            heap_.release(out);
+            return;
+        }
+        hold(context, done_ms);
+        hold(in, done_ms);
+        hold(out, done_ms);
+    }
+
+    void controlRequest(uint64_t now)
+    {
+        if (arena_)
+        {
+            ArenaScope scope(request_);
+            StrBuilder out(request_, 1024);
+            out.appendf("{\"success\":true,\"profile\":\"default\",\"settings\":{\"framesize\":\"svga\"");
+            for (int i = 0; i < 17; i++)
+            {
+                out.appendf(",\"field%d\":%d", i, (int)between(0, 1200));
+            }
+            out.append("}}");
+            note(out);
+            return;
+        }
+        // DynamicJsonDocument(1024) for the response
+        hold(heap_.alloc(1024), now + between(2, 20));
+    }
+
+    bool arena_;
+    ModelHeap heap_;
+    std::mt19937 rng_;      // message contents and durations
+    std::mt19937 timeline_; // arrivals and the unchanged background traffic
+    uint8_t job_buf_[JOB_SCRATCH_BYTES];
+    uint8_t request_buf_[REQUEST_SCRATCH_BYTES];
+    ScratchArena job_;
+    ScratchArena request_;
+    std::priority_queue<Held, std::vector<Held>, std::greater<Held>> held_;
+    Result result_;
+};
+
+// The arena and builder themselves: alignment, rewinding, truncation
+static void unitChecks()
+{
+    alignas(8) uint8_t buf[64];
+    ScratchArena arena(buf, sizeof(buf));
+    CHECK(arena.alloc(3, 1) == buf);
+    void *p = arena.alloc(8, 8);
+    CHECK(p == buf + 8);
+    size_t mark = arena.mark();
+    CHECK(arena.alloc(64) == NULL);
+    CHECK(arena.failures() == 1);
+    {
+        ArenaScope scope(arena);
+        CHECK(arena.alloc(40, 1) != NULL);
+        CHECK(arena.used() == 56);
+    }
+    CHECK(arena.used() == mark);
+    CHECK(arena.peak() == 56);
+    arena.reset();
+    CHECK(arena.used() == 0);
+
+    StrBuilder s(arena, 8);
+    s.append("abc").append('d').appendf("%d", 42);
+    CHECK(strcmp(s.c_str(), "abcd42") == 0 && !s.truncated());
+    s.appendf("%s", "xyz");
+    CHECK(strcmp(s.c_str(), "abcd42x") == 0 && s.truncated() && s.length() == 7);
+    s.clear();
+    CHECK(s.length() == 0 && !s.truncated() && s.c_str()[0] == 0);
+
+    // No room left: the builder still works, empty and truncated
+    ScratchArena empty(NULL, 0);
+    StrBuilder none(empty, 16);
+    none.append("x");
+    CHECK(none.length() == 0 && none.truncated());
+
+    FixedString<4> fixed;
+    fixed.append("hello");
+    CHECK(strcmp(fixed.c_str(), "hel") == 0 && fixed.truncated());
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t days = 7;
+    size_t heap_kb = 160;
+    uint32_t seed = 1;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (!strcmp(argv[i], "--days"))
+            days = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--heap-kb"))
+            heap_kb = atoi(argv[i + 1]);
+        else if (!strcmp(argv[i], "--seed"))
+            seed = atoi(argv[i + 1]);
+        else
+        {
+            fprintf(stderr, "usage: %s [--days N] [--heap-kb N] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    unitChecks();
+
+    Result results[2];
+    for (int mode = 0; mode < 2; mode++)
+    {
+        printf("%s, %u days, %zu KB heap:\n", mode ? "arena" : "String", days, heap_kb);
+        Soak *soak = new Soak(mode == 1, heap_kb * 1024, seed);
+        results[mode] = soak->run(days);
+        delete soak;
+    }
+
+    printf("\n%-7s %10s %10s %14s %11s %9s %10s\n", "mode", "heap ops", "peak used", "min largest", "worst frag",
+           "end frag", "TLS fails");
+    for (int mode = 0; mode < 2; mode++)
+    {
+        const Result &r = results[mode];
+        printf("%-7s %10llu %10zu %14zu %10.1f%% %8.1f%% %6u/%u\n", mode ? "arena" : "String",
+               (unsigned long long)r.ops, r.peak, r.min_largest, r.worst_frag * 100, r.end_frag * 100,
+               r.tls_failures, r.tls_attempts);
+    }
+    printf("arena peaks: job %zu of %d bytes, request %zu of %d bytes, %u strings truncated\n",
+           results[1].job_peak, JOB_SCRATCH_BYTES, results[1].request_peak, REQUEST_SCRATCH_BYTES,
+           results[1].truncated);
+
+    CHECK(results[1].truncated == 0);
+    CHECK(results[1].job_peak <= JOB_SCRATCH_BYTES);
+    CHECK(results[1].ops < results[0].ops);
+
+    if (failures)
+    {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
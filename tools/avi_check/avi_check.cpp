@@ -0,0 +1,230 @@
+// Host check and benchmark for the MJPEG AVI writer (src/avi_writer.cpp).
+//
+// Writes clips to real files the way sd_recorder does (16 KB blocks, space
+// preallocated) and parses them back: RIFF and LIST sizes, the frame counts
+// in avih and strh, every 00dc chunk against the frame that went in, and
+// every idx1 entry against the chunk it points at. Also checks that close()
+// trims the preallocated space and reports a failure when it cannot, then
+// measures write throughput for a range of block sizes.
+//
+//   g++ -O2 -std=c++17 -Isrc tools/avi_check/avi_check.cpp src/avi_writer.cpp -o avi_check
+//   ./avi_check [directory]       (default /tmp; point it at a mounted SD card to time the card)
+
+#include "avi_writer.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                \
+    do                                                  \
+    {                                                   \
+        if (!(cond))                                    \
+        {                                               \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__);                        \
+            printf("\n");                               \
+            failures++;                                 \
+        }                                               \
+    } while (0)
+
+typedef std::vector<uint8_t> Bytes;
+
+// JPEG-like frame with a length that is odd about half the time
+static Bytes makeFrame(std::mt19937 &rng, size_t min_len, size_t max_len)
+{
+    Bytes f(min_len + rng() % (max_len - min_len + 1));
+    for (uint8_t &b : f)
+        b = rng();
+    f[0] = 0xFF;
+    f[1] = 0xD8;
+    f[f.size() - 2] = 0xFF;
+    f[f.size() - 1] = 0xD9;
+    return f;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool fourcc(const uint8_t *p, const char *cc)
+{
+    return memcmp(p, cc, 4) == 0;
+}
+
+static bool readFile(const std::string &path, Bytes &out)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+    fseek(f, 0, SEEK_END);
+    out.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+    bool ok = fread(out.data(), 1, out.size(), f) == out.size();
+    fclose(f);
+    return ok;
+}
+
+// Parses path and compares it with the frames that were written
+static void verifyAvi(const std::string &path, const std::vector<Bytes> &frames, uint16_t width, uint16_t height)
+{
+    Bytes avi;
+    CHECK(readFile(path, avi), "cannot read %s", path.c_str());
+    if (avi.size() < 512 + 8)
+    {
+        CHECK(false, "file is only %zu bytes", avi.size());
+        return;
+    }
+    const uint8_t *p = avi.data();
+
+    CHECK(fourcc(p, "RIFF") && fourcc(p + 8, "AVI "), "not a RIFF AVI");
+    CHECK(get32(p + 4) == avi.size() - 8, "RIFF size %u, file %zu", get32(p + 4), avi.size());
+    CHECK(fourcc(p + 12, "LIST") && fourcc(p + 20, "hdrl"), "hdrl missing");
+    CHECK(fourcc(p + 24, "avih") && get32(p + 48) == frames.size(), "avih frames %u, wrote %zu", get32(p + 48),
+          frames.size());
+    CHECK(get32(p + 64) == width && get32(p + 68) == height, "avih size %ux%u", get32(p + 64), get32(p + 68));
+    CHECK(fourcc(p + 100, "strh") && fourcc(p + 108, "vids") && fourcc(p + 112, "MJPG"), "strh is not MJPG video");
+    CHECK(get32(p + 140) == frames.size(), "strh length %u", get32(p + 140));
+    CHECK(fourcc(p + 212, "JUNK") && 212 + 8 + get32(p + 216) == 500, "JUNK does not pad to 500");
+    CHECK(fourcc(p + 500, "LIST") && fourcc(p + 508, "movi"), "movi LIST not at 500");
+
+    // Movie data: one 00dc chunk per frame, padded to even length
+    uint32_t movi_size = get32(p + 504);
+    size_t movi_start = 508; // offsets in idx1 are relative to the 'movi' fourcc
+    size_t movi_end = movi_start + movi_size;
+    CHECK(movi_end + 8 <= avi.size(), "movi LIST runs past the file");
+    if (movi_end + 8 > avi.size())
+        return;
+
+    std::vector<size_t> chunk_at;
+    size_t pos = movi_start + 4;
+    for (size_t i = 0; i < frames.size() && pos + 8 <= movi_end; i++)
+    {
+        uint32_t len = get32(p + pos + 4);
+        bool same = fourcc(p + pos, "00dc") && len == frames[i].size() && pos + 8 + len <= movi_end &&
+                    memcmp(p + pos + 8, frames[i].data(), len) == 0;
+        CHECK(same, "chunk %zu differs from frame %zu", i, i);
+        if (!same)
+            return;
+        chunk_at.push_back(pos - movi_start);
+        pos += 8 + len + (len & 1);
+    }
+    CHECK(chunk_at.size() == frames.size() && pos == movi_end, "%zu chunks, movi ends %zu bytes off",
+          chunk_at.size(), movi_end - pos);
+
+    // idx1 right behind movi, one entry per chunk, and nothing after it
+    const uint8_t *idx = p + movi_end;
+    CHECK(fourcc(idx, "idx1") && get32(idx + 4) == frames.size() * 16, "idx1 header");
+    CHECK(movi_end + 8 + frames.size() * 16 == avi.size(), "%zu bytes after idx1",
+          avi.size() - (movi_end + 8 + frames.size() * 16));
+    for (size_t i = 0; i < chunk_at.size() && movi_end + 8 + (i + 1) * 16 <= avi.size(); i++)
+    {
+        const uint8_t *e = idx + 8 + i * 16;
+        CHECK(fourcc(e, "00dc") && get32(e + 4) == 0x10 && get32(e + 8) == chunk_at[i] &&
+                  get32(e + 12) == frames[i].size(),
+              "idx1 entry %zu: offset %u (chunk at %zu), size %u", i, get32(e + 8), chunk_at[i], get32(e + 12));
+    }
+}
+
+static void checkClip(const std::string &dir, size_t block, size_t prealloc, int count, std::mt19937 &rng)
+{
+    std::string path = dir + "/avi_check.avi";
+    std::vector<uint8_t> buffer(block);
+    std::vector<Bytes> frames;
+    AviWriter writer(buffer.data(), buffer.size());
+    CHECK(writer.open(path.c_str(), 800, 600, 10, prealloc), "open %s", path.c_str());
+    for (int i = 0; i < count; i++)
+    {
+        // Includes frames smaller and larger than a block
+        frames.push_back(makeFrame(rng, 100, i % 5 == 0 ? 3 * block : block / 2 + 100));
+        CHECK(writer.addFrame(frames.back().data(), frames.back().size()), "addFrame %d", i);
+    }
+    CHECK(writer.close(count * 100), "close");
+    CHECK(access((path + ".idx").c_str(), F_OK) != 0, "index side file left behind");
+    verifyAvi(path, frames, 800, 600);
+    unlink(path.c_str());
+}
+
+// close() must report a clip it could not finish
+static void checkCloseFailure(const std::string &dir)
+{
+    std::string path = dir + "/avi_check_fail.avi";
+    uint8_t buffer[4096];
+    AviWriter writer(buffer, sizeof(buffer));
+    CHECK(writer.open(path.c_str(), 320, 240, 10, 1 << 20), "open");
+    uint8_t frame[1000] = {0xFF, 0xD8};
+    writer.addFrame(frame, sizeof(frame));
+
+    // The file disappears before it can be trimmed
+    unlink(path.c_str());
+    CHECK(!writer.close(1000), "close succeeded although the file could not be trimmed");
+
+    // /dev/full takes the open but fails every write
+    AviWriter full(buffer, sizeof(buffer));
+    if (full.open("/dev/full", 320, 240, 10, 0))
+    {
+        for (int i = 0; i < 8; i++)
+            full.addFrame(frame, sizeof(frame));
+        CHECK(!full.close(1000), "close succeeded on a full device");
+    }
+    unlink("/dev/full.idx");
+}
+
+static void benchmark(const std::string &dir)
+{
+    std::mt19937 rng(99);
+    std::vector<Bytes> pool;
+    for (int i = 0; i < 32; i++)
+        pool.push_back(makeFrame(rng, 15000, 45000)); // SVGA-sized JPEGs
+
+    std::string path = dir + "/avi_bench.avi";
+    printf("%8s %10s %10s %10s\n", "block", "frames", "MB/s", "frames/s");
+    for (size_t block : {512, 4096, 16384, 65536})
+    {
+        std::vector<uint8_t> buffer(block);
+        AviWriter writer(buffer.data(), buffer.size());
+        const int frames = 2000;
+        auto start = std::chrono::steady_clock::now();
+        writer.open(path.c_str(), 800, 600, 25, 8 << 20);
+        for (int i = 0; i < frames; i++)
+            writer.addFrame(pool[i % pool.size()].data(), pool[i % pool.size()].size());
+        uint64_t bytes = writer.bytesWritten();
+        bool ok = writer.close(frames * 40);
+        // Include getting it to the medium, as the card would have to
+        FILE *f = fopen(path.c_str(), "rb+");
+        if (f)
+        {
+            fsync(fileno(f));
+            fclose(f);
+        }
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        CHECK(ok, "benchmark clip with %zu-byte blocks failed", block);
+        printf("%8zu %10d %10.1f %10.0f\n", block, frames, bytes / secs / 1e6, frames / secs);
+        unlink(path.c_str());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::string dir = argc > 1 ? argv[1] : "/tmp";
+    std::mt19937 rng(1);
+
+    checkClip(dir, 16384, 8 << 20, 200, rng); // as sd_recorder writes
+    checkClip(dir, 512, 0, 50, rng);           // smallest block, no preallocation
+    checkClip(dir, 16384, 4096, 1, rng);       // single frame, preallocation smaller than the clip
+    checkClip(dir, 16384, 1 << 20, 0, rng);    // empty clip
+    checkCloseFailure(dir);
+    benchmark(dir);
+
+    printf("%s (%d failures)\n", failures ? "FAILED" : "all checks passed", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,313 @@
+// Host check for the log deduplicator (src/log_dedup.cpp).
+//
+// Feeds it bursts of repeated messages the way the firmware produces them
+// (Wi-Fi wait dots, per-request lines, error storms) with quiet gaps of
+// random length, and compares every admit and every summary with a plain
+// std::map model of the sliding window. Also checks that no occurrence is
+// lost: every message is either emitted or counted in exactly one summary,
+// including when a run ends inside admit() without collect() being called,
+// when the table is full and when millis() wraps.
+//
+//   g++ -O2 -std=c++17 -Isrc tools/dedup_check/dedup_check.cpp src/log_dedup.cpp -o dedup_check
+//   ./dedup_check
+
+#include "log_dedup.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <tuple>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                \
+    do                                                  \
+    {                                                   \
+        if (!(cond))                                    \
+        {                                               \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__);                        \
+            printf("\n");                               \
+            failures++;                                 \
+        }                                               \
+    } while (0)
+
+typedef LogDeduplicator::Summary Summary;
+typedef std::tuple<uint8_t, std::string, uint32_t, uint32_t> SummaryKey; // level, text, count, duration
+
+static SummaryKey key(const Summary &s)
+{
+    return SummaryKey(s.level, s.text, s.count, s.duration_ms);
+}
+
+// Collects in small batches, the way Logger::emitRepeatSummaries does
+static std::vector<Summary> collectAll(LogDeduplicator &dedup, uint32_t now_ms, bool force = false)
+{
+    std::vector<Summary> all;
+    Summary batch[4];
+    size_t n;
+    while ((n = dedup.collect(now_ms, batch, 4, force)) > 0)
+        all.insert(all.end(), batch, batch + n);
+    return all;
+}
+
+// The sliding window spelled out with a map, for templates that fit the table
+class Model
+{
+public:
+    bool admit(uint8_t level, const std::string &text, uint32_t now_ms, std::vector<SummaryKey> &out)
+    {
+        auto it = runs.find({level, text});
+        if (it == runs.end())
+        {
+            runs[{level, text}] = Run{now_ms, now_ms, 0};
+            return true;
+        }
+        Run &r = it->second;
+        if (now_ms - r.last < LOG_DEDUP_WINDOW_MS)
+        {
+            r.last = now_ms;
+            r.count++;
+            if (now_ms - r.first >= LOG_DEDUP_MAX_SPAN_MS)
+                close(level, text, r, out);
+            return false;
+        }
+        if (r.count > 0)
+            close(level, text, r, out);
+        r = Run{now_ms, now_ms, 0};
+        return true;
+    }
+
+    void collect(uint32_t now_ms, bool force, std::vector<SummaryKey> &out)
+    {
+        for (auto it = runs.begin(); it != runs.end();)
+        {
+            Run &r = it->second;
+            if (force || now_ms - r.last >= LOG_DEDUP_WINDOW_MS)
+            {
+                if (r.count > 0)
+                    close(it->first.first, it->first.second, r, out);
+                it = runs.erase(it);
+                continue;
+            }
+            if (r.count > 0 && now_ms - r.first >= LOG_DEDUP_MAX_SPAN_MS)
+                close(it->first.first, it->first.second, r, out);
+            ++it;
+        }
+    }
+
+private:
+    struct Run
+    {
+        uint32_t first, last, count;
+    };
+
+    static void close(uint8_t level, const std::string &text, Run &r, std::vector<SummaryKey> &out)
+    {
+        out.push_back(SummaryKey(level, text, r.count, r.last - r.first));
+        r.first = r.last;
+        r.count = 0;
+    }
+
+    std::map<std::pair<uint8_t, std::string>, Run> runs;
+};
+
+static void checkBasics()
+{
+    LogDeduplicator dedup;
+    Summary closed;
+
+    CHECK(dedup.admit(1, "Sent 1024 bytes", 0, closed), "first occurrence held back");
+    CHECK(!dedup.admit(1, "Sent 2048 bytes", 100, closed), "digits are not folded");
+    CHECK(dedup.admit(2, "Sent 2048 bytes", 100, closed), "level is not part of the key");
+    CHECK(dedup.admit(1, "Sent bytes", 100, closed), "a digit run matches nothing");
+
+    // The window slides: a repeat every 9 s keeps the run open well past 10 s
+    for (uint32_t t = 9000; t <= 45000; t += 9000)
+        CHECK(!dedup.admit(1, "Sent 7 bytes", t, closed) && closed.count == 0, "repeat at %u emitted", t);
+    CHECK(collectAll(dedup, 50000).size() == 0, "summary while the run is still open");
+
+    std::vector<Summary> s = collectAll(dedup, 45000 + LOG_DEDUP_WINDOW_MS);
+    CHECK(s.size() == 1 && s[0].count == 6 && s[0].duration_ms == 45000 && strcmp(s[0].text, "Sent # bytes") == 0,
+          "summary after the run went quiet: %zu summaries", s.size());
+    CHECK(dedup.admit(1, "Sent 1 bytes", 60000, closed), "a new run starts with an emitted message");
+}
+
+// A run that ends inside admit() must hand back its count, not drop it
+static void checkRolloverInAdmit()
+{
+    LogDeduplicator dedup;
+    Summary closed;
+    dedup.admit(0, "Health request received", 1000, closed);
+    for (int i = 0; i < 5; i++)
+        dedup.admit(0, "Health request received", 1000 + i * 100, closed);
+
+    CHECK(dedup.admit(0, "Health request received", 1400 + LOG_DEDUP_WINDOW_MS, closed), "message after the gap");
+    CHECK(closed.count == 5 && closed.duration_ms == 400 && closed.level == 0, "rollover summary count %u",
+          (unsigned)closed.count);
+    CHECK(collectAll(dedup, 1400 + LOG_DEDUP_WINDOW_MS, true).size() == 0, "the old run was reported twice");
+
+    // Nothing was suppressed in the old run: nothing to report
+    dedup.admit(0, "Once", 0, closed);
+    dedup.admit(0, "Once", 2 * LOG_DEDUP_WINDOW_MS, closed);
+    CHECK(closed.count == 0, "empty summary from admit");
+}
+
+// The Wi-Fi wait loop logs a dot every second and never goes quiet
+static void checkEndlessRun()
+{
+    LogDeduplicator dedup;
+    Summary closed;
+    uint32_t counted = 0;
+    int summaries = 0;
+    dedup.admit(0, ".", 0, closed);
+    for (uint32_t t = 1000; t <= 300000; t += 1000)
+    {
+        CHECK(!dedup.admit(0, ".", t, closed), "dot at %u emitted", t);
+        if (closed.count)
+        {
+            counted += closed.count;
+            summaries++;
+        }
+    }
+    CHECK(summaries == 300000 / LOG_DEDUP_MAX_SPAN_MS, "%d summaries in 300 s", summaries);
+    for (const Summary &s : collectAll(dedup, 300000, true))
+        counted += s.count;
+    CHECK(counted == 300, "%u of 300 dots counted", counted);
+}
+
+// Random bursts over a handful of templates, compared step by step with the model
+static void checkBursts(uint32_t start_ms, uint32_t seed)
+{
+    static const char *templates[] = {
+        "Stream requested",
+        "Client disconnected or streaming error",
+        "Frame %d took %d ms",
+        "Photo queued for Telegram (%d bytes)",
+        "Health request received",
+        "Wi-Fi RSSI %d dBm",
+    };
+    const int count = sizeof(templates) / sizeof(templates[0]);
+
+    std::mt19937 rng(seed);
+    LogDeduplicator dedup;
+    Model model;
+    uint32_t now = start_ms;
+    uint64_t total = 0;
+    uint64_t emitted = 0;
+    uint64_t summarized = 0;
+    int mismatches = 0;
+
+    for (int burst = 0; burst < 2000; burst++)
+    {
+        // Quiet gaps from nothing to well past the window
+        now += rng() % 3 == 0 ? rng() % (3 * LOG_DEDUP_WINDOW_MS) : rng() % 500;
+        int t = rng() % count;
+        uint8_t level = rng() % 2;
+        int length = 1 + (rng() % 4 == 0 ? rng() % 200 : rng() % 5);
+
+        for (int i = 0; i < length; i++)
+        {
+            char message[96];
+            snprintf(message, sizeof(message), templates[t], (int)(rng() % 100000), (int)(rng() % 100));
+            char text[LOG_DEDUP_TEXT_LEN];
+            snprintf(text, sizeof(text), templates[t], 0, 0);
+            for (char *p = text; *p; p++)
+                if (*p == '0')
+                    *p = '#';
+
+            Summary closed;
+            std::vector<SummaryKey> expected;
+            bool admitted = dedup.admit(level, message, now, closed);
+            bool want = model.admit(level, text, now, expected);
+            std::vector<SummaryKey> got;
+            if (closed.count)
+                got.push_back(key(closed));
+            if ((admitted != want || got != expected) && mismatches++ < 5)
+                CHECK(false, "burst %d at %u: admit %d (want %d), %zu summaries (want %zu)", burst, now, admitted,
+                      want, got.size(), expected.size());
+            total++;
+            emitted += admitted;
+            summarized += closed.count;
+            now += rng() % 300;
+        }
+
+        // Logger flushes from loop() and on every log call; not always in time
+        if (rng() % 3 == 0)
+        {
+            std::vector<SummaryKey> expected, got;
+            model.collect(now, false, expected);
+            for (const Summary &s : collectAll(dedup, now))
+            {
+                got.push_back(key(s));
+                summarized += s.count;
+            }
+            std::sort(expected.begin(), expected.end());
+            std::sort(got.begin(), got.end());
+            if (got != expected && mismatches++ < 5)
+                CHECK(false, "collect at %u: %zu summaries (want %zu)", now, got.size(), expected.size());
+        }
+    }
+
+    for (const Summary &s : collectAll(dedup, now, true))
+        summarized += s.count;
+    CHECK(emitted + summarized == total, "%llu messages, %llu emitted, %llu in summaries",
+          (unsigned long long)total, (unsigned long long)emitted, (unsigned long long)summarized);
+    CHECK(dedup.suppressedTotal() == summarized, "suppressedTotal %u, summaries %llu", dedup.suppressedTotal(),
+          (unsigned long long)summarized);
+    CHECK(mismatches == 0, "%d decisions differ from the model", mismatches);
+}
+
+// More templates than slots: the overflow passes through and chains survive removal
+static void checkFullTable()
+{
+    LogDeduplicator dedup;
+    std::mt19937 rng(7);
+    uint32_t now = 0;
+    uint64_t total = 0;
+    uint64_t emitted = 0;
+    uint64_t summarized = 0;
+
+    for (int i = 0; i < 20000; i++)
+    {
+        char message[32];
+        snprintf(message, sizeof(message), "event %c%c", (int)('a' + rng() % 8), (int)('a' + rng() % 8)); // 64 templates
+        Summary closed;
+        emitted += dedup.admit(0, message, now, closed);
+        summarized += closed.count;
+        total++;
+        now += rng() % 50;
+        if (rng() % 100 == 0)
+        {
+            now += LOG_DEDUP_WINDOW_MS / 2;
+            for (const Summary &s : collectAll(dedup, now))
+                summarized += s.count;
+        }
+    }
+    for (const Summary &s : collectAll(dedup, now, true))
+        summarized += s.count;
+    CHECK(emitted + summarized == total, "%llu messages, %llu emitted, %llu in summaries",
+          (unsigned long long)total, (unsigned long long)emitted, (unsigned long long)summarized);
+
+    // After force everything is gone and each template starts over
+    Summary closed;
+    CHECK(dedup.admit(0, "event aa", now, closed), "table not emptied by force");
+}
+
+int main()
+{
+    checkBasics();
+    checkRolloverInAdmit();
+    checkEndlessRun();
+    checkBursts(0, 1);
+    checkBursts(2, 2);
+    checkBursts(UINT32_MAX - 20 * LOG_DEDUP_WINDOW_MS, 3); // millis() wraps during the run
+    checkFullTable();
+
+    printf("%s (%d failures)\n", failures ? "FAILED" : "all checks passed", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,254 @@
+// Host check for the RTC flight recorder format (src/flight_recorder.cpp).
+//
+// The ring is an ordinary struct here, so a "reset" is simply constructing a
+// new FlightRecorder over the same memory and calling recover(). Torn writes
+// are simulated by mixing the bytes of a slot before and after a write: every
+// prefix and suffix split, plus random byte subsets for stores that land out
+// of order. Recovery must return the old event, the new one, or drop the
+// slot, and never anything else. Also covers power-on garbage, wrap-around
+// order, concurrent writers and the cost of record().
+//
+//   g++ -O2 -std=c++17 -pthread -Isrc tools/flight_check/flight_check.cpp src/flight_recorder.cpp -o flight_check
+//   ./flight_check
+
+#include "flight_recorder.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                   \
+    do                                     \
+    {                                      \
+        if (!(cond))                       \
+        {                                  \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__);           \
+            printf("\n");                  \
+            failures++;                    \
+        }                                  \
+    } while (0)
+
+static std::string eventText(uint32_t n)
+{
+    char text[160];
+    snprintf(text, sizeof(text), "event %u: frame %u sent to client, heap %u", n, n * 7, 100000 + n);
+    return text;
+}
+
+static size_t recoverAll(FlightRing &ring, std::vector<FlightRecorder::Event> &events, uint32_t *torn = nullptr)
+{
+    FlightRecorder rec(&ring);
+    events.resize(FLIGHT_RECORDER_SLOTS);
+    size_t n = rec.recover(events.data(), events.size());
+    events.resize(n);
+    if (torn)
+        *torn = rec.tornSlots();
+    return n;
+}
+
+static void checkPowerOn(std::mt19937 &rng)
+{
+    int recovered = 0;
+    for (int trial = 0; trial < 1000; trial++)
+    {
+        FlightRing ring;
+        uint8_t *raw = (uint8_t *)&ring;
+        for (size_t i = 0; i < sizeof(ring); i++)
+            raw[i] = rng();
+        std::vector<FlightRecorder::Event> events;
+        recovered += recoverAll(ring, events);
+    }
+    CHECK(recovered == 0, "garbage after power-on produced %d events", recovered);
+
+    // A cleared ring is empty on the next boot
+    FlightRing ring;
+    memset(&ring, 0xA5, sizeof(ring));
+    std::vector<FlightRecorder::Event> events;
+    recoverAll(ring, events);
+    uint32_t torn = 0;
+    size_t n = recoverAll(ring, events, &torn);
+    CHECK(n == 0 && torn == 0, "empty ring recovered %zu events, %u torn", n, torn);
+}
+
+static void checkWrapAround()
+{
+    FlightRing ring;
+    memset(&ring, 0, sizeof(ring));
+    {
+        FlightRecorder rec(&ring);
+        std::vector<FlightRecorder::Event> events(FLIGHT_RECORDER_SLOTS);
+        rec.recover(events.data(), events.size());
+        for (uint32_t i = 1; i <= 100; i++)
+            rec.record(i % 5, i * 10, eventText(i).c_str());
+    }
+
+    std::vector<FlightRecorder::Event> events;
+    size_t n = recoverAll(ring, events);
+    CHECK(n == FLIGHT_RECORDER_SLOTS, "recovered %zu of %d", n, FLIGHT_RECORDER_SLOTS);
+    for (size_t k = 0; k < n; k++)
+    {
+        uint32_t expected = 100 - FLIGHT_RECORDER_SLOTS + 1 + k;
+        std::string text = eventText(expected).substr(0, FLIGHT_RECORDER_TEXT_LEN - 1);
+        CHECK(events[k].seq == expected, "event %zu has seq %u, expected %u", k, events[k].seq, expected);
+        CHECK(events[k].uptime_ms == expected * 10 && events[k].level == expected % 5, "event %u fields", expected);
+        CHECK(text == events[k].text, "event %u text '%s'", expected, events[k].text);
+    }
+
+    // Fewer output slots keep the newest events
+    memset(&ring, 0, sizeof(ring));
+    {
+        FlightRecorder rec(&ring);
+        rec.recover(events.data(), 0);
+        for (uint32_t i = 1; i <= 10; i++)
+            rec.record(1, i, eventText(i).c_str());
+    }
+    FlightRecorder rec(&ring);
+    FlightRecorder::Event last[3];
+    n = rec.recover(last, 3);
+    CHECK(n == 3 && last[0].seq == 8 && last[2].seq == 10, "newest-three returned %zu from seq %u", n,
+          n ? last[0].seq : 0);
+
+    // Long messages are truncated, not rejected
+    std::string long_text(300, 'x');
+    rec.record(2, 1, long_text.c_str());
+    n = recoverAll(ring, events);
+    CHECK(n == 1 && strlen(events[0].text) == FLIGHT_RECORDER_TEXT_LEN - 1, "long message length %zu",
+          n ? strlen(events[0].text) : 0);
+}
+
+// Fills a ring, then replaces one slot with a mixture of its bytes before and
+// after the next write
+static void checkTornWrites(std::mt19937 &rng)
+{
+    const uint32_t prefill = FLIGHT_RECORDER_SLOTS + 5;
+    FlightRing ring;
+    memset(&ring, 0, sizeof(ring));
+    FlightRecorder rec(&ring);
+    std::vector<FlightRecorder::Event> scratch(FLIGHT_RECORDER_SLOTS);
+    rec.recover(scratch.data(), scratch.size());
+    for (uint32_t i = 1; i <= prefill; i++)
+        rec.record(1, i, eventText(i).c_str());
+
+    FlightRing before = ring;
+    rec.record(3, 999, eventText(prefill + 1).c_str());
+    FlightRing after = ring;
+
+    const size_t slot = (prefill + 1) % FLIGHT_RECORDER_SLOTS;
+    const uint8_t *old_bytes = (const uint8_t *)&before.slots[slot];
+    const uint8_t *new_bytes = (const uint8_t *)&after.slots[slot];
+    const size_t slot_size = sizeof(FlightRing::Slot);
+    const uint32_t old_seq = prefill + 1 - FLIGHT_RECORDER_SLOTS;
+    const uint32_t new_seq = prefill + 1;
+
+    int trials = 0, kept_old = 0, kept_new = 0, dropped = 0;
+    auto verify = [&](const FlightRing &mixed, const char *how, size_t split) {
+        FlightRing copy = mixed;
+        std::vector<FlightRecorder::Event> events;
+        uint32_t torn = 0;
+        size_t n = recoverAll(copy, events, &torn);
+        trials++;
+
+        bool has_old = false, has_new = false;
+        for (size_t k = 0; k < n; k++)
+        {
+            uint32_t seq = events[k].seq;
+            std::string expected = eventText(seq).substr(0, FLIGHT_RECORDER_TEXT_LEN - 1);
+            CHECK(expected == events[k].text, "%s split %zu: seq %u text corrupted", how, split, seq);
+            CHECK(k == 0 || events[k - 1].seq < seq, "%s split %zu: out of order", how, split);
+            has_old |= seq == old_seq;
+            has_new |= seq == new_seq;
+        }
+        CHECK(!(has_old && has_new), "%s split %zu: slot recovered twice", how, split);
+        CHECK(n + torn == FLIGHT_RECORDER_SLOTS, "%s split %zu: %zu events + %u torn", how, split, n, torn);
+        if (has_old)
+            kept_old++;
+        else if (has_new)
+            kept_new++;
+        else
+            dropped++;
+    };
+
+    for (size_t split = 0; split <= slot_size; split++)
+    {
+        FlightRing mixed = before;
+        uint8_t *dst = (uint8_t *)&mixed.slots[slot];
+        // Reset after the first `split` bytes reached memory...
+        memcpy(dst, new_bytes, split);
+        verify(mixed, "prefix", split);
+        // ...or after the last `split` bytes did
+        mixed = before;
+        memcpy(dst + slot_size - split, new_bytes + slot_size - split, split);
+        verify(mixed, "suffix", split);
+    }
+    for (int i = 0; i < 20000; i++)
+    {
+        FlightRing mixed = before;
+        uint8_t *dst = (uint8_t *)&mixed.slots[slot];
+        for (size_t b = 0; b < slot_size; b++)
+            dst[b] = (rng() & 1) ? new_bytes[b] : old_bytes[b];
+        verify(mixed, "random", i);
+    }
+
+    printf("torn writes: %d mixtures, old event kept %d, new event kept %d, slot dropped %d\n", trials, kept_old,
+           kept_new, dropped);
+}
+
+static void checkConcurrentWriters()
+{
+    FlightRing ring;
+    memset(&ring, 0, sizeof(ring));
+    {
+        FlightRecorder rec(&ring);
+        std::vector<FlightRecorder::Event> scratch(FLIGHT_RECORDER_SLOTS);
+        rec.recover(scratch.data(), scratch.size());
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++)
+        {
+            threads.emplace_back([&rec, t]() {
+                for (uint32_t i = 0; i < 10000; i++)
+                    rec.record(t, i, eventText(i).c_str());
+            });
+        }
+        for (auto &th : threads)
+            th.join();
+    }
+    std::vector<FlightRecorder::Event> events;
+    uint32_t torn = 0;
+    size_t n = recoverAll(ring, events, &torn);
+    CHECK(n == FLIGHT_RECORDER_SLOTS && torn == 0, "concurrent writers: %zu events, %u torn", n, torn);
+}
+
+static void benchRecord()
+{
+    FlightRing ring;
+    memset(&ring, 0, sizeof(ring));
+    FlightRecorder rec(&ring);
+    std::string text = eventText(12345);
+    const int n = 1000000;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; i++)
+        rec.record(1, i, text.c_str());
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n;
+    printf("record(): %.0f ns per %zu-byte event, ring %zu bytes\n", ns, text.size(), sizeof(FlightRing));
+}
+
+int main()
+{
+    std::mt19937 rng(20240501);
+    checkPowerOn(rng);
+    checkWrapAround();
+    checkTornWrites(rng);
+    checkConcurrentWriters();
+    benchRecord();
+
+    printf(failures ? "%d check(s) failed\n" : "all checks passed\n", failures);
+    return failures ? 1 : 0;
+}
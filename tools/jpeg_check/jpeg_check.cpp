@@ -0,0 +1,389 @@
+// Fuzz and benchmark for the JPEG integrity scanner (src/jpeg_scan.cpp).
+//
+// Frames are synthesized with the layout the camera produces (JFIF header,
+// DQT, SOF0, DHT, SOS, byte-stuffed entropy data with restart markers, EOI);
+// JPEG files given on the command line are checked as well. The word-at-a-
+// time scanner is compared against a plain byte-by-byte reference on every
+// truncation of a frame, on hundreds of thousands of random mutations and on
+// random buffers, at every alignment. Then both are timed per frame.
+//
+//   g++ -O2 -std=c++17 -Isrc tools/jpeg_check/jpeg_check.cpp src/jpeg_scan.cpp -o jpeg_check
+//   ./jpeg_check [photo.jpg ...]
+//
+// With clang, -DJPEG_CHECK_LIBFUZZER -fsanitize=fuzzer,address builds a
+// libFuzzer target running the same comparison instead.
+
+#include "jpeg_scan.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+typedef std::vector<uint8_t> Bytes;
+
+// Straightforward version of jpegScan() that looks at every byte
+static JpegStatus referenceScan(const uint8_t *data, size_t len, JpegInfo *info)
+{
+    memset(info, 0, sizeof(*info));
+    if (len < 4 || data[0] != 0xFF || data[1] != 0xD8)
+        return JPEG_NO_SOI;
+
+    size_t pos = 2;
+    bool have_sof = false;
+    for (;;)
+    {
+        if (pos + 4 > len)
+            return JPEG_TRUNCATED;
+        if (data[pos] != 0xFF)
+            return JPEG_BAD_HEADER;
+        uint8_t m = data[pos + 1];
+        if (m == 0xFF)
+        {
+            pos++;
+            continue;
+        }
+        if (m == 0x00 || m == 0x01 || (m >= 0xD0 && m <= 0xD9))
+            return JPEG_BAD_HEADER;
+        size_t seg = data[pos + 2] << 8 | data[pos + 3];
+        if (seg < 2)
+            return JPEG_BAD_HEADER;
+        if (pos + 2 + seg > len)
+            return JPEG_TRUNCATED;
+        if (m >= 0xC0 && m <= 0xCF && m != 0xC4 && m != 0xC8 && m != 0xCC)
+        {
+            if (seg < 8)
+                return JPEG_BAD_HEADER;
+            info->height = data[pos + 5] << 8 | data[pos + 6];
+            info->width = data[pos + 7] << 8 | data[pos + 8];
+            info->components = data[pos + 9];
+            have_sof = info->width && info->height;
+        }
+        pos += 2 + seg;
+        if (m == 0xDA)
+            break;
+    }
+    if (!have_sof)
+        return JPEG_NO_SOF;
+
+    for (; pos < len; pos++)
+    {
+        if (data[pos] != 0xFF)
+            continue;
+        if (pos + 1 >= len)
+            return JPEG_TRUNCATED;
+        uint8_t m = data[pos + 1];
+        if (m == 0xD9)
+        {
+            info->end = pos + 2;
+            return JPEG_OK;
+        }
+        if (m == 0x00 || (m >= 0xD0 && m <= 0xD7))
+        {
+            pos++;
+        }
+        else if (m == 0xC4 || (m >= 0xDA && m <= 0xDD) || (m >= 0xE0 && m <= 0xEF) || m == 0xFE)
+        {
+            // Between the scans of a progressive image
+            if (pos + 4 > len)
+                return JPEG_TRUNCATED;
+            size_t seg = data[pos + 2] << 8 | data[pos + 3];
+            if (pos + 2 + seg > len)
+                return JPEG_TRUNCATED;
+            if (seg < 2)
+                return JPEG_BAD_MARKER;
+            pos += 1 + seg;
+        }
+        else if (m != 0xFF)
+        {
+            return JPEG_BAD_MARKER;
+        }
+    }
+    return JPEG_TRUNCATED;
+}
+
+static void put16(Bytes &out, unsigned v)
+{
+    out.push_back(v >> 8);
+    out.push_back(v & 0xFF);
+}
+
+static void segment(Bytes &out, uint8_t marker, const Bytes &body)
+{
+    out.push_back(0xFF);
+    out.push_back(marker);
+    put16(out, body.size() + 2);
+    out.insert(out.end(), body.begin(), body.end());
+}
+
+// Structurally valid baseline JPEG; the image data is random but stuffed
+static Bytes makeFrame(std::mt19937 &rng, uint16_t width, uint16_t height, size_t entropy_bytes,
+                       unsigned restart_interval, size_t padding)
+{
+    Bytes out = {0xFF, 0xD8};
+    segment(out, 0xE0, {'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0});
+    Bytes dqt(65);
+    for (uint8_t &b : dqt)
+        b = rng(); // tables may contain 0xFF; header segments are skipped by length
+    dqt[0] = 0;
+    segment(out, 0xDB, dqt);
+    segment(out, 0xC0, {8, (uint8_t)(height >> 8), (uint8_t)height, (uint8_t)(width >> 8), (uint8_t)width, 3, 1,
+                        0x21, 0, 2, 0x11, 1, 3, 0x11, 1});
+    if (restart_interval)
+        segment(out, 0xDD, {(uint8_t)(restart_interval >> 8), (uint8_t)restart_interval});
+    Bytes dht(29);
+    for (uint8_t &b : dht)
+        b = rng();
+    dht[0] = 0;
+    segment(out, 0xC4, dht);
+    segment(out, 0xDA, {3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0});
+
+    unsigned rst = 0;
+    for (size_t i = 0; i < entropy_bytes; i++)
+    {
+        uint8_t v = rng();
+        out.push_back(v);
+        if (v == 0xFF)
+            out.push_back(0x00);
+        if (restart_interval && i % restart_interval == restart_interval - 1)
+        {
+            out.push_back(0xFF);
+            out.push_back(0xD0 + (rst++ & 7));
+        }
+    }
+    out.push_back(0xFF);
+    out.push_back(0xD9);
+    out.insert(out.end(), padding, 0);
+    return out;
+}
+
+static bool sameResult(const uint8_t *data, size_t len, JpegStatus *status = nullptr)
+{
+    JpegInfo fast, ref;
+    JpegStatus a = jpegScan(data, len, &fast);
+    JpegStatus b = referenceScan(data, len, &ref);
+    if (status)
+        *status = a;
+    return a == b && fast.width == ref.width && fast.height == ref.height && fast.components == ref.components &&
+           fast.end == ref.end;
+}
+
+#ifdef JPEG_CHECK_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    if (!sameResult(data, size))
+        abort();
+    return 0;
+}
+
+#else
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                \
+    do                                                  \
+    {                                                   \
+        if (!(cond))                                    \
+        {                                               \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__);                        \
+            printf("\n");                               \
+            failures++;                                 \
+        }                                               \
+    } while (0)
+
+// Every alignment, since the word loop reads unaligned words
+static bool sameAtAllOffsets(const Bytes &frame, JpegStatus *status)
+{
+    std::vector<uint8_t> shifted(frame.size() + 16);
+    for (size_t offset = 0; offset < 8; offset++)
+    {
+        if (!frame.empty())
+            memcpy(shifted.data() + offset, frame.data(), frame.size());
+        if (!sameResult(shifted.data() + offset, frame.size(), status))
+            return false;
+    }
+    return true;
+}
+
+static void checkValidFrames(std::mt19937 &rng)
+{
+    for (int trial = 0; trial < 2000; trial++)
+    {
+        uint16_t w = 16 + rng() % 2000, h = 16 + rng() % 1500;
+        size_t padding = trial % 3 ? 0 : rng() % 64;
+        Bytes frame = makeFrame(rng, w, h, rng() % 4096, trial % 2 ? 64 : 0, padding);
+        JpegInfo info;
+        JpegStatus status = jpegScan(frame.data(), frame.size(), &info);
+        CHECK(status == JPEG_OK && info.width == w && info.height == h && info.components == 3 &&
+                  info.end == frame.size() - padding,
+              "valid %ux%u frame: %s, %ux%u, end %zu of %zu", w, h, jpegStatusName(status), info.width,
+              info.height, info.end, frame.size());
+        CHECK(sameAtAllOffsets(frame, &status), "valid frame differs from reference at some alignment");
+    }
+}
+
+static void checkTruncation(std::mt19937 &rng)
+{
+    int ok_prefixes = 0;
+    int mismatches = 0;
+    for (int trial = 0; trial < 50; trial++)
+    {
+        Bytes frame = makeFrame(rng, 640, 480, 1500 + rng() % 1500, trial % 2 ? 32 : 0, 0);
+        for (size_t len = 0; len < frame.size(); len++)
+        {
+            JpegStatus status;
+            mismatches += !sameResult(frame.data(), len, &status);
+            ok_prefixes += status == JPEG_OK;
+        }
+    }
+    CHECK(ok_prefixes == 0, "%d truncated frames passed", ok_prefixes);
+    CHECK(mismatches == 0, "%d truncations differ from the reference", mismatches);
+}
+
+static void checkMutations(std::mt19937 &rng, int trials)
+{
+    int mismatches = 0;
+    int counts[JPEG_STATUS_COUNT] = {};
+    for (int trial = 0; trial < trials; trial++)
+    {
+        Bytes frame = makeFrame(rng, 320 + rng() % 1280, 240 + rng() % 960, rng() % 2048, trial % 2 ? 16 : 0,
+                                rng() % 4 ? 0 : rng() % 8);
+        int edits = 1 + rng() % 4;
+        for (int e = 0; e < edits && !frame.empty(); e++)
+        {
+            size_t at = rng() % frame.size();
+            switch (rng() % 6)
+            {
+            case 0: // bit flip
+                frame[at] ^= 1 << (rng() % 8);
+                break;
+            case 1: // random byte
+                frame[at] = rng();
+                break;
+            case 2: // stray marker
+                frame[at] = 0xFF;
+                break;
+            case 3: // lost bytes, like a dropped DMA block
+                frame.erase(frame.begin() + at, frame.begin() + std::min(frame.size(), at + 1 + rng() % 64));
+                break;
+            case 4: // duplicated run
+                frame.insert(frame.begin() + at, frame.begin() + at,
+                             frame.begin() + std::min(frame.size(), at + 1 + rng() % 32));
+                break;
+            case 5: // truncation
+                frame.resize(at);
+                break;
+            }
+        }
+        JpegStatus status;
+        bool same = sameAtAllOffsets(frame, &status);
+        mismatches += !same;
+        counts[status]++;
+    }
+    CHECK(mismatches == 0, "%d mutated frames differ from the reference", mismatches);
+    printf("mutations: %d frames:", trials);
+    for (int i = 0; i < JPEG_STATUS_COUNT; i++)
+        printf(" %s %d%s", jpegStatusName((JpegStatus)i), counts[i], i + 1 < JPEG_STATUS_COUNT ? "," : "\n");
+}
+
+static void checkRandomBuffers(std::mt19937 &rng)
+{
+    int mismatches = 0;
+    for (int trial = 0; trial < 100000; trial++)
+    {
+        Bytes buf(rng() % 256);
+        for (uint8_t &b : buf)
+            b = rng() % 3 ? rng() : 0xFF;
+        if (buf.size() >= 2 && trial % 2)
+        {
+            buf[0] = 0xFF;
+            buf[1] = 0xD8;
+        }
+        mismatches += !sameAtAllOffsets(buf, nullptr);
+    }
+    CHECK(mismatches == 0, "%d random buffers differ from the reference", mismatches);
+}
+
+static void checkFiles(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        FILE *f = fopen(argv[i], "rb");
+        if (!f)
+        {
+            CHECK(false, "cannot open %s", argv[i]);
+            continue;
+        }
+        Bytes data;
+        uint8_t buf[65536];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+            data.insert(data.end(), buf, buf + n);
+        fclose(f);
+
+        JpegInfo info;
+        JpegStatus status = jpegScan(data.data(), data.size(), &info);
+        printf("%s: %s, %ux%u, %u components, EOI at %zu of %zu bytes\n", argv[i], jpegStatusName(status), info.width,
+               info.height, info.components, info.end, data.size());
+        JpegStatus truncated = jpegScan(data.data(), data.size() * 3 / 4, &info);
+        CHECK(truncated != JPEG_OK, "%s: truncated copy passed", argv[i]);
+        CHECK(sameResult(data.data(), data.size()), "%s: differs from the reference", argv[i]);
+    }
+}
+
+template <typename Scan>
+static double nsPerFrame(Scan scan, const Bytes &frame)
+{
+    JpegInfo info;
+    int iterations = (int)(200000000 / frame.size()) + 1;
+    volatile size_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        scan(frame.data(), frame.size(), &info);
+        sink = sink + info.end;
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+static void bench(std::mt19937 &rng)
+{
+    struct Size
+    {
+        const char *name;
+        uint16_t w, h;
+        size_t bytes;
+    } sizes[] = {{"QVGA", 320, 240, 8000}, {"VGA", 640, 480, 25000}, {"SVGA", 800, 600, 40000},
+                 {"UXGA", 1600, 1200, 150000}};
+    printf("\n%-6s %8s %12s %12s %10s\n", "frame", "bytes", "scan us", "bytewise us", "scan MB/s");
+    for (const Size &s : sizes)
+    {
+        Bytes frame = makeFrame(rng, s.w, s.h, s.bytes, 0, 0);
+        double fast = nsPerFrame(jpegScan, frame);
+        double ref = nsPerFrame(referenceScan, frame);
+        printf("%-6s %8zu %12.2f %12.2f %10.0f\n", s.name, frame.size(), fast / 1000, ref / 1000,
+               frame.size() / fast * 1000);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    std::mt19937 rng(20240601);
+
+    checkValidFrames(rng);
+    checkTruncation(rng);
+    checkMutations(rng, 200000);
+    checkRandomBuffers(rng);
+    checkFiles(argc, argv);
+    bench(rng);
+
+    printf("\n%s (%d failures)\n", failures ? "FAILED" : "all checks passed", failures);
+    return failures ? 1 : 0;
+}
+
+#endif // JPEG_CHECK_LIBFUZZER
@@ -0,0 +1,270 @@
+// Ingestion benchmark for Logger's Logstash shipping, run against
+// logstash_sink (or a real Logstash http input).
+//
+// Logger::sendToLogstash needs the Arduino core, so this driver reproduces its
+// request pattern instead of linking it: one new connection per event,
+// "Connection: close", the same headers, a document with Logger's fields and
+// the 5 s connect / 10 s response timeouts. Each logging thread blocks for the
+// whole exchange exactly as a task calling Logger::info() does, and a failed
+// send is lost because Logger does not retry.
+//
+// Build:  g++ -O2 -std=c++17 -pthread logship_bench.cpp -o logship_bench
+// Run:    ./logstash_sink --listen 8080 --latency-ms 50 --error-rate 0.05 &
+//         ./logship_bench --port 8080 --events 2000 --threads 4
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Options
+{
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    std::string path = "/";
+    int events = 1000;
+    int threads = 1;
+    double rate = 0; // events/s per thread, 0 = back to back
+    int connect_timeout_ms = 5000;
+    int timeout_ms = 10000;
+};
+
+enum Outcome
+{
+    DELIVERED,
+    HTTP_ERROR,
+    CONNECT_FAILED,
+    RESET,
+    TIMEOUT,
+    OUTCOME_COUNT
+};
+
+static const char *outcome_names[OUTCOME_COUNT] = {"delivered", "http error", "connect failed", "reset", "timeout"};
+
+static Options opt;
+static sockaddr_in target;
+static std::mutex results_lock;
+static std::vector<double> block_ms;
+static uint64_t outcomes[OUTCOME_COUNT];
+static std::atomic<int> next_event{0};
+
+// Same fields as Logger::sendToLogstash, with plausible values
+static std::string makeDocument(int seq)
+{
+    char doc[1536];
+    snprintf(doc, sizeof(doc),
+             "{\"@timestamp\":\"2024-01-01T00:00:%02d.000Z\",\"level\":\"INFO\",\"message\":\"bench event %d\","
+             "\"device\":\"ESP32-CAM-01\",\"uptime_ms\":%d,\"free_heap\":182344,\"total_heap\":327680,"
+             "\"min_free_heap\":150112,\"max_alloc_heap\":110580,\"memory_usage_percent\":44.35,"
+             "\"chip_id\":\"a4c2f1d8\",\"chip_model\":\"ESP32-D0WDQ6\",\"chip_revision\":1,\"cpu_freq_mhz\":240,"
+             "\"wifi_rssi\":-61,\"ip_address\":\"192.168.1.50\",\"mac_address\":\"24:0A:C4:00:00:01\","
+             "\"wifi_ssid\":\"bench\",\"gateway_ip\":\"192.168.1.1\",\"subnet_mask\":\"255.255.255.0\","
+             "\"flash_chip_size\":4194304,\"flash_chip_speed\":80000000,\"sdk_version\":\"v4.4.7\","
+             "\"logger_attempts\":%d,\"logger_successes\":%d,\"logger_failures\":0,\"logger_success_rate\":100}",
+             seq % 60, seq, seq * 10, seq, seq);
+    return doc;
+}
+
+static Outcome connectWithTimeout(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    if (connect(fd, (sockaddr *)&target, sizeof(target)) < 0 && errno != EINPROGRESS)
+    {
+        return CONNECT_FAILED;
+    }
+    pollfd pfd{fd, POLLOUT, 0};
+    if (poll(&pfd, 1, opt.connect_timeout_ms) <= 0)
+    {
+        return TIMEOUT;
+    }
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err)
+    {
+        return CONNECT_FAILED;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+    timeval tv{opt.timeout_ms / 1000, (opt.timeout_ms % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    return DELIVERED;
+}
+
+static Outcome shipOne(int seq)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    Outcome result = connectWithTimeout(fd);
+    if (result != DELIVERED)
+    {
+        close(fd);
+        return result;
+    }
+
+    std::string body = makeDocument(seq);
+    char head[512];
+    int head_len = snprintf(head, sizeof(head),
+                            "POST %s HTTP/1.1\r\nHost: %s:%d\r\nContent-Type: application/json\r\n"
+                            "User-Agent: ESP32-Logger/1.0\r\nAccept: */*\r\nConnection: close\r\n"
+                            "Content-Length: %zu\r\n\r\n",
+                            opt.path.c_str(), opt.host.c_str(), opt.port, body.size());
+    std::string request = std::string(head, head_len) + body;
+    if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t)request.size())
+    {
+        close(fd);
+        return errno == EAGAIN ? TIMEOUT : RESET;
+    }
+
+    // HTTPClient reads the whole response before http.end()
+    std::string response;
+    char buf[1024];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0)
+    {
+        response.append(buf, n);
+    }
+    int err = errno;
+    close(fd);
+
+    if (response.size() < 12)
+    {
+        return n < 0 && (err == EAGAIN || err == EWOULDBLOCK) ? TIMEOUT : RESET;
+    }
+    int status = atoi(response.c_str() + 9);
+    return status >= 200 && status < 300 ? DELIVERED : HTTP_ERROR;
+}
+
+static void loggingThread()
+{
+    auto next = std::chrono::steady_clock::now();
+    std::vector<double> local_block;
+    uint64_t local_outcomes[OUTCOME_COUNT] = {};
+
+    int seq;
+    while ((seq = next_event++) < opt.events)
+    {
+        if (opt.rate > 0)
+        {
+            std::this_thread::sleep_until(next);
+            next += std::chrono::microseconds((int64_t)(1e6 / opt.rate));
+        }
+        auto start = std::chrono::steady_clock::now();
+        Outcome o = shipOne(seq);
+        local_block.push_back(
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        local_outcomes[o]++;
+    }
+
+    std::lock_guard<std::mutex> guard(results_lock);
+    block_ms.insert(block_ms.end(), local_block.begin(), local_block.end());
+    for (int i = 0; i < OUTCOME_COUNT; i++)
+    {
+        outcomes[i] += local_outcomes[i];
+    }
+}
+
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t i = std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+    return sorted[i];
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [--host H] [--port P] [--path /] [--events N] [--threads T] [--rate EVENTS_PER_S] "
+            "[--connect-timeout-ms N] [--timeout-ms N]\n",
+            argv0);
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string a = argv[i];
+        bool has_value = i + 1 < argc;
+        if (a == "--host" && has_value)
+            opt.host = argv[++i];
+        else if (a == "--port" && has_value)
+            opt.port = atoi(argv[++i]);
+        else if (a == "--path" && has_value)
+            opt.path = argv[++i];
+        else if (a == "--events" && has_value)
+            opt.events = atoi(argv[++i]);
+        else if (a == "--threads" && has_value)
+            opt.threads = std::max(1, atoi(argv[++i]));
+        else if (a == "--rate" && has_value)
+            opt.rate = atof(argv[++i]);
+        else if (a == "--connect-timeout-ms" && has_value)
+            opt.connect_timeout_ms = atoi(argv[++i]);
+        else if (a == "--timeout-ms" && has_value)
+            opt.timeout_ms = atoi(argv[++i]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    addrinfo hints{}, *res = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(opt.host.c_str(), nullptr, &hints, &res) != 0 || !res)
+    {
+        fprintf(stderr, "cannot resolve %s\n", opt.host.c_str());
+        return 1;
+    }
+    target = *(sockaddr_in *)res->ai_addr;
+    target.sin_port = htons(opt.port);
+    freeaddrinfo(res);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < opt.threads; i++)
+    {
+        threads.emplace_back(loggingThread);
+    }
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::sort(block_ms.begin(), block_ms.end());
+    double total_block = 0;
+    for (double b : block_ms)
+        total_block += b;
+
+    uint64_t lost = opt.events - outcomes[DELIVERED];
+    printf("events %d in %.2f s with %d thread(s)\n", opt.events, wall_s, opt.threads);
+    printf("delivered %lu (%.1f events/s), lost %lu (%.2f%%)\n", (unsigned long)outcomes[DELIVERED],
+           outcomes[DELIVERED] / wall_s, (unsigned long)lost, 100.0 * lost / std::max(1, opt.events));
+    for (int i = 1; i < OUTCOME_COUNT; i++)
+    {
+        if (outcomes[i])
+            printf("  %-15s %lu\n", outcome_names[i], (unsigned long)outcomes[i]);
+    }
+    printf("caller blocking per event: avg %.2f ms  p50 %.2f  p99 %.2f  max %.2f\n",
+           block_ms.empty() ? 0 : total_block / block_ms.size(), percentile(block_ms, 0.5),
+           percentile(block_ms, 0.99), block_ms.empty() ? 0 : block_ms.back());
+    return 0;
+}
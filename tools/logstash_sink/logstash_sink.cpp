@@ -0,0 +1,393 @@
+// Local stand-in for the Logstash HTTP input used by Logger.
+//
+// Accepts POSTed JSON the way the http input plugin does: a single document,
+// a JSON array of documents (batch) or newline-delimited documents. Every
+// request is recorded with its arrival time, size and event count, and faults
+// can be injected to see how the device side copes:
+//   --latency-ms N     delay every response by N ms (+ --jitter-ms J, uniform)
+//   --error-rate P     answer a fraction P of requests with 503
+//   --reset-rate P     drop a fraction P of connections with a TCP reset
+//
+// Build:  g++ -O2 -std=c++17 -pthread logstash_sink.cpp -o logstash_sink
+// Run:    ./logstash_sink --listen 8080 --latency-ms 200 --error-rate 0.05 --record arrivals.csv
+//
+// Point logger_url at http://<host>:8080/ and watch the per-interval report;
+// logship_bench in this directory drives it with Logger's request pattern.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+struct Options
+{
+    int port = 8080;
+    int latency_ms = 0;
+    int jitter_ms = 0;
+    double error_rate = 0;
+    double reset_rate = 0;
+    std::string record_path;
+};
+
+struct Counters
+{
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> events{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> ok{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> resets{0};
+    std::atomic<uint64_t> bad{0};
+};
+
+static Options opt;
+static Counters counters;
+static std::mutex record_lock;
+static FILE *record_file = nullptr;
+static std::atomic<bool> stopping{false};
+static const auto start_time = std::chrono::steady_clock::now();
+
+static double sinceStartMs()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+// Counts documents: top-level objects in an array, non-empty lines for
+// NDJSON, otherwise one. Returns 0 for a body that is not JSON at all.
+static size_t countEvents(const std::string &body)
+{
+    size_t i = body.find_first_not_of(" \t\r\n");
+    if (i == std::string::npos)
+    {
+        return 0;
+    }
+
+    if (body[i] == '[')
+    {
+        size_t count = 0;
+        int depth = 0;
+        bool in_string = false;
+        for (; i < body.size(); i++)
+        {
+            char c = body[i];
+            if (in_string)
+            {
+                if (c == '\\')
+                    i++;
+                else if (c == '"')
+                    in_string = false;
+                continue;
+            }
+            if (c == '"')
+                in_string = true;
+            else if (c == '[' || c == '{')
+            {
+                if (c == '{' && depth == 1)
+                    count++;
+                depth++;
+            }
+            else if (c == ']' || c == '}')
+                depth--;
+        }
+        return count;
+    }
+
+    if (body[i] != '{')
+    {
+        return 0;
+    }
+    size_t count = 0;
+    size_t line_start = 0;
+    while (line_start < body.size())
+    {
+        size_t end = body.find('\n', line_start);
+        if (end == std::string::npos)
+            end = body.size();
+        if (body.find_first_not_of(" \t\r", line_start) < end)
+            count++;
+        line_start = end + 1;
+    }
+    return count;
+}
+
+static void record(double arrival_ms, size_t bytes, size_t events, const char *outcome)
+{
+    std::lock_guard<std::mutex> guard(record_lock);
+    if (!record_file)
+    {
+        return;
+    }
+    fprintf(record_file, "%.3f,%zu,%zu,%s\n", arrival_ms, bytes, events, outcome);
+}
+
+static bool readRequest(int fd, std::string &buf, std::string &head, std::string &body)
+{
+    size_t header_end;
+    while ((header_end = buf.find("\r\n\r\n")) == std::string::npos)
+    {
+        char tmp[4096];
+        ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+        if (n <= 0)
+            return false;
+        buf.append(tmp, n);
+    }
+    head = buf.substr(0, header_end);
+    buf.erase(0, header_end + 4);
+
+    std::string lower = head;
+    for (char &c : lower)
+        c = tolower(c);
+
+    size_t content_length = 0;
+    size_t pos = lower.find("\r\ncontent-length:");
+    if (pos != std::string::npos)
+    {
+        content_length = strtoul(head.c_str() + pos + 17, nullptr, 10);
+    }
+    else if (lower.find("transfer-encoding: chunked") != std::string::npos)
+    {
+        body.clear();
+        while (true)
+        {
+            size_t line_end;
+            while ((line_end = buf.find("\r\n")) == std::string::npos)
+            {
+                char tmp[4096];
+                ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+                if (n <= 0)
+                    return false;
+                buf.append(tmp, n);
+            }
+            size_t chunk = strtoul(buf.c_str(), nullptr, 16);
+            while (buf.size() < line_end + 2 + chunk + 2)
+            {
+                char tmp[4096];
+                ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+                if (n <= 0)
+                    return false;
+                buf.append(tmp, n);
+            }
+            body.append(buf, line_end + 2, chunk);
+            buf.erase(0, line_end + 2 + chunk + 2);
+            if (chunk == 0)
+                return true;
+        }
+    }
+
+    while (buf.size() < content_length)
+    {
+        char tmp[4096];
+        ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+        if (n <= 0)
+            return false;
+        buf.append(tmp, n);
+    }
+    body = buf.substr(0, content_length);
+    buf.erase(0, content_length);
+    return true;
+}
+
+static void resetConnection(int fd)
+{
+    // Zero linger turns close() into an RST
+    linger lg{1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    close(fd);
+}
+
+static void serveConnection(int fd)
+{
+    std::mt19937 rng(std::random_device{}());
+    std::uniform_real_distribution<double> chance(0, 1);
+    std::string buf, head, body;
+
+    while (readRequest(fd, buf, head, body))
+    {
+        double arrival = sinceStartMs();
+        bool is_post = head.compare(0, 5, "POST ") == 0;
+        bool keep_alive = head.find("Connection: close") == std::string::npos &&
+                          head.find("connection: close") == std::string::npos;
+
+        if (opt.latency_ms || opt.jitter_ms)
+        {
+            int delay = opt.latency_ms + (opt.jitter_ms ? (int)(rng() % (opt.jitter_ms + 1)) : 0);
+            std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+        }
+
+        size_t events = is_post ? countEvents(body) : 0;
+        if (is_post)
+        {
+            counters.requests++;
+            counters.bytes += body.size();
+        }
+
+        if (is_post && chance(rng) < opt.reset_rate)
+        {
+            counters.resets++;
+            record(arrival, body.size(), events, "reset");
+            resetConnection(fd);
+            return;
+        }
+
+        int status = 200;
+        if (is_post && chance(rng) < opt.error_rate)
+        {
+            status = 503;
+            counters.errors++;
+        }
+        else if (is_post && events == 0)
+        {
+            status = 400;
+            counters.bad++;
+        }
+        else if (is_post)
+        {
+            counters.ok++;
+            counters.events += events;
+        }
+        if (is_post)
+        {
+            record(arrival, body.size(), events, status == 200 ? "200" : status == 503 ? "503" : "400");
+        }
+
+        const char *reason = status == 200 ? "OK" : status == 503 ? "Service Unavailable" : "Bad Request";
+        char response[256];
+        int len = snprintf(response, sizeof(response),
+                           "HTTP/1.1 %d %s\r\nContent-Type: text/plain\r\nContent-Length: 2\r\nConnection: %s\r\n\r\nok",
+                           status, reason, keep_alive ? "keep-alive" : "close");
+        if (send(fd, response, len, MSG_NOSIGNAL) != len || !keep_alive)
+        {
+            break;
+        }
+    }
+    close(fd);
+}
+
+static void reporter()
+{
+    uint64_t last_requests = 0, last_events = 0, last_bytes = 0;
+    while (!stopping)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(5));
+        uint64_t requests = counters.requests, events = counters.events, bytes = counters.bytes;
+        printf("[%7.1fs] %6.1f req/s  %7.1f events/s  %7.1f KB/s  | ok %lu  503 %lu  reset %lu  bad %lu\n",
+               sinceStartMs() / 1000, (requests - last_requests) / 5.0, (events - last_events) / 5.0,
+               (bytes - last_bytes) / 5.0 / 1024, (unsigned long)counters.ok.load(),
+               (unsigned long)counters.errors.load(), (unsigned long)counters.resets.load(),
+               (unsigned long)counters.bad.load());
+        fflush(stdout);
+        last_requests = requests;
+        last_events = events;
+        last_bytes = bytes;
+    }
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [--listen PORT] [--latency-ms N] [--jitter-ms N] [--error-rate P] [--reset-rate P] "
+            "[--record FILE.csv]\n",
+            argv0);
+}
+
+static void onSignal(int)
+{
+    stopping = true;
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string a = argv[i];
+        bool has_value = i + 1 < argc;
+        if (a == "--listen" && has_value)
+            opt.port = atoi(argv[++i]);
+        else if (a == "--latency-ms" && has_value)
+            opt.latency_ms = atoi(argv[++i]);
+        else if (a == "--jitter-ms" && has_value)
+            opt.jitter_ms = atoi(argv[++i]);
+        else if (a == "--error-rate" && has_value)
+            opt.error_rate = atof(argv[++i]);
+        else if (a == "--reset-rate" && has_value)
+            opt.reset_rate = atof(argv[++i]);
+        else if (a == "--record" && has_value)
+            opt.record_path = argv[++i];
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!opt.record_path.empty())
+    {
+        record_file = fopen(opt.record_path.c_str(), "w");
+        if (!record_file)
+        {
+            perror(opt.record_path.c_str());
+            return 1;
+        }
+        fprintf(record_file, "arrival_ms,bytes,events,outcome\n");
+    }
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opt.port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 256) < 0)
+    {
+        perror("listen");
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    printf("logstash_sink listening on :%d (latency %d+%d ms, 503 rate %.2f, reset rate %.2f)\n", opt.port,
+           opt.latency_ms, opt.jitter_ms, opt.error_rate, opt.reset_rate);
+    fflush(stdout);
+
+    std::thread(reporter).detach();
+    while (!stopping)
+    {
+        pollfd pfd{listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0)
+        {
+            continue;
+        }
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd >= 0)
+        {
+            std::thread(serveConnection, fd).detach();
+        }
+    }
+
+    printf("total: %lu requests, %lu events, %lu bytes | ok %lu  503 %lu  reset %lu  bad %lu\n",
+           (unsigned long)counters.requests.load(), (unsigned long)counters.events.load(),
+           (unsigned long)counters.bytes.load(), (unsigned long)counters.ok.load(),
+           (unsigned long)counters.errors.load(), (unsigned long)counters.resets.load(),
+           (unsigned long)counters.bad.load());
+    std::lock_guard<std::mutex> guard(record_lock);
+    if (record_file)
+    {
+        fclose(record_file);
+        record_file = nullptr;
+    }
+    return 0;
+}
@@ -0,0 +1,51 @@
+// Example viewer: joins the camera's multicast group and writes every
+// reassembled JPEG to stdout, which ffplay/ffmpeg accept as "-f mjpeg".
+// Statistics are printed to stderr every 5 seconds.
+
+#include "mcast_receiver.h"
+
+#include <sys/socket.h>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+int main(int argc, char **argv)
+{
+    const char *group = argc > 1 ? argv[1] : "239.255.0.1";
+    uint16_t port = argc > 2 ? atoi(argv[2]) : 5010;
+
+    int fd = mcastOpenSocket(group, port);
+    if (fd < 0)
+    {
+        perror("mcastOpenSocket");
+        return 1;
+    }
+
+    McastReassembler rx([](uint32_t, const uint8_t *data, size_t len)
+                        {
+                            fwrite(data, 1, len, stdout);
+                            fflush(stdout);
+                        });
+
+    uint8_t buf[65536];
+    time_t last_report = time(nullptr);
+    while (true)
+    {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n > 0)
+        {
+            rx.feed(buf, n);
+        }
+
+        time_t now = time(nullptr);
+        if (now - last_report >= 5)
+        {
+            const McastReassembler::Stats &s = rx.stats();
+            fprintf(stderr, "datagrams=%llu bad=%llu frames=%llu recovered=%llu dropped=%llu\n",
+                    (unsigned long long)s.datagrams, (unsigned long long)s.bad_datagrams,
+                    (unsigned long long)s.frames_complete, (unsigned long long)s.frames_recovered,
+                    (unsigned long long)s.frames_dropped);
+            last_report = now;
+        }
+    }
+}
@@ -0,0 +1,231 @@
+#include "mcast_receiver.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+
+// Frame ids wrap, compare them as a signed distance
+static bool newerThan(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) > 0;
+}
+
+McastReassembler::McastReassembler(FrameCallback on_frame)
+    : on_frame_(std::move(on_frame))
+{
+}
+
+McastReassembler::Slot *McastReassembler::slotFor(const McastHeader &h)
+{
+    for (Slot &s : slots_)
+    {
+        if (s.used && s.frame_id == h.frame_id)
+        {
+            return &s;
+        }
+    }
+
+    // Reuse a free slot, otherwise evict the oldest incomplete frame
+    Slot *oldest = &slots_[0];
+    for (Slot &s : slots_)
+    {
+        if (!s.used)
+        {
+            oldest = &s;
+            break;
+        }
+        if (newerThan(oldest->frame_id, s.frame_id))
+        {
+            oldest = &s;
+        }
+    }
+
+    if (oldest->used)
+    {
+        stats_.frames_dropped++;
+    }
+
+    Slot &s = *oldest;
+    s.used = true;
+    s.frame_id = h.frame_id;
+    s.h = h;
+    s.data.assign((size_t)h.frag_count * h.frag_size, 0);
+    s.have.assign(h.frag_count, false);
+    s.parity.assign(h.parity_group ? (h.frag_count + h.parity_group - 1) / h.parity_group : 0, {});
+    s.received = 0;
+    s.recovered = false;
+    return &s;
+}
+
+void McastReassembler::storeFragment(Slot &s, uint16_t index, const uint8_t *payload, size_t len)
+{
+    if (index >= s.h.frag_count || s.have[index])
+    {
+        return;
+    }
+    memcpy(&s.data[(size_t)index * s.h.frag_size], payload, std::min(len, (size_t)s.h.frag_size));
+    s.have[index] = true;
+    s.received++;
+}
+
+void McastReassembler::tryRecover(Slot &s)
+{
+    for (size_t g = 0; g < s.parity.size(); g++)
+    {
+        if (s.parity[g].empty())
+        {
+            continue;
+        }
+
+        uint16_t first = g * s.h.parity_group;
+        uint16_t last = std::min<uint32_t>(first + s.h.parity_group, s.h.frag_count);
+        int missing = -1;
+        int missing_count = 0;
+        for (uint16_t i = first; i < last; i++)
+        {
+            if (!s.have[i])
+            {
+                missing = i;
+                missing_count++;
+            }
+        }
+        if (missing_count != 1)
+        {
+            continue;
+        }
+
+        // Parity XOR every other fragment in the group yields the lost one
+        std::vector<uint8_t> rebuilt = s.parity[g];
+        for (uint16_t i = first; i < last; i++)
+        {
+            if (i == missing)
+            {
+                continue;
+            }
+            const uint8_t *frag = &s.data[(size_t)i * s.h.frag_size];
+            for (size_t b = 0; b < rebuilt.size(); b++)
+            {
+                rebuilt[b] ^= frag[b];
+            }
+        }
+        storeFragment(s, missing, rebuilt.data(), rebuilt.size());
+        s.recovered = true;
+    }
+}
+
+void McastReassembler::complete(Slot &s)
+{
+    // Latest frame wins; a straggler older than what was shown is useless
+    if (!delivered_any_ || newerThan(s.frame_id, last_delivered_))
+    {
+        stats_.frames_complete++;
+        if (s.recovered)
+        {
+            stats_.frames_recovered++;
+        }
+        delivered_any_ = true;
+        last_delivered_ = s.frame_id;
+        on_frame_(s.frame_id, s.data.data(), s.h.frame_len);
+    }
+    else
+    {
+        stats_.frames_dropped++;
+    }
+
+    // Incomplete frames older than this one will never be shown either
+    for (Slot &other : slots_)
+    {
+        if (other.used && &other != &s && newerThan(s.frame_id, other.frame_id))
+        {
+            other.used = false;
+            stats_.frames_dropped++;
+        }
+    }
+    s.used = false;
+}
+
+void McastReassembler::feed(const uint8_t *datagram, size_t len)
+{
+    stats_.datagrams++;
+
+    McastHeader h;
+    if (!mcastDecodeHeader(datagram, len, h))
+    {
+        stats_.bad_datagrams++;
+        return;
+    }
+    if (delivered_any_ && !newerThan(h.frame_id, last_delivered_))
+    {
+        return;
+    }
+
+    Slot *s = slotFor(h);
+    if (s->h.frag_count != h.frag_count || s->h.frag_size != h.frag_size)
+    {
+        stats_.bad_datagrams++;
+        return;
+    }
+
+    const uint8_t *payload = datagram + MCAST_HEADER_LEN;
+    size_t payload_len = len - MCAST_HEADER_LEN;
+
+    if (h.flags & MCAST_FLAG_PARITY)
+    {
+        if (h.frag_index < s->parity.size() && payload_len == h.frag_size)
+        {
+            s->parity[h.frag_index].assign(payload, payload + payload_len);
+        }
+    }
+    else
+    {
+        storeFragment(*s, h.frag_index, payload, payload_len);
+    }
+
+    if (s->received < h.frag_count)
+    {
+        tryRecover(*s);
+    }
+    if (s->received == h.frag_count)
+    {
+        complete(*s);
+    }
+}
+
+int mcastOpenSocket(const char *group, uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    // A few frames of kernel buffering absorbs bursts of fragments
+    int rcvbuf = 1 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    ip_mreq mreq{};
+    mreq.imr_multiaddr.s_addr = inet_addr(group);
+    mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+    if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
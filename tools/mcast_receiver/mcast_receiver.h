@@ -0,0 +1,70 @@
+#ifndef MCAST_RECEIVER_H
+#define MCAST_RECEIVER_H
+
+// Host-side receiver for the ESP32-CAM multicast stream.
+//
+// Build the example viewer with:
+//   g++ -O2 -std=c++17 mcast_receiver.cpp mcast_dump.cpp -o mcast_dump
+//   ./mcast_dump 239.255.0.1 5010 | ffplay -f mjpeg -
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "../../src/mcast_protocol.h"
+
+class McastReassembler
+{
+public:
+    using FrameCallback = std::function<void(uint32_t frame_id, const uint8_t *data, size_t len)>;
+
+    struct Stats
+    {
+        uint64_t datagrams = 0;
+        uint64_t bad_datagrams = 0;
+        uint64_t frames_complete = 0;
+        uint64_t frames_recovered = 0; // completed with the help of parity
+        uint64_t frames_dropped = 0;   // evicted or superseded while incomplete
+    };
+
+    explicit McastReassembler(FrameCallback on_frame);
+
+    // Feed one received datagram; completed frames are delivered in order
+    // through the callback, older frames arriving late are discarded.
+    void feed(const uint8_t *datagram, size_t len);
+
+    const Stats &stats() const { return stats_; }
+
+private:
+    static const int kSlots = 4;
+
+    struct Slot
+    {
+        bool used = false;
+        uint32_t frame_id = 0;
+        McastHeader h{};
+        std::vector<uint8_t> data;
+        std::vector<bool> have;
+        std::vector<std::vector<uint8_t>> parity;
+        uint16_t received = 0;
+        bool recovered = false;
+    };
+
+    Slot *slotFor(const McastHeader &h);
+    void storeFragment(Slot &s, uint16_t index, const uint8_t *payload, size_t len);
+    void tryRecover(Slot &s);
+    void complete(Slot &s);
+
+    FrameCallback on_frame_;
+    Slot slots_[kSlots];
+    bool delivered_any_ = false;
+    uint32_t last_delivered_ = 0;
+    Stats stats_;
+};
+
+// Opens a UDP socket bound to port and joined to the multicast group.
+// Returns the file descriptor or -1 on error.
+int mcastOpenSocket(const char *group, uint16_t port);
+
+#endif // MCAST_RECEIVER_H
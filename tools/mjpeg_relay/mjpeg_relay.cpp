@@ -0,0 +1,1187 @@
+// MJPEG fan-out relay for the ESP32-CAM.
+//
+// Holds a single upstream connection to the camera's /stream and serves any
+// number of downstream clients from one epoll loop:
+//   GET /stream        multipart MJPEG, latest-frame-wins for slow clients
+//   GET /snapshot.jpg  the most recent frame
+//
+// Build:  g++ -O2 -std=c++17 mjpeg_relay.cpp -o mjpeg_relay
+// Run:    ./mjpeg_relay --camera 192.168.1.50 --listen 8080
+// Bench:  ./mjpeg_relay --synthetic --bench 500
+// Check:  ./mjpeg_relay --self-test
+//
+// Upstream JPEG bytes are read straight into pooled frame buffers that already
+// reserve room for the downstream part header, so each frame is written to
+// every client from the same memory without copying.
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static const char *kBoundary = "relayframe";
+static const size_t kHeaderReserve = 128;
+static const size_t kRingSize = 8;
+static const size_t kMaxFrame = 1 << 20;
+
+static uint64_t nowMs()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void setNonBlocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+// One JPEG plus room in front of it for the multipart part header, so a
+// stream client can send [part header][jpeg]["\r\n"] as a single region.
+struct Frame
+{
+    std::vector<uint8_t> buf;
+    size_t part_start = 0; // where the part header begins
+    size_t jpeg_len = 0;
+    uint64_t seq = 0;
+
+    const uint8_t *jpeg() const { return buf.data() + kHeaderReserve; }
+    const uint8_t *part() const { return buf.data() + part_start; }
+    size_t partLen() const { return kHeaderReserve - part_start + jpeg_len + 2; }
+
+    void finish(uint64_t s)
+    {
+        seq = s;
+        char hdr[kHeaderReserve];
+        int n = snprintf(hdr, sizeof(hdr), "--%s\r\nContent-Type: image/jpeg\r\nContent-Length: %zu\r\n\r\n",
+                         kBoundary, jpeg_len);
+        part_start = kHeaderReserve - n;
+        memcpy(buf.data() + part_start, hdr, n);
+        memcpy(buf.data() + kHeaderReserve + jpeg_len, "\r\n", 2);
+    }
+};
+
+using FramePtr = std::shared_ptr<Frame>;
+
+// Pool of frame buffers. A slot is recycled once no client still holds it;
+// otherwise a fresh buffer is allocated and the old one dies with its last reader.
+class FrameRing
+{
+public:
+    FramePtr acquire(size_t jpeg_len)
+    {
+        FramePtr &slot = slots_[next_];
+        next_ = (next_ + 1) % kRingSize;
+        if (!slot || slot.use_count() > 1)
+        {
+            slot = std::make_shared<Frame>();
+        }
+        slot->buf.resize(kHeaderReserve + jpeg_len + 2);
+        slot->jpeg_len = jpeg_len;
+        return slot;
+    }
+
+    void publish(const FramePtr &f) { latest_ = f; }
+    const FramePtr &latest() const { return latest_; }
+
+private:
+    FramePtr slots_[kRingSize];
+    size_t next_ = 0;
+    FramePtr latest_;
+};
+
+struct Stats
+{
+    uint64_t frames_in = 0;
+    uint64_t frames_out = 0;
+    uint64_t frames_skipped = 0;
+    uint64_t bytes_out = 0;
+    uint64_t snapshots = 0;
+};
+
+enum class ClientState
+{
+    ReadingRequest,
+    Streaming,
+    Snapshot,
+};
+
+struct Client
+{
+    int fd;
+    ClientState state = ClientState::ReadingRequest;
+    std::string request;
+    std::string preamble; // HTTP response headers still to send
+    size_t preamble_off = 0;
+    FramePtr frame;       // frame currently being written
+    size_t frame_off = 0;
+    uint64_t last_seq = 0;
+    bool want_out = false;
+};
+
+class Relay
+{
+public:
+    Relay(int epfd, Stats &stats) : epfd_(epfd), stats_(stats) {}
+
+    void addClient(int fd)
+    {
+        setNonBlocking(fd);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        Client c;
+        c.fd = fd;
+        clients_[fd] = std::move(c);
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.fd = fd;
+        epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    bool owns(int fd) const { return clients_.count(fd) != 0; }
+    size_t clientCount() const { return clients_.size(); }
+
+    void onEvent(int fd, uint32_t events)
+    {
+        auto it = clients_.find(fd);
+        if (it == clients_.end())
+        {
+            return;
+        }
+        Client &c = it->second;
+
+        if (events & (EPOLLERR | EPOLLHUP))
+        {
+            drop(c);
+            return;
+        }
+        if (events & (EPOLLIN | EPOLLRDHUP))
+        {
+            if (!readRequest(c))
+            {
+                return;
+            }
+        }
+        if (events & EPOLLOUT)
+        {
+            pump(c);
+        }
+    }
+
+    // A new upstream frame: idle stream clients start on it immediately,
+    // busy ones pick up whatever is latest when their current frame is done.
+    void onFrame()
+    {
+        std::vector<int> idle;
+        for (auto &kv : clients_)
+        {
+            Client &c = kv.second;
+            if (c.state == ClientState::Streaming && !c.frame && c.preamble_off == c.preamble.size())
+            {
+                idle.push_back(kv.first);
+            }
+        }
+        for (int fd : idle)
+        {
+            auto it = clients_.find(fd);
+            if (it != clients_.end())
+            {
+                pump(it->second);
+            }
+        }
+    }
+
+    void setLatest(const FramePtr *latest) { latest_ = latest; }
+
+private:
+    bool readRequest(Client &c)
+    {
+        char buf[2048];
+        while (true)
+        {
+            ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+            if (n > 0)
+            {
+                if (c.state == ClientState::ReadingRequest)
+                {
+                    c.request.append(buf, n);
+                }
+                continue;
+            }
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            {
+                drop(c);
+                return false;
+            }
+            break;
+        }
+
+        if (c.state != ClientState::ReadingRequest)
+        {
+            return true;
+        }
+        if (c.request.size() > 8192)
+        {
+            drop(c);
+            return false;
+        }
+        if (c.request.find("\r\n\r\n") == std::string::npos)
+        {
+            return true;
+        }
+
+        const FramePtr &latest = *latest_;
+        if (c.request.compare(0, 18, "GET /snapshot.jpg ") == 0)
+        {
+            if (!latest)
+            {
+                c.preamble = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            }
+            else
+            {
+                char hdr[256];
+                snprintf(hdr, sizeof(hdr),
+                         "HTTP/1.1 200 OK\r\nContent-Type: image/jpeg\r\nContent-Length: %zu\r\n"
+                         "Cache-Control: no-cache\r\nConnection: close\r\n\r\n",
+                         latest->jpeg_len);
+                c.preamble = hdr;
+                c.frame = latest;
+                c.frame_off = 0;
+            }
+            c.state = ClientState::Snapshot;
+            stats_.snapshots++;
+        }
+        else if (c.request.compare(0, 12, "GET /stream ") == 0 || c.request.compare(0, 6, "GET / ") == 0)
+        {
+            c.preamble = std::string("HTTP/1.1 200 OK\r\nContent-Type: multipart/x-mixed-replace; boundary=") +
+                         kBoundary + "\r\nCache-Control: no-cache\r\nConnection: close\r\n\r\n";
+            c.state = ClientState::Streaming;
+        }
+        else
+        {
+            c.preamble = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            c.state = ClientState::Snapshot;
+        }
+        c.request.clear();
+        // pump() may drop the client, and c with it
+        int fd = c.fd;
+        pump(c);
+        return owns(fd);
+    }
+
+    void startFrame(Client &c, const FramePtr &f)
+    {
+        if (c.last_seq && f->seq > c.last_seq + 1)
+        {
+            stats_.frames_skipped += f->seq - c.last_seq - 1;
+        }
+        c.frame = f;
+        c.frame_off = 0;
+    }
+
+    // Writes as much as the socket accepts without blocking
+    void pump(Client &c)
+    {
+        while (true)
+        {
+            // Latest frame wins: an idle stream client jumps straight to the newest frame
+            const FramePtr &latest = *latest_;
+            if (!c.frame && c.state == ClientState::Streaming && c.preamble_off == c.preamble.size() &&
+                latest && latest->seq > c.last_seq)
+            {
+                startFrame(c, latest);
+            }
+
+            iovec iov[2];
+            int iovcnt = 0;
+            if (c.preamble_off < c.preamble.size())
+            {
+                iov[iovcnt++] = {(void *)(c.preamble.data() + c.preamble_off), c.preamble.size() - c.preamble_off};
+            }
+
+            const uint8_t *region = nullptr;
+            size_t region_len = 0;
+            if (c.frame)
+            {
+                if (c.state == ClientState::Streaming)
+                {
+                    region = c.frame->part();
+                    region_len = c.frame->partLen();
+                }
+                else
+                {
+                    region = c.frame->jpeg();
+                    region_len = c.frame->jpeg_len;
+                }
+                iov[iovcnt++] = {(void *)(region + c.frame_off), region_len - c.frame_off};
+            }
+
+            if (iovcnt == 0)
+            {
+                break;
+            }
+
+            msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = iovcnt;
+            ssize_t n = sendmsg(c.fd, &msg, MSG_NOSIGNAL);
+            if (n < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    setWantOut(c, true);
+                    return;
+                }
+                drop(c);
+                return;
+            }
+            stats_.bytes_out += n;
+
+            size_t pre = std::min((size_t)n, c.preamble.size() - c.preamble_off);
+            c.preamble_off += pre;
+            c.frame_off += n - pre;
+
+            if (c.frame && c.frame_off == region_len)
+            {
+                stats_.frames_out++;
+                c.last_seq = c.frame->seq;
+                c.frame.reset();
+            }
+        }
+
+        if (c.state == ClientState::Snapshot)
+        {
+            drop(c);
+            return;
+        }
+        setWantOut(c, false);
+    }
+
+    void setWantOut(Client &c, bool want)
+    {
+        if (c.want_out == want)
+        {
+            return;
+        }
+        c.want_out = want;
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP | (want ? (uint32_t)EPOLLOUT : 0u);
+        ev.data.fd = c.fd;
+        epoll_ctl(epfd_, EPOLL_CTL_MOD, c.fd, &ev);
+    }
+
+    void drop(Client &c)
+    {
+        int fd = c.fd;
+        epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        clients_.erase(fd);
+    }
+
+    int epfd_;
+    Stats &stats_;
+    const FramePtr *latest_ = nullptr;
+    std::unordered_map<int, Client> clients_;
+};
+
+// Parses the camera's multipart stream. The device sends it with chunked
+// transfer encoding (every httpd_resp_send_chunk is one chunk), so chunk
+// framing is stripped first. Part headers go through a small buffer; JPEG
+// bodies are received directly into ring frames whenever the current chunk
+// still has body bytes left.
+class Upstream
+{
+public:
+    Upstream(int epfd, FrameRing &ring, const std::string &host, int port)
+        : epfd_(epfd), ring_(ring), host_(host), port_(port) {}
+
+    int fd() const { return fd_; }
+    uint64_t reconnectAt() const { return reconnect_at_; }
+
+    void connectNow()
+    {
+        addrinfo hints{}, *res = nullptr;
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host_.c_str(), std::to_string(port_).c_str(), &hints, &res) != 0)
+        {
+            scheduleReconnect("resolve failed");
+            return;
+        }
+        fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        setNonBlocking(fd_);
+        int rc = connect(fd_, res->ai_addr, res->ai_addrlen);
+        freeaddrinfo(res);
+        if (rc < 0 && errno != EINPROGRESS)
+        {
+            close(fd_);
+            fd_ = -1;
+            scheduleReconnect("connect failed");
+            return;
+        }
+
+        connected_ = false;
+        in_body_ = false;
+        http_header_done_ = false;
+        chunked_ = false;
+        chunk_left_ = 0;
+        chunk_crlf_ = false;
+        raw_.clear();
+        hdr_.clear();
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+        ev.data.fd = fd_;
+        epoll_ctl(epfd_, EPOLL_CTL_ADD, fd_, &ev);
+        reconnect_at_ = 0;
+    }
+
+    // Returns a completed frame, if this event finished one
+    FramePtr onEvent(uint32_t events)
+    {
+        if (events & (EPOLLERR | EPOLLHUP))
+        {
+            fail("connection error");
+            return nullptr;
+        }
+
+        if (!connected_ && (events & EPOLLOUT))
+        {
+            connected_ = true;
+            std::string req = "GET /stream HTTP/1.1\r\nHost: " + host_ + "\r\nConnection: close\r\n\r\n";
+            send(fd_, req.data(), req.size(), MSG_NOSIGNAL);
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLRDHUP;
+            ev.data.fd = fd_;
+            epoll_ctl(epfd_, EPOLL_CTL_MOD, fd_, &ev);
+            fprintf(stderr, "upstream connected to %s:%d\n", host_.c_str(), port_);
+        }
+
+        FramePtr done;
+        while (fd_ >= 0)
+        {
+            ssize_t n;
+            if (in_body_ && raw_.empty() && (!chunked_ || (chunk_left_ > 0 && !chunk_crlf_)))
+            {
+                size_t want = frame_->jpeg_len - got_;
+                if (chunked_)
+                {
+                    want = std::min(want, chunk_left_);
+                }
+                n = recv(fd_, frame_->buf.data() + kHeaderReserve + got_, want, 0);
+                if (n > 0)
+                {
+                    got_ += n;
+                    if (chunked_)
+                    {
+                        chunk_left_ -= n;
+                        chunk_crlf_ = chunk_left_ == 0;
+                    }
+                    completeIfFull(done);
+                    continue;
+                }
+            }
+            else
+            {
+                char buf[4096];
+                n = recv(fd_, buf, sizeof(buf), 0);
+                if (n > 0)
+                {
+                    raw_.append(buf, n);
+                    decode(done);
+                    continue;
+                }
+            }
+
+            if (n == 0)
+            {
+                fail("closed by camera");
+            }
+            else if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                fail(strerror(errno));
+            }
+            break;
+        }
+        return done;
+    }
+
+private:
+    // Consumes raw_: the HTTP response header, then the body with any chunk
+    // framing removed
+    void decode(FramePtr &done)
+    {
+        if (!http_header_done_)
+        {
+            size_t end = raw_.find("\r\n\r\n");
+            if (end == std::string::npos)
+            {
+                if (raw_.size() > 16384)
+                {
+                    fail("oversized header");
+                }
+                return;
+            }
+            std::string block = raw_.substr(0, end);
+            raw_.erase(0, end + 4);
+            http_header_done_ = true;
+            if (block.compare(0, 12, "HTTP/1.1 200") != 0 && block.compare(0, 12, "HTTP/1.0 200") != 0)
+            {
+                fail("unexpected response");
+                return;
+            }
+            chunked_ = headerHas(block, "Transfer-Encoding:", "chunked");
+        }
+
+        if (!chunked_)
+        {
+            std::string body;
+            body.swap(raw_);
+            feed(body.data(), body.size(), done);
+            return;
+        }
+
+        size_t pos = 0;
+        while (fd_ >= 0 && pos < raw_.size())
+        {
+            if (chunk_crlf_)
+            {
+                if (raw_.size() - pos < 2)
+                {
+                    break;
+                }
+                if (raw_.compare(pos, 2, "\r\n") != 0)
+                {
+                    fail("bad chunk framing");
+                    return;
+                }
+                pos += 2;
+                chunk_crlf_ = false;
+            }
+            else if (chunk_left_ == 0)
+            {
+                // Size line: hex digits, optionally followed by ";extension"
+                size_t eol = raw_.find("\r\n", pos);
+                if (eol == std::string::npos)
+                {
+                    if (raw_.size() - pos > 256)
+                    {
+                        fail("bad chunk size line");
+                    }
+                    break;
+                }
+                char *end = nullptr;
+                unsigned long size = strtoul(raw_.c_str() + pos, &end, 16);
+                if (end == raw_.c_str() + pos || (*end != ';' && *end != '\r' && *end != ' '))
+                {
+                    fail("bad chunk size line");
+                    return;
+                }
+                pos = eol + 2;
+                if (size == 0)
+                {
+                    fail("stream ended");
+                    return;
+                }
+                chunk_left_ = size;
+            }
+            else
+            {
+                size_t take = std::min(chunk_left_, raw_.size() - pos);
+                feed(raw_.data() + pos, take, done);
+                pos += take;
+                chunk_left_ -= take;
+                chunk_crlf_ = chunk_left_ == 0;
+            }
+        }
+        if (fd_ >= 0)
+        {
+            raw_.erase(0, pos);
+        }
+    }
+
+    static bool headerHas(const std::string &block, const char *name, const char *token)
+    {
+        size_t name_len = strlen(name);
+        for (size_t pos = 0; pos < block.size();)
+        {
+            size_t eol = block.find("\r\n", pos);
+            if (eol == std::string::npos)
+            {
+                eol = block.size();
+            }
+            if (strncasecmp(block.c_str() + pos, name, name_len) == 0 &&
+                strcasestr(block.substr(pos + name_len, eol - pos - name_len).c_str(), token))
+            {
+                return true;
+            }
+            pos = eol + 2;
+        }
+        return false;
+    }
+
+    // Takes decoded body bytes: into the frame being received, the rest into
+    // the part header buffer
+    void feed(const char *data, size_t len, FramePtr &done)
+    {
+        while (len > 0 && fd_ >= 0)
+        {
+            if (in_body_)
+            {
+                size_t take = std::min(len, frame_->jpeg_len - got_);
+                memcpy(frame_->buf.data() + kHeaderReserve + got_, data, take);
+                got_ += take;
+                data += take;
+                len -= take;
+            }
+            else
+            {
+                hdr_.append(data, len);
+                len = 0;
+                parseHeaders();
+            }
+            completeIfFull(done);
+        }
+    }
+
+    // Consumes part header text; once a part header with Content-Length is
+    // complete, switches to body mode and moves any body bytes already
+    // buffered into the frame.
+    void parseHeaders()
+    {
+        while (!in_body_ && fd_ >= 0)
+        {
+            size_t end = hdr_.find("\r\n\r\n");
+            if (end == std::string::npos)
+            {
+                if (hdr_.size() > 16384)
+                {
+                    fail("oversized header");
+                }
+                return;
+            }
+
+            std::string block = hdr_.substr(0, end);
+            hdr_.erase(0, end + 4);
+
+            size_t len = 0;
+            for (size_t pos = 0; pos < block.size();)
+            {
+                size_t eol = block.find("\r\n", pos);
+                if (eol == std::string::npos)
+                {
+                    eol = block.size();
+                }
+                if (strncasecmp(block.c_str() + pos, "Content-Length:", 15) == 0)
+                {
+                    len = strtoul(block.c_str() + pos + 15, nullptr, 10);
+                }
+                pos = eol + 2;
+            }
+            if (len == 0 || len > kMaxFrame)
+            {
+                continue;
+            }
+
+            frame_ = ring_.acquire(len);
+            got_ = std::min(len, hdr_.size());
+            memcpy(frame_->buf.data() + kHeaderReserve, hdr_.data(), got_);
+            hdr_.erase(0, got_);
+            in_body_ = true;
+            if (got_ == len)
+            {
+                return; // whole body was already buffered, caller completes it
+            }
+        }
+    }
+
+    // Finishes the frame being received once all of its bytes are in
+    void completeIfFull(FramePtr &done)
+    {
+        while (in_body_ && got_ == frame_->jpeg_len)
+        {
+            frame_->finish(++seq_);
+            done = frame_;
+            frame_.reset();
+            in_body_ = false;
+            parseHeaders();
+        }
+    }
+
+    void fail(const char *why)
+    {
+        epoll_ctl(epfd_, EPOLL_CTL_DEL, fd_, nullptr);
+        close(fd_);
+        fd_ = -1;
+        frame_.reset();
+        in_body_ = false;
+        scheduleReconnect(why);
+    }
+
+    void scheduleReconnect(const char *why)
+    {
+        fprintf(stderr, "upstream: %s, reconnecting in 1s\n", why);
+        reconnect_at_ = nowMs() + 1000;
+    }
+
+    int epfd_;
+    FrameRing &ring_;
+    std::string host_;
+    int port_;
+    int fd_ = -1;
+    bool connected_ = false;
+    bool http_header_done_ = false;
+    bool in_body_ = false;
+    bool chunked_ = false;
+    size_t chunk_left_ = 0; // body bytes left in the current chunk
+    bool chunk_crlf_ = false; // the CRLF closing a chunk is still due
+    std::string raw_; // received, not yet de-chunked
+    std::string hdr_;
+    FramePtr frame_;
+    size_t got_ = 0;
+    uint64_t seq_ = 0;
+    uint64_t reconnect_at_ = 0;
+};
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                                                               \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            failures++;                                                                                                \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                \
+            printf(__VA_ARGS__);                                                                                       \
+            printf("\n");                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+// JPEG-like bytes for frame i of the self-test, reproducible on both sides
+static std::string testJpeg(int i)
+{
+    std::mt19937 rng(i);
+    std::string jpeg(500 + rng() % 40000, '\0');
+    for (char &c : jpeg)
+    {
+        c = (char)rng();
+    }
+    jpeg[0] = (char)0xFF;
+    jpeg[1] = (char)0xD8;
+    jpeg[jpeg.size() - 2] = (char)0xFF;
+    jpeg[jpeg.size() - 1] = (char)0xD9;
+    return jpeg;
+}
+
+// Stands in for the camera's /stream on an accepted socket. Chunked, it
+// frames the body the way esp_http_server does (one chunk per send), with
+// chunks also split at random points inside part headers and JPEG data.
+static void serveFakeCamera(int fd, bool chunked, int frames)
+{
+    char req[4096];
+    std::string got;
+    ssize_t n;
+    while (got.find("\r\n\r\n") == std::string::npos && (n = recv(fd, req, sizeof(req), 0)) > 0)
+    {
+        got.append(req, n);
+    }
+
+    std::string out = "HTTP/1.1 200 OK\r\nContent-Type: multipart/x-mixed-replace;"
+                      "boundary=123456789000000000000987654321\r\n";
+    out += chunked ? "Transfer-Encoding: chunked\r\n\r\n" : "\r\n";
+    std::mt19937 rng(7);
+    auto emit = [&](const std::string &data) {
+        if (!chunked)
+        {
+            out += data;
+            return;
+        }
+        for (size_t pos = 0; pos < data.size();)
+        {
+            size_t len = std::min<size_t>(data.size() - pos, 1 + rng() % 6000);
+            char size_line[32];
+            snprintf(size_line, sizeof(size_line), rng() % 2 ? "%zX\r\n" : "%zx;ext=1\r\n", len);
+            out += size_line;
+            out.append(data, pos, len);
+            out += "\r\n";
+            pos += len;
+        }
+    };
+    for (int i = 0; i < frames; i++)
+    {
+        std::string jpeg = testJpeg(i);
+        char part[128];
+        snprintf(part, sizeof(part), "Content-Type: image/jpeg\r\nContent-Length: %zu\r\nX-Timestamp: %d.000000\r\n\r\n",
+                 jpeg.size(), i);
+        emit(part);
+        emit(jpeg);
+        emit("\r\n--123456789000000000000987654321\r\n");
+    }
+    if (chunked)
+    {
+        out += "0\r\n\r\n";
+    }
+
+    // Uneven writes so reads end anywhere in the framing
+    for (size_t pos = 0; pos < out.size();)
+    {
+        size_t len = std::min<size_t>(out.size() - pos, 1 + rng() % 9000);
+        if (send(fd, out.data() + pos, len, MSG_NOSIGNAL) <= 0)
+        {
+            break;
+        }
+        pos += len;
+        usleep(rng() % 4 == 0 ? 1000 : 0);
+    }
+    close(fd);
+}
+
+// Runs Upstream against a fake camera on loopback and compares every frame
+static void checkUpstream(bool chunked)
+{
+    const int frames = 40;
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    bind(listen_fd, (sockaddr *)&addr, sizeof(addr));
+    listen(listen_fd, 1);
+    getsockname(listen_fd, (sockaddr *)&addr, &addr_len);
+
+    pid_t camera = fork();
+    if (camera == 0)
+    {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        serveFakeCamera(fd, chunked, frames);
+        _exit(0);
+    }
+    close(listen_fd);
+
+    int epfd = epoll_create1(0);
+    FrameRing ring;
+    Upstream upstream(epfd, ring, "127.0.0.1", ntohs(addr.sin_port));
+    upstream.connectNow();
+
+    // An event that finishes several frames returns the last one; each
+    // returned frame is compared with what the camera sent under that number
+    uint64_t received = 0;
+    int compared = 0;
+    int mismatched = 0;
+    uint64_t deadline = nowMs() + 10000;
+    while (upstream.fd() >= 0 && nowMs() < deadline)
+    {
+        epoll_event ev;
+        if (epoll_wait(epfd, &ev, 1, 100) != 1)
+        {
+            continue;
+        }
+        FramePtr f = upstream.onEvent(ev.events);
+        if (f)
+        {
+            received = f->seq;
+            std::string want = testJpeg((int)f->seq - 1);
+            compared++;
+            mismatched += f->jpeg_len != want.size() || memcmp(f->jpeg(), want.data(), want.size()) != 0;
+        }
+    }
+    waitpid(camera, nullptr, 0);
+    close(epfd);
+
+    const char *mode = chunked ? "chunked" : "plain";
+    CHECK(received == frames, "%s: %llu of %d frames", mode, (unsigned long long)received, frames);
+    CHECK(compared > 0 && mismatched == 0, "%s: %d of %d compared frames differ from what the camera sent", mode,
+          mismatched, compared);
+    printf("%s upstream: %llu frames, %d compared\n", mode, (unsigned long long)received, compared);
+}
+
+static int runSelfTest()
+{
+    checkUpstream(false);
+    checkUpstream(true);
+    printf("%s (%d failures)\n", failures ? "FAILED" : "all checks passed", failures);
+    return failures ? 1 : 0;
+}
+
+// Load generator for --bench: ramps up stream clients against the relay and
+// discards what it receives. Runs in a child process so the relay's CPU
+// usage can be measured on its own.
+static void runLoadGenerator(int port, int max_clients, int step_seconds)
+{
+    int epfd = epoll_create1(0);
+    std::vector<int> fds;
+    char buf[65536];
+    const char *req = "GET /stream HTTP/1.1\r\nHost: relay\r\n\r\n";
+
+    int target = 0;
+    uint64_t next_step = 0;
+    while (true)
+    {
+        uint64_t now = nowMs();
+        if (now >= next_step && target < max_clients)
+        {
+            target = std::min(max_clients, target == 0 ? 10 : target * 2);
+            next_step = now + step_seconds * 1000;
+            while ((int)fds.size() < target)
+            {
+                int fd = socket(AF_INET, SOCK_STREAM, 0);
+                sockaddr_in addr{};
+                addr.sin_family = AF_INET;
+                addr.sin_port = htons(port);
+                addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                if (connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0)
+                {
+                    close(fd);
+                    break;
+                }
+                send(fd, req, strlen(req), MSG_NOSIGNAL);
+                setNonBlocking(fd);
+                epoll_event ev{};
+                ev.events = EPOLLIN;
+                ev.data.fd = fd;
+                epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+                fds.push_back(fd);
+            }
+        }
+
+        epoll_event events[256];
+        int n = epoll_wait(epfd, events, 256, 100);
+        for (int i = 0; i < n; i++)
+        {
+            while (recv(events[i].data.fd, buf, sizeof(buf), 0) > 0)
+            {
+            }
+        }
+    }
+}
+
+// Frames for --synthetic: SOI, pseudo-random payload, EOI
+static FramePtr makeSyntheticFrame(FrameRing &ring, uint64_t seq, size_t len)
+{
+    FramePtr f = ring.acquire(len);
+    uint8_t *p = f->buf.data() + kHeaderReserve;
+    uint32_t x = 2463534242u ^ (uint32_t)seq;
+    for (size_t i = 0; i < len; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        p[i] = x;
+    }
+    p[0] = 0xFF;
+    p[1] = 0xD8;
+    p[len - 2] = 0xFF;
+    p[len - 1] = 0xD9;
+    f->finish(seq);
+    return f;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [--camera HOST] [--camera-port PORT] [--listen PORT]\n"
+            "          [--synthetic] [--fps N] [--frame-bytes N] [--bench MAX_CLIENTS]\n"
+            "       %s --self-test\n",
+            argv0, argv0);
+}
+
+int main(int argc, char **argv)
+{
+    std::string camera;
+    int camera_port = 80;
+    int listen_port = 8080;
+    bool synthetic = false;
+    int fps = 25;
+    size_t frame_bytes = 30000;
+    int bench_clients = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string a = argv[i];
+        bool has_value = i + 1 < argc;
+        if (a == "--camera" && has_value)
+            camera = argv[++i];
+        else if (a == "--camera-port" && has_value)
+            camera_port = atoi(argv[++i]);
+        else if (a == "--listen" && has_value)
+            listen_port = atoi(argv[++i]);
+        else if (a == "--synthetic")
+            synthetic = true;
+        else if (a == "--fps" && has_value)
+            fps = std::max(1, atoi(argv[++i]));
+        else if (a == "--frame-bytes" && has_value)
+            frame_bytes = std::max<size_t>(16, strtoul(argv[++i], nullptr, 10));
+        else if (a == "--bench" && has_value)
+            bench_clients = atoi(argv[++i]);
+        else if (a == "--self-test")
+            return runSelfTest();
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (camera.empty() && !synthetic)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    // Hundreds of clients need more descriptors than the usual soft limit
+    rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(listen_port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 1024) < 0)
+    {
+        perror("listen");
+        return 1;
+    }
+    setNonBlocking(listen_fd);
+
+    pid_t loadgen = 0;
+    if (bench_clients > 0)
+    {
+        loadgen = fork();
+        if (loadgen == 0)
+        {
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            close(listen_fd);
+            runLoadGenerator(listen_port, bench_clients, 5);
+            _exit(0);
+        }
+        printf("%8s %8s %10s %10s %10s %8s\n", "clients", "fps_in", "frames/s", "MB/s", "skipped/s", "cpu%");
+    }
+
+    int epfd = epoll_create1(0);
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = listen_fd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev);
+
+    Stats stats;
+    FrameRing ring;
+    Relay relay(epfd, stats);
+    relay.setLatest(&ring.latest());
+    Upstream upstream(epfd, ring, camera, camera_port);
+    if (!synthetic)
+    {
+        upstream.connectNow();
+    }
+
+    uint64_t synthetic_seq = 0;
+    uint64_t next_synthetic = nowMs();
+    uint64_t report_at = nowMs() + 5000;
+    Stats last = stats;
+    rusage ru_last;
+    getrusage(RUSAGE_SELF, &ru_last);
+    uint64_t last_report = nowMs();
+
+    std::vector<epoll_event> events(1024);
+    while (true)
+    {
+        uint64_t now = nowMs();
+        int timeout = (int)std::min<uint64_t>(report_at - std::min(report_at, now), 100);
+        if (synthetic)
+        {
+            timeout = std::min<int>(timeout, next_synthetic > now ? next_synthetic - now : 0);
+        }
+
+        int n = epoll_wait(epfd, events.data(), events.size(), timeout);
+        for (int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == listen_fd)
+            {
+                int cfd;
+                while ((cfd = accept(listen_fd, nullptr, nullptr)) >= 0)
+                {
+                    relay.addClient(cfd);
+                }
+            }
+            else if (fd == upstream.fd())
+            {
+                FramePtr f = upstream.onEvent(events[i].events);
+                if (f)
+                {
+                    stats.frames_in++;
+                    ring.publish(f);
+                    relay.onFrame();
+                }
+            }
+            else
+            {
+                relay.onEvent(fd, events[i].events);
+            }
+        }
+
+        now = nowMs();
+        if (!synthetic && upstream.fd() < 0 && upstream.reconnectAt() && now >= upstream.reconnectAt())
+        {
+            upstream.connectNow();
+        }
+        if (synthetic && now >= next_synthetic)
+        {
+            FramePtr f = makeSyntheticFrame(ring, ++synthetic_seq, frame_bytes);
+            stats.frames_in++;
+            ring.publish(f);
+            relay.onFrame();
+            next_synthetic += 1000 / fps;
+        }
+
+        if (now >= report_at)
+        {
+            rusage ru;
+            getrusage(RUSAGE_SELF, &ru);
+            double cpu_ms = (ru.ru_utime.tv_sec - ru_last.ru_utime.tv_sec) * 1e3 +
+                            (ru.ru_utime.tv_usec - ru_last.ru_utime.tv_usec) / 1e3 +
+                            (ru.ru_stime.tv_sec - ru_last.ru_stime.tv_sec) * 1e3 +
+                            (ru.ru_stime.tv_usec - ru_last.ru_stime.tv_usec) / 1e3;
+            double secs = (now - last_report) / 1000.0;
+
+            printf("%8zu %8.1f %10.1f %10.2f %10.1f %8.1f\n", relay.clientCount(),
+                   (stats.frames_in - last.frames_in) / secs,
+                   (stats.frames_out - last.frames_out) / secs,
+                   (stats.bytes_out - last.bytes_out) / secs / 1e6,
+                   (stats.frames_skipped - last.frames_skipped) / secs,
+                   cpu_ms / (secs * 10.0));
+            fflush(stdout);
+
+            last = stats;
+            ru_last = ru;
+            last_report = now;
+            report_at = now + 5000;
+        }
+    }
+}
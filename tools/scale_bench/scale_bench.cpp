@@ -0,0 +1,348 @@
+// Host benchmark for the derived low-resolution streams (src/scaled_stream.cpp).
+//
+// A camera-like frame (gradients, edges, sensor noise, 4:2:2 JPEG at about
+// the sensor's default quality) is reduced to 1/2, 1/4 and 1/8 two ways:
+// decoding straight at the reduced size through DCT scaling, as the scaled
+// encoder does, and decoding at full size and box-filtering, the obvious
+// alternative. Both results go through RGB565, as on the device, and are
+// encoded at SCALED_STREAM_QUALITY. Reports decode and encode time per frame,
+// the share of one core at SCALED_STREAM_FPS, output size and PSNR against the
+// box-filtered reference. The cost is paid once per scale per frame, so it
+// does not grow with the number of viewers.
+//
+// libjpeg stands in for the ESP32's decoder and encoder, so absolute times
+// are the host's; the ratios between scales and methods are what carry over.
+//
+//   g++ -O2 -std=c++17 tools/scale_bench/scale_bench.cpp -ljpeg -o scale_bench
+//   ./scale_bench [frame.jpg ...]
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+// Needs size_t and FILE first
+#include <jpeglib.h>
+
+// Mirrors the defaults in src/scaled_stream.h, which needs the Arduino core
+#define SCALED_STREAM_QUALITY 50
+#define SCALED_STREAM_FPS 10
+
+typedef std::vector<uint8_t> Bytes;
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                                                               \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            failures++;                                                                                                \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                \
+            printf(__VA_ARGS__);                                                                                       \
+            printf("\n");                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+struct Image
+{
+    int width = 0;
+    int height = 0;
+    Bytes rgb; // 8 bits per channel
+};
+
+static double nowUs()
+{
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// A scene with what makes real frames expensive to code: smooth shading,
+// hard edges, fine texture and noise
+static Image synthesize(int width, int height, std::mt19937 &rng)
+{
+    Image img;
+    img.width = width;
+    img.height = height;
+    img.rgb.resize((size_t)width * height * 3);
+    std::normal_distribution<float> noise(0.0f, 4.0f);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            float fx = (float)x / width;
+            float fy = (float)y / height;
+            float r = 60 + 120 * fy;
+            float g = 80 + 100 * fx;
+            float b = 140 - 60 * fy;
+            // A window frame, a wall with texture, a round object
+            if ((x / (width / 8)) % 3 == 0 && y < height / 2)
+            {
+                r = g = b = 230;
+            }
+            if (y > height * 2 / 3)
+            {
+                float t = 20 * sinf(x * 0.9f) * sinf(y * 0.7f);
+                r = 120 + t;
+                g = 100 + t;
+                b = 80 + t;
+            }
+            float dx = fx - 0.6f, dy = fy - 0.45f;
+            if (dx * dx + dy * dy < 0.02f)
+            {
+                r = 200;
+                g = 40;
+                b = 40;
+            }
+            uint8_t *p = &img.rgb[((size_t)y * width + x) * 3];
+            p[0] = (uint8_t)std::min(255.0f, std::max(0.0f, r + noise(rng)));
+            p[1] = (uint8_t)std::min(255.0f, std::max(0.0f, g + noise(rng)));
+            p[2] = (uint8_t)std::min(255.0f, std::max(0.0f, b + noise(rng)));
+        }
+    }
+    return img;
+}
+
+static Bytes encode(const Image &img, int quality, bool subsample_422)
+{
+    jpeg_compress_struct c;
+    jpeg_error_mgr err;
+    c.err = jpeg_std_error(&err);
+    jpeg_create_compress(&c);
+    unsigned char *out = NULL;
+    unsigned long out_len = 0;
+    jpeg_mem_dest(&c, &out, &out_len);
+    c.image_width = img.width;
+    c.image_height = img.height;
+    c.input_components = 3;
+    c.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&c);
+    jpeg_set_quality(&c, quality, TRUE);
+    if (subsample_422)
+    {
+        // What the OV2640 produces
+        c.comp_info[0].h_samp_factor = 2;
+        c.comp_info[0].v_samp_factor = 1;
+    }
+    jpeg_start_compress(&c, TRUE);
+    while (c.next_scanline < c.image_height)
+    {
+        JSAMPROW row = (JSAMPROW)&img.rgb[(size_t)c.next_scanline * img.width * 3];
+        jpeg_write_scanlines(&c, &row, 1);
+    }
+    jpeg_finish_compress(&c);
+    Bytes jpg(out, out + out_len);
+    free(out);
+    jpeg_destroy_compress(&c);
+    return jpg;
+}
+
+// denom 1 decodes at full size; 2, 4 and 8 use DCT scaling
+static bool decode(const Bytes &jpg, int denom, Image &img)
+{
+    jpeg_decompress_struct d;
+    jpeg_error_mgr err;
+    d.err = jpeg_std_error(&err);
+    jpeg_create_decompress(&d);
+    jpeg_mem_src(&d, jpg.data(), jpg.size());
+    if (jpeg_read_header(&d, TRUE) != JPEG_HEADER_OK)
+    {
+        jpeg_destroy_decompress(&d);
+        return false;
+    }
+    d.out_color_space = JCS_RGB;
+    d.scale_num = 1;
+    d.scale_denom = denom;
+    jpeg_start_decompress(&d);
+    img.width = d.output_width;
+    img.height = d.output_height;
+    img.rgb.resize((size_t)img.width * img.height * 3);
+    while (d.output_scanline < d.output_height)
+    {
+        JSAMPROW row = (JSAMPROW)&img.rgb[(size_t)d.output_scanline * img.width * 3];
+        jpeg_read_scanlines(&d, &row, 1);
+    }
+    jpeg_finish_decompress(&d);
+    jpeg_destroy_decompress(&d);
+    return true;
+}
+
+static Image boxDownscale(const Image &src, int factor)
+{
+    Image out;
+    out.width = src.width / factor;
+    out.height = src.height / factor;
+    out.rgb.resize((size_t)out.width * out.height * 3);
+    for (int y = 0; y < out.height; y++)
+    {
+        for (int x = 0; x < out.width; x++)
+        {
+            for (int ch = 0; ch < 3; ch++)
+            {
+                unsigned sum = 0;
+                for (int j = 0; j < factor; j++)
+                {
+                    const uint8_t *row = &src.rgb[((size_t)(y * factor + j) * src.width + x * factor) * 3];
+                    for (int i = 0; i < factor; i++)
+                    {
+                        sum += row[i * 3 + ch];
+                    }
+                }
+                out.rgb[((size_t)y * out.width + x) * 3 + ch] = sum / (factor * factor);
+            }
+        }
+    }
+    return out;
+}
+
+// The device decodes to RGB565 and encodes from it
+static void through565(Image &img)
+{
+    for (size_t i = 0; i < img.rgb.size(); i += 3)
+    {
+        uint8_t r = img.rgb[i] >> 3, g = img.rgb[i + 1] >> 2, b = img.rgb[i + 2] >> 3;
+        img.rgb[i] = r << 3 | r >> 2;
+        img.rgb[i + 1] = g << 2 | g >> 4;
+        img.rgb[i + 2] = b << 3 | b >> 2;
+    }
+}
+
+static double psnr(const Image &a, const Image &b)
+{
+    if (a.width != b.width || a.height != b.height)
+        return 0;
+    double se = 0;
+    for (size_t i = 0; i < a.rgb.size(); i++)
+    {
+        double d = (double)a.rgb[i] - b.rgb[i];
+        se += d * d;
+    }
+    double mse = se / a.rgb.size();
+    return mse > 0 ? 10 * log10(255.0 * 255.0 / mse) : 99;
+}
+
+struct Result
+{
+    double decode_us = 0;
+    double encode_us = 0;
+    size_t bytes = 0;
+    double psnr_db = 0;
+};
+
+static Result measure(const Bytes &src_jpg, int scale, bool dct_scaled, const Image &reference, int rounds)
+{
+    Result r;
+    Image small;
+    Bytes out;
+    for (int i = 0; i < rounds; i++)
+    {
+        double t0 = nowUs();
+        if (dct_scaled)
+        {
+            decode(src_jpg, scale, small);
+        }
+        else
+        {
+            Image full;
+            decode(src_jpg, 1, full);
+            small = boxDownscale(full, scale);
+        }
+        through565(small);
+        double t1 = nowUs();
+        out = encode(small, SCALED_STREAM_QUALITY, false);
+        double t2 = nowUs();
+        r.decode_us += t1 - t0;
+        r.encode_us += t2 - t1;
+    }
+    r.decode_us /= rounds;
+    r.encode_us /= rounds;
+    r.bytes = out.size();
+
+    Image shown;
+    decode(out, 1, shown);
+    r.psnr_db = psnr(shown, reference);
+    return r;
+}
+
+static void benchFrame(const char *name, const Bytes &jpg)
+{
+    Image full;
+    if (!decode(jpg, 1, full))
+    {
+        CHECK(false, "%s: not a JPEG", name);
+        return;
+    }
+    printf("\n%s: %dx%d, %zu bytes\n", name, full.width, full.height, jpg.size());
+    printf("  scale  method       size      decode_us  encode_us  core@%dfps  bytes   PSNR_dB\n", SCALED_STREAM_FPS);
+
+    int rounds = std::max(3, 2000000 / (full.width * full.height));
+    for (int scale : {2, 4, 8})
+    {
+        Image reference = boxDownscale(full, scale);
+        for (bool dct_scaled : {true, false})
+        {
+            Result r = measure(jpg, scale, dct_scaled, reference, rounds);
+            double total = r.decode_us + r.encode_us;
+            printf("  1/%d    %-11s  %4dx%-4d  %9.0f  %9.0f  %8.1f%%  %6zu  %6.1f\n", scale,
+                   dct_scaled ? "dct-scaled" : "full+box", full.width / scale, full.height / scale, r.decode_us,
+                   r.encode_us, total * SCALED_STREAM_FPS / 10000.0, r.bytes, r.psnr_db);
+
+            CHECK(r.bytes > 0 && r.bytes < jpg.size(), "%s 1/%d: output %zu bytes not smaller than source", name,
+                  scale, r.bytes);
+            CHECK(r.psnr_db > 25, "%s 1/%d %s: PSNR %.1f dB against the box-filtered frame", name, scale,
+                  dct_scaled ? "dct" : "box", r.psnr_db);
+        }
+
+        Image small;
+        CHECK(decode(jpg, scale, small) && small.width == full.width / scale && small.height == full.height / scale,
+              "%s 1/%d: decoded %dx%d", name, scale, small.width, small.height);
+    }
+}
+
+static bool readFile(const char *path, Bytes &out)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        out.insert(out.end(), buf, buf + n);
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    std::mt19937 rng(20240601);
+
+    // The camera's sizes up to SVGA, at roughly its default quality (10 on 0-63)
+    struct
+    {
+        const char *name;
+        int width;
+        int height;
+    } sizes[] = {{"QVGA", 320, 240}, {"VGA", 640, 480}, {"SVGA", 800, 600}};
+    for (auto &s : sizes)
+    {
+        Image img = synthesize(s.width, s.height, rng);
+        benchFrame(s.name, encode(img, 85, true));
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        Bytes jpg;
+        if (!readFile(argv[i], jpg))
+        {
+            CHECK(false, "cannot read %s", argv[i]);
+            continue;
+        }
+        benchFrame(argv[i], jpg);
+    }
+
+    printf("\n%s (%d failures)\n", failures ? "FAILED" : "all checks passed", failures);
+    return failures ? 1 : 0;
+}
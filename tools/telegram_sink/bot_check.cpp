@@ -0,0 +1,356 @@
+// Checks the getUpdates parser and command reader (src/bot_commands.cpp) on a
+// host, then optionally polls telegram_sink for commands the way
+// telegram_commands.cpp does: one kept-alive connection for the long polls,
+// offsets acknowledged after each answer, and a sendPhoto for every /photo.
+// Reports how many connections the polls needed and the time from a command
+// arriving to its photo being accepted; the sink reports the same from its
+// side, including the time the command waited in the poll.
+//
+// Build:  g++ -O2 -std=c++17 -Isrc tools/telegram_sink/bot_check.cpp src/bot_commands.cpp -o bot_check
+// Run:    ./bot_check
+//         ./telegram_sink --command-every 3000 /photo &
+//         ./bot_check --poll 60 [--host HOST] [--port PORT] [--timeout-s N]
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "bot_commands.h"
+
+struct Options
+{
+    std::string host = "127.0.0.1";
+    int port = 8081;
+    int poll_s = 0;
+    int timeout_s = 25;
+    long long chat_id = 42;
+};
+
+static Options opt;
+static int failures = 0;
+static const auto start_time = std::chrono::steady_clock::now();
+
+#define CHECK(cond, ...)                                                                                               \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            failures++;                                                                                                \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                \
+            printf(__VA_ARGS__);                                                                                       \
+            printf("\n");                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+static double nowMs()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+static int parse(const std::string &body, BotUpdate *out, int max, int64_t *last_id)
+{
+    return parseBotUpdates(body.data(), body.size(), out, max, last_id);
+}
+
+static void checkParser()
+{
+    BotUpdate u[4];
+    int64_t last_id = 0;
+
+    std::string two =
+        "{\"ok\":true,\"result\":[{\"update_id\":900000001,\"message\":{\"message_id\":5,\"from\":{\"id\":7,"
+        "\"is_bot\":false,\"first_name\":\"A \\\"quoted\\\" name\"},\"chat\":{\"id\":-1001234567890,\"type\":"
+        "\"supergroup\"},\"date\":1700000000,\"text\":\"/burst@cam_bot 5\",\"entities\":[{\"offset\":0,\"length\":14,"
+        "\"type\":\"bot_command\"}]}},\n  {\"update_id\":900000002,\"edited_message\":{\"text\":\"/photo\"}}]}";
+    CHECK(parse(two, u, 4, &last_id) == 2, "two updates");
+    CHECK(last_id == 900000002, "last_id %lld", (long long)last_id);
+    CHECK(u[0].chat_id == -1001234567890LL && u[0].date == 1700000000, "chat %lld date %lld",
+          (long long)u[0].chat_id, (long long)u[0].date);
+    CHECK(strcmp(u[0].text, "/burst@cam_bot 5") == 0, "text '%s'", u[0].text);
+    CHECK(u[1].chat_id == 0 && u[1].text[0] == '\0', "edited message is not a message");
+
+    // "result" before "ok", escapes, nested arrays, unicode
+    std::string escaped = "{\"result\":[{\"message\":{\"text\":\"\\/st\\u0061tus\\n\\u00e9\",\"chat\":{\"id\":3},"
+                          "\"photo\":[[1,2],{\"a\":null}],\"x\":-1.5e3,\"y\":true},\"update_id\":11}],\"ok\":true}";
+    last_id = 0;
+    CHECK(parse(escaped, u, 4, &last_id) == 1 && u[0].update_id == 11 && u[0].chat_id == 3, "reordered keys");
+    CHECK(strcmp(u[0].text, "/status\n\xC3\xA9") == 0, "escapes decoded to '%s'", u[0].text);
+
+    CHECK(parse("{\"ok\":true,\"result\":[]}", u, 4, &last_id) == 0, "empty result");
+    CHECK(parse("{\"ok\":false,\"error_code\":409,\"description\":\"Conflict\"}", u, 4, &last_id) == -1,
+          "error answer");
+    CHECK(parse("<html>502 Bad Gateway</html>", u, 4, &last_id) == -1, "not JSON");
+    CHECK(parse("", u, 4, &last_id) == -1, "empty body");
+
+    // A body cut off anywhere keeps the complete entries before the cut and
+    // still reports the id of the entry that was cut, once its id was read
+    size_t second = two.find("{\"update_id\":900000002");
+    size_t second_id_end = second + strlen("{\"update_id\":900000002");
+    size_t first_end = two.rfind('}', second) + 1;
+    size_t second_end = two.size() - strlen("]}");
+    for (size_t cut = 0; cut < two.size(); cut++)
+    {
+        last_id = 0;
+        int n = parse(two.substr(0, cut), u, 4, &last_id);
+        int expect = cut < strlen("{\"ok\":true,\"result\":") ? -1 : cut < first_end ? 0 : cut < second_end ? 1 : 2;
+        CHECK(n == expect, "cut at %zu: %d entries, expected %d", cut, n, expect);
+        CHECK(cut <= second_id_end || last_id == 900000002, "cut at %zu: last_id %lld", cut, (long long)last_id);
+    }
+
+    // More entries than fit still acknowledges all of them
+    std::string many = "{\"ok\":true,\"result\":[";
+    for (int i = 1; i <= 6; i++)
+        many += (i > 1 ? "," : "") + std::string("{\"update_id\":") + std::to_string(i) + "}";
+    many += "]}";
+    last_id = 0;
+    CHECK(parse(many, u, 4, &last_id) == 4 && last_id == 6, "max entries");
+
+    // Deep nesting and long text are bounded
+    std::string deep = "{\"ok\":true,\"result\":[{\"update_id\":1,\"x\":" + std::string(40, '[') +
+                       std::string(40, ']') + "}]}";
+    last_id = 0;
+    CHECK(parse(deep, u, 4, &last_id) == 0 && last_id == 1, "nesting limit stops parsing, id still acknowledged");
+    std::string long_text = "{\"ok\":true,\"result\":[{\"update_id\":1,\"message\":{\"text\":\"/photo " +
+                            std::string(200, 'x') + "\"}}]}";
+    CHECK(parse(long_text, u, 4, &last_id) == 1 && strlen(u[0].text) == BOT_TEXT_MAX - 1, "long text cut off");
+}
+
+static void checkCommands()
+{
+    struct
+    {
+        const char *text;
+        BotCommand command;
+        int arg;
+    } cases[] = {
+        {"/photo", BOT_PHOTO, -1},
+        {"  /PHOTO", BOT_PHOTO, -1},
+        {"/photo@cam_bot", BOT_PHOTO, -1},
+        {"/burst 5", BOT_BURST, 5},
+        {"/burst@cam_bot   12", BOT_BURST, 12},
+        {"/burst five", BOT_BURST, -1},
+        {"/quality 10", BOT_QUALITY, 10},
+        {"/quality", BOT_QUALITY, -1},
+        {"/status\nsecond line", BOT_STATUS, -1},
+        {"/start", BOT_HELP, -1},
+        {"/help", BOT_HELP, -1},
+        {"/photograph", BOT_UNKNOWN, -1},
+        {"/", BOT_UNKNOWN, -1},
+        {"photo", BOT_NONE, -1},
+        {"", BOT_NONE, -1},
+    };
+    for (const auto &c : cases)
+    {
+        int arg = 0;
+        BotCommand command = parseBotCommand(c.text, &arg);
+        CHECK(command == c.command && arg == c.arg, "'%s': /%s %d, expected /%s %d", c.text, botCommandName(command),
+              arg, botCommandName(c.command), c.arg);
+    }
+}
+
+static int connectSink()
+{
+    addrinfo hints{}, *ai = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(opt.host.c_str(), std::to_string(opt.port).c_str(), &hints, &ai) != 0)
+        return -1;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    timeval tv{opt.timeout_s + 10, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    bool connected = connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+    freeaddrinfo(ai);
+    if (!connected)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// One request and its answer; reads exactly Content-Length so the
+// connection can carry the next poll. Returns the status, 0 on failure.
+static int exchange(int fd, const std::string &request, std::string &body, bool &keep_open)
+{
+    body.clear();
+    keep_open = false;
+    if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != (ssize_t)request.size())
+        return 0;
+    std::string buf;
+    size_t header_end;
+    while ((header_end = buf.find("\r\n\r\n")) == std::string::npos)
+    {
+        char tmp[2048];
+        ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+        if (n <= 0)
+            return 0;
+        buf.append(tmp, n);
+    }
+    std::string head = buf.substr(0, header_end);
+    body = buf.substr(header_end + 4);
+    for (char &c : head)
+        c = tolower(c);
+    size_t at = head.find("\r\ncontent-length:");
+    size_t length = at != std::string::npos ? strtoul(head.c_str() + at + 17, nullptr, 10) : 0;
+    while (body.size() < length)
+    {
+        char tmp[2048];
+        ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+        if (n <= 0)
+            return 0;
+        body.append(tmp, n);
+    }
+    keep_open = at != std::string::npos && head.find("\r\nconnection: close") == std::string::npos;
+    return atoi(head.c_str() + head.find(' ') + 1);
+}
+
+static bool sendPhoto()
+{
+    int fd = connectSink();
+    if (fd < 0)
+        return false;
+    std::string boundary = "ESP32CAM-check";
+    std::string body = "--" + boundary +
+                       "\r\nContent-Disposition: form-data; name=\"photo\"; filename=\"esp32cam.jpg\"\r\n"
+                       "Content-Type: image/jpeg\r\n\r\n" +
+                       std::string(20 * 1024, '\xA5') + "\r\n--" + boundary + "--\r\n";
+    std::string request = "POST /botTOKEN/sendPhoto?chat_id=" + std::to_string(opt.chat_id) +
+                          " HTTP/1.1\r\nHost: api.telegram.org\r\nContent-Length: " + std::to_string(body.size()) +
+                          "\r\nContent-Type: multipart/form-data; boundary=" + boundary +
+                          "\r\nConnection: close\r\n\r\n" + body;
+    std::string answer;
+    bool keep_open;
+    bool ok = exchange(fd, request, answer, keep_open) == 200;
+    close(fd);
+    return ok;
+}
+
+// Mirrors commandTask() in telegram_commands.cpp, without the backoff
+static void pollSink()
+{
+    printf("\npolling %s:%d for %d s (long poll %d s)\n", opt.host.c_str(), opt.port, opt.poll_s, opt.timeout_s);
+    int fd = -1;
+    int64_t offset = 0;
+    int polls = 0, connects = 0, errors = 0, commands = 0, photos = 0;
+    std::vector<double> latencies;
+    while (nowMs() < opt.poll_s * 1000.0)
+    {
+        if (fd < 0)
+        {
+            fd = connectSink();
+            if (fd < 0)
+            {
+                errors++;
+                sleep(1);
+                continue;
+            }
+            connects++;
+        }
+        std::string request = "GET /botTOKEN/getUpdates?offset=" + std::to_string(offset) +
+                              "&limit=4&timeout=" + std::to_string(opt.timeout_s) +
+                              "&allowed_updates=%5B%22message%22%5D HTTP/1.1\r\nHost: api.telegram.org\r\n"
+                              "User-Agent: ESP32-CAM\r\nConnection: keep-alive\r\n\r\n";
+        std::string body;
+        bool keep_open;
+        int status = exchange(fd, request, body, keep_open);
+        double received = nowMs();
+        polls++;
+        if (!keep_open)
+        {
+            close(fd);
+            fd = -1;
+        }
+
+        BotUpdate updates[4];
+        int64_t last_id = offset - 1;
+        int n = status == 200 ? parseBotUpdates(body.data(), body.size(), updates, 4, &last_id) : -1;
+        if (n < 0)
+        {
+            errors++;
+            printf("[%7.1fs] poll failed (HTTP %d)\n", received / 1000, status);
+            sleep(1);
+            continue;
+        }
+        offset = n > 0 ? updates[n - 1].update_id + 1 : std::max(offset, last_id + 1);
+        for (int i = 0; i < n; i++)
+        {
+            int arg;
+            BotCommand command = parseBotCommand(updates[i].text, &arg);
+            if (command == BOT_NONE || updates[i].chat_id != opt.chat_id)
+                continue;
+            commands++;
+            int shots = command == BOT_PHOTO ? 1 : command == BOT_BURST ? (arg > 0 ? std::min(arg, 10) : 3) : 0;
+            for (int s = 0; s < shots; s++)
+            {
+                if (sendPhoto())
+                {
+                    photos++;
+                    if (s == 0)
+                        latencies.push_back(nowMs() - received);
+                }
+            }
+            printf("[%7.1fs] update %lld: /%s\n", received / 1000, (long long)updates[i].update_id,
+                   botCommandName(command));
+        }
+        fflush(stdout);
+    }
+    if (fd >= 0)
+        close(fd);
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("polls %d over %d connection(s), %d failed | commands %d, photos %d\n", polls, connects, errors, commands,
+           photos);
+    if (!latencies.empty())
+        printf("command received to photo accepted: p50 %.1f ms  max %.1f ms\n", latencies[latencies.size() / 2],
+               latencies.back());
+    CHECK(errors == 0, "%d failed polls", errors);
+    CHECK(polls < 2 || connects < polls, "every poll opened a new connection");
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [--poll SECONDS] [--host HOST] [--port PORT] [--timeout-s N] [--chat-id N]\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string a = argv[i];
+        bool has_value = i + 1 < argc;
+        if (a == "--poll" && has_value)
+            opt.poll_s = atoi(argv[++i]);
+        else if (a == "--host" && has_value)
+            opt.host = argv[++i];
+        else if (a == "--port" && has_value)
+            opt.port = atoi(argv[++i]);
+        else if (a == "--timeout-s" && has_value)
+            opt.timeout_s = atoi(argv[++i]);
+        else if (a == "--chat-id" && has_value)
+            opt.chat_id = atoll(argv[++i]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    checkParser();
+    checkCommands();
+    if (opt.poll_s > 0)
+        pollSink();
+
+    printf("%s (%d failures)\n", failures ? "FAILED" : "all checks passed", failures);
+    return failures ? 1 : 0;
+}
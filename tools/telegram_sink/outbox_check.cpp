@@ -0,0 +1,308 @@
+// Runs the outbox's delivery loop on a host against telegram_sink: queues
+// photos and messages at a fixed rate and delivers them one at a time with
+// the firmware's own backoff and circuit breaker (src/outbox_policy.cpp),
+// classifying answers the way telegram_utils.cpp does. Reports delivery
+// latency, attempts and breaker activity, and fails if anything was lost.
+//
+// Build:  g++ -O2 -std=c++17 -pthread -Isrc tools/telegram_sink/outbox_check.cpp src/outbox_policy.cpp -o outbox_check
+// Run:    ./telegram_sink --error-rate 0.2 --outage 5000:60000 &
+//         ./outbox_check --items 40 --interval-ms 1000
+//
+// The policy timings are the firmware's; a quicker run scales them down, e.g.
+// -DOUTBOX_BACKOFF_BASE_MS=200 -DBREAKER_COOLDOWN_MS=3000 with a 500:6000 outage.
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "outbox_policy.h"
+
+enum Status
+{
+    STATUS_OK,
+    STATUS_RETRY,
+    STATUS_REJECTED
+};
+
+struct Result
+{
+    Status status;
+    int http_code;
+    uint32_t retry_after_ms;
+};
+
+struct Entry
+{
+    uint32_t id;
+    bool photo;
+    uint32_t enqueued_ms;
+    uint32_t next_attempt_ms;
+    uint8_t attempts;
+};
+
+struct Options
+{
+    std::string host = "127.0.0.1";
+    int port = 8081;
+    int items = 40;
+    int interval_ms = 1000;
+    size_t photo_bytes = 20 * 1024;
+    int deadline_s = 600;
+};
+
+static Options opt;
+static const auto start_time = std::chrono::steady_clock::now();
+
+static std::mutex outbox_lock;
+static std::condition_variable outbox_wake;
+static std::vector<Entry> entries;
+static int enqueued = 0;
+static CircuitBreaker breaker;
+
+static uint32_t nowMs()
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                                           start_time)
+        .count();
+}
+
+static bool sendAll(int fd, const std::string &data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+// Same request shape and answer classification as telegramRequest()
+static Result post(const Entry &e)
+{
+    Result r = {STATUS_RETRY, 0, 0};
+
+    addrinfo hints{}, *ai = nullptr;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(opt.host.c_str(), std::to_string(opt.port).c_str(), &hints, &ai) != 0)
+        return r;
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    timeval tv{10, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    bool connected = connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+    freeaddrinfo(ai);
+    if (!connected)
+    {
+        close(fd);
+        return r;
+    }
+
+    std::string path, content_type, body;
+    if (e.photo)
+    {
+        std::string boundary = "ESP32CAM-" + std::to_string(nowMs());
+        path = "/botTOKEN/sendPhoto?chat_id=42";
+        content_type = "multipart/form-data; boundary=" + boundary;
+        body = "--" + boundary + "\r\nContent-Disposition: form-data; name=\"photo\"; filename=\"esp32cam.jpg\"\r\n"
+                                 "Content-Type: image/jpeg\r\n\r\n" +
+               std::string(opt.photo_bytes, '\xA5') + "\r\n--" + boundary + "--\r\n";
+    }
+    else
+    {
+        path = "/botTOKEN/sendMessage";
+        content_type = "application/x-www-form-urlencoded";
+        body = "chat_id=42&text=outbox%20check%20" + std::to_string(e.id) + "&parse_mode=HTML";
+    }
+    std::string request = "POST " + path + " HTTP/1.1\r\nHost: api.telegram.org\r\nUser-Agent: ESP32-CAM\r\n" +
+                          "Content-Length: " + std::to_string(body.size()) + "\r\nContent-Type: " + content_type +
+                          "\r\nConnection: close\r\n\r\n" + body;
+
+    std::string response;
+    if (sendAll(fd, request))
+    {
+        char buf[1024];
+        ssize_t n;
+        while ((n = recv(fd, buf, sizeof(buf), 0)) > 0)
+            response.append(buf, n);
+    }
+    close(fd);
+
+    size_t space = response.find(' ');
+    r.http_code = space != std::string::npos ? atoi(response.c_str() + space + 1) : 0;
+    size_t body_at = response.find("\r\n\r\n");
+    std::string answer = body_at != std::string::npos ? response.substr(body_at + 4) : "";
+
+    if (r.http_code == 200 && answer.find("\"ok\":true") != std::string::npos)
+    {
+        r.status = STATUS_OK;
+    }
+    else if (r.http_code == 429)
+    {
+        size_t at = answer.find("\"retry_after\":");
+        r.retry_after_ms = at != std::string::npos ? atoi(answer.c_str() + at + 14) * 1000 : 0;
+    }
+    else if (r.http_code != 0 && r.http_code < 500)
+    {
+        r.status = STATUS_REJECTED;
+    }
+    return r;
+}
+
+struct Report
+{
+    int delivered = 0;
+    int rejected = 0;
+    int attempts = 0;
+    int failed_attempts = 0;
+    int max_attempts = 0;
+    std::vector<uint32_t> latencies;
+};
+
+// Mirrors deliverNext() in telegram_outbox.cpp
+static void deliver(Report &report)
+{
+    std::mt19937 rng(std::random_device{}());
+    std::unique_lock<std::mutex> lock(outbox_lock);
+    while (report.delivered + report.rejected < opt.items && nowMs() < (uint32_t)opt.deadline_s * 1000)
+    {
+        uint32_t now = nowMs();
+        uint32_t wait_ms = 60000;
+        Entry *due = nullptr;
+        for (Entry &e : entries)
+        {
+            int32_t until = (int32_t)(e.next_attempt_ms - now);
+            if (until <= 0)
+                due = !due || e.id < due->id ? &e : due;
+            else
+                wait_ms = std::min(wait_ms, (uint32_t)until);
+        }
+        if (!due || !breaker.allow(now))
+        {
+            if (due)
+                wait_ms = std::max((int32_t)(breaker.reopensAt() - now), (int32_t)100);
+            outbox_wake.wait_for(lock, std::chrono::milliseconds(wait_ms));
+            continue;
+        }
+
+        Entry e = *due;
+        lock.unlock();
+        Result result = post(e);
+        lock.lock();
+
+        now = nowMs();
+        auto it = std::find_if(entries.begin(), entries.end(), [&](const Entry &x) { return x.id == e.id; });
+        it->attempts++;
+        report.attempts++;
+        report.max_attempts = std::max(report.max_attempts, (int)it->attempts);
+        if (result.status == STATUS_OK)
+        {
+            breaker.onSuccess();
+            report.delivered++;
+            report.latencies.push_back(now - it->enqueued_ms);
+            entries.erase(it);
+        }
+        else if (result.status == STATUS_REJECTED)
+        {
+            breaker.onSuccess();
+            report.rejected++;
+            printf("[%7.1fs] #%u rejected (HTTP %d)\n", now / 1000.0, e.id, result.http_code);
+            entries.erase(it);
+        }
+        else
+        {
+            breaker.onFailure(now, result.retry_after_ms);
+            report.failed_attempts++;
+            uint32_t delay_ms = std::max(outboxBackoffMs(it->attempts, rng()), result.retry_after_ms);
+            it->next_attempt_ms = now + delay_ms;
+            printf("[%7.1fs] #%u failed (HTTP %d), retry %u in %u ms, breaker %s\n", now / 1000.0, e.id,
+                   result.http_code, it->attempts, delay_ms, CircuitBreaker::stateName(breaker.state()));
+        }
+        fflush(stdout);
+    }
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [--host HOST] [--port PORT] [--items N] [--interval-ms N] [--photo-bytes N] "
+            "[--deadline-s N]\n",
+            argv0);
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string a = argv[i];
+        bool has_value = i + 1 < argc;
+        if (a == "--host" && has_value)
+            opt.host = argv[++i];
+        else if (a == "--port" && has_value)
+            opt.port = atoi(argv[++i]);
+        else if (a == "--items" && has_value)
+            opt.items = atoi(argv[++i]);
+        else if (a == "--interval-ms" && has_value)
+            opt.interval_ms = atoi(argv[++i]);
+        else if (a == "--photo-bytes" && has_value)
+            opt.photo_bytes = strtoul(argv[++i], nullptr, 10);
+        else if (a == "--deadline-s" && has_value)
+            opt.deadline_s = atoi(argv[++i]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    printf("outbox_check: %d items every %d ms to %s:%d (backoff %d..%d ms, breaker after %d failures, "
+           "cooldown %d..%d ms)\n",
+           opt.items, opt.interval_ms, opt.host.c_str(), opt.port, OUTBOX_BACKOFF_BASE_MS, OUTBOX_BACKOFF_MAX_MS,
+           BREAKER_FAILURE_THRESHOLD, BREAKER_COOLDOWN_MS, BREAKER_COOLDOWN_MAX_MS);
+
+    Report report;
+    std::thread delivery(deliver, std::ref(report));
+    for (int i = 0; i < opt.items; i++)
+    {
+        {
+            std::lock_guard<std::mutex> guard(outbox_lock);
+            uint32_t now = nowMs();
+            // Every fourth entry is a message, like the periodic status texts
+            entries.push_back({(uint32_t)++enqueued, i % 4 != 3, now, now, 0});
+        }
+        outbox_wake.notify_one();
+        std::this_thread::sleep_for(std::chrono::milliseconds(opt.interval_ms));
+    }
+    delivery.join();
+
+    std::vector<uint32_t> &lat = report.latencies;
+    std::sort(lat.begin(), lat.end());
+    auto pct = [&](double p) { return lat.empty() ? 0u : lat[std::min(lat.size() - 1, (size_t)(p * lat.size()))]; };
+    int lost = opt.items - report.delivered - report.rejected;
+    printf("\ndelivered %d  rejected %d  lost %d\n", report.delivered, report.rejected, lost);
+    printf("attempts  %d total, %d failed, max %d for one entry\n", report.attempts, report.failed_attempts,
+           report.max_attempts);
+    printf("latency   p50 %u ms  p99 %u ms  max %u ms (enqueue to delivery)\n", pct(0.5), pct(0.99),
+           lat.empty() ? 0u : lat.back());
+    printf("breaker   opened %u time(s), now %s\n", breaker.opens(), CircuitBreaker::stateName(breaker.state()));
+    printf("%s\n", lost == 0 ? "PASS" : "FAIL: entries left undelivered at the deadline");
+    return lost == 0 ? 0 : 1;
+}
@@ -0,0 +1,523 @@
+// Local stand-in for the Telegram Bot API endpoints the camera uses
+// (sendPhoto, sendMediaGroup, sendMessage, getUpdates), with fault injection for exercising the outbox:
+//   --latency-ms N         delay every response by N ms
+//   --error-rate P         answer a fraction P of requests with 500
+//   --throttle-rate P      answer a fraction P with 429 and retry_after
+//   --retry-after-s N      retry_after sent with 429 (default 1)
+//   --reset-rate P         drop a fraction P of connections with a TCP reset
+//   --outage START:LEN     reset every connection between START and
+//                          START+LEN ms after startup (repeatable)
+// Requests that arrive during an outage are counted separately, so the
+// effect of the circuit breaker on a down API is visible.
+//
+// getUpdates is a long poll on a kept-alive connection, as with the real API.
+// Commands for it come from stdin, one per line, or from
+//   --command-every MS TEXT  queue TEXT (e.g. "/photo") every MS ms
+//   --chat-id N              chat the commands come from (default 42)
+// For /photo and /burst the time from queuing the command until the next
+// sendPhoto arrives is reported as the command-to-photo latency.
+//
+// Build:  g++ -O2 -std=c++17 -pthread telegram_sink.cpp -o telegram_sink
+// Run:    ./telegram_sink --listen 8081 --error-rate 0.1 --outage 5000:20000
+//
+// Build the firmware with -DTELEGRAM_API_HOST='"<host>"' -DTELEGRAM_API_PORT=8081
+// -DTELEGRAM_API_TLS=0 to point the device at it; outbox_check in this
+// directory drives it with the outbox's retry and breaker logic on a host,
+// and bot_check polls it for commands the way telegram_commands.cpp does:
+//   ./telegram_sink --command-every 3000 /photo &
+//   ./bot_check --poll 60
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Outage
+{
+    double start_ms;
+    double end_ms;
+};
+
+struct Options
+{
+    int port = 8081;
+    int latency_ms = 0;
+    double error_rate = 0;
+    double throttle_rate = 0;
+    int retry_after_s = 1;
+    double reset_rate = 0;
+    std::vector<Outage> outages;
+    int command_every_ms = 0;
+    std::string command_text;
+    long long chat_id = 42;
+};
+
+struct Counters
+{
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> photos{0};
+    std::atomic<uint64_t> albums{0};
+    std::atomic<uint64_t> messages{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> errors{0};
+    std::atomic<uint64_t> throttled{0};
+    std::atomic<uint64_t> resets{0};
+    std::atomic<uint64_t> bad{0};
+    std::atomic<uint64_t> during_outage{0};
+    std::atomic<uint64_t> polls{0};
+    std::atomic<uint64_t> commands{0};
+};
+
+struct Update
+{
+    uint64_t id;
+    std::string text;
+    time_t date;
+};
+
+static Options opt;
+static Counters counters;
+static std::atomic<bool> stopping{false};
+static std::atomic<uint64_t> next_message_id{1};
+static const auto start_time = std::chrono::steady_clock::now();
+
+// Commands queued for getUpdates; acknowledged ones are dropped when a poll
+// asks for a higher offset
+static std::mutex updates_lock;
+static std::condition_variable updates_wake;
+static std::vector<Update> updates;
+static uint64_t next_update_id = 1;
+static std::deque<double> awaiting_photo; // queue times of /photo and /burst
+static std::vector<double> photo_latencies;
+
+static double sinceStartMs()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+}
+
+static bool inOutage(double now_ms)
+{
+    for (const Outage &o : opt.outages)
+    {
+        if (now_ms >= o.start_ms && now_ms < o.end_ms)
+            return true;
+    }
+    return false;
+}
+
+static void queueCommand(const std::string &text)
+{
+    std::lock_guard<std::mutex> guard(updates_lock);
+    updates.push_back({next_update_id++, text, time(nullptr)});
+    if (text.compare(0, 6, "/photo") == 0 || text.compare(0, 6, "/burst") == 0)
+        awaiting_photo.push_back(sinceStartMs());
+    counters.commands++;
+    updates_wake.notify_all();
+}
+
+static void photoArrived()
+{
+    std::lock_guard<std::mutex> guard(updates_lock);
+    if (!awaiting_photo.empty())
+    {
+        photo_latencies.push_back(sinceStartMs() - awaiting_photo.front());
+        awaiting_photo.pop_front();
+    }
+}
+
+static std::string jsonEscape(const std::string &text)
+{
+    std::string out;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if (c == '\n')
+            out += "\\n";
+        else
+            out += c;
+    }
+    return out;
+}
+
+static long queryValue(const std::string &request_line, const char *name, long fallback)
+{
+    std::string key = std::string(name) + "=";
+    size_t at = request_line.find(key);
+    if (at == std::string::npos || (request_line[at - 1] != '?' && request_line[at - 1] != '&'))
+        return fallback;
+    return strtol(request_line.c_str() + at + key.size(), nullptr, 10);
+}
+
+// Holds the request until an update past offset is queued or the timeout ends
+static std::string getUpdates(const std::string &request_line)
+{
+    long offset = queryValue(request_line, "offset", 0);
+    long limit = std::max(1L, std::min(100L, queryValue(request_line, "limit", 100)));
+    long timeout_s = queryValue(request_line, "timeout", 0);
+
+    std::unique_lock<std::mutex> lock(updates_lock);
+    updates.erase(std::remove_if(updates.begin(), updates.end(),
+                                 [&](const Update &u) { return (long)u.id < offset; }),
+                  updates.end());
+    updates_wake.wait_for(lock, std::chrono::seconds(timeout_s), [] { return !updates.empty() || stopping; });
+
+    std::string json = "{\"ok\":true,\"result\":[";
+    for (long i = 0; i < (long)updates.size() && i < limit; i++)
+    {
+        const Update &u = updates[i];
+        char entry[256];
+        snprintf(entry, sizeof(entry),
+                 "%s{\"update_id\":%llu,\"message\":{\"message_id\":%llu,\"from\":{\"id\":%lld,\"is_bot\":false,"
+                 "\"first_name\":\"Sink\"},\"chat\":{\"id\":%lld,\"first_name\":\"Sink\",\"type\":\"private\"},"
+                 "\"date\":%ld,\"text\":\"",
+                 i ? "," : "", (unsigned long long)u.id, (unsigned long long)next_message_id++, opt.chat_id,
+                 opt.chat_id, (long)u.date);
+        json += entry;
+        json += jsonEscape(u.text) + "\",\"entities\":[{\"offset\":0,\"length\":" +
+                std::to_string(u.text.find(' ') == std::string::npos ? u.text.size() : u.text.find(' ')) +
+                ",\"type\":\"bot_command\"}]}}";
+    }
+    return json + "]}";
+}
+
+static void resetConnection(int fd)
+{
+    // Zero linger turns close() into an RST
+    linger lg{1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    close(fd);
+}
+
+static bool readRequest(int fd, std::string &head, std::string &body)
+{
+    std::string buf;
+    size_t header_end;
+    while ((header_end = buf.find("\r\n\r\n")) == std::string::npos)
+    {
+        char tmp[4096];
+        ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+        if (n <= 0)
+            return false;
+        buf.append(tmp, n);
+    }
+    head = buf.substr(0, header_end);
+    buf.erase(0, header_end + 4);
+
+    std::string lower = head;
+    for (char &c : lower)
+        c = tolower(c);
+    size_t content_length = 0;
+    size_t pos = lower.find("\r\ncontent-length:");
+    if (pos != std::string::npos)
+        content_length = strtoul(head.c_str() + pos + 17, nullptr, 10);
+
+    while (buf.size() < content_length)
+    {
+        char tmp[4096];
+        ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+        if (n <= 0)
+            return false;
+        buf.append(tmp, n);
+    }
+    body = buf.substr(0, content_length);
+    return true;
+}
+
+static void sendJson(int fd, int status, const char *reason, const std::string &json, bool keep_alive = false)
+{
+    char head[256];
+    int len = snprintf(head, sizeof(head),
+                       "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n"
+                       "Connection: %s\r\n\r\n",
+                       status, reason, json.size(), keep_alive ? "keep-alive" : "close");
+    std::string response = std::string(head, len) + json;
+    send(fd, response.data(), response.size(), MSG_NOSIGNAL);
+}
+
+// Answers one request; true when the connection stays open for the next
+static bool serveRequest(int fd, std::mt19937 &rng)
+{
+    std::uniform_real_distribution<double> chance(0, 1);
+
+    std::string head, body;
+    if (!readRequest(fd, head, body))
+    {
+        close(fd);
+        return false;
+    }
+    counters.requests++;
+    counters.bytes += body.size();
+    if (inOutage(sinceStartMs()))
+    {
+        counters.during_outage++;
+        resetConnection(fd);
+        return false;
+    }
+
+    if (opt.latency_ms)
+        std::this_thread::sleep_for(std::chrono::milliseconds(opt.latency_ms));
+
+    if (chance(rng) < opt.reset_rate)
+    {
+        counters.resets++;
+        resetConnection(fd);
+        return false;
+    }
+
+    // POST /bot<token>/sendPhoto?chat_id=..., /bot<token>/sendMediaGroup or /bot<token>/sendMessage,
+    // GET /bot<token>/getUpdates?offset=...&timeout=...
+    size_t line_end = head.find("\r\n");
+    std::string request_line = head.substr(0, line_end);
+    bool is_photo = request_line.find("/sendPhoto") != std::string::npos;
+    bool is_album = request_line.find("/sendMediaGroup") != std::string::npos;
+    bool is_message = request_line.find("/sendMessage") != std::string::npos;
+    bool is_poll = request_line.compare(0, 8, "GET /bot") == 0 && request_line.find("/getUpdates") != std::string::npos;
+    bool well_formed = is_poll ||
+                       (request_line.compare(0, 9, "POST /bot") == 0 &&
+                        ((is_photo && request_line.find("chat_id=") != std::string::npos &&
+                          body.find("\r\nContent-Type: image/jpeg\r\n") != std::string::npos) ||
+                         (is_album && body.find("name=\"chat_id\"") != std::string::npos &&
+                          body.find("name=\"media\"") != std::string::npos &&
+                          body.find("\r\nContent-Type: image/jpeg\r\n") != std::string::npos) ||
+                         (is_message && body.find("chat_id=") != std::string::npos &&
+                          body.find("text=") != std::string::npos)));
+
+    std::string lower = head;
+    for (char &c : lower)
+        c = tolower(c);
+    bool keep_alive = is_poll && lower.find("\r\nconnection: keep-alive") != std::string::npos;
+
+    char json[256];
+    if (!well_formed)
+    {
+        counters.bad++;
+        snprintf(json, sizeof(json), "{\"ok\":false,\"error_code\":400,\"description\":\"Bad Request\"}");
+        sendJson(fd, 400, "Bad Request", json);
+        keep_alive = false;
+    }
+    else if (chance(rng) < opt.throttle_rate)
+    {
+        counters.throttled++;
+        snprintf(json, sizeof(json),
+                 "{\"ok\":false,\"error_code\":429,\"description\":\"Too Many Requests: retry after %d\","
+                 "\"parameters\":{\"retry_after\":%d}}",
+                 opt.retry_after_s, opt.retry_after_s);
+        sendJson(fd, 429, "Too Many Requests", json);
+        keep_alive = false;
+    }
+    else if (chance(rng) < opt.error_rate)
+    {
+        counters.errors++;
+        snprintf(json, sizeof(json), "{\"ok\":false,\"error_code\":500,\"description\":\"Internal Server Error\"}");
+        sendJson(fd, 500, "Internal Server Error", json);
+        keep_alive = false;
+    }
+    else if (is_poll)
+    {
+        counters.polls++;
+        sendJson(fd, 200, "OK", getUpdates(request_line), keep_alive);
+    }
+    else
+    {
+        (is_photo ? counters.photos : is_album ? counters.albums : counters.messages)++;
+        if (is_photo)
+            photoArrived();
+        snprintf(json, sizeof(json), "{\"ok\":true,\"result\":{\"message_id\":%lu,\"date\":%ld}}",
+                 (unsigned long)next_message_id++, (long)time(nullptr));
+        sendJson(fd, 200, "OK", json);
+    }
+    if (!keep_alive)
+        close(fd);
+    return keep_alive;
+}
+
+static void serveConnection(int fd)
+{
+    // The device closes after every send; only getUpdates keeps the connection
+    thread_local std::mt19937 rng(std::random_device{}());
+
+    if (inOutage(sinceStartMs()))
+    {
+        counters.during_outage++;
+        resetConnection(fd);
+        return;
+    }
+    while (serveRequest(fd, rng))
+    {
+    }
+}
+
+static void printCounters(const char *prefix)
+{
+    printf("%s requests %lu | photos %lu  albums %lu  messages %lu  500 %lu  429 %lu  reset %lu  bad %lu | "
+           "refused during outage %lu\n",
+           prefix, (unsigned long)counters.requests.load(), (unsigned long)counters.photos.load(),
+           (unsigned long)counters.albums.load(),
+           (unsigned long)counters.messages.load(), (unsigned long)counters.errors.load(),
+           (unsigned long)counters.throttled.load(), (unsigned long)counters.resets.load(),
+           (unsigned long)counters.bad.load(), (unsigned long)counters.during_outage.load());
+    if (counters.polls || counters.commands)
+    {
+        std::lock_guard<std::mutex> guard(updates_lock);
+        double total = 0, worst = 0;
+        for (double ms : photo_latencies)
+        {
+            total += ms;
+            worst = std::max(worst, ms);
+        }
+        printf("%*s polls %lu  commands %lu | command to photo: %zu measured, avg %.0f ms  max %.0f ms, "
+               "%zu waiting\n",
+               (int)strlen(prefix), "", (unsigned long)counters.polls.load(), (unsigned long)counters.commands.load(),
+               photo_latencies.size(), photo_latencies.empty() ? 0 : total / photo_latencies.size(), worst,
+               awaiting_photo.size());
+    }
+    fflush(stdout);
+}
+
+static void reporter()
+{
+    while (!stopping)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(5));
+        char prefix[48];
+        snprintf(prefix, sizeof(prefix), "[%7.1fs]%s", sinceStartMs() / 1000,
+                 inOutage(sinceStartMs()) ? " OUTAGE" : "");
+        printCounters(prefix);
+    }
+}
+
+static void commandTimer()
+{
+    while (!stopping)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(opt.command_every_ms));
+        queueCommand(opt.command_text);
+    }
+}
+
+static void commandReader()
+{
+    std::string line;
+    while (std::getline(std::cin, line))
+    {
+        if (!line.empty())
+            queueCommand(line);
+    }
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [--listen PORT] [--latency-ms N] [--error-rate P] [--throttle-rate P] [--retry-after-s N] "
+            "[--reset-rate P] [--outage START_MS:LEN_MS]... [--command-every MS TEXT] [--chat-id N]\n",
+            argv0);
+}
+
+static void onSignal(int)
+{
+    stopping = true;
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string a = argv[i];
+        bool has_value = i + 1 < argc;
+        if (a == "--listen" && has_value)
+            opt.port = atoi(argv[++i]);
+        else if (a == "--latency-ms" && has_value)
+            opt.latency_ms = atoi(argv[++i]);
+        else if (a == "--error-rate" && has_value)
+            opt.error_rate = atof(argv[++i]);
+        else if (a == "--throttle-rate" && has_value)
+            opt.throttle_rate = atof(argv[++i]);
+        else if (a == "--retry-after-s" && has_value)
+            opt.retry_after_s = atoi(argv[++i]);
+        else if (a == "--reset-rate" && has_value)
+            opt.reset_rate = atof(argv[++i]);
+        else if (a == "--outage" && has_value)
+        {
+            double start = 0, len = 0;
+            if (sscanf(argv[++i], "%lf:%lf", &start, &len) != 2)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            opt.outages.push_back({start, start + len});
+        }
+        else if (a == "--command-every" && i + 2 < argc)
+        {
+            opt.command_every_ms = atoi(argv[++i]);
+            opt.command_text = argv[++i];
+        }
+        else if (a == "--chat-id" && has_value)
+            opt.chat_id = atoll(argv[++i]);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(opt.port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(listen_fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, 256) < 0)
+    {
+        perror("listen");
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    printf("telegram_sink listening on :%d (latency %d ms, 500 rate %.2f, 429 rate %.2f, reset rate %.2f, "
+           "%zu outage(s))\n",
+           opt.port, opt.latency_ms, opt.error_rate, opt.throttle_rate, opt.reset_rate, opt.outages.size());
+    fflush(stdout);
+
+    std::thread(reporter).detach();
+    std::thread(commandReader).detach();
+    if (opt.command_every_ms > 0)
+        std::thread(commandTimer).detach();
+    while (!stopping)
+    {
+        pollfd pfd{listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 200) <= 0)
+        {
+            continue;
+        }
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd >= 0)
+        {
+            std::thread(serveConnection, fd).detach();
+        }
+    }
+
+    updates_wake.notify_all();
+    printCounters("total:");
+    return 0;
+}
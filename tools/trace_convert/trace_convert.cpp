@@ -0,0 +1,532 @@
+// Converts a dump from the camera's /trace endpoint (src/trace.cpp, format in
+// src/trace_format.h) into Chrome trace JSON, which ui.perfetto.dev and
+// chrome://tracing open directly. Each task becomes a thread; spans keep
+// their argument and the core they ran on, and every streamed frame is linked
+// by a flow arrow to the esp_camera_fb_get that produced it. A summary of
+// span durations per kind goes to stderr.
+//
+// Timestamps are rebuilt from the cycle counters: every event is placed
+// relative to the latest sync event of its core, which pairs the counter
+// with esp_timer and the CPU clock (1 MHz while the camera stamps events with
+// esp_timer under frequency scaling). Events older than the oldest sync left
+// in a ring cannot be placed and are dropped.
+//
+// Without arguments it checks itself against a synthetic dump (counter
+// wrap, clock change, esp_timer stamps, task migration, overwritten ring).
+//
+// Build:  g++ -O2 -std=c++17 -Isrc tools/trace_convert/trace_convert.cpp -o trace_convert
+// Run:    curl -s 'http://<camera>/trace?enable=1'; ...; curl -s http://<camera>/trace -o cam.trace
+//         ./trace_convert cam.trace > cam.json
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "trace_format.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...)                                                                                               \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (!(cond))                                                                                                   \
+        {                                                                                                              \
+            failures++;                                                                                                \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                \
+            printf(__VA_ARGS__);                                                                                       \
+            printf("\n");                                                                                              \
+        }                                                                                                              \
+    } while (0)
+
+typedef std::vector<uint8_t> Bytes;
+
+struct Dump
+{
+    TraceDumpHeader header;
+    std::vector<TraceEvent> events[TRACE_MAX_CORES];
+    std::vector<std::string> tasks; // tasks[0] is task 1
+};
+
+// An event with its time rebuilt
+struct Placed
+{
+    double ts_us;
+    uint8_t id;
+    uint8_t phase;
+    uint8_t task;
+    uint8_t core;
+    uint32_t arg;
+    size_t order; // position in its ring, keeps equal times stable
+};
+
+struct Converted
+{
+    std::vector<Placed> events;
+    size_t unplaced = 0; // before the first sync of their ring
+    uint32_t overwritten = 0;
+};
+
+static bool parseDump(const Bytes &data, Dump &dump, std::string &error)
+{
+    size_t at = 0;
+    auto take = [&](void *out, size_t len) {
+        if (data.size() - at < len)
+            return false;
+        memcpy(out, data.data() + at, len);
+        at += len;
+        return true;
+    };
+
+    if (!take(&dump.header, sizeof(dump.header)) || dump.header.magic != TRACE_MAGIC)
+    {
+        error = "not a trace dump";
+        return false;
+    }
+    const TraceDumpHeader &h = dump.header;
+    if (h.version != TRACE_VERSION || h.event_size != sizeof(TraceEvent) || h.cores == 0 ||
+        h.cores > TRACE_MAX_CORES || h.task_count > TRACE_TASK_SLOTS)
+    {
+        error = "unsupported dump version or layout";
+        return false;
+    }
+    for (int core = 0; core < h.cores; core++)
+    {
+        uint32_t count;
+        if (!take(&count, sizeof(count)) || count > h.capacity || (data.size() - at) / sizeof(TraceEvent) < count)
+        {
+            error = "dump cut off in the events of core " + std::to_string(core);
+            return false;
+        }
+        dump.events[core].resize(count);
+        take(dump.events[core].data(), count * sizeof(TraceEvent));
+    }
+    for (int i = 0; i < h.task_count; i++)
+    {
+        char name[TRACE_TASK_NAME_LEN + 1] = {};
+        if (!take(name, TRACE_TASK_NAME_LEN))
+        {
+            error = "dump cut off in the task table";
+            return false;
+        }
+        dump.tasks.push_back(name);
+    }
+    return true;
+}
+
+static Converted place(const Dump &dump)
+{
+    Converted out;
+    for (int core = 0; core < dump.header.cores; core++)
+    {
+        uint32_t written = dump.header.written[core];
+        out.overwritten += written > dump.header.capacity ? written - dump.header.capacity : 0;
+
+        bool synced = false;
+        uint32_t sync_cycles = 0;
+        double sync_us = 0;
+        double mhz = 1;
+        const std::vector<TraceEvent> &events = dump.events[core];
+        for (size_t i = 0; i < events.size(); i++)
+        {
+            const TraceEvent &e = events[i];
+            if (e.phase == TRACE_PHASE_SYNC)
+            {
+                synced = e.id > 0;
+                sync_cycles = e.cycles;
+                sync_us = (double)((uint64_t)e.arg | (uint64_t)e.task << 32 | (uint64_t)e.reserved << 40);
+                mhz = e.id;
+                continue;
+            }
+            if (!synced)
+            {
+                out.unplaced++;
+                continue;
+            }
+            // Signed: a writer may read the counter just before the sync it triggers
+            int32_t delta = (int32_t)(e.cycles - sync_cycles);
+            out.events.push_back({sync_us + delta / mhz, e.id, e.phase, e.task, (uint8_t)core, e.arg, i});
+        }
+    }
+    std::stable_sort(out.events.begin(), out.events.end(),
+                     [](const Placed &a, const Placed &b) { return a.ts_us < b.ts_us; });
+    return out;
+}
+
+struct Span
+{
+    uint8_t id;
+    double begin_us;
+    double end_us;
+    uint32_t begin_arg;
+    uint32_t end_arg;
+    uint8_t task;
+};
+
+// Pairs begins and ends per task; an end whose begin was overwritten is dropped
+static std::vector<Span> spans(const Converted &c, size_t *orphans)
+{
+    std::vector<Span> out;
+    std::map<uint8_t, std::vector<Span>> open;
+    *orphans = 0;
+    for (const Placed &e : c.events)
+    {
+        std::vector<Span> &stack = open[e.task];
+        if (e.phase == TRACE_PHASE_BEGIN)
+        {
+            stack.push_back({e.id, e.ts_us, -1, e.arg, 0, e.task});
+        }
+        else if (e.phase == TRACE_PHASE_END)
+        {
+            auto it = std::find_if(stack.rbegin(), stack.rend(), [&](const Span &s) { return s.id == e.id; });
+            if (it == stack.rend())
+            {
+                (*orphans)++;
+                continue;
+            }
+            Span s = *it;
+            s.end_us = e.ts_us;
+            s.end_arg = e.arg;
+            out.push_back(s);
+            stack.erase(std::next(it).base());
+        }
+    }
+    return out;
+}
+
+static std::string taskName(const Dump &dump, uint8_t task)
+{
+    if (task == 0 || task > dump.tasks.size())
+        return "other tasks";
+    return dump.tasks[task - 1];
+}
+
+static std::string jsonString(const std::string &text)
+{
+    std::string out = "\"";
+    for (char ch : text)
+    {
+        if (ch == '"' || ch == '\\')
+            out += '\\';
+        if ((unsigned char)ch >= 0x20)
+            out += ch;
+    }
+    return out + "\"";
+}
+
+static std::string toChromeJson(const Dump &dump, const Converted &c)
+{
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    char line[256];
+    json += "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\",\"args\":{\"name\":\"ESP32-CAM\"}}";
+    for (int task = 0; task <= (int)dump.tasks.size(); task++)
+    {
+        json += ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(task) +
+                ",\"name\":\"thread_name\",\"args\":{\"name\":" + jsonString(taskName(dump, task)) + "}}";
+    }
+
+    // Where each frame came out of the driver, for the flow arrows
+    std::map<uint32_t, std::pair<double, uint8_t>> captured;
+    int flow_id = 0;
+    for (const Placed &e : c.events)
+    {
+        const char *ph = e.phase == TRACE_PHASE_BEGIN ? "B" : e.phase == TRACE_PHASE_END ? "E" : "i";
+        snprintf(line, sizeof(line),
+                 ",\n{\"ph\":\"%s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"name\":\"%s\",\"args\":{\"arg\":%u,\"core\":%u}%s}",
+                 ph, e.task, e.ts_us, traceIdName(e.id), e.arg, e.core, e.phase == TRACE_PHASE_INSTANT ? ",\"s\":\"t\"" : "");
+        json += line;
+
+        if (e.id == TRACE_FB_GET && e.phase == TRACE_PHASE_END && e.arg)
+        {
+            captured[e.arg] = {e.ts_us, e.task};
+        }
+        else if (e.id == TRACE_STREAM_FRAME && e.phase == TRACE_PHASE_BEGIN && captured.count(e.arg))
+        {
+            // Both ends sit just inside their slices so the arrow binds to them
+            auto from = captured[e.arg];
+            flow_id++;
+            snprintf(line, sizeof(line),
+                     ",\n{\"ph\":\"s\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"name\":\"frame\",\"cat\":\"frame\",\"id\":%d}"
+                     ",\n{\"ph\":\"f\",\"bp\":\"e\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"name\":\"frame\",\"cat\":\"frame\","
+                     "\"id\":%d}",
+                     from.second, from.first - 0.001, flow_id, e.task, e.ts_us + 0.001, flow_id);
+            json += line;
+        }
+    }
+    return json + "\n]}\n";
+}
+
+static void printSummary(const Dump &dump, const Converted &c, FILE *out)
+{
+    size_t orphans;
+    std::vector<Span> all = spans(c, &orphans);
+    fprintf(out, "%zu events from %u core(s), %zu tasks; %u overwritten, %zu before the first sync, %zu unmatched ends\n",
+            c.events.size(), dump.header.cores, dump.tasks.size(), c.overwritten, c.unplaced, orphans);
+    if (!c.events.empty())
+        fprintf(out, "covers %.3f s up to %.3f s after boot\n", (c.events.back().ts_us - c.events.front().ts_us) / 1e6,
+                c.events.back().ts_us / 1e6);
+    fprintf(out, "  %-18s %7s %10s %10s %10s\n", "span", "count", "p50_us", "p99_us", "max_us");
+    for (int id = 1; id < TRACE_ID_COUNT; id++)
+    {
+        std::vector<double> d;
+        for (const Span &s : all)
+        {
+            if (s.id == id)
+                d.push_back(s.end_us - s.begin_us);
+        }
+        if (d.empty())
+            continue;
+        std::sort(d.begin(), d.end());
+        fprintf(out, "  %-18s %7zu %10.0f %10.0f %10.0f\n", traceIdName(id), d.size(), d[d.size() / 2],
+                d[std::min(d.size() - 1, (size_t)(d.size() * 0.99))], d.back());
+    }
+}
+
+// Writes dumps the way trace.cpp does, for the self-check
+struct Recorder
+{
+    uint32_t capacity;
+    uint32_t mhz = 240;
+    bool timer_clock = false; // stamps are esp_timer, as under DFS
+    int epoch = 1;
+    double now_us = 1000000; // true time
+    double cycles_at_us[TRACE_MAX_CORES] = {0, 0}; // counter value at now_us, unwrapped
+    struct Ring
+    {
+        std::vector<TraceEvent> slots;
+        uint32_t head = 0;
+        int epoch = 0;
+        double synced_us = -1e12;
+    } rings[TRACE_MAX_CORES];
+    std::vector<std::string> tasks;
+
+    explicit Recorder(uint32_t capacity) : capacity(capacity)
+    {
+        for (Ring &r : rings)
+            r.slots.resize(capacity);
+        cycles_at_us[1] = 123456789; // the cores' counters are unrelated
+    }
+
+    void advance(double us)
+    {
+        now_us += us;
+        for (double &c : cycles_at_us)
+            c += us * mhz;
+    }
+
+    void put(int core, const TraceEvent &e)
+    {
+        Ring &r = rings[core];
+        r.slots[r.head++ % capacity] = e;
+    }
+
+    void record(int core, uint8_t task, uint8_t id, uint8_t phase, uint32_t arg)
+    {
+        Ring &r = rings[core];
+        uint32_t cycles = timer_clock ? (uint32_t)(uint64_t)now_us : (uint32_t)fmod(cycles_at_us[core], 4294967296.0);
+        if (r.epoch != epoch || now_us - r.synced_us > 4000000)
+        {
+            uint64_t us = (uint64_t)now_us;
+            uint8_t rate = timer_clock ? 1 : (uint8_t)mhz;
+            put(core, {cycles, (uint32_t)us, rate, TRACE_PHASE_SYNC, (uint8_t)(us >> 32), (uint8_t)(us >> 40)});
+            r.epoch = epoch;
+            r.synced_us = now_us;
+        }
+        put(core, {cycles, arg, id, phase, task, 0});
+    }
+
+    Bytes dump() const
+    {
+        TraceDumpHeader h = {};
+        h.magic = TRACE_MAGIC;
+        h.version = TRACE_VERSION;
+        h.event_size = sizeof(TraceEvent);
+        h.cores = 2;
+        h.task_count = tasks.size();
+        h.cpu_mhz = mhz;
+        h.capacity = capacity;
+        h.written[0] = rings[0].head;
+        h.written[1] = rings[1].head;
+        h.dumped_us = (uint64_t)now_us;
+        Bytes out((const uint8_t *)&h, (const uint8_t *)&h + sizeof(h));
+        for (const Ring &r : rings)
+        {
+            uint32_t count = std::min(r.head, capacity);
+            out.insert(out.end(), (const uint8_t *)&count, (const uint8_t *)&count + 4);
+            for (uint32_t i = r.head - count; i != r.head; i++)
+            {
+                const uint8_t *p = (const uint8_t *)&r.slots[i % capacity];
+                out.insert(out.end(), p, p + sizeof(TraceEvent));
+            }
+        }
+        for (const std::string &t : tasks)
+        {
+            char name[TRACE_TASK_NAME_LEN] = {};
+            strncpy(name, t.c_str(), sizeof(name) - 1);
+            out.insert(out.end(), name, name + sizeof(name));
+        }
+        return out;
+    }
+};
+
+static void selfCheck()
+{
+    // A stream on task 1 alternating cores, a Telegram upload on task 2, with
+    // the CPU dropping to 80 MHz halfway, esp_timer stamps for a stretch
+    // near the end and gaps long enough to wrap the counters several times
+    Recorder rec(64);
+    rec.tasks = {"httpd", "tg_outbox"};
+    struct Expected
+    {
+        uint8_t id;
+        double duration_us;
+    };
+    std::vector<Expected> expected;
+    double first_us = 0;
+    for (int frame = 0; frame < 40; frame++)
+    {
+        int core = frame % 2;
+        if (frame == 20)
+        {
+            rec.mhz = 80;
+            rec.epoch++;
+        }
+        if (frame == 31 || frame == 34)
+        {
+            rec.timer_clock = frame == 31;
+            rec.epoch++;
+        }
+        if (frame % 7 == 0)
+            rec.advance(30e6); // idle, counters wrap
+        uint32_t id = (uint32_t)rec.now_us;
+        if (frame == 0)
+            first_us = rec.now_us;
+        rec.record(core, 1, TRACE_FB_GET, TRACE_PHASE_BEGIN, 0);
+        rec.advance(40000 + frame * 100);
+        rec.record(core, 1, TRACE_FB_GET, TRACE_PHASE_END, id);
+        rec.record(core, 1, TRACE_STREAM_FRAME, TRACE_PHASE_BEGIN, id);
+        rec.advance(25000);
+        rec.record(core, 1, TRACE_STREAM_FRAME, TRACE_PHASE_END, 0);
+        if (frame >= 30)
+        {
+            expected.push_back({TRACE_FB_GET, 40000.0 + frame * 100});
+            expected.push_back({TRACE_STREAM_FRAME, 25000});
+        }
+        if (frame == 35)
+        {
+            rec.record(1 - core, 2, TRACE_TELEGRAM_UPLOAD, TRACE_PHASE_BEGIN, 50000);
+            rec.advance(800000);
+            rec.record(1 - core, 2, TRACE_TELEGRAM_UPLOAD, TRACE_PHASE_END, 1);
+            expected.push_back({TRACE_TELEGRAM_UPLOAD, 800000});
+        }
+    }
+    // Recording stops here; this begin has no end yet
+    rec.record(0, 1, TRACE_LOGSTASH_SEND, TRACE_PHASE_BEGIN, 0);
+
+    Bytes data = rec.dump();
+    Dump dump;
+    std::string error;
+    CHECK(parseDump(data, dump, error), "parse: %s", error.c_str());
+    Converted c = place(dump);
+    CHECK(c.overwritten > 0, "ring should have wrapped");
+    CHECK(c.events.front().ts_us > first_us, "oldest events were overwritten");
+
+    size_t orphans;
+    std::vector<Span> all = spans(c, &orphans);
+    // Only the last frames survive in a 64-event ring; match from the end
+    std::vector<Span> tail(all.end() - std::min(all.size(), expected.size()), all.end());
+    std::sort(tail.begin(), tail.end(), [](const Span &a, const Span &b) { return a.begin_us < b.begin_us; });
+    size_t matched = 0;
+    for (const Expected &e : expected)
+    {
+        for (const Span &s : tail)
+        {
+            if (s.id == e.id && fabs(s.end_us - s.begin_us - e.duration_us) < 0.01)
+            {
+                matched++;
+                break;
+            }
+        }
+    }
+    CHECK(matched == expected.size(), "%zu of %zu spans have the right duration", matched, expected.size());
+    for (const Span &s : all)
+    {
+        CHECK(s.end_us >= s.begin_us, "span %s ends before it begins", traceIdName(s.id));
+        CHECK(s.id != TRACE_FB_GET || s.end_us - s.begin_us < 50000, "fb_get took %.0f us", s.end_us - s.begin_us);
+    }
+    CHECK(std::is_sorted(c.events.begin(), c.events.end(),
+                         [](const Placed &a, const Placed &b) { return a.ts_us < b.ts_us; }),
+          "events out of order");
+    CHECK(fabs(c.events.back().ts_us - (double)dump.header.dumped_us) < 1, "last event at %.1f, dump at %llu",
+          c.events.back().ts_us, (unsigned long long)dump.header.dumped_us);
+
+    std::string json = toChromeJson(dump, c);
+    CHECK(json.find("\"name\":\"tg_outbox\"") != std::string::npos, "task names");
+    CHECK(json.find("\"ph\":\"s\"") != std::string::npos && json.find("\"ph\":\"f\"") != std::string::npos,
+          "frame flows");
+    CHECK(json.find("logstash_send") != std::string::npos, "open span kept");
+    int depth = 0;
+    for (char ch : json)
+        depth += ch == '{' || ch == '[' ? 1 : ch == '}' || ch == ']' ? -1 : 0;
+    CHECK(depth == 0, "unbalanced JSON");
+
+    // Damaged input is refused
+    Dump bad;
+    CHECK(!parseDump(Bytes(data.begin(), data.begin() + 100), bad, error), "cut-off dump accepted");
+    Bytes wrong = data;
+    wrong[0] ^= 1;
+    CHECK(!parseDump(wrong, bad, error), "wrong magic accepted");
+
+    printSummary(dump, c, stdout);
+}
+
+static bool readFile(const char *path, Bytes &out)
+{
+    FILE *f = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!f)
+        return false;
+    uint8_t buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        out.insert(out.end(), buf, buf + n);
+    if (f != stdin)
+        fclose(f);
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 2)
+    {
+        fprintf(stderr, "usage: %s [dump.trace|-] > trace.json\n", argv[0]);
+        return 1;
+    }
+    if (argc == 1)
+    {
+        selfCheck();
+        printf("%s (%d failures)\n", failures ? "FAILED" : "all checks passed", failures);
+        return failures ? 1 : 0;
+    }
+
+    Bytes data;
+    Dump dump;
+    std::string error;
+    if (!readFile(argv[1], data))
+    {
+        fprintf(stderr, "cannot read %s\n", argv[1]);
+        return 1;
+    }
+    if (!parseDump(data, dump, error))
+    {
+        fprintf(stderr, "%s: %s\n", argv[1], error.c_str());
+        return 1;
+    }
+    Converted c = place(dump);
+    fputs(toChromeJson(dump, c).c_str(), stdout);
+    printSummary(dump, c, stderr);
+    return 0;
+}